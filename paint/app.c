@@ -22,25 +22,33 @@ static void paint_application_startup                (GApplication *self);
 * メニュー、アクセラレーター、およびウィンドウを作成する方法を提供します。
 */
 G_DEFINE_FINAL_TYPE (PaintApplication, paint_application, GTK_TYPE_APPLICATION);
+static const char *ACCELS_CLEAR        [] = { "Delete", NULL };
 static const char *ACCELS_CLOSE        [] = { "<Ctrl>q", NULL };
 static const char *ACCELS_HELP_OVERLAY [] = { "<Ctrl>question", "<Ctrl>slash", NULL };
 static const char *ACCELS_NEW          [] = { "<Ctrl>n", NULL };
 static const char *ACCELS_OPEN         [] = { "<Ctrl>o", NULL };
+static const char *ACCELS_PASTE        [] = { "<Ctrl>v", NULL };
 static const char *ACCELS_PRINT        [] = { "<Ctrl>p", NULL };
+static const char *ACCELS_REDO         [] = { "<Ctrl>y", "<Shift><Ctrl>z", NULL };
 static const char *ACCELS_SAVE         [] = { "<Ctrl>s", NULL };
 static const char *ACCELS_SAVE_AS      [] = { "<Shift><Ctrl>s", NULL };
+static const char *ACCELS_UNDO         [] = { "<Ctrl>z", NULL };
 
 /* メニュー アクセラレーター */
 static const ShareAccelEntry
 ACCEL_ENTRIES [] =
 {
+	{ "win.clear",             ACCELS_CLEAR        },
 	{ "window.close",          ACCELS_CLOSE        },
 	{ "win.show-help-overlay", ACCELS_HELP_OVERLAY },
 	{ "app.new",               ACCELS_NEW          },
 	{ "win.open",              ACCELS_OPEN         },
+	{ "win.paste",             ACCELS_PASTE        },
 	{ "win.print",             ACCELS_PRINT        },
+	{ "win.redo",              ACCELS_REDO         },
 	{ "win.save",              ACCELS_SAVE         },
 	{ "win.save-as",           ACCELS_SAVE_AS      },
+	{ "win.undo",              ACCELS_UNDO         },
 };
 
 /* メニュー アクション */
@@ -0,0 +1,692 @@
+/* Copyright (C) 2025 Taichi Murakami. */
+#include <math.h>
+#include <string.h>
+#include <gtk/gtk.h>
+#include "paint.h"
+#include "share.h"
+#if defined (__AVX2__) || defined (__SSE2__)
+#include <immintrin.h>
+#elif defined (__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#define BRUSH_MAXIMUM   256
+#define DAB_PHASES      4
+#define DIV255(x)       (((x) + 128 + (((x) + 128) >> 8)) >> 8)
+#define SPACING_FACTOR  0.125
+#define SPACING_MINIMUM 0.25
+
+/* ブラシ */
+struct _PaintBrush
+{
+	GArray                *points;
+	GArray                *clips;
+	cairo_surface_t       *target;
+	guint8                *dabs;
+	guint8                *mask;
+	guint8                *previous;
+	gsize                  mask_size;
+	cairo_rectangle_int_t  mask_bounds;
+	int                    dab_size;
+	int                    line_width;
+	gboolean               erase;
+	guint                  marked;
+	int                    x;
+	int                    y;
+};
+
+static void paint_brush_blend_row (guint32 *target, const guint8 *mask, int n, guint32 color);
+static void paint_brush_erase_row (guint32 *target, const guint8 *mask, int n);
+static void paint_brush_max_row   (guint8 *target, const guint8 *source, int n);
+static void paint_brush_prepare   (PaintBrush *self, int line_width);
+static void paint_brush_stamp     (PaintBrush *self, guint8 *mask, double x, double y);
+static void paint_brush_stroke    (PaintBrush *self, guint8 *mask, guint first, guint last);
+
+/*******************************************************************************
+* Paint Brush モジュール:
+* 線の太さの円を線に沿って一定の間隔で押して描画します。
+* 円は小数点以下の位置ごとに被覆率を計算して保持し、線の太さが変わるまで使い回します。
+* 被覆率はマスクに最大値で重ねるため、重なった部分が濃くならず、丸い線端と丸い接合の線と同じ形になります。
+* マスクは最後に一度だけ色と合成して ARGB32 の画像に直接書き込みます。
+* 描画先の演算子が CLEAR の場合は、色の代わりにマスクの被覆率だけ描画先を透明にします。
+* 線を続けて描画する場合は書き込み済みの線の被覆率を差し引き、継ぎ目を二重に合成しません。
+*/
+
+/*******************************************************************************
+* @brief 描画を開始します。
+* 描画先が平行移動だけの ARGB32 の画像で、クリップが整数の矩形で表せる場合に限り描画できます。
+* 演算子は OVER と CLEAR に対応します。
+* 中間サーフィスに描画している場合は、中間サーフィスに書き込みます。
+* @return 描画できない場合は FALSE。
+*/
+gboolean
+paint_brush_begin (PaintBrush *self, cairo_t *cairo, int line_width)
+{
+	cairo_surface_t *target;
+	cairo_rectangle_list_t *list;
+	cairo_rectangle_int_t clip, extents;
+	cairo_matrix_t matrix;
+	double x1, y1, x2, y2;
+	int n;
+	gboolean result;
+	target = cairo_get_group_target (cairo);
+	cairo_get_matrix (cairo, &matrix);
+	cairo_surface_get_device_offset (target, &x1, &y1);
+	matrix.x0 += x1;
+	matrix.y0 += y1;
+	cairo_surface_get_device_scale (target, &x1, &y1);
+
+	if ((line_width < 1) || (line_width > BRUSH_MAXIMUM) || (x1 != 1) || (y1 != 1) || (matrix.xx != 1) || (matrix.yy != 1) || matrix.xy || matrix.yx || (matrix.x0 != floor (matrix.x0)) || (matrix.y0 != floor (matrix.y0)))
+	{
+		return FALSE;
+	}
+	if ((cairo_surface_get_type (target) != CAIRO_SURFACE_TYPE_IMAGE) || (cairo_image_surface_get_format (target) != CAIRO_FORMAT_ARGB32) || ((cairo_get_operator (cairo) != CAIRO_OPERATOR_OVER) && (cairo_get_operator (cairo) != CAIRO_OPERATOR_CLEAR)))
+	{
+		return FALSE;
+	}
+
+	extents.x = 0;
+	extents.y = 0;
+	extents.width = cairo_image_surface_get_width (target);
+	extents.height = cairo_image_surface_get_height (target);
+	g_array_set_size (self->clips, 0);
+	list = cairo_copy_clip_rectangle_list (cairo);
+
+	if (list->status == CAIRO_STATUS_SUCCESS)
+	{
+		for (n = 0, result = TRUE; result && (n < list->num_rectangles); n++)
+		{
+			x1 = list->rectangles [n].x + matrix.x0;
+			y1 = list->rectangles [n].y + matrix.y0;
+			x2 = x1 + list->rectangles [n].width;
+			y2 = y1 + list->rectangles [n].height;
+			result = (x1 == floor (x1)) && (y1 == floor (y1)) && (x2 == floor (x2)) && (y2 == floor (y2));
+			clip.x = x1;
+			clip.y = y1;
+			clip.width = x2 - x1;
+			clip.height = y2 - y1;
+
+			if (result && gdk_rectangle_intersect (&clip, &extents, &clip))
+			{
+				g_array_append_val (self->clips, clip);
+			}
+		}
+	}
+	else
+	{
+		/* クリップしていない場合は矩形で表せないため、範囲が描画先全体と一致することを確かめます。 */
+		cairo_clip_extents (cairo, &x1, &y1, &x2, &y2);
+		result = (x1 + matrix.x0 <= 0) && (y1 + matrix.y0 <= 0) && (x2 + matrix.x0 >= extents.width) && (y2 + matrix.y0 >= extents.height);
+
+		if (result)
+		{
+			g_array_append_val (self->clips, extents);
+		}
+	}
+
+	cairo_rectangle_list_destroy (list);
+
+	if (result)
+	{
+		paint_brush_prepare (self, line_width);
+		g_array_set_size (self->points, 0);
+		self->marked = 0;
+		self->target = target;
+		self->erase = cairo_get_operator (cairo) == CAIRO_OPERATOR_CLEAR;
+		self->x = matrix.x0;
+		self->y = matrix.y0;
+	}
+
+	return result;
+}
+
+/*******************************************************************************
+* @brief マスクの 1 行を色と合成します。
+* @param color 乗算済みアルファの色。
+*/
+static void
+paint_brush_blend_row (guint32 *target, const guint8 *mask, int n, guint32 color)
+{
+	guint32 pixel, alpha, result;
+	guint m, channel, shift;
+	int i;
+	i = 0;
+#if defined (__AVX2__)
+	__m256i zero, c, c255, half, mm, m1, m2, d, d1, d2, s1, s2, a1, a2;
+	guint64 u;
+	zero = _mm256_setzero_si256 ();
+	c = _mm256_unpacklo_epi8 (_mm256_set1_epi32 (color), zero);
+	c255 = _mm256_set1_epi16 (255);
+	half = _mm256_set1_epi16 (128);
+#define DIV255_256(x) (_mm256_srli_epi16 (_mm256_add_epi16 (_mm256_add_epi16 ((x), half), _mm256_srli_epi16 (_mm256_add_epi16 ((x), half), 8)), 8))
+
+	for (; i + 8 <= n; i += 8)
+	{
+		memcpy (&u, mask + i, sizeof (u));
+
+		if (u)
+		{
+			mm = _mm256_mullo_epi32 (_mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *) (mask + i))), _mm256_set1_epi32 (0x01010101));
+			m1 = _mm256_unpacklo_epi8 (mm, zero);
+			m2 = _mm256_unpackhi_epi8 (mm, zero);
+			d = _mm256_loadu_si256 ((const __m256i *) (target + i));
+			d1 = _mm256_unpacklo_epi8 (d, zero);
+			d2 = _mm256_unpackhi_epi8 (d, zero);
+			s1 = DIV255_256 (_mm256_mullo_epi16 (c, m1));
+			s2 = DIV255_256 (_mm256_mullo_epi16 (c, m2));
+			a1 = _mm256_sub_epi16 (c255, _mm256_shufflehi_epi16 (_mm256_shufflelo_epi16 (s1, 0xFF), 0xFF));
+			a2 = _mm256_sub_epi16 (c255, _mm256_shufflehi_epi16 (_mm256_shufflelo_epi16 (s2, 0xFF), 0xFF));
+			d1 = _mm256_add_epi16 (s1, DIV255_256 (_mm256_mullo_epi16 (d1, a1)));
+			d2 = _mm256_add_epi16 (s2, DIV255_256 (_mm256_mullo_epi16 (d2, a2)));
+			_mm256_storeu_si256 ((__m256i *) (target + i), _mm256_packus_epi16 (d1, d2));
+		}
+	}
+#undef DIV255_256
+#elif defined (__SSE2__)
+	__m128i zero, c, c255, half, mm, m1, m2, d, d1, d2, s1, s2, a1, a2;
+	guint32 u;
+	zero = _mm_setzero_si128 ();
+	c = _mm_unpacklo_epi8 (_mm_set1_epi32 (color), zero);
+	c255 = _mm_set1_epi16 (255);
+	half = _mm_set1_epi16 (128);
+#define DIV255_128(x) (_mm_srli_epi16 (_mm_add_epi16 (_mm_add_epi16 ((x), half), _mm_srli_epi16 (_mm_add_epi16 ((x), half), 8)), 8))
+
+	for (; i + 4 <= n; i += 4)
+	{
+		memcpy (&u, mask + i, sizeof (u));
+
+		if (u)
+		{
+			mm = _mm_cvtsi32_si128 (u);
+			mm = _mm_unpacklo_epi8 (mm, mm);
+			mm = _mm_unpacklo_epi16 (mm, mm);
+			m1 = _mm_unpacklo_epi8 (mm, zero);
+			m2 = _mm_unpackhi_epi8 (mm, zero);
+			d = _mm_loadu_si128 ((const __m128i *) (target + i));
+			d1 = _mm_unpacklo_epi8 (d, zero);
+			d2 = _mm_unpackhi_epi8 (d, zero);
+			s1 = DIV255_128 (_mm_mullo_epi16 (c, m1));
+			s2 = DIV255_128 (_mm_mullo_epi16 (c, m2));
+			a1 = _mm_sub_epi16 (c255, _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (s1, 0xFF), 0xFF));
+			a2 = _mm_sub_epi16 (c255, _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (s2, 0xFF), 0xFF));
+			d1 = _mm_add_epi16 (s1, DIV255_128 (_mm_mullo_epi16 (d1, a1)));
+			d2 = _mm_add_epi16 (s2, DIV255_128 (_mm_mullo_epi16 (d2, a2)));
+			_mm_storeu_si128 ((__m128i *) (target + i), _mm_packus_epi16 (d1, d2));
+		}
+	}
+#undef DIV255_128
+#elif defined (__ARM_NEON)
+	uint8x16_t c, mm, s, a, d;
+	uint16x8_t p1, p2;
+	guint32 u;
+	c = vreinterpretq_u8_u32 (vdupq_n_u32 (color));
+
+	for (; i + 4 <= n; i += 4)
+	{
+		memcpy (&u, mask + i, sizeof (u));
+
+		if (u)
+		{
+			mm = vreinterpretq_u8_u32 (vmulq_n_u32 (vmovl_u16 (vget_low_u16 (vmovl_u8 (vcreate_u8 (u)))), 0x01010101));
+			p1 = vmull_u8 (vget_low_u8 (c), vget_low_u8 (mm));
+			p2 = vmull_u8 (vget_high_u8 (c), vget_high_u8 (mm));
+			s = vcombine_u8 (vraddhn_u16 (p1, vrshrq_n_u16 (p1, 8)), vraddhn_u16 (p2, vrshrq_n_u16 (p2, 8)));
+			a = vmvnq_u8 (vreinterpretq_u8_u32 (vmulq_n_u32 (vshrq_n_u32 (vreinterpretq_u32_u8 (s), 24), 0x01010101)));
+			d = vld1q_u8 ((const uint8_t *) (target + i));
+			p1 = vmull_u8 (vget_low_u8 (d), vget_low_u8 (a));
+			p2 = vmull_u8 (vget_high_u8 (d), vget_high_u8 (a));
+			d = vcombine_u8 (vraddhn_u16 (p1, vrshrq_n_u16 (p1, 8)), vraddhn_u16 (p2, vrshrq_n_u16 (p2, 8)));
+			vst1q_u8 ((uint8_t *) (target + i), vqaddq_u8 (s, d));
+		}
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		if ((m = mask [i]))
+		{
+			alpha = 255 - DIV255 ((color >> 24) * m);
+			pixel = target [i];
+			result = 0;
+
+			for (shift = 0; shift < 32; shift += 8)
+			{
+				channel = DIV255 (((color >> shift) & 255) * m) + DIV255 (((pixel >> shift) & 255) * alpha);
+				result |= (guint32) MIN (channel, 255) << shift;
+			}
+
+			target [i] = result;
+		}
+	}
+}
+
+/*******************************************************************************
+* @brief 合成済みの被覆率を差し引き、残りだけを合成する被覆率に変換します。
+* 合成済みの被覆率 p に被覆率 d を合成した結果が、2 つの最大値 m と等しくなるように
+* d = (m - p) / (1 - p) を求めます。
+* @param mask 線全体の被覆率。合成する被覆率を受け取ります。
+* @param previous 合成済みの被覆率。
+*/
+void
+paint_brush_difference (guint8 *mask, const guint8 *previous, gsize n)
+{
+	guint m, p;
+	gsize i;
+
+	for (i = 0; i < n; i++)
+	{
+		m = mask [i];
+		p = previous [i];
+		mask [i] = (m > p) ? ((m - p) * 255 + (255 - p) / 2) / (255 - p) : 0;
+	}
+}
+
+/*******************************************************************************
+* @brief 描画を終了し、押した円を色と合成して描画先に書き込みます。
+* 消去する場合は色を使いません。
+*/
+void
+paint_brush_end (PaintBrush *self, PaintColor color)
+{
+	const PaintPoint *point;
+	const cairo_rectangle_int_t *clip;
+	cairo_rectangle_int_t bounds, area;
+	guint32 premultiplied;
+	const guint8 *row;
+	guint8 *data;
+	guint n, c, first;
+	int x1, y1, x2, y2, half, j, stride;
+
+	/* 書き込み済みの線に続けて描画する場合は、最後に書き込んだ点から描画します。 */
+	first = self->marked ? self->marked - 1 : 0;
+
+	if (first + (self->marked != 0) >= self->points->len)
+	{
+		self->target = NULL;
+		return;
+	}
+
+	/* 円を押す範囲を求めます。 */
+	point = &g_array_index (self->points, PaintPoint, first);
+	x1 = x2 = point->x;
+	y1 = y2 = point->y;
+
+	for (n = first + 1; n < self->points->len; n++)
+	{
+		point++;
+		x1 = MIN (x1, point->x);
+		y1 = MIN (y1, point->y);
+		x2 = MAX (x2, point->x);
+		y2 = MAX (y2, point->y);
+	}
+
+	half = self->dab_size / 2 + 1;
+	bounds.x = x1 + self->x - half;
+	bounds.y = y1 + self->y - half;
+	bounds.width = x2 - x1 + half * 2;
+	bounds.height = y2 - y1 + half * 2;
+
+	for (c = 0; c < self->clips->len; c++)
+	{
+		clip = &g_array_index (self->clips, cairo_rectangle_int_t, c);
+
+		if (c)
+		{
+			gdk_rectangle_union (&area, clip, &area);
+		}
+		else
+		{
+			area = *clip;
+		}
+	}
+	if (!self->clips->len || !gdk_rectangle_intersect (&bounds, &area, &self->mask_bounds))
+	{
+		self->target = NULL;
+		return;
+	}
+	if (self->mask_size < (gsize) self->mask_bounds.width * self->mask_bounds.height)
+	{
+		self->mask_size = (gsize) self->mask_bounds.width * self->mask_bounds.height;
+		self->mask = g_realloc (self->mask, self->mask_size);
+		self->previous = g_realloc (self->previous, self->mask_size);
+	}
+
+	memset (self->mask, 0, (gsize) self->mask_bounds.width * self->mask_bounds.height);
+	paint_brush_stroke (self, self->mask, first, self->points->len);
+
+	if (self->marked)
+	{
+		/* 書き込み済みの線と重なる画素は、足りない被覆率だけを合成します。 */
+		memset (self->previous, 0, (gsize) self->mask_bounds.width * self->mask_bounds.height);
+		paint_brush_stroke (self, self->previous, 0, self->marked);
+		paint_brush_difference (self->mask, self->previous, (gsize) self->mask_bounds.width * self->mask_bounds.height);
+	}
+
+	/* マスクをクリップの矩形ごとに合成します。 */
+	premultiplied = RGBA (DIV255 (GetRValue (color) * GetAValue (color)), DIV255 (GetGValue (color) * GetAValue (color)), DIV255 (GetBValue (color) * GetAValue (color)), GetAValue (color));
+	cairo_surface_flush (self->target);
+	data = cairo_image_surface_get_data (self->target);
+	stride = cairo_image_surface_get_stride (self->target);
+
+	for (c = 0; c < self->clips->len; c++)
+	{
+		clip = &g_array_index (self->clips, cairo_rectangle_int_t, c);
+
+		if (gdk_rectangle_intersect (clip, &self->mask_bounds, &area))
+		{
+			for (j = area.y; j < area.y + area.height; j++)
+			{
+				row = self->mask + (gsize) (j - self->mask_bounds.y) * self->mask_bounds.width + (area.x - self->mask_bounds.x);
+
+				if (self->erase)
+				{
+					paint_brush_erase_row ((guint32 *) (data + (gsize) j * stride) + area.x, row, area.width);
+				}
+				else
+				{
+					paint_brush_blend_row ((guint32 *) (data + (gsize) j * stride) + area.x, row, area.width, premultiplied);
+				}
+			}
+
+			cairo_surface_mark_dirty_rectangle (self->target, area.x, area.y, area.width, area.height);
+		}
+	}
+
+	self->target = NULL;
+}
+
+/*******************************************************************************
+* @brief マスクの 1 行の被覆率だけ描画先を透明にします。
+* 乗算済みアルファなので、すべてのチャンネルに同じ割合を掛けます。
+*/
+static void
+paint_brush_erase_row (guint32 *target, const guint8 *mask, int n)
+{
+	guint32 pixel, result;
+	guint m, shift;
+	int i;
+	i = 0;
+#if defined (__AVX2__)
+	__m256i zero, ones, half, mm, m1, m2, d, d1, d2;
+	guint64 u;
+	zero = _mm256_setzero_si256 ();
+	ones = _mm256_set1_epi8 (-1);
+	half = _mm256_set1_epi16 (128);
+#define DIV255_256(x) (_mm256_srli_epi16 (_mm256_add_epi16 (_mm256_add_epi16 ((x), half), _mm256_srli_epi16 (_mm256_add_epi16 ((x), half), 8)), 8))
+
+	for (; i + 8 <= n; i += 8)
+	{
+		memcpy (&u, mask + i, sizeof (u));
+
+		if (u)
+		{
+			mm = _mm256_xor_si256 (_mm256_mullo_epi32 (_mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *) (mask + i))), _mm256_set1_epi32 (0x01010101)), ones);
+			m1 = _mm256_unpacklo_epi8 (mm, zero);
+			m2 = _mm256_unpackhi_epi8 (mm, zero);
+			d = _mm256_loadu_si256 ((const __m256i *) (target + i));
+			d1 = DIV255_256 (_mm256_mullo_epi16 (_mm256_unpacklo_epi8 (d, zero), m1));
+			d2 = DIV255_256 (_mm256_mullo_epi16 (_mm256_unpackhi_epi8 (d, zero), m2));
+			_mm256_storeu_si256 ((__m256i *) (target + i), _mm256_packus_epi16 (d1, d2));
+		}
+	}
+#undef DIV255_256
+#elif defined (__SSE2__)
+	__m128i zero, ones, half, mm, m1, m2, d, d1, d2;
+	guint32 u;
+	zero = _mm_setzero_si128 ();
+	ones = _mm_set1_epi8 (-1);
+	half = _mm_set1_epi16 (128);
+#define DIV255_128(x) (_mm_srli_epi16 (_mm_add_epi16 (_mm_add_epi16 ((x), half), _mm_srli_epi16 (_mm_add_epi16 ((x), half), 8)), 8))
+
+	for (; i + 4 <= n; i += 4)
+	{
+		memcpy (&u, mask + i, sizeof (u));
+
+		if (u)
+		{
+			mm = _mm_cvtsi32_si128 (u);
+			mm = _mm_unpacklo_epi8 (mm, mm);
+			mm = _mm_xor_si128 (_mm_unpacklo_epi16 (mm, mm), ones);
+			m1 = _mm_unpacklo_epi8 (mm, zero);
+			m2 = _mm_unpackhi_epi8 (mm, zero);
+			d = _mm_loadu_si128 ((const __m128i *) (target + i));
+			d1 = DIV255_128 (_mm_mullo_epi16 (_mm_unpacklo_epi8 (d, zero), m1));
+			d2 = DIV255_128 (_mm_mullo_epi16 (_mm_unpackhi_epi8 (d, zero), m2));
+			_mm_storeu_si128 ((__m128i *) (target + i), _mm_packus_epi16 (d1, d2));
+		}
+	}
+#undef DIV255_128
+#elif defined (__ARM_NEON)
+	uint8x16_t a, d;
+	uint16x8_t p1, p2;
+	guint32 u;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		memcpy (&u, mask + i, sizeof (u));
+
+		if (u)
+		{
+			a = vmvnq_u8 (vreinterpretq_u8_u32 (vmulq_n_u32 (vmovl_u16 (vget_low_u16 (vmovl_u8 (vcreate_u8 (u)))), 0x01010101)));
+			d = vld1q_u8 ((const uint8_t *) (target + i));
+			p1 = vmull_u8 (vget_low_u8 (d), vget_low_u8 (a));
+			p2 = vmull_u8 (vget_high_u8 (d), vget_high_u8 (a));
+			vst1q_u8 ((uint8_t *) (target + i), vcombine_u8 (vraddhn_u16 (p1, vrshrq_n_u16 (p1, 8)), vraddhn_u16 (p2, vrshrq_n_u16 (p2, 8))));
+		}
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		if ((m = mask [i]))
+		{
+			pixel = target [i];
+			result = 0;
+
+			for (shift = 0; shift < 32; shift += 8)
+			{
+				result |= (guint32) DIV255 (((pixel >> shift) & 255) * (255 - m)) << shift;
+			}
+
+			target [i] = result;
+		}
+	}
+}
+
+/*******************************************************************************
+* @brief 破棄します。
+*/
+void
+paint_brush_free (PaintBrush *self)
+{
+	g_array_unref (self->points);
+	g_array_unref (self->clips);
+	g_free (self->dabs);
+	g_free (self->mask);
+	g_free (self->previous);
+	g_free (self);
+}
+
+/*******************************************************************************
+* @brief 線を指定した点まで伸ばします。
+* 最初の点は始点になります。
+*/
+void
+paint_brush_line_to (PaintBrush *self, int x, int y)
+{
+	PaintPoint point;
+	point.x = x;
+	point.y = y;
+	g_array_append_val (self->points, point);
+}
+
+/*******************************************************************************
+* @brief これまでに伸ばした線を書き込み済みとします。
+* 描画を終了するときは、この後に伸ばした線だけを書き込み済みの線と重ならないように合成します。
+*/
+void
+paint_brush_mark (PaintBrush *self)
+{
+	self->marked = self->points->len;
+}
+
+/*******************************************************************************
+* @brief マスクの 1 行に円の 1 行を最大値で重ねます。
+*/
+static void
+paint_brush_max_row (guint8 *target, const guint8 *source, int n)
+{
+	int i;
+	i = 0;
+#if defined (__AVX2__)
+	for (; i + 32 <= n; i += 32)
+	{
+		_mm256_storeu_si256 ((__m256i *) (target + i), _mm256_max_epu8 (_mm256_loadu_si256 ((const __m256i *) (target + i)), _mm256_loadu_si256 ((const __m256i *) (source + i))));
+	}
+#endif
+#if defined (__SSE2__)
+	for (; i + 16 <= n; i += 16)
+	{
+		_mm_storeu_si128 ((__m128i *) (target + i), _mm_max_epu8 (_mm_loadu_si128 ((const __m128i *) (target + i)), _mm_loadu_si128 ((const __m128i *) (source + i))));
+	}
+#elif defined (__ARM_NEON)
+	for (; i + 16 <= n; i += 16)
+	{
+		vst1q_u8 (target + i, vmaxq_u8 (vld1q_u8 (target + i), vld1q_u8 (source + i)));
+	}
+#endif
+	for (; i < n; i++)
+	{
+		target [i] = MAX (target [i], source [i]);
+	}
+}
+
+/*******************************************************************************
+* @brief 作成します。
+*/
+PaintBrush *
+paint_brush_new (void)
+{
+	PaintBrush *self;
+	self = g_new0 (PaintBrush, 1);
+	self->points = g_array_new (FALSE, FALSE, sizeof (PaintPoint));
+	self->clips = g_array_new (FALSE, FALSE, sizeof (cairo_rectangle_int_t));
+	return self;
+}
+
+/*******************************************************************************
+* @brief 線の太さの円の被覆率を、小数点以下の位置ごとに計算します。
+* 線の太さが前回と同じ場合は計算済みの円を使います。
+*/
+static void
+paint_brush_prepare (PaintBrush *self, int line_width)
+{
+	guint8 *dab;
+	double radius, dx, dy, coverage;
+	int size, half, px, py, i, j;
+
+	if (self->line_width != line_width)
+	{
+		radius = line_width / 2.0;
+		half = (int) ceil (radius) + 1;
+		size = half * 2 + 1;
+		self->dabs = g_realloc (self->dabs, (gsize) size * size * DAB_PHASES * DAB_PHASES);
+		self->dab_size = size;
+		self->line_width = line_width;
+		dab = self->dabs;
+
+		for (py = 0; py < DAB_PHASES; py++)
+		{
+			for (px = 0; px < DAB_PHASES; px++)
+			{
+				for (j = 0; j < size; j++)
+				{
+					for (i = 0; i < size; i++)
+					{
+						/* 画素の中心から円の中心までの距離で被覆率を近似します。 */
+						dx = i - half + 0.5 - (double) px / DAB_PHASES;
+						dy = j - half + 0.5 - (double) py / DAB_PHASES;
+						coverage = CLAMP (radius + 0.5 - sqrt (dx * dx + dy * dy), 0, 1);
+						*dab++ = lround (coverage * 255);
+					}
+				}
+			}
+		}
+	}
+}
+
+/*******************************************************************************
+* @brief 指定した位置に円を押します。
+* 位置は 1/4 画素単位に丸め、対応する計算済みの円を使います。
+*/
+static void
+paint_brush_stamp (PaintBrush *self, guint8 *mask, double x, double y)
+{
+	const guint8 *dab;
+	double qx, qy;
+	int left, top, px, py, half, i1, j1, i2, j2, j;
+	qx = floor (x * DAB_PHASES + 0.5);
+	qy = floor (y * DAB_PHASES + 0.5);
+	left = floor (qx / DAB_PHASES);
+	top = floor (qy / DAB_PHASES);
+	px = qx - left * DAB_PHASES;
+	py = qy - top * DAB_PHASES;
+	half = self->dab_size / 2;
+	left -= half;
+	top -= half;
+	i1 = MAX (left, self->mask_bounds.x);
+	j1 = MAX (top, self->mask_bounds.y);
+	i2 = MIN (left + self->dab_size, self->mask_bounds.x + self->mask_bounds.width);
+	j2 = MIN (top + self->dab_size, self->mask_bounds.y + self->mask_bounds.height);
+
+	if ((i1 < i2) && (j1 < j2))
+	{
+		dab = self->dabs + (gsize) (py * DAB_PHASES + px) * self->dab_size * self->dab_size;
+
+		for (j = j1; j < j2; j++)
+		{
+			paint_brush_max_row (mask + (gsize) (j - self->mask_bounds.y) * self->mask_bounds.width + (i1 - self->mask_bounds.x), dab + (gsize) (j - top) * self->dab_size + (i1 - left), i2 - i1);
+		}
+	}
+}
+
+/*******************************************************************************
+* @brief 線の太さに応じた間隔で線分に沿って円を押します。
+* マスクと重ならない線分は押しません。
+* @param first 最初の点。
+* @param last 最後の点の次の点。
+*/
+static void
+paint_brush_stroke (PaintBrush *self, guint8 *mask, guint first, guint last)
+{
+	const PaintPoint *point, *previous;
+	cairo_rectangle_int_t bounds;
+	double dx, dy, spacing, length;
+	guint n;
+	int half, step, i;
+	half = self->dab_size / 2 + 1;
+	spacing = MAX (self->line_width * SPACING_FACTOR, SPACING_MINIMUM);
+	point = &g_array_index (self->points, PaintPoint, first);
+	paint_brush_stamp (self, mask, point->x + self->x, point->y + self->y);
+
+	for (n = first + 1; n < last; n++)
+	{
+		previous = point++;
+		bounds.x = MIN (previous->x, point->x) + self->x - half;
+		bounds.y = MIN (previous->y, point->y) + self->y - half;
+		bounds.width = ABS (point->x - previous->x) + half * 2;
+		bounds.height = ABS (point->y - previous->y) + half * 2;
+
+		if (gdk_rectangle_intersect (&bounds, &self->mask_bounds, NULL))
+		{
+			dx = point->x - previous->x;
+			dy = point->y - previous->y;
+			length = sqrt (dx * dx + dy * dy);
+			step = MAX ((int) ceil (length / spacing), 1);
+
+			for (i = 1; i <= step; i++)
+			{
+				paint_brush_stamp (self, mask, previous->x + self->x + dx * i / step, previous->y + self->y + dy * i / step);
+			}
+		}
+	}
+}
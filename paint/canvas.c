@@ -22,49 +22,64 @@ struct _PaintCanvas
 	GtkAdjustment   *hadjustment;
 	GtkAdjustment   *vadjustment;
 	PaintCommand    *command;
-	GQueue          *command_queue;
-	cairo_surface_t *surface;
-	GdkPixbuf       *surface_source;
+	PaintHistory    *history;
+	cairo_region_t  *damage;
+	cairo_pattern_t *checker;
+	cairo_surface_t *view;
+	PaintTiles      *tiles;
 	PaintColor       color;
+	GdkRectangle     command_bounds;
 	PaintPoint       offset;
 	PaintPoint       point;
 	int              content_width;
 	int              content_height;
 	int              line_width;
-	int              surface_width;
-	int              surface_height;
-	int              resize_width;
-	int              resize_height;
+	int              view_width;
+	int              view_height;
 	int              zoom;
+	guint32          time;
 	unsigned char    antialias;
 	unsigned char    command_type;
+	unsigned char    deferred;
+	unsigned char    invalid;
 };
 
 static void paint_canvas_change_hadjustment  (GtkAdjustment *adjustment, gpointer user_data);
 static void paint_canvas_change_vadjustment  (GtkAdjustment *adjustment, gpointer user_data);
 static void paint_canvas_class_init          (PaintCanvasClass *this_class);
 static void paint_canvas_class_init_object   (GObjectClass *this_class);
+static void paint_canvas_clip                (PaintCanvas *self, cairo_t *cairo);
+static void paint_canvas_convert_point       (PaintCanvas *self, double x, double y, PaintPoint *point);
 static void paint_canvas_click_pressed       (GtkGestureClick *click, int n_press, double x, double y, gpointer user_data);
 static void paint_canvas_click_released      (GtkGestureClick *click, int n_press, double x, double y, gpointer user_data);
 static void paint_canvas_destroy             (PaintCanvas *self);
-static void paint_canvas_destroy_commands    (PaintCanvas *self);
 static void paint_canvas_dispose             (GObject *self);
 static void paint_canvas_draw                (GtkDrawingArea *area, cairo_t *cairo, int width, int height, gpointer user_data);
-static void paint_canvas_draw_commands       (PaintCanvas *self, cairo_t *cairo);
+static void paint_canvas_draw_background     (PaintCanvas *self, cairo_t *cairo);
+static void paint_canvas_draw_command        (PaintCanvas *self, cairo_t *cairo);
 static void paint_canvas_draw_surface        (PaintCanvas *self, cairo_t *cairo);
+static void paint_canvas_draw_view           (PaintCanvas *self);
+static void paint_canvas_flush_command       (PaintCanvas *self);
 static void paint_canvas_init                (PaintCanvas *self);
 static void paint_canvas_init_area           (PaintCanvas *self);
+static void paint_canvas_init_checker        (PaintCanvas *self);
 static void paint_canvas_init_command        (PaintCanvas *self, GType type);
 static void paint_canvas_init_command_draw   (PaintCanvas *self);
+static void paint_canvas_init_command_erase  (PaintCanvas *self);
+static void paint_canvas_init_command_fill   (PaintCanvas *self, double x, double y);
 static void paint_canvas_init_hscrollbar     (PaintCanvas *self);
 static void paint_canvas_init_vscrollbar     (PaintCanvas *self);
-static void paint_canvas_load_surface        (PaintCanvas *self);
+static void paint_canvas_invalidate          (PaintCanvas *self);
+static void paint_canvas_invalidate_bounds   (PaintCanvas *self, const cairo_rectangle_int_t *bounds);
 static void paint_canvas_motion_enter        (GtkEventControllerMotion *motion, double x, double y, gpointer user_data);
 static void paint_canvas_motion_leave        (GtkEventControllerMotion *motion, gpointer user_data);
 static void paint_canvas_motion_move         (GtkEventControllerMotion *motion, double x, double y, gpointer user_data);
+static void paint_canvas_notify_prepared     (GObject *command, GParamSpec *pspec, gpointer user_data);
 static void paint_canvas_resize_area         (GtkDrawingArea *area, int width, int height, gpointer user_data);
-static void paint_canvas_resize_surface      (PaintCanvas *self, cairo_t *cairo);
+static void paint_canvas_resize_view         (PaintCanvas *self, cairo_t *cairo, int width, int height);
 static void paint_canvas_transform           (PaintCanvas *self, cairo_t *cairo);
+static void paint_canvas_update_bounds       (PaintCanvas *self);
+static void paint_canvas_update_history      (PaintCanvas *self, GdkEvent *event, double x, double y);
 static void paint_canvas_update_offset_x     (PaintCanvas *self);
 static void paint_canvas_update_offset_y     (PaintCanvas *self);
 static void paint_canvas_update_point        (PaintCanvas *self, double x, double y);
@@ -78,6 +93,7 @@ static void paint_canvas_update_range_width  (PaintCanvas *self);
 * スクロール バーの値に応じて画像を平行移動します。
 */
 G_DEFINE_FINAL_TYPE (PaintCanvas, paint_canvas, GTK_TYPE_GRID);
+#define FACTOR 255.0
 
 /* 描画領域 */
 #define AREA_COLUMN 0
@@ -85,6 +101,11 @@ G_DEFINE_FINAL_TYPE (PaintCanvas, paint_canvas, GTK_TYPE_GRID);
 #define AREA_WIDTH  1
 #define AREA_HEIGHT 1
 
+/* 透明な部分の市松模様 */
+#define CHECKER_SIZE  8
+#define CHECKER_LIGHT 0.8
+#define CHECKER_DARK  0.6
+
 /* 水平スクロール バー */
 #define HSCROLLBAR_COLUMN 0
 #define HSCROLLBAR_ROW    1
@@ -101,6 +122,7 @@ G_DEFINE_FINAL_TYPE (PaintCanvas, paint_canvas, GTK_TYPE_GRID);
 #define SIGNAL_ENTER         "enter"
 #define SIGNAL_LEAVE         "leave"
 #define SIGNAL_MOTION        "motion"
+#define SIGNAL_PREPARED      "notify::prepared"
 #define SIGNAL_PRESSED       "pressed"
 #define SIGNAL_RELEASED      "released"
 #define SIGNAL_RESIZE        "resize"
@@ -157,7 +179,7 @@ paint_canvas_change_hadjustment (GtkAdjustment *adjustment, gpointer user_data)
 	PaintCanvas *self;
 	self = PAINT_CANVAS (user_data);
 	paint_canvas_update_offset_x (self);
-	gtk_widget_queue_draw (self->area);
+	paint_canvas_invalidate (self);
 }
 
 static void
@@ -166,7 +188,7 @@ paint_canvas_change_vadjustment (GtkAdjustment *adjustment, gpointer user_data)
 	PaintCanvas *self;
 	self = PAINT_CANVAS (user_data);
 	paint_canvas_update_offset_y (self);
-	gtk_widget_queue_draw (self->area);
+	paint_canvas_invalidate (self);
 }
 
 /*******************************************************************************
@@ -187,6 +209,65 @@ paint_canvas_class_init_object (GObjectClass *this_class)
 	this_class->dispose = paint_canvas_dispose;
 }
 
+/*******************************************************************************
+* @brief 再描画する範囲に切り抜きます。
+* 切り抜きの境界はピクセル単位に揃えます。
+*/
+static void
+paint_canvas_clip (PaintCanvas *self, cairo_t *cairo)
+{
+	cairo_rectangle_int_t rectangle;
+	double x1, y1, x2, y2;
+	int n, n_rectangles;
+	n_rectangles = cairo_region_num_rectangles (self->damage);
+
+	for (n = 0; n < n_rectangles; n++)
+	{
+		cairo_region_get_rectangle (self->damage, n, &rectangle);
+		x1 = rectangle.x;
+		y1 = rectangle.y;
+		x2 = rectangle.x + rectangle.width;
+		y2 = rectangle.y + rectangle.height;
+		cairo_user_to_device (cairo, &x1, &y1);
+		cairo_user_to_device (cairo, &x2, &y2);
+		x1 = floor (x1);
+		y1 = floor (y1);
+		cairo_save (cairo);
+		cairo_identity_matrix (cairo);
+		cairo_rectangle (cairo, x1, y1, ceil (x2) - x1, ceil (y2) - y1);
+		cairo_restore (cairo);
+	}
+
+	cairo_clip (cairo);
+}
+
+/*******************************************************************************
+* @brief 画像全体を透明にします。
+* 描画せずにタイルを破棄するため、画像の大きさにかかわらずすぐに終わります。
+* 貼り付け中の画像は書き込まずに破棄し、履歴に残しません。
+*/
+void
+paint_canvas_clear (PaintCanvas *self)
+{
+	PaintCommandClear *command;
+
+	if (self->command && (paint_command_get_command_type (self->command) == PAINT_COMMAND_TYPE_PASTE))
+	{
+		paint_canvas_invalidate_bounds (self, &self->command_bounds);
+		g_clear_object (&self->command);
+	}
+
+	paint_canvas_flush_command (self);
+	paint_canvas_init_command (self, PAINT_TYPE_COMMAND_CLEAR);
+	command = PAINT_COMMAND_CLEAR (self->command);
+	paint_command_clear_set_size (command, paint_tiles_get_width (self->tiles), paint_tiles_get_height (self->tiles));
+	self->command_bounds.width = 0;
+	self->command_bounds.height = 0;
+	paint_canvas_update_bounds (self);
+	paint_canvas_flush_command (self);
+	g_clear_object (&self->command);
+}
+
 /*******************************************************************************
 * @brief マウス ボタンを押しました。
 */
@@ -196,20 +277,39 @@ paint_canvas_click_pressed (GtkGestureClick *click, int n_press, double x, doubl
 	PaintCanvas *self;
 	self = PAINT_CANVAS (user_data);
 
+	/* 範囲を求めている途中で離した塗りつぶしは、次の操作の前に書き込みます。 */
+	if (self->deferred)
+	{
+		paint_canvas_flush_command (self);
+		g_clear_object (&self->command);
+	}
+
+	/* 貼り付け中の画像はカーソルと一緒に移動しており、離した位置に書き込みます。 */
+	if (self->command && (paint_command_get_command_type (self->command) == PAINT_COMMAND_TYPE_PASTE))
+	{
+		paint_canvas_update_point (self, x, y);
+		return;
+	}
+
 	switch (self->command_type)
 	{
 	case PAINT_COMMAND_TYPE_DRAW:
 		paint_canvas_init_command_draw (self);
 		break;
+	case PAINT_COMMAND_TYPE_ERASE:
+		paint_canvas_init_command_erase (self);
+		break;
+	case PAINT_COMMAND_TYPE_FILL:
+		paint_canvas_init_command_fill (self, x, y);
+		break;
 	default:
 		g_clear_object (&self->command);
 		break;
 	}
-	if (self->command)
-	{
-		g_queue_push_tail (self->command_queue, g_object_ref (self->command));
-	}
 
+	self->command_bounds.width = 0;
+	self->command_bounds.height = 0;
+	self->time = gtk_event_controller_get_current_event_time (GTK_EVENT_CONTROLLER (click));
 	paint_canvas_update_point (self, x, y);
 }
 
@@ -221,43 +321,42 @@ paint_canvas_click_released (GtkGestureClick *click, int n_press, double x, doub
 {
 	PaintCanvas *self;
 	self = PAINT_CANVAS (user_data);
+
+	/* 塗りつぶす範囲を求めている途中であれば、求め終えてから書き込みます。 */
+	if (self->command && (paint_command_get_command_type (self->command) == PAINT_COMMAND_TYPE_FILL) && !paint_command_fill_get_prepared (PAINT_COMMAND_FILL (self->command)))
+	{
+		self->deferred = TRUE;
+		return;
+	}
+
+	paint_canvas_flush_command (self);
 	g_clear_object (&self->command);
 }
 
 /*******************************************************************************
-* @brief プロパティを破棄します。
+* @brief 描画領域の座標を画像の座標に変換します。
 */
 static void
-paint_canvas_destroy (PaintCanvas *self)
+paint_canvas_convert_point (PaintCanvas *self, double x, double y, PaintPoint *point)
 {
-	paint_canvas_destroy_commands (self);
-	g_clear_pointer (&self->surface, cairo_surface_destroy);
-	g_clear_object (&self->command);
-	g_clear_object (&self->surface_source);
+	double scale;
+	scale = paint_canvas_get_zoom_percent (self);
+	point->x = lround (x / scale - self->offset.x);
+	point->y = lround (y / scale - self->offset.y);
 }
 
+/*******************************************************************************
+* @brief プロパティを破棄します。
+*/
 static void
-paint_canvas_destroy_commands (PaintCanvas *self)
+paint_canvas_destroy (PaintCanvas *self)
 {
-	GList *list;
-
-	if (self->command_queue)
-	{
-		list = self->command_queue->head;
-
-		while (list)
-		{
-			if (list->data)
-			{
-				g_object_unref (list->data);
-			}
-
-			list = list->next;
-		}
-
-		g_queue_free (self->command_queue);
-		self->command_queue = NULL;
-	}
+	g_clear_pointer (&self->checker, cairo_pattern_destroy);
+	g_clear_pointer (&self->damage, cairo_region_destroy);
+	g_clear_pointer (&self->history, paint_history_free);
+	g_clear_pointer (&self->tiles, paint_tiles_free);
+	g_clear_pointer (&self->view, cairo_surface_destroy);
+	g_clear_object (&self->command);
 }
 
 /*******************************************************************************
@@ -272,35 +371,60 @@ paint_canvas_dispose (GObject *self)
 
 /*******************************************************************************
 * @brief 領域に描画します。
+* 前回の描画から変更された範囲だけを合成し直します。
 */
 static void
 paint_canvas_draw (GtkDrawingArea *area, cairo_t *cairo, int width, int height, gpointer user_data)
 {
 	PaintCanvas *self;
 	self = PAINT_CANVAS (user_data);
-	paint_canvas_resize_surface (self, cairo);
-	paint_canvas_load_surface (self);
-	paint_canvas_transform (self, cairo);
-	paint_canvas_draw_surface (self, cairo);
-	paint_canvas_draw_commands (self, cairo);
+	paint_canvas_resize_view (self, cairo, width, height);
+	paint_canvas_draw_view (self);
+
+	if (self->view)
+	{
+		cairo_set_source_surface (cairo, self->view, 0, 0);
+		cairo_paint (cairo);
+	}
 }
 
+/*******************************************************************************
+* @brief 画像の範囲に透明な部分を示す市松模様を描画します。
+* 模様の大きさは拡大率によらず一定にし、画像の左上に揃えます。
+*/
 static void
-paint_canvas_draw_commands (PaintCanvas *self, cairo_t *cairo)
+paint_canvas_draw_background (PaintCanvas *self, cairo_t *cairo)
 {
-	GList *list;
-	PaintCommand *command;
-	list = self->command_queue->head;
+	cairo_matrix_t matrix;
+	double x1, y1, x2, y2;
+	x1 = 0;
+	y1 = 0;
+	x2 = paint_tiles_get_width (self->tiles);
+	y2 = paint_tiles_get_height (self->tiles);
+	cairo_user_to_device (cairo, &x1, &y1);
+	cairo_user_to_device (cairo, &x2, &y2);
+	x1 = round (x1);
+	y1 = round (y1);
+	cairo_matrix_init_translate (&matrix, -x1, -y1);
+	cairo_pattern_set_matrix (self->checker, &matrix);
+	cairo_save (cairo);
+	cairo_identity_matrix (cairo);
+	cairo_rectangle (cairo, x1, y1, round (x2) - x1, round (y2) - y1);
+	cairo_set_source (cairo, self->checker);
+	cairo_fill (cairo);
+	cairo_restore (cairo);
+}
 
-	while (list)
+/*******************************************************************************
+* @brief 実行中のコマンドを描画します。
+* 完了したコマンドと確定した部分は画像に書き込み済みのため再生しません。
+*/
+static void
+paint_canvas_draw_command (PaintCanvas *self, cairo_t *cairo)
+{
+	if (self->command)
 	{
-		if (list->data)
-		{
-			command = PAINT_COMMAND (list->data);
-			paint_command_execute (command, cairo);
-		}
-
-		list = list->next;
+		paint_command_execute_pending (self->command, cairo);
 	}
 }
 
@@ -310,10 +434,96 @@ paint_canvas_draw_commands (PaintCanvas *self, cairo_t *cairo)
 static void
 paint_canvas_draw_surface (PaintCanvas *self, cairo_t *cairo)
 {
-	if (self->surface)
+	paint_tiles_paint (self->tiles, cairo);
+}
+
+/*******************************************************************************
+* @brief 合成した画像を更新します。
+*/
+static void
+paint_canvas_draw_view (PaintCanvas *self)
+{
+	cairo_t *cairo;
+	gboolean erase;
+
+	if (self->view && (self->invalid || !cairo_region_is_empty (self->damage)))
 	{
-		cairo_set_source_surface (cairo, self->surface, 0, 0);
+		cairo = cairo_create (self->view);
+		paint_canvas_transform (self, cairo);
+
+		if (!self->invalid)
+		{
+			paint_canvas_clip (self, cairo);
+		}
+
+		cairo_set_operator (cairo, CAIRO_OPERATOR_CLEAR);
 		cairo_paint (cairo);
+		cairo_set_operator (cairo, CAIRO_OPERATOR_OVER);
+		paint_canvas_draw_background (self, cairo);
+
+		/* 消去中の線が市松模様まで消さないように、画像と線は再描画する範囲の中間サーフィスに合成します。 */
+		erase = self->command && (paint_command_get_command_type (self->command) == PAINT_COMMAND_TYPE_ERASE);
+
+		if (erase)
+		{
+			cairo_push_group (cairo);
+		}
+
+		paint_canvas_draw_surface (self, cairo);
+		paint_canvas_draw_command (self, cairo);
+
+		if (erase)
+		{
+			cairo_pop_group_to_source (cairo);
+			cairo_paint (cairo);
+		}
+
+		cairo_destroy (cairo);
+		cairo_region_destroy (self->damage);
+		self->damage = cairo_region_create ();
+		self->invalid = FALSE;
+	}
+}
+
+/*******************************************************************************
+* @brief 実行中のコマンドを画像に書き込み、履歴に記録します。
+* 描画中に部分ごとに書き込んだコマンドは書き込み済みです。
+*/
+static void
+paint_canvas_flush_command (PaintCanvas *self)
+{
+	cairo_rectangle_int_t bounds;
+	self->deferred = FALSE;
+
+	if (self->command && (paint_command_get_command_type (self->command) == PAINT_COMMAND_TYPE_PASTE))
+	{
+		/* 移動してきた範囲には書き込まず、最後の位置だけに書き込みます。 */
+		paint_canvas_invalidate_bounds (self, &self->command_bounds);
+		paint_command_paste_get_extents (PAINT_COMMAND_PASTE (self->command), &bounds);
+		self->command_bounds.x = 0;
+		self->command_bounds.y = 0;
+		self->command_bounds.width = paint_tiles_get_width (self->tiles);
+		self->command_bounds.height = paint_tiles_get_height (self->tiles);
+
+		if (!gdk_rectangle_intersect (&self->command_bounds, &bounds, &self->command_bounds))
+		{
+			return;
+		}
+	}
+	if (self->command && paint_command_fix (self->command))
+	{
+		/* 未確定のまま残っている点や、求め終えていない塗りつぶす範囲を確定して書き込みます。 */
+		paint_canvas_update_bounds (self);
+	}
+	if (self->command && (self->command_bounds.width > 0) && (self->command_bounds.height > 0))
+	{
+		if (!paint_command_get_opaque (self->command))
+		{
+			paint_tiles_execute (self->tiles, self->command, &self->command_bounds);
+			paint_canvas_invalidate_bounds (self, &self->command_bounds);
+		}
+
+		paint_history_push (self->history, self->tiles, &self->command_bounds);
 	}
 }
 
@@ -387,7 +597,7 @@ paint_cnavas_get_point (PaintCanvas *self, int *x, int *y)
 int
 paint_canvas_get_surface_height (PaintCanvas *self)
 {
-	return self->surface_height;
+	return paint_tiles_get_height (self->tiles);
 }
 
 /*******************************************************************************
@@ -396,7 +606,7 @@ paint_canvas_get_surface_height (PaintCanvas *self)
 int
 paint_canvas_get_surface_width (PaintCanvas *self)
 {
-	return self->surface_width;
+	return paint_tiles_get_width (self->tiles);
 }
 
 /*******************************************************************************
@@ -425,10 +635,14 @@ paint_canvas_init (PaintCanvas *self)
 {
 	self->antialias = TRUE;
 	self->color = COLOR_PROPERTY_DEFAULT_VALUE;
-	self->command_queue = g_queue_new ();
+	self->damage = cairo_region_create ();
+	self->history = paint_history_new ();
+	self->tiles = paint_tiles_new ();
 	self->command_type = PAINT_COMMAND_TYPE_DRAW;
 	self->line_width = 10;
 	self->zoom = ZOOM_PROPERTY_DEFAULT_VALUE;
+	paint_history_reset (self->history, self->tiles);
+	paint_canvas_init_checker (self);
 	paint_canvas_init_area (self);
 	paint_canvas_init_vscrollbar (self);
 	paint_canvas_init_hscrollbar (self);
@@ -458,6 +672,29 @@ paint_canvas_init_area (PaintCanvas *self)
 	gtk_widget_add_controller (self->area, controller);
 }
 
+/*******************************************************************************
+* @brief 市松模様を作成します。
+*/
+static void
+paint_canvas_init_checker (PaintCanvas *self)
+{
+	cairo_surface_t *surface;
+	cairo_t *cairo;
+	surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, CHECKER_SIZE * 2, CHECKER_SIZE * 2);
+	cairo = cairo_create (surface);
+	cairo_set_source_rgb (cairo, CHECKER_LIGHT, CHECKER_LIGHT, CHECKER_LIGHT);
+	cairo_paint (cairo);
+	cairo_rectangle (cairo, 0, 0, CHECKER_SIZE, CHECKER_SIZE);
+	cairo_rectangle (cairo, CHECKER_SIZE, CHECKER_SIZE, CHECKER_SIZE, CHECKER_SIZE);
+	cairo_set_source_rgb (cairo, CHECKER_DARK, CHECKER_DARK, CHECKER_DARK);
+	cairo_fill (cairo);
+	cairo_destroy (cairo);
+	self->checker = cairo_pattern_create_for_surface (surface);
+	cairo_pattern_set_extend (self->checker, CAIRO_EXTEND_REPEAT);
+	cairo_pattern_set_filter (self->checker, CAIRO_FILTER_NEAREST);
+	cairo_surface_destroy (surface);
+}
+
 static void
 paint_canvas_init_command (PaintCanvas *self, GType type)
 {
@@ -480,6 +717,37 @@ paint_canvas_init_command_draw (PaintCanvas *self)
 	paint_command_draw_set_line_width (command, self->line_width);
 }
 
+static void
+paint_canvas_init_command_erase (PaintCanvas *self)
+{
+	paint_canvas_init_command (self, PAINT_TYPE_COMMAND_ERASE);
+	paint_command_erase_set_line_width (PAINT_COMMAND_ERASE (self->command), self->line_width);
+}
+
+/*******************************************************************************
+* @brief 塗りつぶしコマンドを作成します。
+* 塗りつぶす範囲は押した時点の画像からワーカー スレッドで求め、求め終えたら表示します。
+*/
+static void
+paint_canvas_init_command_fill (PaintCanvas *self, double x, double y)
+{
+	PaintCommandFill *command;
+	PaintPoint point;
+	GdkRGBA color;
+	paint_canvas_init_command (self, PAINT_TYPE_COMMAND_FILL);
+	paint_canvas_convert_point (self, x, y, &point);
+	command = PAINT_COMMAND_FILL (self->command);
+	color.red = GetRValue (self->color) / FACTOR;
+	color.green = GetGValue (self->color) / FACTOR;
+	color.blue = GetBValue (self->color) / FACTOR;
+	color.alpha = GetAValue (self->color) / FACTOR;
+	paint_command_fill_set_color (command, &color);
+	paint_command_fill_set_point (command, point.x, point.y);
+	paint_command_fill_set_size (command, paint_tiles_get_width (self->tiles), paint_tiles_get_height (self->tiles));
+	g_signal_connect_object (command, SIGNAL_PREPARED, G_CALLBACK (paint_canvas_notify_prepared), self, 0);
+	paint_command_fill_scan (command, self->tiles);
+}
+
 /*******************************************************************************
 * @brief 水平スクロール バーを作成します。
 */
@@ -509,42 +777,100 @@ paint_canvas_init_vscrollbar (PaintCanvas *self)
 }
 
 /*******************************************************************************
-* @brief 画像を設定します。
+* @brief 領域全体を再描画します。
 */
-void
-paint_canvas_load (PaintCanvas *self, GdkPixbuf *source)
+static void
+paint_canvas_invalidate (PaintCanvas *self)
 {
-	if (self->surface_source != source)
+	self->invalid = TRUE;
+	gtk_widget_queue_draw (self->area);
+}
+
+/*******************************************************************************
+* @brief 指定した範囲を再描画します。
+*/
+static void
+paint_canvas_invalidate_bounds (PaintCanvas *self, const cairo_rectangle_int_t *bounds)
+{
+	if ((bounds->width > 0) && (bounds->height > 0))
 	{
-		if (self->surface_source)
-		{
-			g_object_unref (self->surface_source);
-		}
-		if (source)
-		{
-			self->surface_source = g_object_ref (source);
-		}
-		else
+		cairo_region_union_rectangle (self->damage, bounds);
+		gtk_widget_queue_draw (self->area);
+	}
+}
+
+/*******************************************************************************
+* @brief 準備ができた貼り付け画像や塗りつぶす範囲を表示します。
+* 塗りつぶしはボタンを離した後に準備ができた場合、ここで書き込みます。
+*/
+static void
+paint_canvas_notify_prepared (GObject *command, GParamSpec *pspec, gpointer user_data)
+{
+	PaintCanvas *self;
+	self = PAINT_CANVAS (user_data);
+
+	if (self->command == PAINT_COMMAND (command))
+	{
+		paint_canvas_update_bounds (self);
+
+		if (self->deferred)
 		{
-			self->surface_source = NULL;
+			paint_canvas_flush_command (self);
+			g_clear_object (&self->command);
 		}
-
-		gtk_widget_queue_draw (self->area);
 	}
 }
 
+/*******************************************************************************
+* @brief 画像を貼り付けます。
+* 画像は表示中の左上に置き、クリックするまでカーソルと一緒に移動します。
+* 拡大縮小した複製はワーカー スレッドで作成し、できあがるまで描画を待たせません。
+*/
+void
+paint_canvas_paste (PaintCanvas *self, GdkPixbuf *source)
+{
+	PaintCommandPaste *command;
+	paint_canvas_flush_command (self);
+	paint_canvas_init_command (self, PAINT_TYPE_COMMAND_PASTE);
+	command = PAINT_COMMAND_PASTE (self->command);
+	g_signal_connect_object (command, SIGNAL_PREPARED, G_CALLBACK (paint_canvas_notify_prepared), self, 0);
+	paint_command_paste_set_point (command, MAX (-self->offset.x, 0), MAX (-self->offset.y, 0));
+	paint_command_paste_set_source (command, source);
+	paint_command_update (self->command, self->point.x, self->point.y);
+	self->command_bounds.width = 0;
+	self->command_bounds.height = 0;
+	paint_canvas_update_bounds (self);
+}
+
 /*******************************************************************************
 * @brief 画像を設定します。
 */
-static void
-paint_canvas_load_surface (PaintCanvas *self)
+void
+paint_canvas_load (PaintCanvas *self, GdkPixbuf *source)
 {
-	if (self->surface_source)
+	if (source)
 	{
-		share_surface_load (self->surface, self->surface_source);
-		g_object_unref (self->surface_source);
-		self->surface_source = NULL;
+		paint_tiles_load (self->tiles, source);
 	}
+	else
+	{
+		paint_tiles_clear (self->tiles);
+	}
+
+	paint_history_reset (self->history, self->tiles);
+	paint_canvas_invalidate (self);
+}
+
+/*******************************************************************************
+* @brief ジャーナルの画像を設定します。
+* タイルは表示などで使われたときに復元します。
+*/
+void
+paint_canvas_load_journal (PaintCanvas *self, PaintJournal *journal)
+{
+	paint_tiles_attach (self->tiles, journal);
+	paint_history_reset (self->history, self->tiles);
+	paint_canvas_invalidate (self);
 }
 
 /*******************************************************************************
@@ -573,7 +899,15 @@ static void
 paint_canvas_motion_move (GtkEventControllerMotion *motion, double x, double y, gpointer user_data)
 {
 	PaintCanvas *self;
+	GdkEvent *event;
 	self = PAINT_CANVAS (user_data);
+	event = gtk_event_controller_get_current_event (GTK_EVENT_CONTROLLER (motion));
+
+	if (self->command && event && (gdk_event_get_event_type (event) == GDK_MOTION_NOTIFY))
+	{
+		paint_canvas_update_history (self, event, x, y);
+	}
+
 	paint_canvas_update_point (self, x, y);
 }
 
@@ -586,16 +920,34 @@ paint_canvas_new (void)
 	return g_object_new (PAINT_TYPE_CANVAS, NULL);
 }
 
+/*******************************************************************************
+* @brief 取り消したコマンドをやり直します。
+* @return やり直すコマンドがない場合は FALSE。
+*/
+gboolean
+paint_canvas_redo (PaintCanvas *self)
+{
+	cairo_rectangle_int_t bounds;
+
+	if (!self->command && paint_history_redo (self->history, self->tiles, &bounds))
+	{
+		paint_canvas_invalidate_bounds (self, &bounds);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
 /*******************************************************************************
 * @brief 画像の大きさを設定します。
-* 画像の大きさは描画時に更新されます。
+* 履歴は破棄します。
 */
 void
 paint_canvas_resize (PaintCanvas *self, int width, int height)
 {
-	self->resize_width = width;
-	self->resize_height = height;
-	gtk_widget_queue_draw (self->area);
+	paint_tiles_resize (self->tiles, width, height);
+	paint_history_reset (self->history, self->tiles);
+	paint_canvas_invalidate (self);
 }
 
 /*******************************************************************************
@@ -611,32 +963,28 @@ paint_canvas_resize_area (GtkDrawingArea *area, int width, int height, gpointer
 }
 
 /*******************************************************************************
-* @brief サーフィスを作成します。
+* @brief 合成した画像を格納するサーフィスを作成します。
 */
 static void
-paint_canvas_resize_surface (PaintCanvas *self, cairo_t *cairo)
+paint_canvas_resize_view (PaintCanvas *self, cairo_t *cairo, int width, int height)
 {
-	cairo_surface_t *surface;
+	cairo_surface_t *view;
 
-	if ((self->surface_width != self->resize_width) || (self->surface_height != self->resize_height))
+	if (!self->view || (self->view_width != width) || (self->view_height != height))
 	{
-		surface = cairo_surface_create_similar (cairo_get_target (cairo), CAIRO_CONTENT_COLOR_ALPHA, self->resize_width, self->resize_height);
+		view = cairo_surface_create_similar (cairo_get_target (cairo), CAIRO_CONTENT_COLOR_ALPHA, width, height);
 
-		if (surface)
+		if (view)
 		{
-			if (self->surface)
+			if (self->view)
 			{
-				cairo_surface_destroy (self->surface);
+				cairo_surface_destroy (self->view);
 			}
 
-			self->surface = surface;
-			self->surface_width = self->resize_width;
-			self->surface_height = self->resize_height;
-		}
-		else
-		{
-			self->resize_width = self->surface_width;
-			self->resize_height = self->surface_height;
+			self->view = view;
+			self->view_width = width;
+			self->view_height = height;
+			self->invalid = TRUE;
 		}
 	}
 }
@@ -688,6 +1036,15 @@ paint_canvas_set_content_width (PaintCanvas *self, int width)
 	paint_canvas_update_range_width (self);
 }
 
+/*******************************************************************************
+* @brief 履歴のメモリ使用量の上限を設定します。
+*/
+void
+paint_canvas_set_history_limit (PaintCanvas *self, gsize limit)
+{
+	paint_history_set_limit (self->history, limit);
+}
+
 /*******************************************************************************
 * @brief ストローク幅を設定します。
 */
@@ -706,7 +1063,7 @@ paint_canvas_set_zoom (PaintCanvas *self, int zoom)
 	self->zoom = zoom;
 	paint_canvas_update_range_width (self);
 	paint_canvas_update_range_height (self);
-	gtk_widget_queue_draw (self->area);
+	paint_canvas_invalidate (self);
 }
 
 /*******************************************************************************
@@ -720,6 +1077,21 @@ paint_canvas_set_zoom_percent (PaintCanvas *self, double percent)
 	paint_canvas_set_zoom (self, zoom);
 }
 
+/*******************************************************************************
+* @brief 現在の画像の複製を作成します。
+* タイルは共有するため、画像の大きさにかかわらずすぐに終わります。
+* 共有したタイルは描画する前に複製されるので、複製の内容は変わりません。
+* @return 複製したタイル格納域。不要になったら paint_tiles_free で破棄します。
+*/
+PaintTiles *
+paint_canvas_snapshot (PaintCanvas *self)
+{
+	PaintTiles *tiles;
+	tiles = paint_tiles_new ();
+	paint_tiles_assign (tiles, self->tiles);
+	return tiles;
+}
+
 /*******************************************************************************
 * @brief 平行移動を適用します。
 */
@@ -732,6 +1104,91 @@ paint_canvas_transform (PaintCanvas *self, cairo_t *cairo)
 	cairo_translate (cairo, self->offset.x, self->offset.y);
 }
 
+/*******************************************************************************
+* @brief 最後のコマンドを取り消します。
+* @return 取り消すコマンドがない場合は FALSE。
+*/
+gboolean
+paint_canvas_undo (PaintCanvas *self)
+{
+	cairo_rectangle_int_t bounds;
+
+	if (!self->command && paint_history_undo (self->history, self->tiles, &bounds))
+	{
+		paint_canvas_invalidate_bounds (self, &bounds);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*******************************************************************************
+* @brief 実行中のコマンドが描画した範囲を再描画します。
+*/
+static void
+paint_canvas_update_bounds (PaintCanvas *self)
+{
+	cairo_rectangle_int_t bounds;
+
+	if (paint_command_get_bounds (self->command, &bounds))
+	{
+		if ((self->command_bounds.width > 0) && (self->command_bounds.height > 0))
+		{
+			gdk_rectangle_union (&self->command_bounds, &bounds, &self->command_bounds);
+		}
+		else
+		{
+			self->command_bounds = bounds;
+		}
+
+		paint_canvas_invalidate_bounds (self, &bounds);
+		paint_tiles_commit (self->tiles, self->command, &bounds);
+	}
+}
+
+/*******************************************************************************
+* @brief 圧縮されたモーション イベントの履歴をコマンドに渡します。
+* 履歴の座標はサーフィス座標なので、イベントの座標との差で描画領域の座標に変換します。
+* 範囲の更新と再描画は最後の座標と合わせて一度だけ行います。
+*/
+static void
+paint_canvas_update_history (PaintCanvas *self, GdkEvent *event, double x, double y)
+{
+	GdkTimeCoord *history;
+	PaintPoint point;
+	double dx, dy, scale;
+	guint n, n_history;
+	history = gdk_event_get_history (event, &n_history);
+
+	if (history)
+	{
+		gdk_event_get_position (event, &dx, &dy);
+		dx = x - dx;
+		dy = y - dy;
+		scale = paint_canvas_get_zoom_percent (self);
+
+		for (n = 0; n < n_history; n++)
+		{
+			/* 前のイベントより古い履歴と座標のない履歴は無視します。同じミリ秒の履歴は残し、処理済みの点と同じ座標だけを取り除きます。 */
+			if ((history [n].time >= self->time) && (history [n].flags & GDK_AXIS_FLAG_X) && (history [n].flags & GDK_AXIS_FLAG_Y))
+			{
+				point.x = lround ((history [n].axes [GDK_AXIS_X] + dx) / scale - self->offset.x);
+				point.y = lround ((history [n].axes [GDK_AXIS_Y] + dy) / scale - self->offset.y);
+
+				if ((point.x != self->point.x) || (point.y != self->point.y))
+				{
+					paint_command_update (self->command, point.x, point.y);
+					self->point = point;
+				}
+			}
+		}
+
+		g_free (history);
+	}
+
+	self->time = gdk_event_get_time (event);
+}
+
 /*******************************************************************************
 * @brief 平行移動量を更新します。
 */
@@ -762,15 +1219,12 @@ paint_canvas_update_offset_y (PaintCanvas *self)
 static void
 paint_canvas_update_point (PaintCanvas *self, double x, double y)
 {
-	double scale;
-	scale = paint_canvas_get_zoom_percent (self);
-	self->point.x = lround (x / scale - self->offset.x);
-	self->point.y = lround (y / scale - self->offset.y);
+	paint_canvas_convert_point (self, x, y, &self->point);
 
 	if (self->command)
 	{
 		paint_command_update (self->command, self->point.x, self->point.y);
-		gtk_widget_queue_draw (self->area);
+		paint_canvas_update_bounds (self);
 	}
 }
 
@@ -0,0 +1,123 @@
+/* Copyright (C) 2025 Taichi Murakami. */
+#include <gtk/gtk.h>
+#include "paint.h"
+#include "share.h"
+
+/* クラスのインスタンス */
+struct _PaintCommandClear
+{
+	PaintCommand parent_instance;
+	PaintPoint   point;
+	int          width;
+	int          height;
+	gboolean     bounded;
+};
+
+static gboolean paint_command_clear_bounds         (PaintCommand *self, cairo_rectangle_int_t *bounds);
+static void paint_command_clear_class_init         (PaintCommandClearClass *this_class);
+static void paint_command_clear_class_init_command (PaintCommandClass *this_class);
+static void paint_command_clear_execute            (PaintCommand *self, cairo_t *cairo);
+static void paint_command_clear_init               (PaintCommandClear *self);
+
+/*******************************************************************************
+* Paint Command クラス:
+* 指定した範囲を透明にする方法を提供します。
+* タイル格納域に書き込むときは描画せず、範囲に含まれるタイルは破棄し、
+* 一部だけが含まれるタイルは行ごとにゼロで埋めます。
+*/
+G_DEFINE_FINAL_TYPE (PaintCommandClear, paint_command_clear, PAINT_TYPE_COMMAND);
+
+/*******************************************************************************
+* @brief 消去する範囲を取得します。
+* 範囲は最初の 1 回だけ返します。
+*/
+static gboolean
+paint_command_clear_bounds (PaintCommand *self, cairo_rectangle_int_t *bounds)
+{
+	PaintCommandClear *clear;
+	clear = PAINT_COMMAND_CLEAR (self);
+
+	if (clear->bounded || (clear->width <= 0) || (clear->height <= 0))
+	{
+		return FALSE;
+	}
+
+	bounds->x = clear->point.x;
+	bounds->y = clear->point.y;
+	bounds->width = clear->width;
+	bounds->height = clear->height;
+	clear->bounded = TRUE;
+	return TRUE;
+}
+
+static void
+paint_command_clear_class_init (PaintCommandClearClass *this_class)
+{
+	paint_command_clear_class_init_command (PAINT_COMMAND_CLASS (this_class));
+}
+
+static void
+paint_command_clear_class_init_command (PaintCommandClass *this_class)
+{
+	this_class->bounds = paint_command_clear_bounds;
+	this_class->execute = paint_command_clear_execute;
+	this_class->pending = paint_command_clear_execute;
+	this_class->type = PAINT_COMMAND_TYPE_CLEAR;
+}
+
+/*******************************************************************************
+* @brief CLEAR 演算子で範囲を塗りつぶします。
+* タイル格納域はこの関数を使わずに直接消去します。
+*/
+static void
+paint_command_clear_execute (PaintCommand *self, cairo_t *cairo)
+{
+	PaintCommandClear *clear;
+	clear = PAINT_COMMAND_CLEAR (self);
+	cairo_save (cairo);
+	cairo_set_operator (cairo, CAIRO_OPERATOR_CLEAR);
+	cairo_rectangle (cairo, clear->point.x, clear->point.y, clear->width, clear->height);
+	cairo_fill (cairo);
+	cairo_restore (cairo);
+}
+
+void
+paint_command_clear_get_point (PaintCommandClear *self, int *x, int *y)
+{
+	*x = self->point.x;
+	*y = self->point.y;
+}
+
+void
+paint_command_clear_get_size (PaintCommandClear *self, int *width, int *height)
+{
+	*width = self->width;
+	*height = self->height;
+}
+
+static void
+paint_command_clear_init (PaintCommandClear *self)
+{
+}
+
+PaintCommand *
+paint_command_clear_new (void)
+{
+	return g_object_new (PAINT_TYPE_COMMAND_CLEAR, NULL);
+}
+
+void
+paint_command_clear_set_point (PaintCommandClear *self, int x, int y)
+{
+	self->point.x = x;
+	self->point.y = y;
+	self->bounded = FALSE;
+}
+
+void
+paint_command_clear_set_size (PaintCommandClear *self, int width, int height)
+{
+	self->width = width;
+	self->height = height;
+	self->bounded = FALSE;
+}
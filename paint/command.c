@@ -54,6 +54,21 @@ paint_command_class_init_object (GObjectClass *this_class)
 	OBJECT_CLASS_INSTALL_PROPERTY_BOOLEAN (this_class, ANTIALIAS_PROPERTY);
 }
 
+/*******************************************************************************
+* @brief 未確定の部分を確定します。
+*/
+void
+paint_command_commit (PaintCommand *self)
+{
+	PaintCommandCommitFunc commit;
+	commit = PAINT_COMMAND_GET_CLASS (self)->commit;
+
+	if (commit)
+	{
+		commit (self);
+	}
+}
+
 gboolean
 paint_command_get_antialias (PaintCommand *self)
 {
@@ -62,6 +77,39 @@ paint_command_get_antialias (PaintCommand *self)
 	return properties->antialias;
 }
 
+/*******************************************************************************
+* @brief 前回の呼び出し以降に描画した範囲を取得します。
+* @return 描画した範囲がない場合は FALSE。
+*/
+gboolean
+paint_command_get_bounds (PaintCommand *self, cairo_rectangle_int_t *bounds)
+{
+	PaintCommandBoundsFunc get_bounds;
+	get_bounds = PAINT_COMMAND_GET_CLASS (self)->bounds;
+	g_assert (get_bounds);
+	return get_bounds (self, bounds);
+}
+
+/*******************************************************************************
+* @brief コマンドの種類を取得します。
+*/
+PaintCommandType
+paint_command_get_command_type (PaintCommand *self)
+{
+	return PAINT_COMMAND_GET_CLASS (self)->type;
+}
+
+/*******************************************************************************
+* @brief 部分ごとに画像へ書き込んでも結果が変わらないかどうかを取得します。
+*/
+gboolean
+paint_command_get_opaque (PaintCommand *self)
+{
+	PaintCommandOpaqueFunc opaque;
+	opaque = PAINT_COMMAND_GET_CLASS (self)->opaque;
+	return opaque && opaque (self);
+}
+
 void
 paint_command_execute (PaintCommand *self, cairo_t *cairo)
 {
@@ -71,6 +119,59 @@ paint_command_execute (PaintCommand *self, cairo_t *cairo)
 	execute (self, cairo);
 }
 
+/*******************************************************************************
+* @brief 確定した部分のうち、まだ書き込んでいない部分だけを描画します。
+* 未確定の部分を持たないコマンドは、書き込んでいない部分をすべて描画します。
+*/
+void
+paint_command_execute_fixed (PaintCommand *self, cairo_t *cairo)
+{
+	PaintCommandExecuteFunc fixed;
+	fixed = PAINT_COMMAND_GET_CLASS (self)->fixed;
+
+	if (fixed)
+	{
+		fixed (self, cairo);
+	}
+	else
+	{
+		paint_command_execute_pending (self, cairo);
+	}
+}
+
+/*******************************************************************************
+* @brief 書き込んでいない部分だけを描画します。
+* 未確定の部分も描画します。
+*/
+void
+paint_command_execute_pending (PaintCommand *self, cairo_t *cairo)
+{
+	PaintCommandExecuteFunc pending;
+	pending = PAINT_COMMAND_GET_CLASS (self)->pending;
+
+	if (pending)
+	{
+		pending (self, cairo);
+	}
+	else
+	{
+		paint_command_execute (self, cairo);
+	}
+}
+
+/*******************************************************************************
+* @brief 未確定の部分をすべて確定します。
+* 描画を終えるときに呼び出します。
+* @return 確定した部分がある場合は TRUE。
+*/
+gboolean
+paint_command_fix (PaintCommand *self)
+{
+	PaintCommandFixFunc fix;
+	fix = PAINT_COMMAND_GET_CLASS (self)->fix;
+	return fix && fix (self);
+}
+
 static void
 paint_command_get_property (GObject *self, guint property_id, GValue *value, GParamSpec *pspec)
 {
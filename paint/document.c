@@ -3,34 +3,59 @@
 #include <glib/gi18n.h>
 #include "paint.h"
 #include "share.h"
+#define JOURNAL_SUFFIX      ".paint"
 #define LOGO_ICON_NAME      "paint"
 #define SIGNAL_NOTIFY_STATE "notify::state"
 
 #define PROPERTY_APPLICATION  "application"
 #define PROPERTY_SHOW_MENUBAR "show-menubar"
 
-#define SETTINGS_HEIGHT    "window-height"
-#define SETTINGS_MAXIMIZED "window-maximized"
-#define SETTINGS_WIDTH     "window-width"
+#define SETTINGS_HEIGHT        "window-height"
+#define SETTINGS_HISTORY_LIMIT "history-limit"
+#define SETTINGS_MAXIMIZED     "window-maximized"
+#define SETTINGS_WIDTH         "window-width"
 
 #define TITLE          _("Paint")
 #define TITLE_CCH      256
 #define TITLE_FORMAT   "%s - %s"
+#define TITLE_SAVING   "%s (%d%%) - %s"
 #define TITLE_UNTITLED _("(Untitled)")
 
+typedef struct _PaintDocumentWindowTool PaintDocumentWindowTool;
+
 /* クラスのインスタンス */
 struct _PaintDocumentWindow
 {
 	GtkApplicationWindow parent_instance;
+	GCancellable        *cancellable;
 	GFile               *file;
+	GFile               *queued;
+	GFile               *target;
 	GtkWidget           *canvas;
+	PaintJournal        *journal;
 	int                  width;
 	int                  height;
+	int                  history_limit;
 	int                  maximized;
+	int                  saving;
+};
+
+/* ツール */
+struct _PaintDocumentWindowTool
+{
+	const char      *name;
+	PaintCommandType type;
 };
 
 static void paint_document_window_activate_about     (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void paint_document_window_activate_clear     (GSimpleAction *action, GVariant *parameter, gpointer user_data);
 static void paint_document_window_activate_open      (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void paint_document_window_activate_paste     (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void paint_document_window_activate_redo      (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void paint_document_window_activate_save      (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void paint_document_window_activate_save_as   (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void paint_document_window_activate_undo      (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void paint_document_window_change_tool        (GSimpleAction *action, GVariant *value, gpointer user_data);
 static void paint_document_window_class_init         (PaintDocumentWindowClass *this_class);
 static void paint_document_window_class_init_object  (GObjectClass *this_class);
 static void paint_document_window_class_init_widget  (GtkWidgetClass *this_class);
@@ -41,8 +66,17 @@ static void paint_document_window_get_property       (GObject *self, guint prope
 static void paint_document_window_init               (PaintDocumentWindow *self);
 static void paint_document_window_init_canvas        (PaintDocumentWindow *self);
 static void paint_document_window_init_settings      (PaintDocumentWindow *self);
+static gboolean paint_document_window_is_journal     (GFile *file);
+static void paint_document_window_open_journal       (PaintDocumentWindow *self, GFile *file);
 static void paint_document_window_realize            (GtkWidget *self);
 static void paint_document_window_respond_open       (GObject *dialog, GAsyncResult *result, gpointer user_data);
+static void paint_document_window_respond_paste      (GObject *clipboard, GAsyncResult *result, gpointer user_data);
+static void paint_document_window_respond_save       (GObject *dialog, GAsyncResult *result, gpointer user_data);
+static void paint_document_window_save               (PaintDocumentWindow *self, GFile *file);
+static void paint_document_window_save_cancel        (PaintDocumentWindow *self);
+static void paint_document_window_save_finish        (GObject *file, GAsyncResult *result, gpointer user_data);
+static void paint_document_window_save_progress      (double fraction, gpointer user_data);
+static void paint_document_window_save_start         (PaintDocumentWindow *self, GFile *file);
 static void paint_document_window_set_property       (GObject *self, guint property_id, const GValue *value, GParamSpec *pspec);
 static void paint_document_window_settings_apply     (PaintDocumentWindow *self);
 static void paint_document_window_settings_load      (PaintDocumentWindow *self);
@@ -67,8 +101,24 @@ G_DEFINE_FINAL_TYPE (PaintDocumentWindow, paint_document_window, GTK_TYPE_APPLIC
 static const GActionEntry
 ACTION_ENTRIES [] =
 {
-	{ "show-about", paint_document_window_activate_about, NULL, NULL, NULL },
-	{ "open",       paint_document_window_activate_open,  NULL, NULL, NULL },
+	{ "show-about", paint_document_window_activate_about,   NULL, NULL,     NULL                              },
+	{ "clear",      paint_document_window_activate_clear,   NULL, NULL,     NULL                              },
+	{ "open",       paint_document_window_activate_open,    NULL, NULL,     NULL                              },
+	{ "paste",      paint_document_window_activate_paste,   NULL, NULL,     NULL                              },
+	{ "redo",       paint_document_window_activate_redo,    NULL, NULL,     NULL                              },
+	{ "save",       paint_document_window_activate_save,    NULL, NULL,     NULL                              },
+	{ "save-as",    paint_document_window_activate_save_as, NULL, NULL,     NULL                              },
+	{ "undo",       paint_document_window_activate_undo,    NULL, NULL,     NULL                              },
+	{ "tool",       NULL,                                   "s",  "'draw'", paint_document_window_change_tool },
+};
+
+/* ツール */
+static const PaintDocumentWindowTool
+TOOL_ENTRIES [] =
+{
+	{ "draw",  PAINT_COMMAND_TYPE_DRAW  },
+	{ "erase", PAINT_COMMAND_TYPE_ERASE },
+	{ "fill",  PAINT_COMMAND_TYPE_FILL  },
 };
 
 /*******************************************************************************
@@ -80,6 +130,17 @@ paint_document_window_activate_about (GSimpleAction *action, GVariant *parameter
 	share_about_dialog_show (GTK_WINDOW (user_data), TITLE, LOGO_ICON_NAME);
 }
 
+/*******************************************************************************
+* @brief 画像全体を透明にします。
+*/
+static void
+paint_document_window_activate_clear (GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	PaintDocumentWindow *self;
+	self = PAINT_DOCUMENT_WINDOW (user_data);
+	paint_canvas_clear (PAINT_CANVAS (self->canvas));
+}
+
 /*******************************************************************************
 * @brief ファイルを開くダイアログを表示します。
 */
@@ -89,6 +150,91 @@ paint_document_window_activate_open (GSimpleAction *action, GVariant *parameter,
 	share_file_dialog_open (GTK_WINDOW (user_data), NULL, paint_document_window_respond_open, user_data, SHARE_FILE_FILTER_IMAGE | SHARE_FILE_FILTER_ALL);
 }
 
+/*******************************************************************************
+* @brief クリップボードの画像を読み込みます。
+*/
+static void
+paint_document_window_activate_paste (GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	gdk_clipboard_read_texture_async (gtk_widget_get_clipboard (GTK_WIDGET (user_data)), NULL, paint_document_window_respond_paste, user_data);
+}
+
+/*******************************************************************************
+* @brief 取り消したコマンドをやり直します。
+*/
+static void
+paint_document_window_activate_redo (GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	PaintDocumentWindow *self;
+	self = PAINT_DOCUMENT_WINDOW (user_data);
+	paint_canvas_redo (PAINT_CANVAS (self->canvas));
+}
+
+/*******************************************************************************
+* @brief 画像を保存します。
+* ファイルがない場合は名前を付けて保存します。
+*/
+static void
+paint_document_window_activate_save (GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	PaintDocumentWindow *self;
+	self = PAINT_DOCUMENT_WINDOW (user_data);
+
+	if (self->file)
+	{
+		paint_document_window_save (self, self->file);
+	}
+	else
+	{
+		paint_document_window_activate_save_as (action, parameter, user_data);
+	}
+}
+
+/*******************************************************************************
+* @brief ファイルを保存ダイアログを表示します。
+*/
+static void
+paint_document_window_activate_save_as (GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	PaintDocumentWindow *self;
+	self = PAINT_DOCUMENT_WINDOW (user_data);
+	share_file_dialog_save (GTK_WINDOW (self), self->file, paint_document_window_respond_save, self, SHARE_FILE_FILTER_IMAGE | SHARE_FILE_FILTER_ALL);
+}
+
+/*******************************************************************************
+* @brief 最後のコマンドを取り消します。
+*/
+static void
+paint_document_window_activate_undo (GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	PaintDocumentWindow *self;
+	self = PAINT_DOCUMENT_WINDOW (user_data);
+	paint_canvas_undo (PAINT_CANVAS (self->canvas));
+}
+
+/*******************************************************************************
+* @brief ツールを切り替えます。
+*/
+static void
+paint_document_window_change_tool (GSimpleAction *action, GVariant *value, gpointer user_data)
+{
+	PaintDocumentWindow *self;
+	const char *name;
+	guint n;
+	self = PAINT_DOCUMENT_WINDOW (user_data);
+	name = g_variant_get_string (value, NULL);
+
+	for (n = 0; n < G_N_ELEMENTS (TOOL_ENTRIES); n++)
+	{
+		if (g_str_equal (name, TOOL_ENTRIES [n].name))
+		{
+			paint_canvas_set_command_type (PAINT_CANVAS (self->canvas), TOOL_ENTRIES [n].type);
+			g_simple_action_set_state (action, value);
+			break;
+		}
+	}
+}
+
 /*******************************************************************************
 * @brief クラスを初期化します。
 */
@@ -138,7 +284,16 @@ paint_document_window_constructed (GObject *self)
 static void
 paint_document_window_destroy (PaintDocumentWindow *self)
 {
+	if (self->cancellable)
+	{
+		g_cancellable_cancel (self->cancellable);
+		g_clear_object (&self->cancellable);
+	}
+
 	g_clear_object (&self->file);
+	g_clear_object (&self->queued);
+	g_clear_object (&self->target);
+	g_clear_pointer (&self->journal, paint_journal_unref);
 	paint_document_window_settings_save (self);
 }
 
@@ -214,6 +369,63 @@ paint_document_window_new (GApplication *application)
 	return g_object_new (PAINT_TYPE_DOCUMENT_WINDOW, PROPERTY_APPLICATION, application, PROPERTY_SHOW_MENUBAR, TRUE, NULL);
 }
 
+/*******************************************************************************
+* @brief 独自形式のファイルかどうかを拡張子で判断します。
+*/
+static gboolean
+paint_document_window_is_journal (GFile *file)
+{
+	char *name, *lower;
+	gboolean result;
+	result = FALSE;
+	name = g_file_get_basename (file);
+
+	if (name)
+	{
+		lower = g_ascii_strdown (name, -1);
+		result = g_str_has_suffix (lower, JOURNAL_SUFFIX);
+		g_free (lower);
+		g_free (name);
+	}
+
+	return result;
+}
+
+/*******************************************************************************
+* @brief 独自形式のファイルを開きます。
+* ファイルはメモリーにマップし、タイルは使われたときに復元します。
+*/
+static void
+paint_document_window_open_journal (PaintDocumentWindow *self, GFile *file)
+{
+	GError *error;
+	PaintCanvas *canvas;
+	PaintJournal *journal;
+	int width, height;
+	error = NULL;
+	canvas = PAINT_CANVAS (self->canvas);
+	journal = paint_journal_open (file, &error);
+
+	if (journal)
+	{
+		paint_document_window_save_cancel (self);
+		width = paint_journal_get_width (journal);
+		height = paint_journal_get_height (journal);
+		g_clear_pointer (&self->journal, paint_journal_unref);
+		self->journal = journal;
+		paint_document_window_set_file (self, file);
+		paint_canvas_set_content_width (canvas, width);
+		paint_canvas_set_content_height (canvas, height);
+		paint_canvas_resize (canvas, width, height);
+		paint_canvas_load_journal (canvas, journal);
+	}
+	else
+	{
+		share_alert_dialog_show (GTK_WINDOW (self), error);
+		g_error_free (error);
+	}
+}
+
 /*******************************************************************************
 * @brief ウィンドウを表示します。
 */
@@ -238,7 +450,12 @@ paint_document_window_respond_open (GObject *dialog, GAsyncResult *result, gpoin
 	int width, height;
 	file = gtk_file_dialog_open_finish (GTK_FILE_DIALOG (dialog), result, NULL);
 
-	if (file)
+	if (file && paint_document_window_is_journal (file))
+	{
+		paint_document_window_open_journal (PAINT_DOCUMENT_WINDOW (user_data), file);
+		g_object_unref (file);
+	}
+	else if (file)
 	{
 		error = NULL;
 		self = PAINT_DOCUMENT_WINDOW (user_data);
@@ -258,6 +475,8 @@ paint_document_window_respond_open (GObject *dialog, GAsyncResult *result, gpoin
 			height = 0;
 		}
 
+		paint_document_window_save_cancel (self);
+		g_clear_pointer (&self->journal, paint_journal_unref);
 		paint_document_window_set_file (self, pixfile);
 		paint_canvas_set_content_width (canvas, width);
 		paint_canvas_set_content_height (canvas, height);
@@ -277,6 +496,179 @@ paint_document_window_respond_open (GObject *dialog, GAsyncResult *result, gpoin
 	}
 }
 
+/*******************************************************************************
+* @brief クリップボードの画像を貼り付けます。
+*/
+static void
+paint_document_window_respond_paste (GObject *clipboard, GAsyncResult *result, gpointer user_data)
+{
+	GError *error;
+	GdkPixbuf *pixbuf;
+	GdkTexture *texture;
+	PaintDocumentWindow *self;
+	error = NULL;
+	self = PAINT_DOCUMENT_WINDOW (user_data);
+	texture = gdk_clipboard_read_texture_finish (GDK_CLIPBOARD (clipboard), result, &error);
+
+	if (texture)
+	{
+		pixbuf = gdk_pixbuf_get_from_texture (texture);
+		paint_canvas_paste (PAINT_CANVAS (self->canvas), pixbuf);
+		g_object_unref (pixbuf);
+		g_object_unref (texture);
+	}
+	if (error)
+	{
+		share_alert_dialog_show (GTK_WINDOW (self), error);
+		g_error_free (error);
+	}
+}
+
+/*******************************************************************************
+* @brief 選択したファイルに保存します。
+*/
+static void
+paint_document_window_respond_save (GObject *dialog, GAsyncResult *result, gpointer user_data)
+{
+	GFile *file;
+	file = gtk_file_dialog_save_finish (GTK_FILE_DIALOG (dialog), result, NULL);
+
+	if (file)
+	{
+		paint_document_window_save (PAINT_DOCUMENT_WINDOW (user_data), file);
+		g_object_unref (file);
+	}
+}
+
+/*******************************************************************************
+* @brief 画像をバックグラウンドで保存します。
+* 同じファイルに 2 つの保存が同時に書き込まないように、保存中にもう一度保存した場合は
+* 前の保存を取り消し、前の保存が終わってから最後に指定したファイルに保存します。
+*/
+static void
+paint_document_window_save (PaintDocumentWindow *self, GFile *file)
+{
+	if (self->cancellable)
+	{
+		g_cancellable_cancel (self->cancellable);
+		g_set_object (&self->queued, file);
+	}
+	else
+	{
+		paint_document_window_save_start (self, file);
+	}
+}
+
+/*******************************************************************************
+* @brief 保存中の画像を保存しないようにします。
+* 別の画像を開いたときに呼び出します。
+* 取り消した保存が終わるまで、次の保存は開始しません。
+*/
+static void
+paint_document_window_save_cancel (PaintDocumentWindow *self)
+{
+	if (self->cancellable)
+	{
+		g_cancellable_cancel (self->cancellable);
+	}
+
+	g_clear_object (&self->queued);
+}
+
+/*******************************************************************************
+* @brief 保存が終わりました。
+* 保存に成功した場合はウィンドウのファイルを保存先に変更します。
+* 取り消した場合はエラーを表示せず、待っている保存があれば開始します。
+*/
+static void
+paint_document_window_save_finish (GObject *file, GAsyncResult *result, gpointer user_data)
+{
+	GCancellable *cancellable;
+	GError *error;
+	GFile *queued;
+	PaintDocumentWindow *self;
+	gboolean succeeded;
+	error = NULL;
+	self = PAINT_DOCUMENT_WINDOW (user_data);
+	cancellable = g_task_get_cancellable (G_TASK (result));
+	succeeded = paint_save_finish (result, &error);
+
+	/* 破棄したウィンドウの保存は、取り消した保存と同じく何も変更しません。 */
+	if (cancellable == self->cancellable)
+	{
+		g_clear_object (&self->cancellable);
+		g_clear_object (&self->target);
+
+		if (succeeded && !g_cancellable_is_cancelled (cancellable))
+		{
+			paint_document_window_set_file (self, G_FILE (file));
+		}
+		if (self->queued)
+		{
+			queued = g_steal_pointer (&self->queued);
+			paint_document_window_save_start (self, queued);
+			g_object_unref (queued);
+		}
+		else
+		{
+			paint_document_window_update_title (self);
+		}
+	}
+	if (!succeeded)
+	{
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		{
+			share_alert_dialog_show (GTK_WINDOW (self), error);
+		}
+
+		g_error_free (error);
+	}
+
+	g_object_unref (self);
+}
+
+/*******************************************************************************
+* @brief 保存の進行状況をタイトルに表示します。
+*/
+static void
+paint_document_window_save_progress (double fraction, gpointer user_data)
+{
+	PaintDocumentWindow *self;
+	self = PAINT_DOCUMENT_WINDOW (user_data);
+	self->saving = (int) (fraction * 100);
+	paint_document_window_update_title (self);
+}
+
+/*******************************************************************************
+* @brief 保存を開始します。
+* 画像の複製はタイルを共有するだけなので、保存中も描画を続けられます。
+* ウィンドウのファイルは保存に成功するまで変更しません。
+*/
+static void
+paint_document_window_save_start (PaintDocumentWindow *self, GFile *file)
+{
+	self->cancellable = g_cancellable_new ();
+	self->target = g_object_ref (file);
+	self->saving = 0;
+	paint_document_window_update_title (self);
+
+	if (paint_document_window_is_journal (file))
+	{
+		/* 同じファイルに保存する場合は、変更したタイルだけを追記します。 */
+		if (!self->journal || !g_file_equal (paint_journal_get_file (self->journal), file))
+		{
+			g_clear_pointer (&self->journal, paint_journal_unref);
+			self->journal = paint_journal_new (file);
+		}
+
+		paint_save_journal_async (paint_canvas_snapshot (PAINT_CANVAS (self->canvas)), self->journal, self->cancellable, paint_document_window_save_progress, paint_document_window_save_finish, g_object_ref (self));
+	}
+	else
+	{
+		paint_save_async (paint_canvas_snapshot (PAINT_CANVAS (self->canvas)), file, self->cancellable, paint_document_window_save_progress, paint_document_window_save_finish, g_object_ref (self));
+	}
+}
+
 /*******************************************************************************
 * @brief ファイルを設定します。
 */
@@ -313,6 +705,7 @@ paint_document_window_settings_apply (PaintDocumentWindow *self)
 	GtkWindow *window;
 	window = GTK_WINDOW (self);
 	gtk_window_set_default_size (window, self->width, self->height);
+	paint_canvas_set_history_limit (PAINT_CANVAS (self->canvas), (gsize) self->history_limit << 20);
 
 	if (self->maximized)
 	{
@@ -330,6 +723,7 @@ paint_document_window_settings_load (PaintDocumentWindow *self)
 	settings = paint_get_settings ();
 	self->width = g_settings_get_int (settings, SETTINGS_WIDTH);
 	self->height = g_settings_get_int (settings, SETTINGS_HEIGHT);
+	self->history_limit = g_settings_get_int (settings, SETTINGS_HISTORY_LIMIT);
 	self->maximized = g_settings_get_boolean (settings, SETTINGS_MAXIMIZED);
 	g_object_unref (settings);
 }
@@ -424,7 +818,13 @@ paint_document_window_update_title (PaintDocumentWindow *self)
 	char *name;
 	char title [TITLE_CCH];
 
-	if (self->file)
+	if (self->target && self->cancellable)
+	{
+		name = g_file_get_basename (self->target);
+		g_snprintf (title, TITLE_CCH, TITLE_SAVING, name, self->saving, TITLE);
+		g_free (name);
+	}
+	else if (self->file)
 	{
 		name = g_file_get_basename (self->file);
 		g_snprintf (title, TITLE_CCH, TITLE_FORMAT, name, TITLE);
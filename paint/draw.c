@@ -8,6 +8,7 @@
 enum _PaintCommandDrawProperties
 {
 	NULL_PROPERTY_ID,
+	BRUSH_PROPERTY_ID,
 	COLOR_PROPERTY_ID,
 	LINE_WIDTH_PROPERTY_ID,
 };
@@ -16,22 +17,51 @@ enum _PaintCommandDrawProperties
 struct _PaintCommandDraw
 {
 	PaintCommand parent_instance;
-	GArray      *points;
+	PaintBrush  *brush;
+	GByteArray  *deltas;
+	GArray      *tail;
 	PaintColor   color;
+	PaintPoint   first;
+	PaintPoint   last;
+	PaintPoint   commit_point;
+	PaintPoint   bounds_min;
+	PaintPoint   bounds_max;
+	guint        commit_offset;
+	guint        n_points;
+	guint        n_commits;
 	int          line_width;
+	gboolean     dirty;
+	gboolean     use_brush;
 };
 
+static void paint_command_draw_append             (PaintCommandDraw *self, const PaintPoint *point);
+static void paint_command_draw_append_value       (PaintCommandDraw *self, int value);
+static gboolean paint_command_draw_bounds         (PaintCommand *self, cairo_rectangle_int_t *bounds);
 static void paint_command_draw_class_init         (PaintCommandDrawClass *this_class);
 static void paint_command_draw_class_init_command (PaintCommandClass *this_class);
 static void paint_command_draw_class_init_object  (GObjectClass *this_class);
+static void paint_command_draw_commit             (PaintCommand *self);
 static void paint_command_draw_destroy            (PaintCommandDraw *self);
 static void paint_command_draw_dispose            (GObject *self);
 static void paint_command_draw_execute            (PaintCommand *self, cairo_t *cairo);
-static void paint_command_draw_execute_line       (PaintCommandDraw *self, cairo_t *cairo, guint n_points);
-static void paint_command_draw_execute_point      (PaintCommandDraw *self, cairo_t *cairo);
+static gboolean paint_command_draw_execute_brush  (PaintCommandDraw *self, cairo_t *cairo, gboolean written, gboolean tail);
+static void paint_command_draw_execute_line       (PaintCommandDraw *self, cairo_t *cairo, guint offset, const PaintPoint *start, gboolean tail);
+static gboolean paint_command_draw_execute_mask   (PaintCommandDraw *self, cairo_t *cairo, gboolean tail);
+static void paint_command_draw_execute_point      (PaintCommandDraw *self, cairo_t *cairo, const PaintPoint *point);
+static void paint_command_draw_execute_range      (PaintCommandDraw *self, cairo_t *cairo, gboolean written, gboolean tail);
+static gboolean paint_command_draw_fits           (PaintCommandDraw *self, const PaintPoint *point);
+static gboolean paint_command_draw_fix            (PaintCommand *self);
+static void paint_command_draw_fix_tail           (PaintCommandDraw *self);
+static void paint_command_draw_fixed              (PaintCommand *self, cairo_t *cairo);
 static void paint_command_draw_get_property       (GObject *self, guint property_id, GValue *value, GParamSpec *pspec);
+static void paint_command_draw_include            (PaintCommandDraw *self, const PaintPoint *point);
 static void paint_command_draw_init               (PaintCommandDraw *self);
+static gboolean paint_command_draw_opaque         (PaintCommand *self);
+static void paint_command_draw_pending            (PaintCommand *self, cairo_t *cairo);
+static void paint_command_draw_read               (PaintCommandDraw *self, guint *offset, PaintPoint *point);
+static int  paint_command_draw_read_value         (PaintCommandDraw *self, guint *offset);
 static void paint_command_draw_set_property       (GObject *self, guint property_id, const GValue *value, GParamSpec *pspec);
+static void paint_command_draw_trace              (PaintCommandDraw *self, cairo_t *cairo, const cairo_rectangle_int_t *area, guint end, gboolean tail);
 static void paint_command_draw_update             (PaintCommand *self, int x, int y);
 static void paint_command_draw_update_antialias   (PaintCommandDraw *self, cairo_t *cairo);
 static void paint_command_draw_update_color       (PaintCommandDraw *self, cairo_t *cairo);
@@ -39,9 +69,33 @@ static void paint_command_draw_update_color       (PaintCommandDraw *self, cairo
 /*******************************************************************************
 * Paint Command クラス:
 * 領域上をなぞって描画する方法を提供します。
+* 入力した点はストローク幅に応じた許容誤差の範囲で直線に近似して間引きます。
+* 確定した点は前の点との差分を可変長で符号化して格納します。
+* 最後に確定した点より後の点は未確定として保持し、次の点を加えても直線に収まる間は確定しません。
+* 描画中は確定した点までを画像に書き込み、未確定の点は書き込まずに描画するだけにします。
+* 書き込み済みの線に続けて描画するときは、書き込み済みの線の被覆率を差し引いて継ぎ目を二重に合成しません。
 */
 G_DEFINE_FINAL_TYPE (PaintCommandDraw, paint_command_draw, PAINT_TYPE_COMMAND);
 #define FACTOR 255.0
+#define MARGIN 1
+
+/* 間引き */
+#define TAIL_MAXIMUM      64
+#define TOLERANCE_FACTOR  (1.0 / 16.0)
+#define TOLERANCE_MINIMUM 0.25
+#define TOLERANCE_MAXIMUM 0.5
+
+/* 可変長符号 */
+#define VALUE_BITS 7
+#define VALUE_MASK 0x7F
+#define VALUE_MORE 0x80
+
+/* ブラシ プロパティ */
+#define BRUSH_PROPERTY_NAME          "brush"
+#define BRUSH_PROPERTY_NICK          "Brush Enabled"
+#define BRUSH_PROPERTY_BLURB         "Brush Enabled"
+#define BRUSH_PROPERTY_DEFAULT_VALUE TRUE
+#define BRUSH_PROPERTY_FLAGS         G_PARAM_READWRITE
 
 /* 色プロパティ */
 #define COLOR_PROPERTY_NAME          "color"
@@ -61,6 +115,68 @@ G_DEFINE_FINAL_TYPE (PaintCommandDraw, paint_command_draw, PAINT_TYPE_COMMAND);
 #define LINE_WIDTH_PROPERTY_DEFAULT_VALUE 1
 #define LINE_WIDTH_PROPERTY_FLAGS         G_PARAM_READWRITE
 
+/*******************************************************************************
+* @brief 点を確定して格納します。
+*/
+static void
+paint_command_draw_append (PaintCommandDraw *self, const PaintPoint *point)
+{
+	paint_command_draw_append_value (self, point->x - self->last.x);
+	paint_command_draw_append_value (self, point->y - self->last.y);
+	self->last = *point;
+	self->n_points++;
+}
+
+/*******************************************************************************
+* @brief 差分を可変長で符号化して格納します。
+* 負の値は正の値と交互に並べて小さな絶対値を短く符号化します。
+*/
+static void
+paint_command_draw_append_value (PaintCommandDraw *self, int value)
+{
+	guint8 byte;
+	guint u;
+	u = ((guint) value << 1) ^ (guint) (value >> 31);
+
+	while (u > VALUE_MASK)
+	{
+		byte = (u & VALUE_MASK) | VALUE_MORE;
+		g_byte_array_append (self->deltas, &byte, 1);
+		u >>= VALUE_BITS;
+	}
+
+	byte = u;
+	g_byte_array_append (self->deltas, &byte, 1);
+}
+
+/*******************************************************************************
+* @brief 前回から変更した範囲を取得します。
+* 直線の始点は確定した最後の点なので、その点を含めれば近似し直した線分も範囲に収まります。
+*/
+static gboolean
+paint_command_draw_bounds (PaintCommand *self, cairo_rectangle_int_t *bounds)
+{
+	PaintCommandDraw *draw;
+	int margin;
+	draw = PAINT_COMMAND_DRAW (self);
+
+	if (!draw->dirty)
+	{
+		return FALSE;
+	}
+
+	paint_command_draw_include (draw, &draw->last);
+
+	/* 丸い線端はストローク幅の半分だけ点から広がります。 */
+	margin = (draw->line_width + 1) / 2 + MARGIN;
+	bounds->x = draw->bounds_min.x - margin;
+	bounds->y = draw->bounds_min.y - margin;
+	bounds->width = draw->bounds_max.x - draw->bounds_min.x + margin * 2;
+	bounds->height = draw->bounds_max.y - draw->bounds_min.y + margin * 2;
+	draw->dirty = FALSE;
+	return TRUE;
+}
+
 static void
 paint_command_draw_class_init (PaintCommandDrawClass *this_class)
 {
@@ -71,8 +187,15 @@ paint_command_draw_class_init (PaintCommandDrawClass *this_class)
 static void
 paint_command_draw_class_init_command (PaintCommandClass *this_class)
 {
+	this_class->bounds = paint_command_draw_bounds;
+	this_class->commit = paint_command_draw_commit;
 	this_class->execute = paint_command_draw_execute;
+	this_class->fix = paint_command_draw_fix;
+	this_class->fixed = paint_command_draw_fixed;
+	this_class->opaque = paint_command_draw_opaque;
+	this_class->pending = paint_command_draw_pending;
 	this_class->update = paint_command_draw_update;
+	this_class->type = PAINT_COMMAND_TYPE_DRAW;
 }
 
 static void
@@ -81,20 +204,37 @@ paint_command_draw_class_init_object (GObjectClass *this_class)
 	this_class->dispose = paint_command_draw_dispose;
 	this_class->get_property = paint_command_draw_get_property;
 	this_class->set_property = paint_command_draw_set_property;
+	OBJECT_CLASS_INSTALL_PROPERTY_BOOLEAN (this_class, BRUSH_PROPERTY);
 	OBJECT_CLASS_INSTALL_PROPERTY_UINT (this_class, COLOR_PROPERTY);
 	OBJECT_CLASS_INSTALL_PROPERTY_INT (this_class, LINE_WIDTH_PROPERTY);
 }
 
+/*******************************************************************************
+* @brief 確定した点までを書き込み済みにします。
+* 未確定の点は書き込まないため、次の点を加えたときに近似し直せます。
+*/
 static void
-paint_command_draw_destroy (PaintCommandDraw *self)
+paint_command_draw_commit (PaintCommand *self)
 {
-	if (self->points)
+	PaintCommandDraw *draw;
+	draw = PAINT_COMMAND_DRAW (self);
+
+	if (draw->deltas)
 	{
-		g_array_free (self->points, FALSE);
-		self->points = NULL;
+		draw->commit_offset = draw->deltas->len;
+		draw->commit_point = draw->last;
+		draw->n_commits = draw->n_points;
 	}
 }
 
+static void
+paint_command_draw_destroy (PaintCommandDraw *self)
+{
+	g_clear_pointer (&self->brush, paint_brush_free);
+	g_clear_pointer (&self->deltas, g_byte_array_unref);
+	g_clear_pointer (&self->tail, g_array_unref);
+}
+
 static void
 paint_command_draw_dispose (GObject *self)
 {
@@ -106,39 +246,87 @@ static void
 paint_command_draw_execute (PaintCommand *self, cairo_t *cairo)
 {
 	PaintCommandDraw *draw;
-	int n_points;
 	draw = PAINT_COMMAND_DRAW (self);
-	n_points = draw->points->len;
 
-	switch (n_points)
+	if (draw->deltas)
 	{
-	case 0:
-		break;
-	case 1:
-		paint_command_draw_update_antialias (draw, cairo);
-		paint_command_draw_update_color (draw, cairo);
-		paint_command_draw_execute_point (draw, cairo);
-		break;
-	default:
-		paint_command_draw_update_antialias (draw, cairo);
-		paint_command_draw_update_color (draw, cairo);
-		paint_command_draw_execute_line (draw, cairo, n_points);
-		break;
+		paint_command_draw_execute_range (draw, cairo, FALSE, TRUE);
 	}
 }
 
+/*******************************************************************************
+* @brief 最初の点から最後の点までをブラシで描画します。
+* アンチエイリアスしない線はブラシでは描画しません。
+* @param written 書き込み済みの線を除いて描画する場合は TRUE。
+* @param tail 未確定の点も描画する場合は TRUE。
+* @return ブラシで描画できない場合は FALSE。
+*/
+static gboolean
+paint_command_draw_execute_brush (PaintCommandDraw *self, cairo_t *cairo, gboolean written, gboolean tail)
+{
+	const PaintPoint *end;
+	PaintPoint point;
+	guint offset;
+
+	if (!self->use_brush || !paint_command_get_antialias (PAINT_COMMAND (self)))
+	{
+		return FALSE;
+	}
+	if (!self->brush)
+	{
+		self->brush = paint_brush_new ();
+	}
+	if (!paint_brush_begin (self->brush, cairo, self->line_width))
+	{
+		return FALSE;
+	}
+
+	offset = 0;
+	point = self->first;
+	paint_brush_line_to (self->brush, point.x, point.y);
+
+	/* 書き込み済みの線は被覆率を差し引くためだけに渡します。 */
+	while (TRUE)
+	{
+		if (written && (offset == self->commit_offset))
+		{
+			paint_brush_mark (self->brush);
+		}
+		if (offset >= self->deltas->len)
+		{
+			break;
+		}
+
+		paint_command_draw_read (self, &offset, &point);
+		paint_brush_line_to (self->brush, point.x, point.y);
+	}
+	if (tail && self->tail->len)
+	{
+		end = &g_array_index (self->tail, PaintPoint, self->tail->len - 1);
+		paint_brush_line_to (self->brush, end->x, end->y);
+	}
+
+	paint_brush_end (self->brush, self->color);
+	return TRUE;
+}
+
 static void
-paint_command_draw_execute_line (PaintCommandDraw *self, cairo_t *cairo, guint n_points)
+paint_command_draw_execute_line (PaintCommandDraw *self, cairo_t *cairo, guint offset, const PaintPoint *start, gboolean tail)
 {
-	const PaintPoint *point;
-	int n;
-	point = (PaintPoint *) self->points->data;
-	cairo_move_to (cairo, point->x, point->y);
+	const PaintPoint *end;
+	PaintPoint point;
+	point = *start;
+	cairo_move_to (cairo, point.x, point.y);
 
-	for (n = 1; n < n_points; n++)
+	while (offset < self->deltas->len)
 	{
-		point++;
-		cairo_line_to (cairo, point->x, point->y);
+		paint_command_draw_read (self, &offset, &point);
+		cairo_line_to (cairo, point.x, point.y);
+	}
+	if (tail && self->tail->len)
+	{
+		end = &g_array_index (self->tail, PaintPoint, self->tail->len - 1);
+		cairo_line_to (cairo, end->x, end->y);
 	}
 
 	cairo_set_line_cap (cairo, CAIRO_LINE_CAP_ROUND);
@@ -147,18 +335,237 @@ paint_command_draw_execute_line (PaintCommandDraw *self, cairo_t *cairo, guint n
 	cairo_stroke (cairo);
 }
 
+/*******************************************************************************
+* @brief 書き込み済みの線に続く線を、被覆率を差し引いたマスクで描画します。
+* 書き込み済みの線と線全体をそれぞれ A8 のサーフィスに描画し、差を一度だけ合成します。
+* 平行移動だけの描画先に限ります。
+* @param tail 未確定の点も描画する場合は TRUE。
+* @return 描画できない場合は FALSE。
+*/
+static gboolean
+paint_command_draw_execute_mask (PaintCommandDraw *self, cairo_t *cairo, gboolean tail)
+{
+	cairo_surface_t *previous, *mask;
+	cairo_rectangle_int_t area, clip;
+	cairo_matrix_t matrix;
+	const PaintPoint *end;
+	PaintPoint point, point_min, point_max;
+	guint8 *data;
+	const guint8 *previous_data;
+	double x1, y1, x2, y2;
+	guint offset;
+	int margin, stride, previous_stride, row;
+	cairo_get_matrix (cairo, &matrix);
+
+	if ((matrix.xx != 1) || (matrix.yy != 1) || matrix.xy || matrix.yx)
+	{
+		return FALSE;
+	}
+
+	/* 書き込み済みの線に続く部分の範囲を求めます。 */
+	point_min = point_max = self->commit_point;
+	offset = self->commit_offset;
+	point = self->commit_point;
+
+	while (offset < self->deltas->len)
+	{
+		paint_command_draw_read (self, &offset, &point);
+		point_min.x = MIN (point_min.x, point.x);
+		point_min.y = MIN (point_min.y, point.y);
+		point_max.x = MAX (point_max.x, point.x);
+		point_max.y = MAX (point_max.y, point.y);
+	}
+	if (tail && self->tail->len)
+	{
+		end = &g_array_index (self->tail, PaintPoint, self->tail->len - 1);
+		point_min.x = MIN (point_min.x, end->x);
+		point_min.y = MIN (point_min.y, end->y);
+		point_max.x = MAX (point_max.x, end->x);
+		point_max.y = MAX (point_max.y, end->y);
+	}
+
+	margin = (self->line_width + 1) / 2 + MARGIN;
+	area.x = point_min.x - margin;
+	area.y = point_min.y - margin;
+	area.width = point_max.x - point_min.x + margin * 2;
+	area.height = point_max.y - point_min.y + margin * 2;
+	cairo_clip_extents (cairo, &x1, &y1, &x2, &y2);
+	clip.x = floor (x1);
+	clip.y = floor (y1);
+	clip.width = ceil (x2) - clip.x;
+	clip.height = ceil (y2) - clip.y;
+
+	if (!gdk_rectangle_intersect (&area, &clip, &area))
+	{
+		return TRUE;
+	}
+
+	previous = cairo_image_surface_create (CAIRO_FORMAT_A8, area.width, area.height);
+	mask = cairo_image_surface_create (CAIRO_FORMAT_A8, area.width, area.height);
+	paint_command_draw_trace (self, cairo_create (previous), &area, self->commit_offset, FALSE);
+	paint_command_draw_trace (self, cairo_create (mask), &area, self->deltas->len, tail);
+	cairo_surface_flush (previous);
+	cairo_surface_flush (mask);
+	data = cairo_image_surface_get_data (mask);
+	stride = cairo_image_surface_get_stride (mask);
+	previous_data = cairo_image_surface_get_data (previous);
+	previous_stride = cairo_image_surface_get_stride (previous);
+
+	for (row = 0; row < area.height; row++)
+	{
+		paint_brush_difference (data + (gsize) row * stride, previous_data + (gsize) row * previous_stride, area.width);
+	}
+
+	cairo_surface_mark_dirty (mask);
+	cairo_mask_surface (cairo, mask, area.x, area.y);
+	cairo_surface_destroy (mask);
+	cairo_surface_destroy (previous);
+	return TRUE;
+}
+
 static void
-paint_command_draw_execute_point (PaintCommandDraw *self, cairo_t *cairo)
+paint_command_draw_execute_point (PaintCommandDraw *self, cairo_t *cairo, const PaintPoint *point)
 {
-	const PaintPoint *point;
 	double radius, angle;
-	point = (PaintPoint *) self->points->data;
 	radius = self->line_width / 2.0;
 	angle = M_PI * 2.0;
 	cairo_arc (cairo, point->x, point->y, radius, 0, angle);
 	cairo_fill (cairo);
 }
 
+/*******************************************************************************
+* @brief 線を描画します。
+* 書き込み済みの線を除く場合は、書き込み済みの線と重なる画素に足りない被覆率だけを合成します。
+* アンチエイリアスしない線は被覆率が 0 か 1 なので、重ねて描画しても結果は変わりません。
+* @param written 書き込み済みの線を除いて描画する場合は TRUE。
+* @param tail 未確定の点も描画する場合は TRUE。
+*/
+static void
+paint_command_draw_execute_range (PaintCommandDraw *self, cairo_t *cairo, gboolean written, gboolean tail)
+{
+	const PaintPoint *start;
+	guint offset;
+
+	if (paint_command_draw_execute_brush (self, cairo, written, tail))
+	{
+		return;
+	}
+
+	paint_command_draw_update_antialias (self, cairo);
+	paint_command_draw_update_color (self, cairo);
+
+	if (written && paint_command_get_antialias (PAINT_COMMAND (self)) && paint_command_draw_execute_mask (self, cairo, tail))
+	{
+		return;
+	}
+
+	start = written ? &self->commit_point : &self->first;
+	offset = written ? self->commit_offset : 0;
+
+	if ((offset < self->deltas->len) || (tail && self->tail->len))
+	{
+		paint_command_draw_execute_line (self, cairo, offset, start, tail);
+	}
+	else
+	{
+		paint_command_draw_execute_point (self, cairo, start);
+	}
+}
+
+/*******************************************************************************
+* @brief 確定した最後の点から指定した点までの直線に、未確定の点がすべて収まるかどうかを取得します。
+* 許容誤差はストローク幅に比例させ、1 ピクセル未満に抑えます。
+*/
+static gboolean
+paint_command_draw_fits (PaintCommandDraw *self, const PaintPoint *point)
+{
+	const PaintPoint *tail;
+	double dx, dy, length, tolerance, t, x, y;
+	guint n;
+	tolerance = CLAMP (self->line_width * TOLERANCE_FACTOR, TOLERANCE_MINIMUM, TOLERANCE_MAXIMUM);
+	tolerance *= tolerance;
+	dx = point->x - self->last.x;
+	dy = point->y - self->last.y;
+	length = dx * dx + dy * dy;
+
+	for (n = 0; n < self->tail->len; n++)
+	{
+		tail = &g_array_index (self->tail, PaintPoint, n);
+		x = tail->x - self->last.x;
+		y = tail->y - self->last.y;
+		t = length ? CLAMP ((x * dx + y * dy) / length, 0, 1) : 0;
+		x -= t * dx;
+		y -= t * dy;
+
+		if (x * x + y * y > tolerance)
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/*******************************************************************************
+* @brief 描画を終えるときに、未確定の点を確定します。
+* 確定した線分を次に書き込む範囲に含めます。
+* 不透明でない線は部分ごとに書き込まず、未確定の点も含めて最後にまとめて描画するため確定しません。
+*/
+static gboolean
+paint_command_draw_fix (PaintCommand *self)
+{
+	PaintCommandDraw *draw;
+	draw = PAINT_COMMAND_DRAW (self);
+
+	if (draw->deltas && draw->tail->len && paint_command_draw_opaque (self))
+	{
+		paint_command_draw_include (draw, &draw->last);
+		paint_command_draw_fix_tail (draw);
+		paint_command_draw_include (draw, &draw->last);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*******************************************************************************
+* @brief 未確定の最後の点を確定し、それより前の未確定の点を破棄します。
+*/
+static void
+paint_command_draw_fix_tail (PaintCommandDraw *self)
+{
+	if (self->tail->len)
+	{
+		paint_command_draw_append (self, &g_array_index (self->tail, PaintPoint, self->tail->len - 1));
+		g_array_set_size (self->tail, 0);
+	}
+}
+
+/*******************************************************************************
+* @brief 確定した点のうち、書き込んでいない線分を描画します。
+*/
+static void
+paint_command_draw_fixed (PaintCommand *self, cairo_t *cairo)
+{
+	PaintCommandDraw *draw;
+	draw = PAINT_COMMAND_DRAW (self);
+
+	if (draw->deltas && !draw->n_commits)
+	{
+		paint_command_draw_execute_range (draw, cairo, FALSE, FALSE);
+	}
+	else if (draw->deltas && (draw->commit_offset < draw->deltas->len))
+	{
+		paint_command_draw_execute_range (draw, cairo, TRUE, FALSE);
+	}
+}
+
+gboolean
+paint_command_draw_get_brush (PaintCommandDraw *self)
+{
+	return self->use_brush;
+}
+
 PaintColor
 paint_command_draw_get_color (PaintCommandDraw *self)
 {
@@ -179,6 +586,9 @@ paint_command_draw_get_property (GObject *self, guint property_id, GValue *value
 
 	switch (property_id)
 	{
+	case BRUSH_PROPERTY_ID:
+		g_value_set_boolean (value, properties->use_brush);
+		break;
 	case COLOR_PROPERTY_ID:
 		g_value_set_uint (value, properties->color);
 		break;
@@ -191,9 +601,31 @@ paint_command_draw_get_property (GObject *self, guint property_id, GValue *value
 	}
 }
 
+/*******************************************************************************
+* @brief 変更した範囲に点を含めます。
+*/
+static void
+paint_command_draw_include (PaintCommandDraw *self, const PaintPoint *point)
+{
+	if (self->dirty)
+	{
+		self->bounds_min.x = MIN (self->bounds_min.x, point->x);
+		self->bounds_min.y = MIN (self->bounds_min.y, point->y);
+		self->bounds_max.x = MAX (self->bounds_max.x, point->x);
+		self->bounds_max.y = MAX (self->bounds_max.y, point->y);
+	}
+	else
+	{
+		self->bounds_min = *point;
+		self->bounds_max = *point;
+		self->dirty = TRUE;
+	}
+}
+
 static void
 paint_command_draw_init (PaintCommandDraw *self)
 {
+	self->use_brush = BRUSH_PROPERTY_DEFAULT_VALUE;
 	self->color = COLOR_PROPERTY_DEFAULT_VALUE;
 	self->line_width = LINE_WIDTH_PROPERTY_DEFAULT_VALUE;
 }
@@ -204,6 +636,74 @@ paint_command_draw_new (void)
 	return g_object_new (PAINT_TYPE_COMMAND_DRAW, NULL);
 }
 
+/*******************************************************************************
+* @brief 部分ごとに書き込めるかどうかを取得します。
+* 不透明な線は重ねて描画しても色が変わりません。
+*/
+static gboolean
+paint_command_draw_opaque (PaintCommand *self)
+{
+	return GetAValue (PAINT_COMMAND_DRAW (self)->color) == G_MAXUINT8;
+}
+
+/*******************************************************************************
+* @brief 書き込んでいない線分を描画します。
+* 書き込み済みの線分と重なる部分は、書き込み済みの被覆率を差し引いて描画します。
+*/
+static void
+paint_command_draw_pending (PaintCommand *self, cairo_t *cairo)
+{
+	PaintCommandDraw *draw;
+	draw = PAINT_COMMAND_DRAW (self);
+
+	if (draw->deltas && !draw->n_commits)
+	{
+		paint_command_draw_execute_range (draw, cairo, FALSE, TRUE);
+	}
+	else if (draw->deltas && ((draw->commit_offset < draw->deltas->len) || draw->tail->len))
+	{
+		paint_command_draw_execute_range (draw, cairo, TRUE, TRUE);
+	}
+}
+
+/*******************************************************************************
+* @brief 格納した位置から次の点を取得します。
+*/
+static void
+paint_command_draw_read (PaintCommandDraw *self, guint *offset, PaintPoint *point)
+{
+	point->x += paint_command_draw_read_value (self, offset);
+	point->y += paint_command_draw_read_value (self, offset);
+}
+
+/*******************************************************************************
+* @brief 可変長で符号化した差分を取得します。
+*/
+static int
+paint_command_draw_read_value (PaintCommandDraw *self, guint *offset)
+{
+	guint8 byte;
+	guint u, shift;
+	u = 0;
+	shift = 0;
+
+	do
+	{
+		byte = self->deltas->data [(*offset)++];
+		u |= (guint) (byte & VALUE_MASK) << shift;
+		shift += VALUE_BITS;
+	}
+	while (byte & VALUE_MORE);
+
+	return (int) (u >> 1) ^ -(int) (u & 1);
+}
+
+void
+paint_command_draw_set_brush (PaintCommandDraw *self, gboolean brush)
+{
+	self->use_brush = brush != 0;
+}
+
 void
 paint_command_draw_set_color (PaintCommandDraw *self, PaintColor color)
 {
@@ -224,6 +724,9 @@ paint_command_draw_set_property (GObject *self, guint property_id, const GValue
 
 	switch (property_id)
 	{
+	case BRUSH_PROPERTY_ID:
+		paint_command_draw_set_brush (properties, g_value_get_boolean (value));
+		break;
 	case COLOR_PROPERTY_ID:
 		paint_command_draw_set_color (properties, g_value_get_uint (value));
 		break;
@@ -236,21 +739,107 @@ paint_command_draw_set_property (GObject *self, guint property_id, const GValue
 	}
 }
 
+/*******************************************************************************
+* @brief 指定した位置までの線を、範囲と重なる線分ごとにパスに加えてマスクに描画します。
+* 丸い線端の線分を重ねた形は、丸い接合の線と同じ形になります。
+* @param cairo 描画したら破棄します。
+* @param end 格納した位置。この位置より前の点まで描画します。
+* @param tail 未確定の最後の点まで描画する場合は TRUE。
+*/
+static void
+paint_command_draw_trace (PaintCommandDraw *self, cairo_t *cairo, const cairo_rectangle_int_t *area, guint end, gboolean tail)
+{
+	cairo_rectangle_int_t bounds;
+	PaintPoint point, previous;
+	guint offset;
+	int margin;
+	gboolean more;
+	margin = (self->line_width + 1) / 2 + MARGIN;
+	offset = 0;
+	point = self->first;
+	cairo_translate (cairo, -area->x, -area->y);
+
+	/* 点が 1 つだけの場合は長さ 0 の線分が丸い点になります。 */
+	cairo_move_to (cairo, point.x, point.y);
+	cairo_line_to (cairo, point.x, point.y);
+
+	do
+	{
+		previous = point;
+		more = offset < end;
+
+		if (more)
+		{
+			paint_command_draw_read (self, &offset, &point);
+		}
+		else if (tail && self->tail->len)
+		{
+			point = g_array_index (self->tail, PaintPoint, self->tail->len - 1);
+			tail = FALSE;
+			more = TRUE;
+		}
+
+		bounds.x = MIN (previous.x, point.x) - margin;
+		bounds.y = MIN (previous.y, point.y) - margin;
+		bounds.width = ABS (point.x - previous.x) + margin * 2;
+		bounds.height = ABS (point.y - previous.y) + margin * 2;
+
+		if (more && gdk_rectangle_intersect (&bounds, area, NULL))
+		{
+			cairo_move_to (cairo, previous.x, previous.y);
+			cairo_line_to (cairo, point.x, point.y);
+		}
+	}
+	while (more);
+
+	paint_command_draw_update_antialias (self, cairo);
+	cairo_set_line_cap (cairo, CAIRO_LINE_CAP_ROUND);
+	cairo_set_line_width (cairo, self->line_width);
+	cairo_stroke (cairo);
+	cairo_destroy (cairo);
+}
+
+/*******************************************************************************
+* @brief 点を加えます。
+* 未確定の点が直線に収まらなくなった場合は、直前の点までを 1 本の線分として確定します。
+*/
 static void
 paint_command_draw_update (PaintCommand *self, int x, int y)
 {
 	PaintCommandDraw *draw;
+	const PaintPoint *end;
 	PaintPoint point;
 	draw = PAINT_COMMAND_DRAW (self);
+	point.x = x;
+	point.y = y;
 
-	if (!draw->points)
+	if (!draw->deltas)
 	{
-		draw->points = g_array_new (FALSE, FALSE, sizeof (PaintPoint));
+		draw->deltas = g_byte_array_new ();
+		draw->tail = g_array_sized_new (FALSE, FALSE, sizeof (PaintPoint), TAIL_MAXIMUM);
+		draw->first = point;
+		draw->last = point;
+		draw->n_points = 1;
+		paint_command_draw_include (draw, &point);
+		return;
 	}
 
-	point.x = x;
-	point.y = y;
-	g_array_append_val (draw->points, point);
+	end = draw->tail->len ? &g_array_index (draw->tail, PaintPoint, draw->tail->len - 1) : &draw->last;
+
+	if ((end->x == x) && (end->y == y))
+	{
+		return;
+	}
+
+	paint_command_draw_include (draw, end);
+	paint_command_draw_include (draw, &point);
+
+	if ((draw->tail->len >= TAIL_MAXIMUM) || !paint_command_draw_fits (draw, &point))
+	{
+		paint_command_draw_fix_tail (draw);
+	}
+
+	g_array_append_val (draw->tail, point);
 }
 
 static void
@@ -0,0 +1,222 @@
+/* Copyright (C) 2025 Taichi Murakami. */
+#include <gtk/gtk.h>
+#include "paint.h"
+#include "share.h"
+
+/* クラスのプロパティ */
+enum _PaintCommandEraseProperties
+{
+	NULL_PROPERTY_ID,
+	LINE_WIDTH_PROPERTY_ID,
+};
+
+/* クラスのインスタンス */
+struct _PaintCommandErase
+{
+	PaintCommand  parent_instance;
+	PaintCommand *stroke;
+};
+
+static gboolean paint_command_erase_bounds         (PaintCommand *self, cairo_rectangle_int_t *bounds);
+static void paint_command_erase_class_init         (PaintCommandEraseClass *this_class);
+static void paint_command_erase_class_init_command (PaintCommandClass *this_class);
+static void paint_command_erase_class_init_object  (GObjectClass *this_class);
+static void paint_command_erase_commit             (PaintCommand *self);
+static void paint_command_erase_destroy            (PaintCommandErase *self);
+static void paint_command_erase_dispose            (GObject *self);
+static void paint_command_erase_execute            (PaintCommand *self, cairo_t *cairo);
+static void paint_command_erase_execute_func       (PaintCommandErase *self, cairo_t *cairo, PaintCommandExecuteFunc execute);
+static gboolean paint_command_erase_fix            (PaintCommand *self);
+static void paint_command_erase_fixed              (PaintCommand *self, cairo_t *cairo);
+static void paint_command_erase_get_property       (GObject *self, guint property_id, GValue *value, GParamSpec *pspec);
+static void paint_command_erase_init               (PaintCommandErase *self);
+static gboolean paint_command_erase_opaque         (PaintCommand *self);
+static void paint_command_erase_pending            (PaintCommand *self, cairo_t *cairo);
+static void paint_command_erase_set_property       (GObject *self, guint property_id, const GValue *value, GParamSpec *pspec);
+static void paint_command_erase_update             (PaintCommand *self, int x, int y);
+
+/*******************************************************************************
+* Paint Command クラス:
+* 領域上をなぞって画像を透明にする方法を提供します。
+* 線の形は描画コマンドと共有し、CLEAR 演算子で描画して線の下の画素だけを消去します。
+* 描画中に部分ごとに画像へ書き込み、書き込み済みの線と重なる画素は足りない被覆率だけを消去します。
+*/
+G_DEFINE_FINAL_TYPE (PaintCommandErase, paint_command_erase, PAINT_TYPE_COMMAND);
+
+/* ストローク幅プロパティ */
+#define LINE_WIDTH_PROPERTY_NAME          "line-width"
+#define LINE_WIDTH_PROPERTY_NICK          "Line Width"
+#define LINE_WIDTH_PROPERTY_BLURB         "Line Width"
+#define LINE_WIDTH_PROPERTY_MINIMUM       1
+#define LINE_WIDTH_PROPERTY_MAXIMUM       G_MAXINT
+#define LINE_WIDTH_PROPERTY_DEFAULT_VALUE 1
+#define LINE_WIDTH_PROPERTY_FLAGS         G_PARAM_READWRITE
+
+static gboolean
+paint_command_erase_bounds (PaintCommand *self, cairo_rectangle_int_t *bounds)
+{
+	return paint_command_get_bounds (PAINT_COMMAND_ERASE (self)->stroke, bounds);
+}
+
+static void
+paint_command_erase_class_init (PaintCommandEraseClass *this_class)
+{
+	paint_command_erase_class_init_object (G_OBJECT_CLASS (this_class));
+	paint_command_erase_class_init_command (PAINT_COMMAND_CLASS (this_class));
+}
+
+static void
+paint_command_erase_class_init_command (PaintCommandClass *this_class)
+{
+	this_class->bounds = paint_command_erase_bounds;
+	this_class->commit = paint_command_erase_commit;
+	this_class->execute = paint_command_erase_execute;
+	this_class->fix = paint_command_erase_fix;
+	this_class->fixed = paint_command_erase_fixed;
+	this_class->opaque = paint_command_erase_opaque;
+	this_class->pending = paint_command_erase_pending;
+	this_class->update = paint_command_erase_update;
+	this_class->type = PAINT_COMMAND_TYPE_ERASE;
+}
+
+static void
+paint_command_erase_class_init_object (GObjectClass *this_class)
+{
+	this_class->dispose = paint_command_erase_dispose;
+	this_class->get_property = paint_command_erase_get_property;
+	this_class->set_property = paint_command_erase_set_property;
+	OBJECT_CLASS_INSTALL_PROPERTY_INT (this_class, LINE_WIDTH_PROPERTY);
+}
+
+static void
+paint_command_erase_commit (PaintCommand *self)
+{
+	paint_command_commit (PAINT_COMMAND_ERASE (self)->stroke);
+}
+
+static void
+paint_command_erase_destroy (PaintCommandErase *self)
+{
+	g_clear_object (&self->stroke);
+}
+
+static void
+paint_command_erase_dispose (GObject *self)
+{
+	paint_command_erase_destroy (PAINT_COMMAND_ERASE (self));
+	G_OBJECT_CLASS (paint_command_erase_parent_class)->dispose (self);
+}
+
+static void
+paint_command_erase_execute (PaintCommand *self, cairo_t *cairo)
+{
+	paint_command_erase_execute_func (PAINT_COMMAND_ERASE (self), cairo, paint_command_execute);
+}
+
+/*******************************************************************************
+* @brief CLEAR 演算子で線を描画します。
+* ブラシで描画できる場合はブラシが被覆率だけ画素を透明にします。
+*/
+static void
+paint_command_erase_execute_func (PaintCommandErase *self, cairo_t *cairo, PaintCommandExecuteFunc execute)
+{
+	paint_command_set_antialias (self->stroke, paint_command_get_antialias (PAINT_COMMAND (self)));
+	cairo_save (cairo);
+	cairo_set_operator (cairo, CAIRO_OPERATOR_CLEAR);
+	execute (self->stroke, cairo);
+	cairo_restore (cairo);
+}
+
+static gboolean
+paint_command_erase_fix (PaintCommand *self)
+{
+	return paint_command_fix (PAINT_COMMAND_ERASE (self)->stroke);
+}
+
+static void
+paint_command_erase_fixed (PaintCommand *self, cairo_t *cairo)
+{
+	paint_command_erase_execute_func (PAINT_COMMAND_ERASE (self), cairo, paint_command_execute_fixed);
+}
+
+int
+paint_command_erase_get_line_width (PaintCommandErase *self)
+{
+	return paint_command_draw_get_line_width (PAINT_COMMAND_DRAW (self->stroke));
+}
+
+static void
+paint_command_erase_get_property (GObject *self, guint property_id, GValue *value, GParamSpec *pspec)
+{
+	PaintCommandErase *properties;
+	properties = PAINT_COMMAND_ERASE (self);
+
+	switch (property_id)
+	{
+	case LINE_WIDTH_PROPERTY_ID:
+		g_value_set_int (value, paint_command_erase_get_line_width (properties));
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (self, property_id, pspec);
+		break;
+	}
+}
+
+static void
+paint_command_erase_init (PaintCommandErase *self)
+{
+	self->stroke = paint_command_draw_new ();
+	paint_command_erase_set_line_width (self, LINE_WIDTH_PROPERTY_DEFAULT_VALUE);
+}
+
+PaintCommand *
+paint_command_erase_new (void)
+{
+	return g_object_new (PAINT_TYPE_COMMAND_ERASE, NULL);
+}
+
+/*******************************************************************************
+* @brief 部分ごとに書き込めるかどうかを取得します。
+* 被覆率 c で 2 回消去すると画素は (1 - c)² 倍になり、部分的に覆われた画素は 1 回より薄くなります。
+* 線は書き込み済みの被覆率を差し引いて続きを描画するため、継ぎ目の画素も 1 回だけ消去されます。
+*/
+static gboolean
+paint_command_erase_opaque (PaintCommand *self)
+{
+	return TRUE;
+}
+
+static void
+paint_command_erase_pending (PaintCommand *self, cairo_t *cairo)
+{
+	paint_command_erase_execute_func (PAINT_COMMAND_ERASE (self), cairo, paint_command_execute_pending);
+}
+
+void
+paint_command_erase_set_line_width (PaintCommandErase *self, int width)
+{
+	paint_command_draw_set_line_width (PAINT_COMMAND_DRAW (self->stroke), width);
+}
+
+static void
+paint_command_erase_set_property (GObject *self, guint property_id, const GValue *value, GParamSpec *pspec)
+{
+	PaintCommandErase *properties;
+	properties = PAINT_COMMAND_ERASE (self);
+
+	switch (property_id)
+	{
+	case LINE_WIDTH_PROPERTY_ID:
+		paint_command_erase_set_line_width (properties, g_value_get_int (value));
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (self, property_id, pspec);
+		break;
+	}
+}
+
+static void
+paint_command_erase_update (PaintCommand *self, int x, int y)
+{
+	paint_command_update (PAINT_COMMAND_ERASE (self)->stroke, x, y);
+}
@@ -0,0 +1,1515 @@
+/* Copyright (C) 2025 Taichi Murakami. */
+#include <string.h>
+#include <gtk/gtk.h>
+#include "paint.h"
+#include "share.h"
+#if defined (__AVX2__) || defined (__SSE2__)
+#include <immintrin.h>
+#elif defined (__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+typedef struct _PaintCommandFillBand PaintCommandFillBand;
+typedef struct _PaintCommandFillData PaintCommandFillData;
+typedef struct _PaintCommandFillScan PaintCommandFillScan;
+typedef struct _PaintCommandFillSpan PaintCommandFillSpan;
+
+/* クラスのプロパティ */
+enum _PaintCommandFillProperties
+{
+	NULL_PROPERTY_ID,
+	COLOR_PROPERTY_ID,
+	PARALLEL_PROPERTY_ID,
+	PREPARED_PROPERTY_ID,
+	TOLERANCE_PROPERTY_ID,
+};
+
+/* クラスのインスタンス */
+struct _PaintCommandFill
+{
+	PaintCommand  parent_instance;
+	GCancellable *cancellable;
+	GArray       *spans;
+	PaintTiles   *tiles;
+	GdkRGBA       color;
+	GdkRectangle  bounds;
+	PaintPoint    point;
+	int           width;
+	int           height;
+	int           tolerance;
+	gboolean      bounded;
+	gboolean      committed;
+	gboolean      parallel;
+};
+
+/* 並列に探索する横長の帯 */
+struct _PaintCommandFillBand
+{
+	PaintCommandFillScan *scan;
+	GArray *runs;
+	GArray *parents;
+	GArray *rows;
+	guint   offset;
+	int     y1;
+	int     y2;
+};
+
+/* ワーカー スレッドに渡す探索の条件 */
+struct _PaintCommandFillData
+{
+	PaintTiles *tiles;
+	PaintPoint  point;
+	int         width;
+	int         height;
+	int         tolerance;
+	gboolean    parallel;
+};
+
+/* 塗りつぶす範囲の探索 */
+struct _PaintCommandFillScan
+{
+	PaintTiles       *tiles;
+	GCancellable     *cancellable;
+	cairo_surface_t **surfaces;
+	guchar           *fetched;
+	GArray           *stack;
+	guint64          *visited;
+	gsize             stride;
+	PaintPoint        point;
+	int               columns;
+	int               width;
+	int               height;
+	gint              n_runs;
+	guint32           seed;
+	guint8            tolerance;
+};
+
+/* 塗りつぶす範囲の 1 行 */
+struct _PaintCommandFillSpan
+{
+	int x;
+	int y;
+	int width;
+};
+
+static gboolean paint_command_fill_bounds         (PaintCommand *self, cairo_rectangle_int_t *bounds);
+static void paint_command_fill_class_init         (PaintCommandFillClass *this_class);
+static void paint_command_fill_class_init_command (PaintCommandClass *this_class);
+static void paint_command_fill_class_init_object  (GObjectClass *this_class);
+static void paint_command_fill_commit             (PaintCommand *self);
+static gint paint_command_fill_compare            (gconstpointer a, gconstpointer b);
+static int  paint_command_fill_count              (PaintCommandFillScan *scan, int x, int y, int limit);
+static int  paint_command_fill_count_back         (PaintCommandFillScan *scan, int x, int y, int limit);
+static void paint_command_fill_destroy            (PaintCommandFill *self);
+static void paint_command_fill_dispose            (GObject *self);
+static void paint_command_fill_execute            (PaintCommand *self, cairo_t *cairo);
+static guint paint_command_fill_find              (guint *parents, guint index);
+static gboolean paint_command_fill_fix            (PaintCommand *self);
+static int  paint_command_fill_find_visited       (PaintCommandFillScan *scan, int x1, int x2, int y, gboolean visited);
+static int  paint_command_fill_find_visited_back  (PaintCommandFillScan *scan, int x1, int x2, int y);
+static void paint_command_fill_free_data          (gpointer data);
+static void paint_command_fill_get_property       (GObject *self, guint property_id, GValue *value, GParamSpec *pspec);
+static const guint32 *paint_command_fill_get_row  (PaintCommandFillScan *scan, int x, int y);
+static cairo_surface_t *paint_command_fill_get_tile (PaintCommandFillScan *scan, int column, int row);
+static void paint_command_fill_init               (PaintCommandFill *self);
+static void paint_command_fill_join               (GArray *spans);
+static void paint_command_fill_label              (gpointer data, gpointer user_data);
+static void paint_command_fill_link               (guint *parents, GArray *above, guint above_offset, guint above_first, guint above_last, GArray *below, guint below_offset, guint below_first, guint below_last);
+static int  paint_command_fill_match              (const guint32 *row, int n, guint32 seed, guint8 tolerance);
+static int  paint_command_fill_match_back         (const guint32 *row, int n, guint32 seed, guint8 tolerance);
+static int  paint_command_fill_mismatch           (const guint32 *row, int n, guint32 seed, guint8 tolerance);
+static gboolean paint_command_fill_opaque         (PaintCommand *self);
+static void paint_command_fill_pending            (PaintCommand *self, cairo_t *cairo);
+static void paint_command_fill_prepared           (GObject *source_object, GAsyncResult *result, gpointer user_data);
+static void paint_command_fill_push_row           (PaintCommandFillScan *scan, int x1, int x2, int y);
+static gboolean paint_command_fill_scan_parallel  (PaintCommandFillScan *scan, GArray *spans);
+static void paint_command_fill_scan_serial        (PaintCommandFillScan *scan, GArray *spans);
+static GArray *paint_command_fill_search          (const PaintCommandFillData *data, GCancellable *cancellable);
+static void paint_command_fill_set_property       (GObject *self, guint property_id, const GValue *value, GParamSpec *pspec);
+static void paint_command_fill_set_spans          (PaintCommandFill *self, GArray *spans);
+static int  paint_command_fill_skip               (PaintCommandFillScan *scan, int x, int y, int limit);
+static gboolean paint_command_fill_stopped        (PaintCommandFillScan *scan);
+static void paint_command_fill_thread             (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+static void paint_command_fill_union              (guint *parents, guint index1, guint index2);
+static void paint_command_fill_update             (PaintCommand *self, int x, int y);
+static void paint_command_fill_visit              (PaintCommandFillScan *scan, int x1, int x2, int y);
+
+/*******************************************************************************
+* Paint Command クラス:
+* 指定した点と似た色の連続した範囲を塗りつぶす方法を提供します。
+* 範囲は行ごとに連続した区間を左右に広げ、上下の行の区間の始点をスタックに積んで探索します。
+* 色は各チャンネルの差が許容値以下であれば似た色とみなし、複数の画素をまとめて比較します。
+* 求めた範囲は行ごとの区間の一覧として保持し、再生するときは探索し直しません。
+* 探索は押した時点の画像の複製を使ってワーカー スレッドで行い、終わったら prepared プロパティの変更を通知します。
+*/
+G_DEFINE_FINAL_TYPE (PaintCommandFill, paint_command_fill, PAINT_TYPE_COMMAND);
+#define TILE_SIZE PAINT_TILE_SIZE
+#define WORD_BITS 64
+
+/* 並列に探索する画素数の下限、帯の高さ、スレッド数の上限、すべての帯に保持する区間数の上限 */
+#define PARALLEL_MINIMUM (1 << 22)
+#define BAND_SIZE        TILE_SIZE
+#define THREAD_LIMIT     16
+#define RUN_LIMIT        (1 << 20)
+
+/* 色プロパティ */
+#define COLOR_PROPERTY_NAME       "color"
+#define COLOR_PROPERTY_NICK       "Color"
+#define COLOR_PROPERTY_BLURB      "Color"
+#define COLOR_PROPERTY_BOXED_TYPE GDK_TYPE_RGBA
+#define COLOR_PROPERTY_FLAGS      G_PARAM_READWRITE
+
+/* 並列処理プロパティ */
+#define PARALLEL_PROPERTY_NAME          "parallel"
+#define PARALLEL_PROPERTY_NICK          "Parallel Enabled"
+#define PARALLEL_PROPERTY_BLURB         "Parallel Enabled"
+#define PARALLEL_PROPERTY_DEFAULT_VALUE TRUE
+#define PARALLEL_PROPERTY_FLAGS         G_PARAM_READWRITE
+
+/* 準備完了プロパティ */
+#define PREPARED_PROPERTY_NAME          "prepared"
+#define PREPARED_PROPERTY_NICK          "Prepared"
+#define PREPARED_PROPERTY_BLURB         "Prepared"
+#define PREPARED_PROPERTY_DEFAULT_VALUE FALSE
+#define PREPARED_PROPERTY_FLAGS         G_PARAM_READABLE
+
+/* 許容値プロパティ */
+#define TOLERANCE_PROPERTY_NAME          "tolerance"
+#define TOLERANCE_PROPERTY_NICK          "Tolerance"
+#define TOLERANCE_PROPERTY_BLURB         "Tolerance"
+#define TOLERANCE_PROPERTY_MINIMUM       0
+#define TOLERANCE_PROPERTY_MAXIMUM       255
+#define TOLERANCE_PROPERTY_DEFAULT_VALUE 32
+#define TOLERANCE_PROPERTY_FLAGS         G_PARAM_READWRITE
+
+/* 作成されていないタイルの画素 */
+static const guint32 TRANSPARENT_ROW [TILE_SIZE];
+
+/*******************************************************************************
+* @brief 塗りつぶす範囲を取得します。
+* 範囲は一度だけ返します。
+*/
+static gboolean
+paint_command_fill_bounds (PaintCommand *self, cairo_rectangle_int_t *bounds)
+{
+	PaintCommandFill *fill;
+	fill = PAINT_COMMAND_FILL (self);
+
+	if (fill->bounded || !fill->spans || !fill->spans->len)
+	{
+		return FALSE;
+	}
+
+	*bounds = fill->bounds;
+	fill->bounded = TRUE;
+	return TRUE;
+}
+
+static void
+paint_command_fill_class_init (PaintCommandFillClass *this_class)
+{
+	paint_command_fill_class_init_object (G_OBJECT_CLASS (this_class));
+	paint_command_fill_class_init_command (PAINT_COMMAND_CLASS (this_class));
+}
+
+static void
+paint_command_fill_class_init_command (PaintCommandClass *this_class)
+{
+	this_class->bounds = paint_command_fill_bounds;
+	this_class->commit = paint_command_fill_commit;
+	this_class->execute = paint_command_fill_execute;
+	this_class->fix = paint_command_fill_fix;
+	this_class->opaque = paint_command_fill_opaque;
+	this_class->pending = paint_command_fill_pending;
+	this_class->update = paint_command_fill_update;
+	this_class->type = PAINT_COMMAND_TYPE_FILL;
+}
+
+static void
+paint_command_fill_class_init_object (GObjectClass *this_class)
+{
+	this_class->dispose = paint_command_fill_dispose;
+	this_class->get_property = paint_command_fill_get_property;
+	this_class->set_property = paint_command_fill_set_property;
+	OBJECT_CLASS_INSTALL_PROPERTY_BOXED (this_class, COLOR_PROPERTY);
+	OBJECT_CLASS_INSTALL_PROPERTY_BOOLEAN (this_class, PARALLEL_PROPERTY);
+	OBJECT_CLASS_INSTALL_PROPERTY_BOOLEAN (this_class, PREPARED_PROPERTY);
+	OBJECT_CLASS_INSTALL_PROPERTY_INT (this_class, TOLERANCE_PROPERTY);
+}
+
+static void
+paint_command_fill_commit (PaintCommand *self)
+{
+	PAINT_COMMAND_FILL (self)->committed = TRUE;
+}
+
+/*******************************************************************************
+* @brief 区間を上から下、左から右の順に並べ替えます。
+*/
+static gint
+paint_command_fill_compare (gconstpointer a, gconstpointer b)
+{
+	const PaintCommandFillSpan *span1, *span2;
+	span1 = a;
+	span2 = b;
+
+	if (span1->y != span2->y)
+	{
+		return (span1->y > span2->y) - (span1->y < span2->y);
+	}
+
+	return (span1->x > span2->x) - (span1->x < span2->x);
+}
+
+/*******************************************************************************
+* @brief 指定した点から右に向かって似た色が続く画素数を取得します。
+* 塗りつぶし済みかどうかは考慮しません。
+*/
+static int
+paint_command_fill_count (PaintCommandFillScan *scan, int x, int y, int limit)
+{
+	int n, count, start;
+	start = x;
+
+	while (x < limit)
+	{
+		n = MIN (limit, (x | (TILE_SIZE - 1)) + 1) - x;
+		count = paint_command_fill_match (paint_command_fill_get_row (scan, x, y), n, scan->seed, scan->tolerance);
+		x += count;
+
+		if (count < n)
+		{
+			break;
+		}
+	}
+
+	return x - start;
+}
+
+/*******************************************************************************
+* @brief 指定した点の左隣から左に向かって似た色が続く画素数を取得します。
+* 塗りつぶし済みかどうかは考慮しません。
+*/
+static int
+paint_command_fill_count_back (PaintCommandFillScan *scan, int x, int y, int limit)
+{
+	int n, count, start;
+	start = x;
+
+	while (x > limit)
+	{
+		n = x - MAX (limit, (x - 1) & ~(TILE_SIZE - 1));
+		count = paint_command_fill_match_back (paint_command_fill_get_row (scan, x - n, y), n, scan->seed, scan->tolerance);
+		x -= count;
+
+		if (count < n)
+		{
+			break;
+		}
+	}
+
+	return start - x;
+}
+
+static void
+paint_command_fill_destroy (PaintCommandFill *self)
+{
+	if (self->cancellable)
+	{
+		g_cancellable_cancel (self->cancellable);
+		g_clear_object (&self->cancellable);
+	}
+
+	g_clear_pointer (&self->spans, g_array_unref);
+	g_clear_pointer (&self->tiles, paint_tiles_free);
+}
+
+static void
+paint_command_fill_dispose (GObject *self)
+{
+	paint_command_fill_destroy (PAINT_COMMAND_FILL (self));
+	G_OBJECT_CLASS (paint_command_fill_parent_class)->dispose (self);
+}
+
+/*******************************************************************************
+* @brief 描画先のクリップ範囲にある区間を塗りつぶします。
+*/
+static void
+paint_command_fill_execute (PaintCommand *self, cairo_t *cairo)
+{
+	PaintCommandFill *fill;
+	const PaintCommandFillSpan *span, *end;
+	double x1, y1, x2, y2;
+	guint low, high, middle;
+	fill = PAINT_COMMAND_FILL (self);
+
+	if (!fill->spans || !fill->spans->len)
+	{
+		return;
+	}
+
+	/* クリップ範囲の最初の行を二分探索します。 */
+	cairo_clip_extents (cairo, &x1, &y1, &x2, &y2);
+	low = 0;
+	high = fill->spans->len;
+
+	while (low < high)
+	{
+		middle = (low + high) / 2;
+
+		if (g_array_index (fill->spans, PaintCommandFillSpan, middle).y + 1 <= y1)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	end = &g_array_index (fill->spans, PaintCommandFillSpan, fill->spans->len);
+
+	for (span = &g_array_index (fill->spans, PaintCommandFillSpan, low); (span < end) && (span->y < y2); span++)
+	{
+		if ((span->x < x2) && (span->x + span->width > x1))
+		{
+			cairo_rectangle (cairo, span->x, span->y, span->width, 1);
+		}
+	}
+
+	gdk_cairo_set_source_rgba (cairo, &fill->color);
+	cairo_fill (cairo);
+}
+
+/*******************************************************************************
+* @brief 区間が属する集合の代表の番号を取得します。
+* 探索した経路は半分ずつ短くします。
+*/
+static guint
+paint_command_fill_find (guint *parents, guint index)
+{
+	while (parents [index] != index)
+	{
+		parents [index] = parents [parents [index]];
+		index = parents [index];
+	}
+
+	return index;
+}
+
+/*******************************************************************************
+* @brief 指定した範囲で塗りつぶし済みの画素、または塗りつぶしていない画素を探します。
+* @param visited 塗りつぶし済みの画素を探す場合は TRUE。
+* @return 見つからない場合は x2。
+*/
+static int
+paint_command_fill_find_visited (PaintCommandFillScan *scan, int x1, int x2, int y, gboolean visited)
+{
+	const guint64 *words;
+	guint64 word, mask;
+	int x;
+	words = scan->visited + (gsize) y * scan->stride;
+	x = x1;
+
+	while (x < x2)
+	{
+		word = words [x / WORD_BITS];
+
+		if (!visited)
+		{
+			word = ~word;
+		}
+
+		mask = ~(guint64) 0 << (x % WORD_BITS);
+		word &= mask;
+
+		if (word)
+		{
+			x = (x & ~(WORD_BITS - 1)) + __builtin_ctzll (word);
+			return MIN (x, x2);
+		}
+
+		x = (x & ~(WORD_BITS - 1)) + WORD_BITS;
+	}
+
+	return x2;
+}
+
+/*******************************************************************************
+* @brief 指定した範囲で最も右にある塗りつぶし済みの画素を探します。
+* @return 見つからない場合は x1 - 1。
+*/
+static int
+paint_command_fill_find_visited_back (PaintCommandFillScan *scan, int x1, int x2, int y)
+{
+	const guint64 *words;
+	guint64 word;
+	int x;
+	words = scan->visited + (gsize) y * scan->stride;
+	x = x2;
+
+	while (x > x1)
+	{
+		word = words [(x - 1) / WORD_BITS];
+
+		if (x % WORD_BITS)
+		{
+			word &= ((guint64) 1 << (x % WORD_BITS)) - 1;
+		}
+		if (word)
+		{
+			x = ((x - 1) & ~(WORD_BITS - 1)) + (WORD_BITS - 1 - __builtin_clzll (word));
+			return MAX (x, x1 - 1);
+		}
+
+		x = (x - 1) & ~(WORD_BITS - 1);
+	}
+
+	return x1 - 1;
+}
+
+/*******************************************************************************
+* @brief 探索が終わっていない場合は、ワーカー スレッドを待たずにこのスレッドで探索します。
+* @return 塗りつぶす範囲を求めた場合は TRUE。
+*/
+static gboolean
+paint_command_fill_fix (PaintCommand *self)
+{
+	PaintCommandFill *fill;
+	PaintCommandFillData data;
+	fill = PAINT_COMMAND_FILL (self);
+
+	if (fill->spans || !fill->tiles)
+	{
+		return FALSE;
+	}
+	if (fill->cancellable)
+	{
+		g_cancellable_cancel (fill->cancellable);
+		g_clear_object (&fill->cancellable);
+	}
+
+	data.tiles = fill->tiles;
+	data.point = fill->point;
+	data.width = fill->width;
+	data.height = fill->height;
+	data.tolerance = fill->tolerance;
+	data.parallel = fill->parallel;
+	paint_command_fill_set_spans (fill, paint_command_fill_search (&data, NULL));
+	return TRUE;
+}
+
+static void
+paint_command_fill_free_data (gpointer data)
+{
+	PaintCommandFillData *fill;
+	fill = data;
+	paint_tiles_free (fill->tiles);
+	g_free (fill);
+}
+
+GdkRGBA *
+paint_command_fill_get_color (PaintCommandFill *self)
+{
+	return &self->color;
+}
+
+gboolean
+paint_command_fill_get_parallel (PaintCommandFill *self)
+{
+	return self->parallel;
+}
+
+void
+paint_command_fill_get_point (PaintCommandFill *self, int *x, int *y)
+{
+	*x = self->point.x;
+	*y = self->point.y;
+}
+
+/*******************************************************************************
+* @brief 塗りつぶす範囲を求め終えたかどうかを取得します。
+*/
+gboolean
+paint_command_fill_get_prepared (PaintCommandFill *self)
+{
+	return self->spans != NULL;
+}
+
+static void
+paint_command_fill_get_property (GObject *self, guint property_id, GValue *value, GParamSpec *pspec)
+{
+	PaintCommandFill *properties;
+	properties = PAINT_COMMAND_FILL (self);
+
+	switch (property_id)
+	{
+	case COLOR_PROPERTY_ID:
+		g_value_set_boxed (value, &properties->color);
+		break;
+	case PARALLEL_PROPERTY_ID:
+		g_value_set_boolean (value, properties->parallel);
+		break;
+	case PREPARED_PROPERTY_ID:
+		g_value_set_boolean (value, paint_command_fill_get_prepared (properties));
+		break;
+	case TOLERANCE_PROPERTY_ID:
+		g_value_set_int (value, properties->tolerance);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (self, property_id, pspec);
+		break;
+	}
+}
+
+/*******************************************************************************
+* @brief 指定した画素を指すポインターを取得します。
+* ポインターは同じタイルの行の終わりまで使えます。
+*/
+static const guint32 *
+paint_command_fill_get_row (PaintCommandFillScan *scan, int x, int y)
+{
+	cairo_surface_t *tile;
+	tile = paint_command_fill_get_tile (scan, x / TILE_SIZE, y / TILE_SIZE);
+
+	if (!tile)
+	{
+		return TRANSPARENT_ROW + x % TILE_SIZE;
+	}
+
+	return (const guint32 *) (cairo_image_surface_get_data (tile) + (gsize) (y % TILE_SIZE) * cairo_image_surface_get_stride (tile)) + x % TILE_SIZE;
+}
+
+/*******************************************************************************
+* @brief 探索するタイルを取得します。
+* 初めて使うタイルだけをタイル格納域から取得します。描画した内容は探索を始める前に画素に反映しておきます。
+* タイル格納域はジャーナルのタイルを復元するときに書き換わるため、並列に探索する帯からは呼び出しません。
+*/
+static cairo_surface_t *
+paint_command_fill_get_tile (PaintCommandFillScan *scan, int column, int row)
+{
+	int n;
+	n = row * scan->columns + column;
+
+	if (!scan->fetched [n])
+	{
+		scan->surfaces [n] = paint_tiles_get_tile (scan->tiles, column, row);
+		scan->fetched [n] = TRUE;
+	}
+
+	return scan->surfaces [n];
+}
+
+void
+paint_command_fill_get_size (PaintCommandFill *self, int *width, int *height)
+{
+	*width = self->width;
+	*height = self->height;
+}
+
+int
+paint_command_fill_get_tolerance (PaintCommandFill *self)
+{
+	return self->tolerance;
+}
+
+static void
+paint_command_fill_init (PaintCommandFill *self)
+{
+	self->color.alpha = 1;
+	self->parallel = PARALLEL_PROPERTY_DEFAULT_VALUE;
+	self->tolerance = TOLERANCE_PROPERTY_DEFAULT_VALUE;
+}
+
+/*******************************************************************************
+* @brief 同じ行で隣り合う区間を 1 つにまとめます。
+* 区間は並べ替え済みである必要があります。
+*/
+static void
+paint_command_fill_join (GArray *spans)
+{
+	PaintCommandFillSpan *span, *last;
+	guint i, n;
+	n = 0;
+
+	for (i = 0; i < spans->len; i++)
+	{
+		span = &g_array_index (spans, PaintCommandFillSpan, i);
+		last = n ? &g_array_index (spans, PaintCommandFillSpan, n - 1) : NULL;
+
+		if (last && (last->y == span->y) && (last->x + last->width == span->x))
+		{
+			last->width += span->width;
+		}
+		else
+		{
+			g_array_index (spans, PaintCommandFillSpan, n++) = *span;
+		}
+	}
+
+	g_array_set_size (spans, n);
+}
+
+/*******************************************************************************
+* @brief 帯に含まれる行ごとに似た色が続く区間を求め、上下に接する区間を併合します。
+* スレッドプールのスレッドで実行します。
+* すべての帯の区間数が上限を超えたら、残りの行は調べずに終えます。
+*/
+static void
+paint_command_fill_label (gpointer data, gpointer user_data)
+{
+	PaintCommandFillBand *band;
+	PaintCommandFillScan *scan;
+	PaintCommandFillSpan span;
+	guint first, last;
+	int y;
+	band = data;
+	scan = band->scan;
+	band->runs = g_array_new (FALSE, FALSE, sizeof (PaintCommandFillSpan));
+	band->parents = g_array_new (FALSE, FALSE, sizeof (guint));
+	band->rows = g_array_sized_new (FALSE, FALSE, sizeof (guint), band->y2 - band->y1 + 1);
+	first = last = 0;
+
+	for (y = band->y1; (y < band->y2) && !paint_command_fill_stopped (scan); y++)
+	{
+		g_array_append_val (band->rows, band->runs->len);
+		span.x = 0;
+		span.y = y;
+
+		while ((span.x += paint_command_fill_skip (scan, span.x, y, scan->width)) < scan->width)
+		{
+			span.width = paint_command_fill_count (scan, span.x, y, scan->width);
+			g_array_append_val (band->parents, band->runs->len);
+			g_array_append_val (band->runs, span);
+			span.x += span.width;
+		}
+
+		/* 上の行と接する区間を併合します。 */
+		if (y > band->y1)
+		{
+			paint_command_fill_link ((guint *) band->parents->data, band->runs, 0, first, last, band->runs, 0, last, band->runs->len);
+		}
+
+		g_atomic_int_add (&scan->n_runs, band->runs->len - last);
+		first = last;
+		last = band->runs->len;
+	}
+
+	g_array_append_val (band->rows, band->runs->len);
+}
+
+/*******************************************************************************
+* @brief 上下に隣り合う行の区間のうち、重なる区間を併合します。
+* 区間の番号には、それぞれの帯の最初の区間の番号を加えます。
+*/
+static void
+paint_command_fill_link (guint *parents, GArray *above, guint above_offset, guint above_first, guint above_last, GArray *below, guint below_offset, guint below_first, guint below_last)
+{
+	const PaintCommandFillSpan *span1, *span2;
+	guint i, j;
+	i = above_first;
+	j = below_first;
+
+	while ((i < above_last) && (j < below_last))
+	{
+		span1 = &g_array_index (above, PaintCommandFillSpan, i);
+		span2 = &g_array_index (below, PaintCommandFillSpan, j);
+
+		if ((span1->x < span2->x + span2->width) && (span2->x < span1->x + span1->width))
+		{
+			paint_command_fill_union (parents, above_offset + i, below_offset + j);
+		}
+		if (span1->x + span1->width < span2->x + span2->width)
+		{
+			i++;
+		}
+		else
+		{
+			j++;
+		}
+	}
+}
+
+/*******************************************************************************
+* @brief 先頭から似た色が続く画素数を取得します。
+*/
+static int
+paint_command_fill_match (const guint32 *row, int n, guint32 seed, guint8 tolerance)
+{
+	guint32 pixel;
+	guint shift;
+	int i;
+	i = 0;
+#if defined (__AVX2__)
+	__m256i s8, t8;
+	guint32 bits;
+	s8 = _mm256_set1_epi32 (seed);
+	t8 = _mm256_set1_epi8 (tolerance);
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i p, d;
+		p = _mm256_loadu_si256 ((const __m256i *) (row + i));
+		d = _mm256_or_si256 (_mm256_subs_epu8 (p, s8), _mm256_subs_epu8 (s8, p));
+		bits = ~_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (_mm256_subs_epu8 (d, t8), _mm256_setzero_si256 ()));
+
+		if (bits)
+		{
+			return i + __builtin_ctz (bits) / 4;
+		}
+	}
+#endif
+#if defined (__SSE2__)
+	__m128i s4, t4;
+	guint mask;
+	s4 = _mm_set1_epi32 (seed);
+	t4 = _mm_set1_epi8 (tolerance);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i p, d;
+		p = _mm_loadu_si128 ((const __m128i *) (row + i));
+		d = _mm_or_si128 (_mm_subs_epu8 (p, s4), _mm_subs_epu8 (s4, p));
+		mask = ~_mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_subs_epu8 (d, t4), _mm_setzero_si128 ())) & 0xFFFF;
+
+		if (mask)
+		{
+			return i + __builtin_ctz (mask) / 4;
+		}
+	}
+#elif defined (__ARM_NEON)
+	uint8x16_t s4, t4;
+	uint64x2_t m;
+	s4 = vreinterpretq_u8_u32 (vdupq_n_u32 (seed));
+	t4 = vdupq_n_u8 (tolerance);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		m = vreinterpretq_u64_u8 (vcleq_u8 (vabdq_u8 (vld1q_u8 ((const uint8_t *) (row + i)), s4), t4));
+
+		if ((vgetq_lane_u64 (m, 0) & vgetq_lane_u64 (m, 1)) != G_MAXUINT64)
+		{
+			break;
+		}
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		pixel = row [i];
+
+		for (shift = 0; shift < 32; shift += 8)
+		{
+			if (ABS ((int) ((pixel >> shift) & 255) - (int) ((seed >> shift) & 255)) > tolerance)
+			{
+				return i;
+			}
+		}
+	}
+
+	return n;
+}
+
+/*******************************************************************************
+* @brief 末尾から似た色が続く画素数を取得します。
+*/
+static int
+paint_command_fill_match_back (const guint32 *row, int n, guint32 seed, guint8 tolerance)
+{
+	guint32 pixel;
+	guint shift;
+	int i;
+	i = n;
+#if defined (__AVX2__)
+	__m256i s8, t8;
+	guint32 bits;
+	s8 = _mm256_set1_epi32 (seed);
+	t8 = _mm256_set1_epi8 (tolerance);
+
+	for (; i >= 8; i -= 8)
+	{
+		__m256i p, d;
+		p = _mm256_loadu_si256 ((const __m256i *) (row + i - 8));
+		d = _mm256_or_si256 (_mm256_subs_epu8 (p, s8), _mm256_subs_epu8 (s8, p));
+		bits = ~_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (_mm256_subs_epu8 (d, t8), _mm256_setzero_si256 ()));
+
+		if (bits)
+		{
+			return n - i + __builtin_clz (bits) / 4;
+		}
+	}
+#endif
+#if defined (__SSE2__)
+	__m128i s4, t4;
+	guint mask;
+	s4 = _mm_set1_epi32 (seed);
+	t4 = _mm_set1_epi8 (tolerance);
+
+	for (; i >= 4; i -= 4)
+	{
+		__m128i p, d;
+		p = _mm_loadu_si128 ((const __m128i *) (row + i - 4));
+		d = _mm_or_si128 (_mm_subs_epu8 (p, s4), _mm_subs_epu8 (s4, p));
+		mask = ~_mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_subs_epu8 (d, t4), _mm_setzero_si128 ())) & 0xFFFF;
+
+		if (mask)
+		{
+			return n - i + (__builtin_clz (mask) - 16) / 4;
+		}
+	}
+#elif defined (__ARM_NEON)
+	uint8x16_t s4, t4;
+	uint64x2_t m;
+	s4 = vreinterpretq_u8_u32 (vdupq_n_u32 (seed));
+	t4 = vdupq_n_u8 (tolerance);
+
+	for (; i >= 4; i -= 4)
+	{
+		m = vreinterpretq_u64_u8 (vcleq_u8 (vabdq_u8 (vld1q_u8 ((const uint8_t *) (row + i - 4)), s4), t4));
+
+		if ((vgetq_lane_u64 (m, 0) & vgetq_lane_u64 (m, 1)) != G_MAXUINT64)
+		{
+			break;
+		}
+	}
+#endif
+
+	for (; i > 0; i--)
+	{
+		pixel = row [i - 1];
+
+		for (shift = 0; shift < 32; shift += 8)
+		{
+			if (ABS ((int) ((pixel >> shift) & 255) - (int) ((seed >> shift) & 255)) > tolerance)
+			{
+				return n - i;
+			}
+		}
+	}
+
+	return n;
+}
+
+/*******************************************************************************
+* @brief 先頭から似ていない色が続く画素数を取得します。
+*/
+static int
+paint_command_fill_mismatch (const guint32 *row, int n, guint32 seed, guint8 tolerance)
+{
+	guint32 pixel;
+	guint shift;
+	int i;
+	i = 0;
+#if defined (__AVX2__)
+	__m256i s8, t8;
+	guint32 bits;
+	s8 = _mm256_set1_epi32 (seed);
+	t8 = _mm256_set1_epi8 (tolerance);
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i p, d;
+		p = _mm256_loadu_si256 ((const __m256i *) (row + i));
+		d = _mm256_or_si256 (_mm256_subs_epu8 (p, s8), _mm256_subs_epu8 (s8, p));
+		bits = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (_mm256_subs_epu8 (d, t8), _mm256_setzero_si256 ()));
+		bits &= (bits >> 1) & (bits >> 2) & (bits >> 3) & 0x11111111;
+
+		if (bits)
+		{
+			return i + __builtin_ctz (bits) / 4;
+		}
+	}
+#endif
+#if defined (__SSE2__)
+	__m128i s4, t4;
+	guint mask;
+	s4 = _mm_set1_epi32 (seed);
+	t4 = _mm_set1_epi8 (tolerance);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i p, d;
+		p = _mm_loadu_si128 ((const __m128i *) (row + i));
+		d = _mm_or_si128 (_mm_subs_epu8 (p, s4), _mm_subs_epu8 (s4, p));
+		mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_subs_epu8 (d, t4), _mm_setzero_si128 ()));
+		mask &= (mask >> 1) & (mask >> 2) & (mask >> 3) & 0x1111;
+
+		if (mask)
+		{
+			return i + __builtin_ctz (mask) / 4;
+		}
+	}
+#elif defined (__ARM_NEON)
+	uint8x16_t s4, t4;
+	uint64x2_t m;
+	s4 = vreinterpretq_u8_u32 (vdupq_n_u32 (seed));
+	t4 = vdupq_n_u8 (tolerance);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		m = vreinterpretq_u64_u32 (vceqq_u32 (vreinterpretq_u32_u8 (vcleq_u8 (vabdq_u8 (vld1q_u8 ((const uint8_t *) (row + i)), s4), t4)), vdupq_n_u32 (G_MAXUINT32)));
+
+		if (vgetq_lane_u64 (m, 0) | vgetq_lane_u64 (m, 1))
+		{
+			break;
+		}
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		pixel = row [i];
+
+		for (shift = 0; shift < 32; shift += 8)
+		{
+			if (ABS ((int) ((pixel >> shift) & 255) - (int) ((seed >> shift) & 255)) > tolerance)
+			{
+				break;
+			}
+		}
+		if (shift >= 32)
+		{
+			return i;
+		}
+	}
+
+	return n;
+}
+
+PaintCommand *
+paint_command_fill_new (void)
+{
+	return g_object_new (PAINT_TYPE_COMMAND_FILL, NULL);
+}
+
+/*******************************************************************************
+* @brief 部分ごとに書き込めるかどうかを取得します。
+*/
+static gboolean
+paint_command_fill_opaque (PaintCommand *self)
+{
+	return PAINT_COMMAND_FILL (self)->color.alpha >= 1;
+}
+
+/*******************************************************************************
+* @brief 画像に書き込んでいない場合は範囲を塗りつぶします。
+*/
+static void
+paint_command_fill_pending (PaintCommand *self, cairo_t *cairo)
+{
+	if (!PAINT_COMMAND_FILL (self)->committed)
+	{
+		paint_command_fill_execute (self, cairo);
+	}
+}
+
+/*******************************************************************************
+* @brief ワーカー スレッドで求めた範囲を受け取ります。
+* メイン スレッドで呼び出します。取り消した探索の範囲は破棄します。
+*/
+static void
+paint_command_fill_prepared (GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+	PaintCommandFill *self;
+	GArray *spans;
+	self = PAINT_COMMAND_FILL (source_object);
+	spans = g_task_propagate_pointer (G_TASK (result), NULL);
+
+	if (spans)
+	{
+		if (g_task_get_cancellable (G_TASK (result)) != self->cancellable)
+		{
+			g_array_unref (spans);
+			return;
+		}
+
+		g_clear_object (&self->cancellable);
+		paint_command_fill_set_spans (self, spans);
+		g_object_notify (source_object, PREPARED_PROPERTY_NAME);
+	}
+}
+
+/*******************************************************************************
+* @brief 指定した行の区間のうち、塗りつぶせる連続した画素の始点をスタックに積みます。
+*/
+static void
+paint_command_fill_push_row (PaintCommandFillScan *scan, int x1, int x2, int y)
+{
+	PaintPoint point;
+	int x, n;
+	x = x1;
+	point.y = y;
+
+	while (x < x2)
+	{
+		x = paint_command_fill_find_visited (scan, x, x2, y, FALSE);
+		n = paint_command_fill_count (scan, x, y, paint_command_fill_find_visited (scan, x, x2, y, TRUE));
+
+		if (n)
+		{
+			point.x = x;
+			g_array_append_val (scan->stack, point);
+			x += n;
+		}
+
+		x++;
+	}
+}
+
+/*******************************************************************************
+* @brief 画像の画素から塗りつぶす範囲を求め始めます。
+* 始点と似た色が上下左右に連続する画素を塗りつぶします。
+* 探索はタイルを共有した複製に対してワーカー スレッドで行うため、押した時点の画像から求めます。
+* 求め終えるまでは描画せず、求め終えたら prepared プロパティの変更を通知します。
+*/
+void
+paint_command_fill_scan (PaintCommandFill *self, PaintTiles *tiles)
+{
+	PaintCommandFillData *data;
+	cairo_surface_t *tile;
+	GTask *task;
+	int column, row;
+
+	if (self->cancellable)
+	{
+		g_cancellable_cancel (self->cancellable);
+		g_clear_object (&self->cancellable);
+	}
+
+	g_clear_pointer (&self->spans, g_array_unref);
+	g_clear_pointer (&self->tiles, paint_tiles_free);
+
+	/* タイルに描画した内容を画素に反映します。復元していないタイルは復元しません。 */
+	for (row = 0; row < paint_tiles_get_rows (tiles); row++)
+	{
+		for (column = 0; column < paint_tiles_get_columns (tiles); column++)
+		{
+			if (!paint_tiles_get_pending (tiles, column, row) && (tile = paint_tiles_get_tile (tiles, column, row)))
+			{
+				cairo_surface_flush (tile);
+			}
+		}
+	}
+
+	/* ワーカー スレッドが探索を終える前に書き込む場合に備え、このスレッド用の複製も残します。 */
+	self->tiles = paint_tiles_new ();
+	paint_tiles_assign (self->tiles, tiles);
+	data = g_new (PaintCommandFillData, 1);
+	data->tiles = paint_tiles_new ();
+	paint_tiles_assign (data->tiles, tiles);
+	data->point = self->point;
+	data->width = self->width;
+	data->height = self->height;
+	data->tolerance = self->tolerance;
+	data->parallel = self->parallel;
+	self->cancellable = g_cancellable_new ();
+	task = g_task_new (self, self->cancellable, paint_command_fill_prepared, NULL);
+	g_task_set_source_tag (task, paint_command_fill_scan);
+	g_task_set_task_data (task, data, paint_command_fill_free_data);
+	g_task_run_in_thread (task, paint_command_fill_thread);
+	g_object_unref (task);
+}
+
+/*******************************************************************************
+* @brief 画像を横長の帯に分け、帯ごとの探索をスレッドプールで並列に実行します。
+* 帯の境界で接する区間を併合し、始点を含む区間とつながる区間を塗りつぶします。
+* 帯は始点とつながっていない区間も保持するため、区間数が上限を超えたら中止します。
+* @return 中止した場合は FALSE。
+*/
+static gboolean
+paint_command_fill_scan_parallel (PaintCommandFillScan *scan, GArray *spans)
+{
+	PaintCommandFillBand *bands, *above, *below;
+	const PaintCommandFillSpan *span;
+	GThreadPool *pool;
+	guint *parents;
+	guint i, n, root;
+	int band, count, column, row;
+	count = (scan->height + BAND_SIZE - 1) / BAND_SIZE;
+
+	/* 帯はすべての画素を調べるため、すべてのタイルをこのスレッドで先に取得し、帯からは読むだけにします。 */
+	for (row = 0; row < (scan->height + TILE_SIZE - 1) / TILE_SIZE; row++)
+	{
+		for (column = 0; column < scan->columns; column++)
+		{
+			paint_command_fill_get_tile (scan, column, row);
+		}
+	}
+
+	bands = g_new0 (PaintCommandFillBand, count);
+	pool = g_thread_pool_new (paint_command_fill_label, NULL, CLAMP (g_get_num_processors (), 1, THREAD_LIMIT), FALSE, NULL);
+
+	for (band = 0; band < count; band++)
+	{
+		bands [band].scan = scan;
+		bands [band].y1 = band * BAND_SIZE;
+		bands [band].y2 = MIN (scan->height, (band + 1) * BAND_SIZE);
+		g_thread_pool_push (pool, &bands [band], NULL);
+	}
+
+	/* すべての帯の探索が終わるまで待ちます。 */
+	g_thread_pool_free (pool, FALSE, TRUE);
+
+	if (paint_command_fill_stopped (scan))
+	{
+		for (band = 0; band < count; band++)
+		{
+			g_array_unref (bands [band].runs);
+			g_array_unref (bands [band].parents);
+			g_array_unref (bands [band].rows);
+		}
+
+		g_free (bands);
+		return FALSE;
+	}
+
+	n = 0;
+
+	for (band = 0; band < count; band++)
+	{
+		bands [band].offset = n;
+		n += bands [band].runs->len;
+	}
+
+	/* 帯ごとの親の番号を画像全体の番号に変換します。 */
+	parents = g_new (guint, n);
+
+	for (band = 0; band < count; band++)
+	{
+		for (i = 0; i < bands [band].parents->len; i++)
+		{
+			parents [bands [band].offset + i] = bands [band].offset + g_array_index (bands [band].parents, guint, i);
+		}
+
+		g_clear_pointer (&bands [band].parents, g_array_unref);
+	}
+
+	/* 帯の境界で接する区間を併合します。 */
+	for (band = 1; band < count; band++)
+	{
+		above = &bands [band - 1];
+		below = &bands [band];
+		row = above->y2 - above->y1 - 1;
+		paint_command_fill_link (parents,
+			above->runs, above->offset, g_array_index (above->rows, guint, row), g_array_index (above->rows, guint, row + 1),
+			below->runs, below->offset, g_array_index (below->rows, guint, 0), g_array_index (below->rows, guint, 1));
+	}
+
+	/* 始点を含む区間を探します。 */
+	below = &bands [scan->point.y / BAND_SIZE];
+	row = scan->point.y - below->y1;
+
+	for (i = g_array_index (below->rows, guint, row); i < g_array_index (below->rows, guint, row + 1); i++)
+	{
+		span = &g_array_index (below->runs, PaintCommandFillSpan, i);
+
+		if (scan->point.x < span->x + span->width)
+		{
+			break;
+		}
+	}
+
+	root = paint_command_fill_find (parents, below->offset + i);
+
+	/* 帯と行の順に並んでいるため、並べ替えずに区間を集めます。 */
+	for (band = 0; band < count; band++)
+	{
+		for (i = 0; i < bands [band].runs->len; i++)
+		{
+			if (paint_command_fill_find (parents, bands [band].offset + i) == root)
+			{
+				g_array_append_val (spans, g_array_index (bands [band].runs, PaintCommandFillSpan, i));
+			}
+		}
+
+		g_array_unref (bands [band].runs);
+		g_array_unref (bands [band].rows);
+	}
+
+	g_free (parents);
+	g_free (bands);
+	return TRUE;
+}
+
+/*******************************************************************************
+* @brief 始点から上下の行の区間をスタックに積みながら、1 つのスレッドで探索します。
+*/
+static void
+paint_command_fill_scan_serial (PaintCommandFillScan *scan, GArray *spans)
+{
+	PaintCommandFillSpan span;
+	PaintPoint point;
+	scan->stride = (scan->width + WORD_BITS - 1) / WORD_BITS;
+	scan->visited = g_new0 (guint64, scan->stride * scan->height);
+	scan->stack = g_array_new (FALSE, FALSE, sizeof (PaintPoint));
+	g_array_append_val (scan->stack, scan->point);
+
+	while (scan->stack->len && !g_cancellable_is_cancelled (scan->cancellable))
+	{
+		point = g_array_index (scan->stack, PaintPoint, scan->stack->len - 1);
+		g_array_set_size (scan->stack, scan->stack->len - 1);
+
+		if (paint_command_fill_find_visited (scan, point.x, point.x + 1, point.y, TRUE) == point.x)
+		{
+			continue;
+		}
+
+		/* 始点から左右に広げます。塗りつぶし済みの画素の手前で止めます。 */
+		span.x = point.x - paint_command_fill_count_back (scan, point.x, point.y, paint_command_fill_find_visited_back (scan, 0, point.x, point.y) + 1);
+		span.y = point.y;
+		span.width = point.x + paint_command_fill_count (scan, point.x, point.y, paint_command_fill_find_visited (scan, point.x, scan->width, point.y, TRUE)) - span.x;
+		paint_command_fill_visit (scan, span.x, span.x + span.width, span.y);
+		g_array_append_val (spans, span);
+
+		if (span.y > 0)
+		{
+			paint_command_fill_push_row (scan, span.x, span.x + span.width, span.y - 1);
+		}
+		if (span.y + 1 < scan->height)
+		{
+			paint_command_fill_push_row (scan, span.x, span.x + span.width, span.y + 1);
+		}
+	}
+
+	g_array_unref (scan->stack);
+	g_free (scan->visited);
+	g_array_sort (spans, paint_command_fill_compare);
+	paint_command_fill_join (spans);
+}
+
+/*******************************************************************************
+* @brief 画像の画素から塗りつぶす範囲を求めます。
+* 大きな画像は帯に分けて並列に探索しますが、求める範囲は 1 つのスレッドで探索した場合と同じです。
+* 並列の探索を中止した場合は 1 つのスレッドで探索し直します。
+* ワーカー スレッドからも呼び出します。
+* @return 行ごとの区間の一覧。取り消した場合は途中までの一覧。
+*/
+static GArray *
+paint_command_fill_search (const PaintCommandFillData *data, GCancellable *cancellable)
+{
+	PaintCommandFillScan scan;
+	GArray *spans;
+	gsize n_tiles;
+	spans = g_array_new (FALSE, FALSE, sizeof (PaintCommandFillSpan));
+	scan.width = MIN (data->width, paint_tiles_get_width (data->tiles));
+	scan.height = MIN (data->height, paint_tiles_get_height (data->tiles));
+
+	if ((data->point.x < 0) || (data->point.y < 0) || (data->point.x >= scan.width) || (data->point.y >= scan.height))
+	{
+		return spans;
+	}
+
+	/* タイルは探索が届いたものだけを取得します。 */
+	scan.tiles = data->tiles;
+	scan.cancellable = cancellable;
+	scan.point = data->point;
+	scan.columns = (scan.width + TILE_SIZE - 1) / TILE_SIZE;
+	n_tiles = (gsize) scan.columns * ((scan.height + TILE_SIZE - 1) / TILE_SIZE);
+	scan.surfaces = g_new (cairo_surface_t *, n_tiles);
+	scan.fetched = g_new0 (guchar, n_tiles);
+	scan.n_runs = 0;
+	scan.tolerance = data->tolerance;
+	scan.seed = *paint_command_fill_get_row (&scan, scan.point.x, scan.point.y);
+
+	if (!data->parallel || (scan.height <= BAND_SIZE) || ((gsize) scan.width * scan.height < PARALLEL_MINIMUM) || (g_get_num_processors () <= 1) || !paint_command_fill_scan_parallel (&scan, spans))
+	{
+		paint_command_fill_scan_serial (&scan, spans);
+	}
+
+	g_free (scan.surfaces);
+	g_free (scan.fetched);
+	return spans;
+}
+
+void
+paint_command_fill_set_color (PaintCommandFill *self, const GdkRGBA *color)
+{
+	self->color = *color;
+}
+
+void
+paint_command_fill_set_parallel (PaintCommandFill *self, gboolean parallel)
+{
+	self->parallel = parallel;
+}
+
+void
+paint_command_fill_set_point (PaintCommandFill *self, int x, int y)
+{
+	self->point.x = x;
+	self->point.y = y;
+}
+
+static void
+paint_command_fill_set_property (GObject *self, guint property_id, const GValue *value, GParamSpec *pspec)
+{
+	PaintCommandFill *properties;
+	properties = PAINT_COMMAND_FILL (self);
+
+	switch (property_id)
+	{
+	case COLOR_PROPERTY_ID:
+		paint_command_fill_set_color (properties, g_value_get_boxed (value));
+		break;
+	case PARALLEL_PROPERTY_ID:
+		paint_command_fill_set_parallel (properties, g_value_get_boolean (value));
+		break;
+	case TOLERANCE_PROPERTY_ID:
+		paint_command_fill_set_tolerance (properties, g_value_get_int (value));
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (self, property_id, pspec);
+		break;
+	}
+}
+
+void
+paint_command_fill_set_size (PaintCommandFill *self, int width, int height)
+{
+	self->width = width;
+	self->height = height;
+}
+
+/*******************************************************************************
+* @brief 求めた範囲を設定し、範囲を囲む矩形を求めます。
+* 探索に使った画像の複製は不要になるため破棄します。
+*/
+static void
+paint_command_fill_set_spans (PaintCommandFill *self, GArray *spans)
+{
+	const PaintCommandFillSpan *span;
+	int x1, x2;
+	guint i;
+	g_clear_pointer (&self->spans, g_array_unref);
+	g_clear_pointer (&self->tiles, paint_tiles_free);
+	self->spans = spans;
+	self->bounded = FALSE;
+	self->committed = FALSE;
+
+	if (!spans->len)
+	{
+		return;
+	}
+
+	x1 = G_MAXINT;
+	x2 = G_MININT;
+
+	for (i = 0; i < spans->len; i++)
+	{
+		span = &g_array_index (spans, PaintCommandFillSpan, i);
+		x1 = MIN (x1, span->x);
+		x2 = MAX (x2, span->x + span->width);
+	}
+
+	self->bounds.x = x1;
+	self->bounds.y = g_array_index (spans, PaintCommandFillSpan, 0).y;
+	self->bounds.width = x2 - x1;
+	self->bounds.height = g_array_index (spans, PaintCommandFillSpan, spans->len - 1).y + 1 - self->bounds.y;
+}
+
+void
+paint_command_fill_set_tolerance (PaintCommandFill *self, int tolerance)
+{
+	self->tolerance = CLAMP (tolerance, TOLERANCE_PROPERTY_MINIMUM, TOLERANCE_PROPERTY_MAXIMUM);
+}
+
+/*******************************************************************************
+* @brief 指定した点から右に向かって似ていない色が続く画素数を取得します。
+*/
+static int
+paint_command_fill_skip (PaintCommandFillScan *scan, int x, int y, int limit)
+{
+	int n, count, start;
+	start = x;
+
+	while (x < limit)
+	{
+		n = MIN (limit, (x | (TILE_SIZE - 1)) + 1) - x;
+		count = paint_command_fill_mismatch (paint_command_fill_get_row (scan, x, y), n, scan->seed, scan->tolerance);
+		x += count;
+
+		if (count < n)
+		{
+			break;
+		}
+	}
+
+	return x - start;
+}
+
+/*******************************************************************************
+* @brief 探索を中止するかどうかを取得します。
+* 取り消された場合と、並列に探索する区間数が上限を超えた場合に中止します。
+*/
+static gboolean
+paint_command_fill_stopped (PaintCommandFillScan *scan)
+{
+	return (g_atomic_int_get (&scan->n_runs) > RUN_LIMIT) || g_cancellable_is_cancelled (scan->cancellable);
+}
+
+/*******************************************************************************
+* @brief 塗りつぶす範囲を求めます。
+* ワーカー スレッドで呼び出します。
+*/
+static void
+paint_command_fill_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+	GArray *spans;
+	spans = paint_command_fill_search (task_data, cancellable);
+
+	if (g_task_return_error_if_cancelled (task))
+	{
+		g_array_unref (spans);
+	}
+	else
+	{
+		g_task_return_pointer (task, spans, (GDestroyNotify) g_array_unref);
+	}
+}
+
+/*******************************************************************************
+* @brief 2 つの区間が属する集合を併合します。
+* 代表には小さい番号を残します。
+*/
+static void
+paint_command_fill_union (guint *parents, guint index1, guint index2)
+{
+	index1 = paint_command_fill_find (parents, index1);
+	index2 = paint_command_fill_find (parents, index2);
+
+	if (index1 < index2)
+	{
+		parents [index2] = index1;
+	}
+	else if (index2 < index1)
+	{
+		parents [index1] = index2;
+	}
+}
+
+/*******************************************************************************
+* @brief 塗りつぶす範囲は押した点で決まるため、カーソルの移動は無視します。
+*/
+static void
+paint_command_fill_update (PaintCommand *self, int x, int y)
+{
+}
+
+/*******************************************************************************
+* @brief 指定した区間を塗りつぶし済みにします。
+*/
+static void
+paint_command_fill_visit (PaintCommandFillScan *scan, int x1, int x2, int y)
+{
+	guint64 *words;
+	guint64 mask;
+	int x, n;
+	words = scan->visited + (gsize) y * scan->stride;
+
+	for (x = x1; x < x2; x += n)
+	{
+		n = MIN (x2 - x, WORD_BITS - x % WORD_BITS);
+		mask = (n == WORD_BITS) ? ~(guint64) 0 : (((guint64) 1 << n) - 1) << (x % WORD_BITS);
+		words [x / WORD_BITS] |= mask;
+	}
+}
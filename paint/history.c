@@ -0,0 +1,521 @@
+/* Copyright (C) 2025 Taichi Murakami. */
+#include <string.h>
+#include <gtk/gtk.h>
+#include "paint.h"
+#include "share.h"
+#define LIMIT      ((gsize) 256 << 20)
+#define RECENT     4
+#define TILE_BYTES ((gsize) PAINT_TILE_SIZE * PAINT_TILE_SIZE * 4)
+#define TILE_CCH   (PAINT_TILE_SIZE * PAINT_TILE_SIZE)
+#define RUN_FLAG   0x8000
+#define RUN_MAX    0x8000
+
+typedef struct _PaintHistoryEntry PaintHistoryEntry;
+typedef struct _PaintHistoryTile  PaintHistoryTile;
+
+/* 履歴 */
+struct _PaintHistory
+{
+	GArray     *entries;
+	PaintTiles *tiles;
+	gsize       limit;
+	gsize       size;
+	guint       position;
+};
+
+/* 履歴の 1 段階 */
+struct _PaintHistoryEntry
+{
+	GArray               *tiles;
+	cairo_rectangle_int_t bounds;
+	gsize                 size;
+	gboolean              compressed;
+};
+
+/* 差分のタイル */
+struct _PaintHistoryTile
+{
+	cairo_surface_t *surface;
+	GBytes          *bytes;
+	int              column;
+	int              row;
+};
+
+static void               paint_history_age            (PaintHistory *self);
+static void               paint_history_age_entry      (PaintHistory *self, guint index);
+static void               paint_history_clear_entry    (gpointer data);
+static void               paint_history_clear_tile     (gpointer data);
+static GBytes            *paint_history_compress       (cairo_surface_t *surface);
+static cairo_surface_t   *paint_history_decompress     (GBytes *bytes);
+static PaintHistoryEntry *paint_history_get_entry      (PaintHistory *self, guint index);
+static gsize              paint_history_get_tile_size  (PaintHistoryTile *tile);
+static void               paint_history_remove         (PaintHistory *self, guint index);
+static void               paint_history_swap           (PaintHistory *self, PaintTiles *tiles, PaintHistoryEntry *entry);
+static void               paint_history_trim           (PaintHistory *self);
+static void               paint_history_truncate       (PaintHistory *self);
+
+/*******************************************************************************
+* Paint History モジュール:
+* 元に戻す操作とやり直す操作を提供します。
+* 各段階はコマンドが変更したタイルだけを保持します。
+* 元に戻すときとやり直すときは、保持したタイルと画像のタイルを交換します。
+* 現在の段階から離れた段階のタイルは圧縮します。
+* 使用量が上限を超えた場合は古い段階から破棄します。
+*/
+
+/*******************************************************************************
+* @brief 現在の段階から RECENT 個より離れた段階を圧縮します。
+* 一度の操作で離れる段階は前後に 1 つずつです。
+*/
+static void
+paint_history_age (PaintHistory *self)
+{
+	if (self->position > RECENT)
+	{
+		paint_history_age_entry (self, self->position - RECENT - 1);
+	}
+	if (self->position + RECENT < self->entries->len)
+	{
+		paint_history_age_entry (self, self->position + RECENT);
+	}
+}
+
+/*******************************************************************************
+* @brief 段階のタイルを圧縮します。
+* 圧縮しても小さくならないタイルはそのまま保持します。
+*/
+static void
+paint_history_age_entry (PaintHistory *self, guint index)
+{
+	PaintHistoryEntry *entry;
+	PaintHistoryTile *tile;
+	guint n;
+	entry = paint_history_get_entry (self, index);
+
+	if (!entry->compressed)
+	{
+		self->size -= entry->size;
+		entry->size = 0;
+
+		for (n = 0; n < entry->tiles->len; n++)
+		{
+			tile = &g_array_index (entry->tiles, PaintHistoryTile, n);
+
+			if (tile->surface)
+			{
+				tile->bytes = paint_history_compress (tile->surface);
+
+				if (tile->bytes)
+				{
+					g_clear_pointer (&tile->surface, cairo_surface_destroy);
+				}
+			}
+
+			entry->size += paint_history_get_tile_size (tile);
+		}
+
+		entry->compressed = TRUE;
+		self->size += entry->size;
+	}
+}
+
+/*******************************************************************************
+* @brief やり直すことができるかどうかを取得します。
+*/
+gboolean
+paint_history_can_redo (PaintHistory *self)
+{
+	return self->position < self->entries->len;
+}
+
+/*******************************************************************************
+* @brief 元に戻すことができるかどうかを取得します。
+*/
+gboolean
+paint_history_can_undo (PaintHistory *self)
+{
+	return self->position > 0;
+}
+
+/*******************************************************************************
+* @brief すべての履歴を破棄します。
+*/
+void
+paint_history_clear (PaintHistory *self)
+{
+	g_array_set_size (self->entries, 0);
+	self->position = 0;
+	self->size = 0;
+}
+
+/*******************************************************************************
+* @brief 段階を破棄します。
+*/
+static void
+paint_history_clear_entry (gpointer data)
+{
+	PaintHistoryEntry *entry;
+	entry = data;
+	g_clear_pointer (&entry->tiles, g_array_unref);
+}
+
+/*******************************************************************************
+* @brief 差分のタイルを破棄します。
+*/
+static void
+paint_history_clear_tile (gpointer data)
+{
+	PaintHistoryTile *tile;
+	tile = data;
+	g_clear_pointer (&tile->surface, cairo_surface_destroy);
+	g_clear_pointer (&tile->bytes, g_bytes_unref);
+}
+
+/*******************************************************************************
+* @brief タイルをランレングス符号化します。
+* 同じ色が続く部分は繰り返し回数と色を、それ以外は色の並びを格納します。
+* @return 圧縮しても小さくならない場合は NULL。
+*/
+static GBytes *
+paint_history_compress (cairo_surface_t *surface)
+{
+	GByteArray *array;
+	const guint32 *pixels;
+	guint16 header;
+	int n, run, literal;
+	cairo_surface_flush (surface);
+	pixels = (const guint32 *) cairo_image_surface_get_data (surface);
+	array = g_byte_array_new ();
+	n = 0;
+
+	while (n < TILE_CCH)
+	{
+		for (run = 1; (n + run < TILE_CCH) && (run < RUN_MAX) && (pixels [n + run] == pixels [n]); run++);
+
+		if (run > 1)
+		{
+			header = RUN_FLAG | (run - 1);
+			g_byte_array_append (array, (const guint8 *) &header, sizeof (header));
+			g_byte_array_append (array, (const guint8 *) &pixels [n], sizeof (guint32));
+			n += run;
+		}
+		else
+		{
+			for (literal = 1; (n + literal < TILE_CCH) && (literal < RUN_MAX) && (pixels [n + literal] != pixels [n + literal - 1]); literal++);
+
+			if ((n + literal < TILE_CCH) && (literal > 1))
+			{
+				literal--;
+			}
+
+			header = literal - 1;
+			g_byte_array_append (array, (const guint8 *) &header, sizeof (header));
+			g_byte_array_append (array, (const guint8 *) &pixels [n], literal * sizeof (guint32));
+			n += literal;
+		}
+		if (array->len >= TILE_BYTES)
+		{
+			g_byte_array_unref (array);
+			return NULL;
+		}
+	}
+
+	return g_byte_array_free_to_bytes (array);
+}
+
+/*******************************************************************************
+* @brief ランレングス符号化したタイルを復元します。
+*/
+static cairo_surface_t *
+paint_history_decompress (GBytes *bytes)
+{
+	cairo_surface_t *surface;
+	const guint8 *data, *end;
+	guint32 *pixels, color;
+	guint16 header;
+	int n, count;
+	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, PAINT_TILE_SIZE, PAINT_TILE_SIZE);
+	cairo_surface_flush (surface);
+	pixels = (guint32 *) cairo_image_surface_get_data (surface);
+	data = g_bytes_get_data (bytes, NULL);
+	end = data + g_bytes_get_size (bytes);
+	n = 0;
+
+	while (data < end)
+	{
+		memcpy (&header, data, sizeof (header));
+		data += sizeof (header);
+		count = (header & ~RUN_FLAG) + 1;
+
+		if (header & RUN_FLAG)
+		{
+			memcpy (&color, data, sizeof (color));
+			data += sizeof (color);
+
+			while (count--)
+			{
+				pixels [n++] = color;
+			}
+		}
+		else
+		{
+			memcpy (&pixels [n], data, count * sizeof (guint32));
+			data += count * sizeof (guint32);
+			n += count;
+		}
+	}
+
+	cairo_surface_mark_dirty (surface);
+	return surface;
+}
+
+/*******************************************************************************
+* @brief 破棄します。
+*/
+void
+paint_history_free (PaintHistory *self)
+{
+	g_array_free (self->entries, TRUE);
+	g_clear_pointer (&self->tiles, paint_tiles_free);
+	g_free (self);
+}
+
+/*******************************************************************************
+* @brief 段階を取得します。
+*/
+static PaintHistoryEntry *
+paint_history_get_entry (PaintHistory *self, guint index)
+{
+	return &g_array_index (self->entries, PaintHistoryEntry, index);
+}
+
+/*******************************************************************************
+* @brief 差分のタイルのメモリ使用量を取得します。
+*/
+static gsize
+paint_history_get_tile_size (PaintHistoryTile *tile)
+{
+	if (tile->bytes)
+	{
+		return g_bytes_get_size (tile->bytes);
+	}
+	else if (tile->surface)
+	{
+		return TILE_BYTES;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+* @brief 作成します。
+*/
+PaintHistory *
+paint_history_new (void)
+{
+	PaintHistory *self;
+	self = g_new0 (PaintHistory, 1);
+	self->entries = g_array_new (FALSE, FALSE, sizeof (PaintHistoryEntry));
+	self->tiles = paint_tiles_new ();
+	self->limit = LIMIT;
+	g_array_set_clear_func (self->entries, paint_history_clear_entry);
+	return self;
+}
+
+/*******************************************************************************
+* @brief 画像に書き込んだコマンドを記録します。
+* 前回の記録から変更されたタイルの変更前の内容を保持します。
+* やり直すことができる段階は破棄します。
+*/
+void
+paint_history_push (PaintHistory *self, PaintTiles *tiles, const cairo_rectangle_int_t *bounds)
+{
+	PaintHistoryEntry entry;
+	PaintHistoryTile tile;
+	cairo_surface_t *surface;
+	int column, row, columns, rows;
+	paint_history_truncate (self);
+	entry.tiles = g_array_new (FALSE, FALSE, sizeof (PaintHistoryTile));
+	entry.bounds = *bounds;
+	entry.size = 0;
+	entry.compressed = FALSE;
+	g_array_set_clear_func (entry.tiles, paint_history_clear_tile);
+	columns = paint_tiles_get_columns (tiles);
+	rows = paint_tiles_get_rows (tiles);
+
+	for (row = 0; row < rows; row++)
+	{
+		for (column = 0; column < columns; column++)
+		{
+			/* どちらもジャーナルから復元していないタイルは変更されていません。 */
+			if (paint_tiles_get_pending (tiles, column, row) && paint_tiles_get_pending (self->tiles, column, row))
+			{
+				continue;
+			}
+
+			surface = paint_tiles_get_tile (tiles, column, row);
+
+			if (surface != paint_tiles_get_tile (self->tiles, column, row))
+			{
+				tile.surface = paint_tiles_swap_tile (self->tiles, column, row, surface ? cairo_surface_reference (surface) : NULL);
+				tile.bytes = NULL;
+				tile.column = column;
+				tile.row = row;
+				g_array_append_val (entry.tiles, tile);
+				entry.size += paint_history_get_tile_size (&tile);
+			}
+		}
+	}
+
+	g_array_append_val (self->entries, entry);
+	self->position = self->entries->len;
+	self->size += entry.size;
+	paint_history_age (self);
+	paint_history_trim (self);
+}
+
+/*******************************************************************************
+* @brief 取り消した段階をやり直します。
+* @param bounds 変更された範囲を受け取ります。
+* @return やり直す段階がない場合は FALSE。
+*/
+gboolean
+paint_history_redo (PaintHistory *self, PaintTiles *tiles, cairo_rectangle_int_t *bounds)
+{
+	PaintHistoryEntry *entry;
+
+	if (paint_history_can_redo (self))
+	{
+		entry = paint_history_get_entry (self, self->position++);
+		paint_history_swap (self, tiles, entry);
+		*bounds = entry->bounds;
+		paint_history_age (self);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*******************************************************************************
+* @brief 段階を破棄します。
+*/
+static void
+paint_history_remove (PaintHistory *self, guint index)
+{
+	self->size -= paint_history_get_entry (self, index)->size;
+	g_array_remove_index (self->entries, index);
+}
+
+/*******************************************************************************
+* @brief 履歴を破棄して現在の画像を基準にします。
+*/
+void
+paint_history_reset (PaintHistory *self, PaintTiles *tiles)
+{
+	paint_history_clear (self);
+	paint_tiles_assign (self->tiles, tiles);
+}
+
+/*******************************************************************************
+* @brief メモリ使用量の上限を設定します。
+*/
+void
+paint_history_set_limit (PaintHistory *self, gsize limit)
+{
+	self->limit = limit;
+	paint_history_trim (self);
+}
+
+/*******************************************************************************
+* @brief 段階が保持するタイルと画像のタイルを交換します。
+* 交換した後の段階は反対の操作に必要なタイルを保持します。
+*/
+static void
+paint_history_swap (PaintHistory *self, PaintTiles *tiles, PaintHistoryEntry *entry)
+{
+	PaintHistoryTile *tile;
+	cairo_surface_t *surface;
+	guint n;
+	self->size -= entry->size;
+	entry->size = 0;
+
+	for (n = 0; n < entry->tiles->len; n++)
+	{
+		tile = &g_array_index (entry->tiles, PaintHistoryTile, n);
+
+		if (tile->bytes)
+		{
+			tile->surface = paint_history_decompress (tile->bytes);
+			g_clear_pointer (&tile->bytes, g_bytes_unref);
+		}
+
+		surface = tile->surface;
+		tile->surface = paint_tiles_swap_tile (tiles, tile->column, tile->row, surface);
+		surface = paint_tiles_swap_tile (self->tiles, tile->column, tile->row, surface ? cairo_surface_reference (surface) : NULL);
+
+		if (surface)
+		{
+			cairo_surface_destroy (surface);
+		}
+
+		entry->size += paint_history_get_tile_size (tile);
+	}
+
+	entry->compressed = FALSE;
+	self->size += entry->size;
+}
+
+/*******************************************************************************
+* @brief 使用量が上限を超えている間、古い段階から破棄します。
+* 元に戻す段階がない場合はやり直す段階を後ろから破棄します。
+*/
+static void
+paint_history_trim (PaintHistory *self)
+{
+	while (self->entries->len && (self->size > self->limit))
+	{
+		if (self->position)
+		{
+			paint_history_remove (self, 0);
+			self->position--;
+		}
+		else
+		{
+			paint_history_remove (self, self->entries->len - 1);
+		}
+	}
+}
+
+/*******************************************************************************
+* @brief やり直すことができる段階を破棄します。
+*/
+static void
+paint_history_truncate (PaintHistory *self)
+{
+	while (self->entries->len > self->position)
+	{
+		paint_history_remove (self, self->entries->len - 1);
+	}
+}
+
+/*******************************************************************************
+* @brief 最後の段階を取り消します。
+* @param bounds 変更された範囲を受け取ります。
+* @return 取り消す段階がない場合は FALSE。
+*/
+gboolean
+paint_history_undo (PaintHistory *self, PaintTiles *tiles, cairo_rectangle_int_t *bounds)
+{
+	PaintHistoryEntry *entry;
+
+	if (paint_history_can_undo (self))
+	{
+		entry = paint_history_get_entry (self, --self->position);
+		paint_history_swap (self, tiles, entry);
+		*bounds = entry->bounds;
+		paint_history_age (self);
+		return TRUE;
+	}
+
+	return FALSE;
+}
@@ -0,0 +1,843 @@
+/* Copyright (C) 2025 Taichi Murakami. */
+#include <string.h>
+#include <gtk/gtk.h>
+#include <glib/gi18n.h>
+#include "paint.h"
+#include "share.h"
+#define CACHE_MINIMUM     64
+#define COMPACT_MINIMUM   ((guint64) 4 << 20)
+#define COMPRESSION_LEVEL 1
+#define DIRECTORY_MAGIC   "TDIR"
+#define DIRECTORY_SIZE    16
+#define ENTRY_SIZE        24
+#define HEADER_MAGIC      "PAINTDOC"
+#define HEADER_SIZE       16
+#define HEADER_VERSION    1
+#define MAGIC_CCH         4
+#define TILE_BYTES        ((gsize) PAINT_TILE_SIZE * PAINT_TILE_SIZE * 4)
+#define TILE_SIZE         PAINT_TILE_SIZE
+#define TRAILER_MAGIC     "PEND"
+#define TRAILER_SIZE      16
+
+typedef struct _PaintJournalEntry PaintJournalEntry;
+
+/* ジャーナル */
+struct _PaintJournal
+{
+	GMutex             mutex;
+	GFile             *file;
+	GBytes            *contents;
+	PaintJournalEntry *entries;
+	guint64            size;
+	guint64            live;
+	int                n_cached;
+	int                cache_limit;
+	int                width;
+	int                height;
+	int                columns;
+	int                rows;
+};
+
+/* タイルの項目 */
+struct _PaintJournalEntry
+{
+	cairo_surface_t *surface;
+	guint64          offset;
+	guint32          size;
+};
+
+static void             paint_journal_append_uint32  (GByteArray *array, guint32 value);
+static void             paint_journal_append_uint64  (GByteArray *array, guint64 value);
+static void             paint_journal_clear          (gpointer data);
+static GBytes          *paint_journal_compress       (cairo_surface_t *surface);
+static GBytes          *paint_journal_convert        (GConverter *converter, const guchar *data, gsize size, gsize capacity, gsize limit);
+static cairo_surface_t *paint_journal_decompress     (GBytes *contents, const PaintJournalEntry *entry);
+static void             paint_journal_free_blobs     (GBytes **blobs, int n_blobs);
+static void             paint_journal_free_entries   (PaintJournalEntry *entries, int n_entries);
+static PaintJournalEntry *paint_journal_get_entry    (PaintJournal *self, int column, int row);
+static GBytes          *paint_journal_map            (GFile *file, GError **error);
+static gboolean         paint_journal_parse          (PaintJournal *self, GError **error);
+static guint32          paint_journal_read_uint32    (const guchar *data);
+static guint64          paint_journal_read_uint64    (const guchar *data);
+static void             paint_journal_trim           (PaintJournal *self);
+static gboolean         paint_journal_write_stream   (GOutputStream *stream, GBytes **blobs, PaintJournalEntry *entries, int columns, int rows, int width, int height, guint64 *offset, GCancellable *cancellable, GError **error);
+
+/*******************************************************************************
+* Paint Journal モジュール:
+* 画像をタイルごとに圧縮して追記する独自形式のファイルを読み書きします。
+* ファイルは先頭のヘッダーの後に圧縮したタイルを並べ、保存するたびに
+* 変更したタイルとタイルの位置を示すディレクトリを末尾に追記します。
+* 末尾のトレーラーが最後のディレクトリを指し、古いタイルは読み飛ばします。
+* 不要になったタイルが生きているタイルより大きくなったら、ファイル全体を書き直して詰めます。
+* 読み込むときはファイルをメモリーにマップし、タイルは最初に使われたときに復元します。
+* 復元したタイルは他に参照がある間だけ保持し、参照がなくなったものは時々まとめて破棄します。
+* 数値はすべてリトル エンディアンです。
+*
+* ヘッダー:     "PAINTDOC", バージョン (4), タイルの大きさ (4)
+* ディレクトリ: "TDIR", 幅 (4), 高さ (4), 項目数 (4), 項目 × 項目数
+* 項目:         列 (4), 行 (4), 位置 (8), 大きさ (4), 予約 (4)
+* トレーラー:   ディレクトリの位置 (8), "PEND", 予約 (4)
+*/
+
+static void
+paint_journal_append_uint32 (GByteArray *array, guint32 value)
+{
+	value = GUINT32_TO_LE (value);
+	g_byte_array_append (array, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+paint_journal_append_uint64 (GByteArray *array, guint64 value)
+{
+	value = GUINT64_TO_LE (value);
+	g_byte_array_append (array, (const guint8 *) &value, sizeof (value));
+}
+
+/*******************************************************************************
+* @brief 最後の参照が解放されたときに破棄します。
+*/
+static void
+paint_journal_clear (gpointer data)
+{
+	PaintJournal *self;
+	self = data;
+	paint_journal_free_entries (self->entries, self->columns * self->rows);
+	g_clear_pointer (&self->contents, g_bytes_unref);
+	g_clear_object (&self->file);
+	g_mutex_clear (&self->mutex);
+}
+
+/*******************************************************************************
+* @brief タイルを圧縮します。
+* 速度を優先し、最も低い圧縮レベルを使用します。
+*/
+static GBytes *
+paint_journal_compress (cairo_surface_t *surface)
+{
+	GBytes *bytes;
+	GZlibCompressor *compressor;
+	const guchar *data;
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+	guint32 *pixels;
+	gsize n;
+#endif
+	cairo_surface_flush (surface);
+	data = cairo_image_surface_get_data (surface);
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+	pixels = g_memdup2 (data, TILE_BYTES);
+
+	for (n = 0; n < TILE_BYTES / sizeof (guint32); n++)
+	{
+		pixels [n] = GUINT32_TO_LE (pixels [n]);
+	}
+
+	data = (const guchar *) pixels;
+#endif
+	compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW, COMPRESSION_LEVEL);
+	bytes = paint_journal_convert (G_CONVERTER (compressor), data, TILE_BYTES, TILE_BYTES + TILE_BYTES / 8, G_MAXSIZE);
+	g_object_unref (compressor);
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+	g_free (pixels);
+#endif
+	return bytes;
+}
+
+/*******************************************************************************
+* @brief 変換器に入力をすべて渡し、出力を返します。
+* @param limit 出力の最大の大きさ。超える場合は最大の大きさより 1 バイトだけ多く出力した時点で中止します。
+* @return 失敗した場合や出力が最大の大きさを超える場合は NULL。
+*/
+static GBytes *
+paint_journal_convert (GConverter *converter, const guchar *data, gsize size, gsize capacity, gsize limit)
+{
+	GByteArray *array;
+	GConverterResult result;
+	gsize read, written, length, available;
+	array = g_byte_array_new ();
+	length = 0;
+
+	do
+	{
+		available = (limit - length < capacity) ? limit - length + 1 : capacity;
+		g_byte_array_set_size (array, length + available);
+		result = g_converter_convert (converter, data, size, array->data + length, available, G_CONVERTER_INPUT_AT_END, &read, &written, NULL);
+
+		if (result == G_CONVERTER_ERROR)
+		{
+			break;
+		}
+
+		data += read;
+		size -= read;
+		length += written;
+	}
+	while ((result == G_CONVERTER_CONVERTED) && (length <= limit));
+
+	if ((result != G_CONVERTER_FINISHED) || (length > limit))
+	{
+		g_byte_array_unref (array);
+		return NULL;
+	}
+
+	g_byte_array_set_size (array, length);
+	return g_byte_array_free_to_bytes (array);
+}
+
+/*******************************************************************************
+* @brief マップしたファイルからタイルを復元します。
+* @return 壊れている場合は NULL。
+*/
+static cairo_surface_t *
+paint_journal_decompress (GBytes *contents, const PaintJournalEntry *entry)
+{
+	GBytes *bytes;
+	GZlibDecompressor *decompressor;
+	cairo_surface_t *surface;
+	guint32 *pixels;
+	const guint32 *data;
+	gsize n, size;
+	decompressor = g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW);
+	bytes = paint_journal_convert (G_CONVERTER (decompressor), (const guchar *) g_bytes_get_data (contents, NULL) + entry->offset, entry->size, TILE_BYTES, TILE_BYTES);
+	g_object_unref (decompressor);
+
+	if (!bytes)
+	{
+		return NULL;
+	}
+
+	data = g_bytes_get_data (bytes, &size);
+
+	if (size != TILE_BYTES)
+	{
+		g_bytes_unref (bytes);
+		return NULL;
+	}
+
+	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, TILE_SIZE, TILE_SIZE);
+	cairo_surface_flush (surface);
+	pixels = (guint32 *) cairo_image_surface_get_data (surface);
+
+	for (n = 0; n < TILE_BYTES / sizeof (guint32); n++)
+	{
+		pixels [n] = GUINT32_FROM_LE (data [n]);
+	}
+
+	cairo_surface_mark_dirty (surface);
+	g_bytes_unref (bytes);
+	return surface;
+}
+
+static void
+paint_journal_free_blobs (GBytes **blobs, int n_blobs)
+{
+	int n;
+
+	for (n = 0; n < n_blobs; n++)
+	{
+		g_clear_pointer (&blobs [n], g_bytes_unref);
+	}
+
+	g_free (blobs);
+}
+
+static void
+paint_journal_free_entries (PaintJournalEntry *entries, int n_entries)
+{
+	int n;
+
+	if (entries)
+	{
+		for (n = 0; n < n_entries; n++)
+		{
+			g_clear_pointer (&entries [n].surface, cairo_surface_destroy);
+		}
+
+		g_free (entries);
+	}
+}
+
+/*******************************************************************************
+* @brief タイルの項目を取得します。
+* @return 範囲外の場合は NULL。
+*/
+static PaintJournalEntry *
+paint_journal_get_entry (PaintJournal *self, int column, int row)
+{
+	if ((column >= 0) && (row >= 0) && (column < self->columns) && (row < self->rows))
+	{
+		return &self->entries [row * self->columns + column];
+	}
+
+	return NULL;
+}
+
+/*******************************************************************************
+* @brief ファイルを取得します。
+*/
+GFile *
+paint_journal_get_file (PaintJournal *self)
+{
+	return self->file;
+}
+
+/*******************************************************************************
+* @brief 画像の高さを取得します。
+*/
+int
+paint_journal_get_height (PaintJournal *self)
+{
+	return self->height;
+}
+
+/*******************************************************************************
+* @brief 画像の幅を取得します。
+*/
+int
+paint_journal_get_width (PaintJournal *self)
+{
+	return self->width;
+}
+
+/*******************************************************************************
+* @brief タイルが保存されているかどうかを取得します。
+*/
+gboolean
+paint_journal_has_tile (PaintJournal *self, int column, int row)
+{
+	PaintJournalEntry *entry;
+	gboolean result;
+	g_mutex_lock (&self->mutex);
+	entry = paint_journal_get_entry (self, column, row);
+	result = entry && (entry->surface || entry->size);
+	g_mutex_unlock (&self->mutex);
+	return result;
+}
+
+/*******************************************************************************
+* @brief タイルを読み込みます。
+* 複数のスレッドから呼び出せます。
+* 復元したタイルは他に参照がある間は保持し、同じタイルを返します。
+* @return タイルの参照。透明な場合は NULL。
+*/
+cairo_surface_t *
+paint_journal_load_tile (PaintJournal *self, int column, int row)
+{
+	PaintJournalEntry *entry;
+	cairo_surface_t *surface;
+	surface = NULL;
+	g_mutex_lock (&self->mutex);
+	entry = paint_journal_get_entry (self, column, row);
+
+	if (entry)
+	{
+		if (!entry->surface && entry->size && self->contents && (entry->surface = paint_journal_decompress (self->contents, entry)))
+		{
+			self->n_cached++;
+		}
+		if (entry->surface)
+		{
+			surface = cairo_surface_reference (entry->surface);
+		}
+		if (self->n_cached > self->cache_limit)
+		{
+			paint_journal_trim (self);
+		}
+	}
+
+	g_mutex_unlock (&self->mutex);
+	return surface;
+}
+
+/*******************************************************************************
+* @brief ファイルの内容を取得します。
+* ローカル ファイルはメモリーにマップし、それ以外は読み込みます。
+*/
+static GBytes *
+paint_journal_map (GFile *file, GError **error)
+{
+	GBytes *bytes;
+	GMappedFile *mapped;
+	char *path, *contents;
+	gsize length;
+	bytes = NULL;
+	path = g_file_get_path (file);
+
+	if (path)
+	{
+		mapped = g_mapped_file_new (path, FALSE, error);
+
+		if (mapped)
+		{
+			bytes = g_mapped_file_get_bytes (mapped);
+			g_mapped_file_unref (mapped);
+		}
+
+		g_free (path);
+	}
+	else if (g_file_load_contents (file, NULL, &contents, &length, NULL, error))
+	{
+		bytes = g_bytes_new_take (contents, length);
+	}
+
+	return bytes;
+}
+
+/*******************************************************************************
+* @brief まだ保存していないジャーナルを作成します。
+*/
+PaintJournal *
+paint_journal_new (GFile *file)
+{
+	PaintJournal *self;
+	self = g_atomic_rc_box_new0 (PaintJournal);
+	g_mutex_init (&self->mutex);
+	self->file = g_object_ref (file);
+	self->cache_limit = CACHE_MINIMUM;
+	return self;
+}
+
+/*******************************************************************************
+* @brief ファイルを開きます。
+* ディレクトリだけを読み、タイルは使われるまで復元しません。
+* @return 失敗した場合は NULL。
+*/
+PaintJournal *
+paint_journal_open (GFile *file, GError **error)
+{
+	PaintJournal *self;
+	self = paint_journal_new (file);
+	self->contents = paint_journal_map (file, error);
+
+	if (!self->contents || !paint_journal_parse (self, error))
+	{
+		paint_journal_unref (self);
+		return NULL;
+	}
+
+	return self;
+}
+
+/*******************************************************************************
+* @brief 末尾のトレーラーが指すディレクトリを読み込みます。
+*/
+static gboolean
+paint_journal_parse (PaintJournal *self, GError **error)
+{
+	PaintJournalEntry *entry;
+	const guchar *data, *item;
+	guint64 size, directory, offset;
+	guint32 count, length, n;
+	int column, row;
+	data = g_bytes_get_data (self->contents, &size);
+
+	if ((size < HEADER_SIZE + DIRECTORY_SIZE + TRAILER_SIZE) || memcmp (data, HEADER_MAGIC, HEADER_SIZE / 2) || (paint_journal_read_uint32 (data + 8) != HEADER_VERSION) || (paint_journal_read_uint32 (data + 12) != TILE_SIZE) || memcmp (data + size - TRAILER_SIZE + 8, TRAILER_MAGIC, MAGIC_CCH))
+	{
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, _("The file is not a paint document."));
+		return FALSE;
+	}
+
+	directory = paint_journal_read_uint64 (data + size - TRAILER_SIZE);
+
+	if ((directory < HEADER_SIZE) || (directory > size - TRAILER_SIZE - DIRECTORY_SIZE) || memcmp (data + directory, DIRECTORY_MAGIC, MAGIC_CCH))
+	{
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, _("The paint document is damaged."));
+		return FALSE;
+	}
+
+	self->width = paint_journal_read_uint32 (data + directory + 4);
+	self->height = paint_journal_read_uint32 (data + directory + 8);
+	count = paint_journal_read_uint32 (data + directory + 12);
+
+	if ((self->width < 0) || (self->height < 0) || (self->width > G_MAXINT - TILE_SIZE) || (self->height > G_MAXINT - TILE_SIZE) || ((guint64) count * ENTRY_SIZE > size - TRAILER_SIZE - DIRECTORY_SIZE - directory))
+	{
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, _("The paint document is damaged."));
+		return FALSE;
+	}
+
+	self->columns = (self->width + TILE_SIZE - 1) / TILE_SIZE;
+	self->rows = (self->height + TILE_SIZE - 1) / TILE_SIZE;
+
+	/* タイルの数は int で数えるため、桁あふれする大きさは開きません。 */
+	if (self->rows && (self->columns > G_MAXINT / self->rows))
+	{
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, _("The paint document is damaged."));
+		self->columns = 0;
+		self->rows = 0;
+		return FALSE;
+	}
+
+	self->entries = g_try_new0 (PaintJournalEntry, (gsize) self->columns * self->rows);
+
+	if (!self->entries && self->columns && self->rows)
+	{
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE, _("The paint document is too large."));
+		self->columns = 0;
+		self->rows = 0;
+		return FALSE;
+	}
+
+	self->size = size;
+	self->live = 0;
+
+	for (n = 0; n < count; n++)
+	{
+		item = data + directory + DIRECTORY_SIZE + (gsize) n * ENTRY_SIZE;
+		column = paint_journal_read_uint32 (item);
+		row = paint_journal_read_uint32 (item + 4);
+		offset = paint_journal_read_uint64 (item + 8);
+		length = paint_journal_read_uint32 (item + 16);
+		entry = paint_journal_get_entry (self, column, row);
+
+		/* 加算すると桁あふれするため、残りの大きさと比べます。 */
+		if (!entry || (offset < HEADER_SIZE) || (offset > directory) || (length > directory - offset))
+		{
+			g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, _("The paint document is damaged."));
+			return FALSE;
+		}
+
+		entry->offset = offset;
+		entry->size = length;
+		self->live += length;
+	}
+
+	return TRUE;
+}
+
+static guint32
+paint_journal_read_uint32 (const guchar *data)
+{
+	guint32 value;
+	memcpy (&value, data, sizeof (value));
+	return GUINT32_FROM_LE (value);
+}
+
+static guint64
+paint_journal_read_uint64 (const guchar *data)
+{
+	guint64 value;
+	memcpy (&value, data, sizeof (value));
+	return GUINT64_FROM_LE (value);
+}
+
+PaintJournal *
+paint_journal_ref (PaintJournal *self)
+{
+	return g_atomic_rc_box_acquire (self);
+}
+
+/*******************************************************************************
+* @brief 他に参照がない復元済みのタイルを破棄します。
+* 参照がないタイルはどのタイル格納域も使っていないため、破棄しても保存するときの比較には影響しません。
+* 保存していないタイルは復元できないため残します。
+* 次に破棄するまでの上限は、残ったタイルの数に応じて広げます。
+* ミューテックスを取得してから呼び出します。
+*/
+static void
+paint_journal_trim (PaintJournal *self)
+{
+	PaintJournalEntry *entry;
+	int n, n_tiles;
+	n_tiles = self->columns * self->rows;
+	self->n_cached = 0;
+
+	for (n = 0; n < n_tiles; n++)
+	{
+		entry = &self->entries [n];
+
+		if (entry->surface && entry->size && (cairo_surface_get_reference_count (entry->surface) == 1))
+		{
+			g_clear_pointer (&entry->surface, cairo_surface_destroy);
+		}
+		else if (entry->surface)
+		{
+			self->n_cached++;
+		}
+	}
+
+	self->cache_limit = MAX (CACHE_MINIMUM, self->n_cached * 2);
+}
+
+void
+paint_journal_unref (PaintJournal *self)
+{
+	g_atomic_rc_box_release_full (self, paint_journal_clear);
+}
+
+/*******************************************************************************
+* @brief タイル格納域を保存します。
+* ワーカー スレッドで呼び出します。
+* 前回の保存から変更されていないタイルは書き込まず、変更されたタイルとディレクトリだけを追記します。
+* 不要になったタイルが多い場合や、ファイルが外部で変更された場合はファイル全体を書き直します。
+* 追記に失敗した場合はファイルを元の長さに戻します。
+* @param tiles このジャーナルから読み込んだタイルは、読み込んでいなければ復元せずにそのまま使用します。
+* @param progress 圧縮した割合を受け取ります。呼び出したスレッドで呼び出します。
+*/
+gboolean
+paint_journal_write (PaintJournal *self, PaintTiles *tiles, PaintSaveProgressFunc progress, gpointer user_data, GCancellable *cancellable, GError **error)
+{
+	GBytes **blobs, *contents;
+	GCancellable *abort;
+	GFileIOStream *io;
+	GFileOutputStream *output;
+	GOutputStream *stream;
+	PaintJournalEntry *entries, *entry;
+	cairo_surface_t *surface;
+	guint64 kept, size, offset;
+	int column, row, columns, rows, n, n_tiles, n_dirty, n_done;
+	gboolean compact, succeeded;
+	columns = paint_tiles_get_columns (tiles);
+	rows = paint_tiles_get_rows (tiles);
+	n_tiles = columns * rows;
+	entries = g_new0 (PaintJournalEntry, (gsize) n_tiles);
+	blobs = g_new0 (GBytes *, (gsize) n_tiles);
+	kept = 0;
+	n_dirty = 0;
+	g_mutex_lock (&self->mutex);
+	contents = self->contents ? g_bytes_ref (self->contents) : NULL;
+	size = self->size;
+
+	/* 変更されていないタイルは前回の項目を引き継ぎます。 */
+	for (row = 0; row < rows; row++)
+	{
+		for (column = 0; column < columns; column++)
+		{
+			n = row * columns + column;
+			entry = paint_journal_get_entry (self, column, row);
+
+			if (entry && (paint_tiles_get_journal (tiles) == self) && paint_tiles_get_pending (tiles, column, row))
+			{
+				entries [n] = *entry;
+			}
+			else
+			{
+				g_mutex_unlock (&self->mutex);
+				surface = paint_tiles_get_tile (tiles, column, row);
+				g_mutex_lock (&self->mutex);
+				entry = paint_journal_get_entry (self, column, row);
+
+				if (surface && entry && (entry->surface == surface) && entry->size)
+				{
+					entries [n] = *entry;
+				}
+				else if (surface)
+				{
+					entries [n].surface = surface;
+					n_dirty++;
+				}
+			}
+			if (entries [n].surface)
+			{
+				cairo_surface_reference (entries [n].surface);
+			}
+
+			kept += entries [n].size;
+		}
+	}
+
+	g_mutex_unlock (&self->mutex);
+	n_done = 0;
+
+	for (n = 0; n < n_tiles; n++)
+	{
+		if (g_cancellable_set_error_if_cancelled (cancellable, error))
+		{
+			paint_journal_free_entries (entries, n_tiles);
+			paint_journal_free_blobs (blobs, n_tiles);
+			g_clear_pointer (&contents, g_bytes_unref);
+			return FALSE;
+		}
+		if (entries [n].surface && !entries [n].size)
+		{
+			blobs [n] = paint_journal_compress (entries [n].surface);
+			n_done++;
+
+			if (progress)
+			{
+				progress (n_done / (double) n_dirty, user_data);
+			}
+		}
+	}
+
+	/* 不要なタイルが生きているタイルより多ければ詰めます。 */
+	compact = !contents || (size - kept > MAX (kept, COMPACT_MINIMUM));
+	io = NULL;
+	output = NULL;
+	stream = NULL;
+
+	if (!compact)
+	{
+		io = g_file_open_readwrite (self->file, cancellable, NULL);
+
+		if (io && g_seekable_seek (G_SEEKABLE (io), 0, G_SEEK_END, cancellable, NULL) && (g_seekable_tell (G_SEEKABLE (io)) == (goffset) size))
+		{
+			stream = g_io_stream_get_output_stream (G_IO_STREAM (io));
+		}
+		else
+		{
+			g_clear_object (&io);
+			compact = TRUE;
+		}
+	}
+	if (compact)
+	{
+		for (n = 0; n < n_tiles; n++)
+		{
+			if (!blobs [n] && entries [n].size)
+			{
+				blobs [n] = (entries [n].offset + entries [n].size <= g_bytes_get_size (contents)) ? g_bytes_new_from_bytes (contents, entries [n].offset, entries [n].size) : paint_journal_compress (entries [n].surface);
+			}
+		}
+
+		output = g_file_replace (self->file, NULL, FALSE, G_FILE_CREATE_NONE, cancellable, error);
+		stream = output ? G_OUTPUT_STREAM (output) : NULL;
+		size = 0;
+	}
+
+	g_clear_pointer (&contents, g_bytes_unref);
+	offset = size;
+	succeeded = stream && paint_journal_write_stream (stream, blobs, entries, columns, rows, paint_tiles_get_width (tiles), paint_tiles_get_height (tiles), &offset, cancellable, error);
+	paint_journal_free_blobs (blobs, n_tiles);
+
+	if (io)
+	{
+		if (succeeded)
+		{
+			succeeded = g_io_stream_close (G_IO_STREAM (io), cancellable, error);
+		}
+		else
+		{
+			/* 途中まで追記した内容を取り除き、前回保存した状態に戻します。 */
+			g_seekable_truncate (G_SEEKABLE (io), size, NULL, NULL);
+			g_io_stream_close (G_IO_STREAM (io), NULL, NULL);
+		}
+
+		g_object_unref (io);
+	}
+	else if (output)
+	{
+		if (succeeded)
+		{
+			succeeded = g_output_stream_close (stream, cancellable, error);
+		}
+		else
+		{
+			abort = g_cancellable_new ();
+			g_cancellable_cancel (abort);
+			g_output_stream_close (stream, abort, NULL);
+			g_object_unref (abort);
+		}
+
+		g_object_unref (output);
+	}
+	if (succeeded)
+	{
+		contents = paint_journal_map (self->file, error);
+		succeeded = contents != NULL;
+	}
+	if (!succeeded)
+	{
+		/* 前回の状態を残します。ファイルの長さが変わっていれば、次回はマップ済みの内容から書き直します。 */
+		paint_journal_free_entries (entries, n_tiles);
+		return FALSE;
+	}
+
+	kept = 0;
+
+	for (n = 0; n < n_tiles; n++)
+	{
+		kept += entries [n].size;
+	}
+
+	g_mutex_lock (&self->mutex);
+	paint_journal_free_entries (self->entries, self->columns * self->rows);
+	g_clear_pointer (&self->contents, g_bytes_unref);
+	self->entries = entries;
+	self->contents = contents;
+	self->size = offset;
+	self->live = kept;
+	self->width = paint_tiles_get_width (tiles);
+	self->height = paint_tiles_get_height (tiles);
+	self->columns = columns;
+	self->rows = rows;
+	paint_journal_trim (self);
+	g_mutex_unlock (&self->mutex);
+	return TRUE;
+}
+
+/*******************************************************************************
+* @brief 圧縮したタイル、ディレクトリ、トレーラーを書き込みます。
+* 書き直す場合はヘッダーから書き込みます。
+* @param offset 書き込みを始める位置。書き込んだ後の位置を受け取ります。
+*/
+static gboolean
+paint_journal_write_stream (GOutputStream *stream, GBytes **blobs, PaintJournalEntry *entries, int columns, int rows, int width, int height, guint64 *offset, GCancellable *cancellable, GError **error)
+{
+	GByteArray *array;
+	gconstpointer data;
+	gsize size;
+	guint64 directory;
+	guint32 count;
+	int n, n_tiles;
+	gboolean succeeded;
+	n_tiles = columns * rows;
+	array = g_byte_array_new ();
+	succeeded = TRUE;
+
+	if (!*offset)
+	{
+		g_byte_array_append (array, (const guint8 *) HEADER_MAGIC, HEADER_SIZE / 2);
+		paint_journal_append_uint32 (array, HEADER_VERSION);
+		paint_journal_append_uint32 (array, TILE_SIZE);
+		succeeded = g_output_stream_write_all (stream, array->data, array->len, NULL, cancellable, error);
+		*offset = array->len;
+	}
+	for (n = 0; succeeded && (n < n_tiles); n++)
+	{
+		if (blobs [n])
+		{
+			data = g_bytes_get_data (blobs [n], &size);
+			succeeded = g_output_stream_write_all (stream, data, size, NULL, cancellable, error);
+			entries [n].offset = *offset;
+			entries [n].size = size;
+			*offset += size;
+		}
+	}
+	if (succeeded)
+	{
+		directory = *offset;
+		count = 0;
+
+		for (n = 0; n < n_tiles; n++)
+		{
+			count += entries [n].size != 0;
+		}
+
+		g_byte_array_set_size (array, 0);
+		g_byte_array_append (array, (const guint8 *) DIRECTORY_MAGIC, MAGIC_CCH);
+		paint_journal_append_uint32 (array, width);
+		paint_journal_append_uint32 (array, height);
+		paint_journal_append_uint32 (array, count);
+
+		for (n = 0; n < n_tiles; n++)
+		{
+			if (entries [n].size)
+			{
+				paint_journal_append_uint32 (array, n % columns);
+				paint_journal_append_uint32 (array, n / columns);
+				paint_journal_append_uint64 (array, entries [n].offset);
+				paint_journal_append_uint32 (array, entries [n].size);
+				paint_journal_append_uint32 (array, 0);
+			}
+		}
+
+		/* トレーラーを最後に書き込み、途中で中断したディレクトリは読まないようにします。 */
+		paint_journal_append_uint64 (array, directory);
+		g_byte_array_append (array, (const guint8 *) TRAILER_MAGIC, MAGIC_CCH);
+		paint_journal_append_uint32 (array, 0);
+		succeeded = g_output_stream_write_all (stream, array->data, array->len, NULL, cancellable, error);
+		*offset += array->len;
+	}
+
+	g_byte_array_unref (array);
+	return succeeded;
+}
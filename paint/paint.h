@@ -1,15 +1,25 @@
 /* Copyright (C) 2025 Taichi Murakami. */
 #pragma once
 #define PAINT_RESOURCE_PATH_CCH 64
+#define PAINT_TILE_SIZE         256
 #include <gtk/gtk.h>
 
+typedef struct _PaintBrush        PaintBrush;
 typedef guint                     PaintColor;
 typedef struct _PaintCommand      PaintCommand;
 typedef struct _PaintCommandClass PaintCommandClass;
 typedef enum   _PaintCommandType  PaintCommandType;
+typedef struct _PaintHistory      PaintHistory;
+typedef struct _PaintJournal      PaintJournal;
 typedef struct _PaintPoint        PaintPoint;
-typedef void (*PaintCommandExecuteFunc) (PaintCommand *self, cairo_t *cairo);
-typedef void (*PaintCommandUpdateFunc)  (PaintCommand *self, int x, int y);
+typedef struct _PaintTiles        PaintTiles;
+typedef gboolean (*PaintCommandBoundsFunc)  (PaintCommand *self, cairo_rectangle_int_t *bounds);
+typedef void     (*PaintCommandCommitFunc)  (PaintCommand *self);
+typedef void     (*PaintCommandExecuteFunc) (PaintCommand *self, cairo_t *cairo);
+typedef gboolean (*PaintCommandFixFunc)     (PaintCommand *self);
+typedef gboolean (*PaintCommandOpaqueFunc)  (PaintCommand *self);
+typedef void     (*PaintCommandUpdateFunc)  (PaintCommand *self, int x, int y);
+typedef void     (*PaintSaveProgressFunc)   (double fraction, gpointer user_data);
 
 /* コマンド */
 enum _PaintCommandType
@@ -26,7 +36,13 @@ enum _PaintCommandType
 struct _PaintCommandClass
 {
 	GObjectClass            parent_class;
+	PaintCommandBoundsFunc  bounds;
+	PaintCommandCommitFunc  commit;
 	PaintCommandExecuteFunc execute;
+	PaintCommandFixFunc     fix;
+	PaintCommandExecuteFunc fixed;
+	PaintCommandOpaqueFunc  opaque;
+	PaintCommandExecuteFunc pending;
 	PaintCommandUpdateFunc  update;
 	PaintCommandType        type;
 };
@@ -63,7 +79,17 @@ GResource *paint_get_resource      (void);
 int        paint_get_resource_path (char *buffer, size_t maxlen, const char *name);
 GSettings *paint_get_settings      (void);
 
+/* Paint Brush モジュール */
+gboolean    paint_brush_begin      (PaintBrush *self, cairo_t *cairo, int line_width);
+void        paint_brush_difference (guint8 *mask, const guint8 *previous, gsize n);
+void        paint_brush_end        (PaintBrush *self, PaintColor color);
+void        paint_brush_free       (PaintBrush *self);
+void        paint_brush_line_to    (PaintBrush *self, int x, int y);
+void        paint_brush_mark       (PaintBrush *self);
+PaintBrush *paint_brush_new        (void);
+
 /* Paint Canvas クラス */
+void             paint_canvas_clear              (PaintCanvas *self);
 gboolean         paint_canvas_get_antialias      (PaintCanvas *self);
 PaintColor       paint_canvas_get_color          (PaintCanvas *self);
 PaintCommandType paint_canvas_get_command_type   (PaintCanvas *self);
@@ -77,22 +103,35 @@ int              paint_canvas_get_surface_width  (PaintCanvas *self);
 int              paint_canvas_get_zoom           (PaintCanvas *self);
 double           paint_canvas_get_zoom_percent   (PaintCanvas *self);
 void             paint_canvas_load               (PaintCanvas *self, GdkPixbuf *source);
+void             paint_canvas_load_journal       (PaintCanvas *self, PaintJournal *journal);
 GtkWidget       *paint_canvas_new                (void);
+void             paint_canvas_paste              (PaintCanvas *self, GdkPixbuf *source);
+gboolean         paint_canvas_redo               (PaintCanvas *self);
 void             paint_canvas_resize             (PaintCanvas *self, int width, int height);
 void             paint_canvas_set_antialias      (PaintCanvas *self, gboolean antialias);
 void             paint_canvas_set_color          (PaintCanvas *self, PaintColor color);
 void             paint_canvas_set_command_type   (PaintCanvas *self, PaintCommandType type);
 void             paint_canvas_set_content_height (PaintCanvas *self, int height);
 void             paint_canvas_set_content_width  (PaintCanvas *self, int width);
+void             paint_canvas_set_history_limit  (PaintCanvas *self, gsize limit);
 void             paint_canvas_set_line_width     (PaintCanvas *self, int width);
 void             paint_canvas_set_zoom           (PaintCanvas *self, int zoom);
 void             paint_canvas_set_zoom_percent   (PaintCanvas *self, double percent);
+PaintTiles      *paint_canvas_snapshot           (PaintCanvas *self);
+gboolean         paint_canvas_undo               (PaintCanvas *self);
 
 /* Paint Command クラス */
-gboolean paint_command_get_antialias  (PaintCommand *self);
-void     paint_command_execute        (PaintCommand *self, cairo_t *cairo);
-void     paint_command_set_antialias  (PaintCommand *self, gboolean antialias);
-void     paint_command_update         (PaintCommand *self, int x, int y);
+void             paint_command_commit           (PaintCommand *self);
+gboolean         paint_command_get_antialias    (PaintCommand *self);
+gboolean         paint_command_get_bounds       (PaintCommand *self, cairo_rectangle_int_t *bounds);
+PaintCommandType paint_command_get_command_type (PaintCommand *self);
+gboolean         paint_command_get_opaque       (PaintCommand *self);
+void             paint_command_execute          (PaintCommand *self, cairo_t *cairo);
+void             paint_command_execute_fixed    (PaintCommand *self, cairo_t *cairo);
+void             paint_command_execute_pending  (PaintCommand *self, cairo_t *cairo);
+gboolean         paint_command_fix              (PaintCommand *self);
+void             paint_command_set_antialias    (PaintCommand *self, gboolean antialias);
+void             paint_command_update           (PaintCommand *self, int x, int y);
 
 /* Paint Command Clear クラス */
 void          paint_command_clear_get_point (PaintCommandClear *self, int *x, int *y);
@@ -102,9 +141,11 @@ void          paint_command_clear_set_point (PaintCommandClear *self, int x, int
 void          paint_command_clear_set_size  (PaintCommandClear *self, int width, int height);
 
 /* Paint Command Draw クラス */
+gboolean      paint_command_draw_get_brush      (PaintCommandDraw *self);
 PaintColor    paint_command_draw_get_color      (PaintCommandDraw *self);
 int           paint_command_draw_get_line_width (PaintCommandDraw *self);
 PaintCommand *paint_command_draw_new            (void);
+void          paint_command_draw_set_brush      (PaintCommandDraw *self, gboolean brush);
 void          paint_command_draw_set_color      (PaintCommandDraw *self, PaintColor color);
 void          paint_command_draw_set_line_width (PaintCommandDraw *self, int width);
 
@@ -114,22 +155,78 @@ PaintCommand *paint_command_erase_new            (void);
 void          paint_command_erase_set_line_width (PaintCommandErase *self, int width);
 
 /* Paint Command Fill クラス */
-GdkRGBA      *paint_command_fill_get_color (PaintCommandFill *self);
-void          paint_command_fill_get_point (PaintCommandFill *self, int *x, int *y);
-void          paint_command_fill_get_size  (PaintCommandFill *self, int *width, int *height);
-PaintCommand *paint_command_fill_new (void);
-void          paint_command_fill_set_color (PaintCommandFill *self, const GdkRGBA *color);
-void          paint_command_fill_set_point (PaintCommandFill *self, int x, int y);
-void          paint_command_fill_set_size  (PaintCommandFill *self, int width, int height);
+GdkRGBA      *paint_command_fill_get_color     (PaintCommandFill *self);
+gboolean      paint_command_fill_get_parallel  (PaintCommandFill *self);
+void          paint_command_fill_get_point     (PaintCommandFill *self, int *x, int *y);
+gboolean      paint_command_fill_get_prepared  (PaintCommandFill *self);
+void          paint_command_fill_get_size      (PaintCommandFill *self, int *width, int *height);
+int           paint_command_fill_get_tolerance (PaintCommandFill *self);
+PaintCommand *paint_command_fill_new           (void);
+void          paint_command_fill_scan          (PaintCommandFill *self, PaintTiles *tiles);
+void          paint_command_fill_set_color     (PaintCommandFill *self, const GdkRGBA *color);
+void          paint_command_fill_set_parallel  (PaintCommandFill *self, gboolean parallel);
+void          paint_command_fill_set_point     (PaintCommandFill *self, int x, int y);
+void          paint_command_fill_set_size      (PaintCommandFill *self, int width, int height);
+void          paint_command_fill_set_tolerance (PaintCommandFill *self, int tolerance);
 
 /* Paint Command Paste クラス */
-void          paint_command_paste_get_point  (PaintCommandPaste *self, int *x, int *y);
-void          paint_command_paste_get_scale  (PaintCommandPaste *self, float *x, float *y);
-GdkPixbuf    *paint_command_paste_get_source (PaintCommandPaste *self);
-PaintCommand *paint_command_paste_new        (void);
-void          paint_command_paste_set_point  (PaintCommandPaste *self, int x, int y);
-void          paint_command_paste_set_scale  (PaintCommandPaste *self, float x, float y);
-void          paint_command_paste_set_source (PaintCommandPaste *self, GdkPixbuf *source);
+void          paint_command_paste_get_extents (PaintCommandPaste *self, cairo_rectangle_int_t *extents);
+void          paint_command_paste_get_point   (PaintCommandPaste *self, int *x, int *y);
+void          paint_command_paste_get_scale   (PaintCommandPaste *self, float *x, float *y);
+GdkPixbuf    *paint_command_paste_get_source  (PaintCommandPaste *self);
+PaintCommand *paint_command_paste_new         (void);
+void          paint_command_paste_set_point   (PaintCommandPaste *self, int x, int y);
+void          paint_command_paste_set_scale   (PaintCommandPaste *self, float x, float y);
+void          paint_command_paste_set_source  (PaintCommandPaste *self, GdkPixbuf *source);
+
+/* Paint History モジュール */
+gboolean      paint_history_can_redo  (PaintHistory *self);
+gboolean      paint_history_can_undo  (PaintHistory *self);
+void          paint_history_clear     (PaintHistory *self);
+void          paint_history_free      (PaintHistory *self);
+PaintHistory *paint_history_new       (void);
+void          paint_history_push      (PaintHistory *self, PaintTiles *tiles, const cairo_rectangle_int_t *bounds);
+gboolean      paint_history_redo      (PaintHistory *self, PaintTiles *tiles, cairo_rectangle_int_t *bounds);
+void          paint_history_reset     (PaintHistory *self, PaintTiles *tiles);
+void          paint_history_set_limit (PaintHistory *self, gsize limit);
+gboolean      paint_history_undo      (PaintHistory *self, PaintTiles *tiles, cairo_rectangle_int_t *bounds);
+
+/* Paint Journal モジュール */
+GFile           *paint_journal_get_file   (PaintJournal *self);
+int              paint_journal_get_height (PaintJournal *self);
+int              paint_journal_get_width  (PaintJournal *self);
+gboolean         paint_journal_has_tile   (PaintJournal *self, int column, int row);
+cairo_surface_t *paint_journal_load_tile  (PaintJournal *self, int column, int row);
+PaintJournal    *paint_journal_new        (GFile *file);
+PaintJournal    *paint_journal_open       (GFile *file, GError **error);
+PaintJournal    *paint_journal_ref        (PaintJournal *self);
+void             paint_journal_unref      (PaintJournal *self);
+gboolean         paint_journal_write      (PaintJournal *self, PaintTiles *tiles, PaintSaveProgressFunc progress, gpointer user_data, GCancellable *cancellable, GError **error);
+
+/* Paint Save モジュール */
+void     paint_save_async         (PaintTiles *tiles, GFile *file, GCancellable *cancellable, PaintSaveProgressFunc progress, GAsyncReadyCallback callback, gpointer user_data);
+gboolean paint_save_finish        (GAsyncResult *result, GError **error);
+void     paint_save_journal_async (PaintTiles *tiles, PaintJournal *journal, GCancellable *cancellable, PaintSaveProgressFunc progress, GAsyncReadyCallback callback, gpointer user_data);
+
+/* Paint Tiles モジュール */
+void             paint_tiles_assign      (PaintTiles *self, PaintTiles *source);
+void             paint_tiles_attach      (PaintTiles *self, PaintJournal *journal);
+void             paint_tiles_clear       (PaintTiles *self);
+gboolean         paint_tiles_commit      (PaintTiles *self, PaintCommand *command, const cairo_rectangle_int_t *bounds);
+void             paint_tiles_execute     (PaintTiles *self, PaintCommand *command, const cairo_rectangle_int_t *bounds);
+void             paint_tiles_free        (PaintTiles *self);
+int              paint_tiles_get_columns (PaintTiles *self);
+int              paint_tiles_get_height  (PaintTiles *self);
+PaintJournal    *paint_tiles_get_journal (PaintTiles *self);
+gboolean         paint_tiles_get_pending (PaintTiles *self, int column, int row);
+int              paint_tiles_get_rows    (PaintTiles *self);
+cairo_surface_t *paint_tiles_get_tile    (PaintTiles *self, int column, int row);
+int              paint_tiles_get_width   (PaintTiles *self);
+void             paint_tiles_load        (PaintTiles *self, GdkPixbuf *source);
+PaintTiles      *paint_tiles_new         (void);
+void             paint_tiles_paint       (PaintTiles *self, cairo_t *cairo);
+void             paint_tiles_resize      (PaintTiles *self, int width, int height);
+cairo_surface_t *paint_tiles_swap_tile   (PaintTiles *self, int column, int row, cairo_surface_t *tile);
 
 /* Paint Document Window クラス */
 GFile     *paint_document_window_get_file (PaintDocumentWindow *self);
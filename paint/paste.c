@@ -0,0 +1,548 @@
+/* Copyright (C) 2025 Taichi Murakami. */
+#include <math.h>
+#include <gtk/gtk.h>
+#include "paint.h"
+#include "share.h"
+
+typedef struct _PaintCommandPasteData PaintCommandPasteData;
+
+/* クラスのプロパティ */
+enum _PaintCommandPasteProperties
+{
+	NULL_PROPERTY_ID,
+	PREPARED_PROPERTY_ID,
+	SOURCE_PROPERTY_ID,
+};
+
+/* クラスのインスタンス */
+struct _PaintCommandPaste
+{
+	PaintCommand     parent_instance;
+	GCancellable    *cancellable;
+	GdkPixbuf       *source;
+	cairo_surface_t *surface;
+	GdkRectangle     damage;
+	PaintPoint       point;
+	PaintPoint       origin;
+	PaintPoint       anchor;
+	float            scale_x;
+	float            scale_y;
+	gboolean         anchored;
+	gboolean         dirty;
+};
+
+/* ワーカー スレッドに渡す画像 */
+struct _PaintCommandPasteData
+{
+	GdkPixbuf *source;
+	int        width;
+	int        height;
+};
+
+static gboolean paint_command_paste_bounds         (PaintCommand *self, cairo_rectangle_int_t *bounds);
+static void paint_command_paste_class_init         (PaintCommandPasteClass *this_class);
+static void paint_command_paste_class_init_command (PaintCommandClass *this_class);
+static void paint_command_paste_class_init_object  (GObjectClass *this_class);
+static cairo_surface_t *paint_command_paste_create (GdkPixbuf *source, int width, int height);
+static void paint_command_paste_damage             (PaintCommandPaste *self);
+static void paint_command_paste_destroy            (PaintCommandPaste *self);
+static void paint_command_paste_dispose            (GObject *self);
+static void paint_command_paste_execute            (PaintCommand *self, cairo_t *cairo);
+static void paint_command_paste_execute_surface    (PaintCommandPaste *self, cairo_t *cairo, cairo_filter_t filter);
+static void paint_command_paste_free_data          (gpointer data);
+static void paint_command_paste_get_property       (GObject *self, guint property_id, GValue *value, GParamSpec *pspec);
+static void paint_command_paste_get_size           (PaintCommandPaste *self, int *width, int *height);
+static void paint_command_paste_init               (PaintCommandPaste *self);
+static void paint_command_paste_pending            (PaintCommand *self, cairo_t *cairo);
+static void paint_command_paste_prepare            (PaintCommandPaste *self);
+static void paint_command_paste_prepared           (GObject *source_object, GAsyncResult *result, gpointer user_data);
+static void paint_command_paste_set_property       (GObject *self, guint property_id, const GValue *value, GParamSpec *pspec);
+static void paint_command_paste_thread             (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+static void paint_command_paste_update             (PaintCommand *self, int x, int y);
+
+/*******************************************************************************
+* Paint Command クラス:
+* 画像を貼り付ける方法を提供します。
+* 貼り付ける画像は乗算済みアルファに変換して拡大縮小した複製をワーカー スレッドで一度だけ作成し、
+* 再生するときは複製を転送するだけにします。
+* 複製ができるまでは描画領域には表示せず、完了したら prepared プロパティの変更を通知します。
+*/
+G_DEFINE_FINAL_TYPE (PaintCommandPaste, paint_command_paste, PAINT_TYPE_COMMAND);
+
+/* 準備完了プロパティ */
+#define PREPARED_PROPERTY_NAME          "prepared"
+#define PREPARED_PROPERTY_NICK          "Prepared"
+#define PREPARED_PROPERTY_BLURB         "Prepared"
+#define PREPARED_PROPERTY_DEFAULT_VALUE FALSE
+#define PREPARED_PROPERTY_FLAGS         G_PARAM_READABLE
+
+/* 画像プロパティ */
+#define SOURCE_PROPERTY_NAME        "source"
+#define SOURCE_PROPERTY_NICK        "Source"
+#define SOURCE_PROPERTY_BLURB       "Source"
+#define SOURCE_PROPERTY_OBJECT_TYPE GDK_TYPE_PIXBUF
+#define SOURCE_PROPERTY_FLAGS       G_PARAM_READWRITE
+
+/*******************************************************************************
+* @brief 前回から変更した範囲を取得します。
+* 移動した場合は移動前と移動後の両方を含みます。
+*/
+static gboolean
+paint_command_paste_bounds (PaintCommand *self, cairo_rectangle_int_t *bounds)
+{
+	PaintCommandPaste *paste;
+	paste = PAINT_COMMAND_PASTE (self);
+
+	if (!paste->dirty)
+	{
+		return FALSE;
+	}
+
+	*bounds = paste->damage;
+	paste->dirty = FALSE;
+	return TRUE;
+}
+
+static void
+paint_command_paste_class_init (PaintCommandPasteClass *this_class)
+{
+	paint_command_paste_class_init_object (G_OBJECT_CLASS (this_class));
+	paint_command_paste_class_init_command (PAINT_COMMAND_CLASS (this_class));
+}
+
+static void
+paint_command_paste_class_init_command (PaintCommandClass *this_class)
+{
+	this_class->bounds = paint_command_paste_bounds;
+	this_class->execute = paint_command_paste_execute;
+	this_class->pending = paint_command_paste_pending;
+	this_class->update = paint_command_paste_update;
+	this_class->type = PAINT_COMMAND_TYPE_PASTE;
+}
+
+static void
+paint_command_paste_class_init_object (GObjectClass *this_class)
+{
+	this_class->dispose = paint_command_paste_dispose;
+	this_class->get_property = paint_command_paste_get_property;
+	this_class->set_property = paint_command_paste_set_property;
+	OBJECT_CLASS_INSTALL_PROPERTY_BOOLEAN (this_class, PREPARED_PROPERTY);
+	OBJECT_CLASS_INSTALL_PROPERTY_OBJECT (this_class, SOURCE_PROPERTY);
+}
+
+/*******************************************************************************
+* @brief 画像を乗算済みアルファに変換し、指定した大きさに拡大縮小します。
+* ワーカー スレッドからも呼び出します。
+*/
+static cairo_surface_t *
+paint_command_paste_create (GdkPixbuf *source, int width, int height)
+{
+	const guchar *pixels, *source_pixel;
+	cairo_surface_t *surface, *scaled;
+	cairo_t *cairo;
+	guchar *data;
+	guint32 *target_pixel;
+	guint r, g, b, a, t;
+	int n_channels, rowstride, stride, source_width, source_height, column, row;
+	source_width = gdk_pixbuf_get_width (source);
+	source_height = gdk_pixbuf_get_height (source);
+	pixels = gdk_pixbuf_read_pixels (source);
+	n_channels = gdk_pixbuf_get_n_channels (source);
+	rowstride = gdk_pixbuf_get_rowstride (source);
+	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, source_width, source_height);
+	cairo_surface_flush (surface);
+	data = cairo_image_surface_get_data (surface);
+	stride = cairo_image_surface_get_stride (surface);
+
+	for (row = 0; row < source_height; row++)
+	{
+		source_pixel = pixels + (gsize) row * rowstride;
+		target_pixel = (guint32 *) (data + (gsize) row * stride);
+
+		for (column = 0; column < source_width; column++)
+		{
+			r = source_pixel [0];
+			g = source_pixel [1];
+			b = source_pixel [2];
+			a = (n_channels == 4) ? source_pixel [3] : G_MAXUINT8;
+
+			if (a != G_MAXUINT8)
+			{
+				t = r * a + 0x80;
+				r = (t + (t >> 8)) >> 8;
+				t = g * a + 0x80;
+				g = (t + (t >> 8)) >> 8;
+				t = b * a + 0x80;
+				b = (t + (t >> 8)) >> 8;
+			}
+
+			*target_pixel++ = RGBA (r, g, b, a);
+			source_pixel += n_channels;
+		}
+	}
+
+	cairo_surface_mark_dirty (surface);
+
+	if ((width == source_width) && (height == source_height))
+	{
+		return surface;
+	}
+
+	/* 拡大縮小は高品質なフィルターで一度だけ行います。 */
+	scaled = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+	cairo = cairo_create (scaled);
+	cairo_scale (cairo, width / (double) source_width, height / (double) source_height);
+	cairo_set_source_surface (cairo, surface, 0, 0);
+	cairo_pattern_set_extend (cairo_get_source (cairo), CAIRO_EXTEND_PAD);
+	cairo_pattern_set_filter (cairo_get_source (cairo), CAIRO_FILTER_GOOD);
+	cairo_set_operator (cairo, CAIRO_OPERATOR_SOURCE);
+	cairo_paint (cairo);
+	cairo_destroy (cairo);
+	cairo_surface_destroy (surface);
+	return scaled;
+}
+
+/*******************************************************************************
+* @brief 現在の範囲を変更した範囲に含めます。
+*/
+static void
+paint_command_paste_damage (PaintCommandPaste *self)
+{
+	cairo_rectangle_int_t extents;
+	paint_command_paste_get_extents (self, &extents);
+
+	if ((extents.width <= 0) || (extents.height <= 0))
+	{
+		return;
+	}
+	if (self->dirty)
+	{
+		gdk_rectangle_union (&self->damage, &extents, &self->damage);
+	}
+	else
+	{
+		self->damage = extents;
+		self->dirty = TRUE;
+	}
+}
+
+static void
+paint_command_paste_destroy (PaintCommandPaste *self)
+{
+	if (self->cancellable)
+	{
+		g_cancellable_cancel (self->cancellable);
+		g_clear_object (&self->cancellable);
+	}
+
+	g_clear_object (&self->source);
+	g_clear_pointer (&self->surface, cairo_surface_destroy);
+}
+
+static void
+paint_command_paste_dispose (GObject *self)
+{
+	paint_command_paste_destroy (PAINT_COMMAND_PASTE (self));
+	G_OBJECT_CLASS (paint_command_paste_parent_class)->dispose (self);
+}
+
+/*******************************************************************************
+* @brief 画像を書き込みます。
+* 複製がまだできていない場合は、ワーカー スレッドを待たずにこのスレッドで作成します。
+*/
+static void
+paint_command_paste_execute (PaintCommand *self, cairo_t *cairo)
+{
+	PaintCommandPaste *paste;
+	int width, height;
+	paste = PAINT_COMMAND_PASTE (self);
+
+	if (!paste->surface && paste->source)
+	{
+		if (paste->cancellable)
+		{
+			g_cancellable_cancel (paste->cancellable);
+			g_clear_object (&paste->cancellable);
+		}
+
+		paint_command_paste_get_size (paste, &width, &height);
+		paste->surface = paint_command_paste_create (paste->source, width, height);
+	}
+
+	paint_command_paste_execute_surface (paste, cairo, CAIRO_FILTER_GOOD);
+}
+
+/*******************************************************************************
+* @brief 作成した複製を転送します。
+*/
+static void
+paint_command_paste_execute_surface (PaintCommandPaste *self, cairo_t *cairo, cairo_filter_t filter)
+{
+	if (self->surface)
+	{
+		cairo_set_source_surface (cairo, self->surface, self->point.x, self->point.y);
+		cairo_pattern_set_filter (cairo_get_source (cairo), filter);
+		cairo_rectangle (cairo, self->point.x, self->point.y, cairo_image_surface_get_width (self->surface), cairo_image_surface_get_height (self->surface));
+		cairo_fill (cairo);
+	}
+}
+
+static void
+paint_command_paste_free_data (gpointer data)
+{
+	PaintCommandPasteData *paste;
+	paste = data;
+	g_object_unref (paste->source);
+	g_free (paste);
+}
+
+/*******************************************************************************
+* @brief 貼り付ける範囲を取得します。
+*/
+void
+paint_command_paste_get_extents (PaintCommandPaste *self, cairo_rectangle_int_t *extents)
+{
+	extents->x = self->point.x;
+	extents->y = self->point.y;
+	paint_command_paste_get_size (self, &extents->width, &extents->height);
+}
+
+void
+paint_command_paste_get_point (PaintCommandPaste *self, int *x, int *y)
+{
+	*x = self->point.x;
+	*y = self->point.y;
+}
+
+static void
+paint_command_paste_get_property (GObject *self, guint property_id, GValue *value, GParamSpec *pspec)
+{
+	PaintCommandPaste *properties;
+	properties = PAINT_COMMAND_PASTE (self);
+
+	switch (property_id)
+	{
+	case PREPARED_PROPERTY_ID:
+		g_value_set_boolean (value, properties->surface != NULL);
+		break;
+	case SOURCE_PROPERTY_ID:
+		g_value_set_object (value, properties->source);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (self, property_id, pspec);
+		break;
+	}
+}
+
+void
+paint_command_paste_get_scale (PaintCommandPaste *self, float *x, float *y)
+{
+	*x = self->scale_x;
+	*y = self->scale_y;
+}
+
+/*******************************************************************************
+* @brief 拡大縮小した画像の大きさを取得します。
+*/
+static void
+paint_command_paste_get_size (PaintCommandPaste *self, int *width, int *height)
+{
+	if (self->source)
+	{
+		*width = MAX (1, (int) lround (gdk_pixbuf_get_width (self->source) * self->scale_x));
+		*height = MAX (1, (int) lround (gdk_pixbuf_get_height (self->source) * self->scale_y));
+	}
+	else
+	{
+		*width = 0;
+		*height = 0;
+	}
+}
+
+GdkPixbuf *
+paint_command_paste_get_source (PaintCommandPaste *self)
+{
+	return self->source;
+}
+
+static void
+paint_command_paste_init (PaintCommandPaste *self)
+{
+	self->scale_x = 1;
+	self->scale_y = 1;
+}
+
+PaintCommand *
+paint_command_paste_new (void)
+{
+	return g_object_new (PAINT_TYPE_COMMAND_PASTE, NULL);
+}
+
+/*******************************************************************************
+* @brief 描画領域に表示します。
+* ドラッグ中は毎回表示し直すため、拡大表示では速いフィルターを使い、複製ができるまでは表示しません。
+*/
+static void
+paint_command_paste_pending (PaintCommand *self, cairo_t *cairo)
+{
+	paint_command_paste_execute_surface (PAINT_COMMAND_PASTE (self), cairo, CAIRO_FILTER_FAST);
+}
+
+/*******************************************************************************
+* @brief 作成済みの複製を破棄し、ワーカー スレッドで作成し直します。
+*/
+static void
+paint_command_paste_prepare (PaintCommandPaste *self)
+{
+	PaintCommandPasteData *data;
+	GTask *task;
+
+	if (self->cancellable)
+	{
+		g_cancellable_cancel (self->cancellable);
+		g_clear_object (&self->cancellable);
+	}
+
+	g_clear_pointer (&self->surface, cairo_surface_destroy);
+
+	if (self->source)
+	{
+		data = g_new (PaintCommandPasteData, 1);
+		data->source = g_object_ref (self->source);
+		paint_command_paste_get_size (self, &data->width, &data->height);
+		self->cancellable = g_cancellable_new ();
+		task = g_task_new (self, self->cancellable, paint_command_paste_prepared, NULL);
+		g_task_set_source_tag (task, paint_command_paste_prepare);
+		g_task_set_task_data (task, data, paint_command_paste_free_data);
+		g_task_run_in_thread (task, paint_command_paste_thread);
+		g_object_unref (task);
+	}
+}
+
+/*******************************************************************************
+* @brief ワーカー スレッドで作成した複製を受け取ります。
+* メイン スレッドで呼び出します。取り消した複製は破棄します。
+*/
+static void
+paint_command_paste_prepared (GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+	PaintCommandPaste *self;
+	cairo_surface_t *surface;
+	self = PAINT_COMMAND_PASTE (source_object);
+	surface = g_task_propagate_pointer (G_TASK (result), NULL);
+
+	if (surface)
+	{
+		if (g_task_get_cancellable (G_TASK (result)) != self->cancellable)
+		{
+			cairo_surface_destroy (surface);
+			return;
+		}
+
+		g_clear_object (&self->cancellable);
+		self->surface = surface;
+		paint_command_paste_damage (self);
+		g_object_notify (source_object, PREPARED_PROPERTY_NAME);
+	}
+}
+
+/*******************************************************************************
+* @brief 貼り付ける位置を設定します。
+*/
+void
+paint_command_paste_set_point (PaintCommandPaste *self, int x, int y)
+{
+	paint_command_paste_damage (self);
+	self->point.x = x;
+	self->point.y = y;
+	paint_command_paste_damage (self);
+}
+
+static void
+paint_command_paste_set_property (GObject *self, guint property_id, const GValue *value, GParamSpec *pspec)
+{
+	PaintCommandPaste *properties;
+	properties = PAINT_COMMAND_PASTE (self);
+
+	switch (property_id)
+	{
+	case SOURCE_PROPERTY_ID:
+		paint_command_paste_set_source (properties, g_value_get_object (value));
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (self, property_id, pspec);
+		break;
+	}
+}
+
+/*******************************************************************************
+* @brief 拡大率を設定します。
+* 拡大縮小した複製を作成し直します。
+*/
+void
+paint_command_paste_set_scale (PaintCommandPaste *self, float x, float y)
+{
+	if ((x > 0) && (y > 0) && ((self->scale_x != x) || (self->scale_y != y)))
+	{
+		paint_command_paste_damage (self);
+		self->scale_x = x;
+		self->scale_y = y;
+		paint_command_paste_damage (self);
+		paint_command_paste_prepare (self);
+	}
+}
+
+/*******************************************************************************
+* @brief 貼り付ける画像を設定します。
+* 乗算済みアルファの複製を作成し直します。
+*/
+void
+paint_command_paste_set_source (PaintCommandPaste *self, GdkPixbuf *source)
+{
+	if (self->source != source)
+	{
+		paint_command_paste_damage (self);
+		g_set_object (&self->source, source);
+		paint_command_paste_damage (self);
+		paint_command_paste_prepare (self);
+	}
+}
+
+/*******************************************************************************
+* @brief 複製を作成します。
+* ワーカー スレッドで呼び出します。
+*/
+static void
+paint_command_paste_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+	PaintCommandPasteData *data;
+	data = task_data;
+
+	if (!g_task_return_error_if_cancelled (task))
+	{
+		g_task_return_pointer (task, paint_command_paste_create (data->source, data->width, data->height), (GDestroyNotify) cairo_surface_destroy);
+	}
+}
+
+/*******************************************************************************
+* @brief カーソルの移動に合わせて画像を移動します。
+* 最初の点を基準にし、以降はその点からの移動量だけ移動します。
+*/
+static void
+paint_command_paste_update (PaintCommand *self, int x, int y)
+{
+	PaintCommandPaste *paste;
+	paste = PAINT_COMMAND_PASTE (self);
+
+	if (!paste->anchored)
+	{
+		paste->anchor.x = x;
+		paste->anchor.y = y;
+		paste->origin = paste->point;
+		paste->anchored = TRUE;
+	}
+	else
+	{
+		paint_command_paste_set_point (paste, paste->origin.x + x - paste->anchor.x, paste->origin.y + y - paste->anchor.y);
+	}
+}
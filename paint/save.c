@@ -0,0 +1,388 @@
+/* Copyright (C) 2025 Taichi Murakami. */
+#include <string.h>
+#include <gtk/gtk.h>
+#include "paint.h"
+#include "share.h"
+#define FORMAT_JPEG  "jpeg"
+#define FORMAT_PNG   "png"
+#define JPEG_QUALITY "quality"
+#define JPEG_VALUE   "90"
+#define TILE_SIZE    PAINT_TILE_SIZE
+
+typedef struct _PaintSaveData PaintSaveData;
+
+/* 保存 */
+struct _PaintSaveData
+{
+	GMutex                mutex;
+	PaintJournal         *journal;
+	PaintTiles           *tiles;
+	PaintSaveProgressFunc progress;
+	gpointer              user_data;
+	double                fraction;
+	gboolean              pending;
+};
+
+static GdkPixbuf  *paint_save_convert    (PaintTiles *tiles, gboolean alpha, GTask *task, GCancellable *cancellable);
+static void       paint_save_free        (gpointer data);
+static const char *paint_save_get_format (GFile *file);
+static gboolean   paint_save_notify      (gpointer user_data);
+static void       paint_save_report      (double fraction, gpointer user_data);
+static void       paint_save_thread      (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+static gboolean   paint_save_write       (GdkPixbuf *pixbuf, GFile *file, const char *format, GCancellable *cancellable, GError **error);
+
+/*******************************************************************************
+* Paint Save モジュール:
+* 画像をワーカー スレッドで PNG または JPEG 形式、あるいは独自形式のファイルに保存します。
+* タイルは共有した複製を受け取るため、保存中もメイン スレッドで描画を続けられます。
+* 描画されたタイルは書き込む前に複製されるので、保存する画像は変わりません。
+*/
+
+/*******************************************************************************
+* @brief 非同期に保存します。
+* @param tiles 保存するタイル格納域。所有権を引き継ぎ、保存が終わると破棄します。
+* @param file 保存するファイル。拡張子が .jpg または .jpeg の場合は JPEG 形式、それ以外は PNG 形式で保存します。
+* コールバックの source_object に渡します。
+* @param cancellable 保存を取り消す場合に使用します。取り消した場合はファイルを置き換えません。
+* @param progress 変換した割合をメイン スレッドで受け取ります。NULL の場合は通知しません。
+*/
+void
+paint_save_async (PaintTiles *tiles, GFile *file, GCancellable *cancellable, PaintSaveProgressFunc progress, GAsyncReadyCallback callback, gpointer user_data)
+{
+	GTask *task;
+	PaintSaveData *data;
+	data = g_new0 (PaintSaveData, 1);
+	g_mutex_init (&data->mutex);
+	data->tiles = tiles;
+	data->progress = progress;
+	data->user_data = user_data;
+	task = g_task_new (file, cancellable, callback, user_data);
+	g_task_set_source_tag (task, paint_save_async);
+	g_task_set_task_data (task, data, paint_save_free);
+	g_task_run_in_thread (task, paint_save_thread);
+	g_object_unref (task);
+}
+
+/*******************************************************************************
+* @brief タイルのアルファ値の乗算を解除して画像に変換します。
+* ワーカー スレッドで呼び出します。
+* タイルの行ごとに進行状況を通知し、取り消されていないか確認します。
+* @param alpha FALSE の場合は白い背景に合成します。
+* @return 画像。取り消した場合は NULL。
+*/
+static GdkPixbuf *
+paint_save_convert (PaintTiles *tiles, gboolean alpha, GTask *task, GCancellable *cancellable)
+{
+	cairo_surface_t *tile;
+	const guint32 *source_pixel;
+	GdkPixbuf *pixbuf;
+	guchar *pixels, *target_pixel;
+	guint32 p;
+	guint a;
+	int n_channels, rowstride, stride, width, height, columns, rows, column, row, x, y, n;
+	width = paint_tiles_get_width (tiles);
+	height = paint_tiles_get_height (tiles);
+	columns = paint_tiles_get_columns (tiles);
+	rows = paint_tiles_get_rows (tiles);
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, alpha, 8, width, height);
+	pixels = gdk_pixbuf_get_pixels (pixbuf);
+	n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+	rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+
+	for (row = 0; row < rows; row++)
+	{
+		if (g_cancellable_is_cancelled (cancellable))
+		{
+			g_object_unref (pixbuf);
+			return NULL;
+		}
+		for (column = 0; column < columns; column++)
+		{
+			tile = paint_tiles_get_tile (tiles, column, row);
+			stride = tile ? cairo_image_surface_get_stride (tile) : 0;
+
+			for (y = row * TILE_SIZE; y < MIN ((row + 1) * TILE_SIZE, height); y++)
+			{
+				target_pixel = pixels + (gsize) y * rowstride + (gsize) column * TILE_SIZE * n_channels;
+				n = MIN (TILE_SIZE, width - column * TILE_SIZE);
+
+				if (!tile)
+				{
+					/* 作成されていないタイルは透明です。 */
+					memset (target_pixel, alpha ? 0 : G_MAXUINT8, (gsize) n * n_channels);
+					continue;
+				}
+
+				source_pixel = (const guint32 *) (cairo_image_surface_get_data (tile) + (y - row * TILE_SIZE) * stride);
+
+				for (x = 0; x < n; x++)
+				{
+					p = source_pixel [x];
+					a = p >> 24;
+
+					if (!alpha)
+					{
+						/* 乗算済みの色を白に重ねると、解除せずに合成できます。 */
+						target_pixel [0] = ((p >> 16) & 0xFF) + G_MAXUINT8 - a;
+						target_pixel [1] = ((p >> 8) & 0xFF) + G_MAXUINT8 - a;
+						target_pixel [2] = (p & 0xFF) + G_MAXUINT8 - a;
+					}
+					else if (a == G_MAXUINT8)
+					{
+						target_pixel [0] = (p >> 16) & 0xFF;
+						target_pixel [1] = (p >> 8) & 0xFF;
+						target_pixel [2] = p & 0xFF;
+						target_pixel [3] = a;
+					}
+					else if (a)
+					{
+						target_pixel [0] = (((p >> 16) & 0xFF) * G_MAXUINT8 + a / 2) / a;
+						target_pixel [1] = (((p >> 8) & 0xFF) * G_MAXUINT8 + a / 2) / a;
+						target_pixel [2] = ((p & 0xFF) * G_MAXUINT8 + a / 2) / a;
+						target_pixel [3] = a;
+					}
+					else
+					{
+						target_pixel [0] = 0;
+						target_pixel [1] = 0;
+						target_pixel [2] = 0;
+						target_pixel [3] = 0;
+					}
+
+					target_pixel += n_channels;
+				}
+			}
+		}
+
+		paint_save_report ((row + 1) / (double) rows, task);
+	}
+
+	return pixbuf;
+}
+
+/*******************************************************************************
+* @brief 非同期に保存した結果を取得します。
+* どちらの形式で保存した場合にも使用します。
+* @return 失敗した場合や取り消した場合は FALSE。
+*/
+gboolean
+paint_save_finish (GAsyncResult *result, GError **error)
+{
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/*******************************************************************************
+* @brief 保存の状態を破棄します。
+* タイルの参照はワーカー スレッドで解放することもあります。
+*/
+static void
+paint_save_free (gpointer data)
+{
+	PaintSaveData *save;
+	save = data;
+	paint_tiles_free (save->tiles);
+
+	if (save->journal)
+	{
+		paint_journal_unref (save->journal);
+	}
+
+	g_mutex_clear (&save->mutex);
+	g_free (save);
+}
+
+/*******************************************************************************
+* @brief 拡張子から保存する形式を選択します。
+*/
+static const char *
+paint_save_get_format (GFile *file)
+{
+	const char *format;
+	char *name, *lower;
+	format = FORMAT_PNG;
+	name = g_file_get_basename (file);
+
+	if (name)
+	{
+		lower = g_ascii_strdown (name, -1);
+
+		if (g_str_has_suffix (lower, ".jpg") || g_str_has_suffix (lower, ".jpeg"))
+		{
+			format = FORMAT_JPEG;
+		}
+
+		g_free (lower);
+		g_free (name);
+	}
+
+	return format;
+}
+
+/*******************************************************************************
+* @brief 非同期に独自形式で保存します。
+* 前回保存してから変更したタイルだけをジャーナルに追記します。
+* @param tiles 保存するタイル格納域。所有権を引き継ぎ、保存が終わると破棄します。
+* @param journal 保存するジャーナル。保存が終わるまで参照を保持します。
+* ジャーナルのファイルをコールバックの source_object に渡します。
+* @param progress 圧縮した割合をメイン スレッドで受け取ります。NULL の場合は通知しません。
+*/
+void
+paint_save_journal_async (PaintTiles *tiles, PaintJournal *journal, GCancellable *cancellable, PaintSaveProgressFunc progress, GAsyncReadyCallback callback, gpointer user_data)
+{
+	GTask *task;
+	PaintSaveData *data;
+	data = g_new0 (PaintSaveData, 1);
+	g_mutex_init (&data->mutex);
+	data->journal = paint_journal_ref (journal);
+	data->tiles = tiles;
+	data->progress = progress;
+	data->user_data = user_data;
+	task = g_task_new (paint_journal_get_file (journal), cancellable, callback, user_data);
+	g_task_set_source_tag (task, paint_save_journal_async);
+	g_task_set_task_data (task, data, paint_save_free);
+	g_task_run_in_thread (task, paint_save_thread);
+	g_object_unref (task);
+}
+
+/*******************************************************************************
+* @brief 変換した割合を通知します。
+* メイン スレッドで呼び出します。
+* 完了した保存と取り消した保存は通知しません。
+*/
+static gboolean
+paint_save_notify (gpointer user_data)
+{
+	GTask *task;
+	PaintSaveData *data;
+	double fraction;
+	task = G_TASK (user_data);
+	data = g_task_get_task_data (task);
+	g_mutex_lock (&data->mutex);
+	fraction = data->fraction;
+	data->pending = FALSE;
+	g_mutex_unlock (&data->mutex);
+
+	if (!g_task_get_completed (task) && !g_cancellable_is_cancelled (g_task_get_cancellable (task)))
+	{
+		data->progress (fraction, data->user_data);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+/*******************************************************************************
+* @brief 進行状況を記録します。
+* ワーカー スレッドで呼び出します。
+* 通知を待っていない場合だけメイン スレッドに通知を予約します。
+*/
+static void
+paint_save_report (double fraction, gpointer user_data)
+{
+	GTask *task;
+	PaintSaveData *data;
+	task = G_TASK (user_data);
+	data = g_task_get_task_data (task);
+
+	if (data->progress)
+	{
+		g_mutex_lock (&data->mutex);
+		data->fraction = fraction;
+
+		if (!data->pending)
+		{
+			data->pending = TRUE;
+			g_main_context_invoke_full (g_task_get_context (task), G_PRIORITY_DEFAULT, paint_save_notify, g_object_ref (task), g_object_unref);
+		}
+
+		g_mutex_unlock (&data->mutex);
+	}
+}
+
+/*******************************************************************************
+* @brief ワーカー スレッドで画像を変換して保存します。
+*/
+static void
+paint_save_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+	GError *error;
+	GdkPixbuf *pixbuf;
+	PaintSaveData *data;
+	const char *format;
+	data = task_data;
+	error = NULL;
+
+	if (data->journal)
+	{
+		if (paint_journal_write (data->journal, data->tiles, paint_save_report, task, cancellable, &error))
+		{
+			g_task_return_boolean (task, TRUE);
+		}
+		else
+		{
+			g_task_return_error (task, error);
+		}
+
+		return;
+	}
+
+	format = paint_save_get_format (G_FILE (source_object));
+	pixbuf = paint_save_convert (data->tiles, format == FORMAT_PNG, task, cancellable);
+
+	if (!pixbuf)
+	{
+		g_task_return_error_if_cancelled (task);
+	}
+	else if (paint_save_write (pixbuf, G_FILE (source_object), format, cancellable, &error))
+	{
+		g_object_unref (pixbuf);
+		g_task_return_boolean (task, TRUE);
+	}
+	else
+	{
+		g_object_unref (pixbuf);
+		g_task_return_error (task, error);
+	}
+}
+
+/*******************************************************************************
+* @brief 画像をファイルに書き込みます。
+* 一時ファイルに書き込んでから置き換えるため、失敗した場合は元のファイルが残ります。
+*/
+static gboolean
+paint_save_write (GdkPixbuf *pixbuf, GFile *file, const char *format, GCancellable *cancellable, GError **error)
+{
+	GCancellable *abort;
+	GFileOutputStream *stream;
+	char *keys [2] = { NULL, NULL };
+	char *values [2] = { NULL, NULL };
+	gboolean succeeded;
+	stream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, cancellable, error);
+
+	if (!stream)
+	{
+		return FALSE;
+	}
+	if (format == FORMAT_JPEG)
+	{
+		keys [0] = JPEG_QUALITY;
+		values [0] = JPEG_VALUE;
+	}
+
+	succeeded = gdk_pixbuf_save_to_streamv (pixbuf, G_OUTPUT_STREAM (stream), format, keys, values, cancellable, error);
+
+	if (succeeded)
+	{
+		succeeded = g_output_stream_close (G_OUTPUT_STREAM (stream), cancellable, error);
+	}
+	else
+	{
+		/* 取り消した状態で閉じると、一時ファイルを削除して元のファイルを残します。 */
+		abort = g_cancellable_new ();
+		g_cancellable_cancel (abort);
+		g_output_stream_close (G_OUTPUT_STREAM (stream), abort, NULL);
+		g_object_unref (abort);
+	}
+
+	g_object_unref (stream);
+	return succeeded;
+}
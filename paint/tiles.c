@@ -0,0 +1,918 @@
+/* Copyright (C) 2025 Taichi Murakami. */
+#include <math.h>
+#include <string.h>
+#include <gtk/gtk.h>
+#include "paint.h"
+#include "share.h"
+#define TILE_FORMAT CAIRO_FORMAT_ARGB32
+#define TILE_SIZE   PAINT_TILE_SIZE
+
+typedef struct _PaintTilesLevel PaintTilesLevel;
+
+/* タイル */
+struct _PaintTiles
+{
+	cairo_surface_t **tiles;
+	PaintTilesLevel  *levels;
+	PaintJournal     *journal;
+	guchar           *pending;
+	int               width;
+	int               height;
+	int               columns;
+	int               rows;
+	int               n_levels;
+};
+
+/* 縮小した画像のタイル */
+struct _PaintTilesLevel
+{
+	cairo_surface_t **tiles;
+	guchar           *valid;
+	int               columns;
+	int               rows;
+};
+
+static void             paint_tiles_clear_edges       (PaintTiles *self);
+static void             paint_tiles_clear_levels      (PaintTiles *self);
+static void             paint_tiles_clear_tile        (PaintTiles *self, int column, int row, int x, int y, int width, int height);
+static cairo_surface_t *paint_tiles_copy_tile         (cairo_surface_t *source);
+static void             paint_tiles_create_levels     (PaintTiles *self);
+static cairo_surface_t *paint_tiles_create_tile       (PaintTiles *self, int column, int row);
+static void             paint_tiles_downsample        (cairo_surface_t *target, cairo_surface_t *source, int x, int y);
+static void             paint_tiles_execute_clear     (PaintTiles *self, PaintCommandClear *command, const cairo_rectangle_int_t *bounds);
+static cairo_surface_t *paint_tiles_fetch             (PaintTiles *self, int column, int row);
+static void             paint_tiles_execute_func      (PaintTiles *self, PaintCommand *command, const cairo_rectangle_int_t *bounds, PaintCommandExecuteFunc execute);
+static int              paint_tiles_get_level         (PaintTiles *self, cairo_t *cairo);
+static cairo_surface_t *paint_tiles_get_level_tile    (PaintTiles *self, int level, int column, int row);
+static gboolean         paint_tiles_get_range         (PaintTiles *self, int x, int y, int width, int height, int *column1, int *row1, int *column2, int *row2);
+static void             paint_tiles_invalidate        (PaintTiles *self, int column, int row);
+static gboolean         paint_tiles_load_tile         (cairo_surface_t *tile, GdkPixbuf *source, int x, int y, int width, int height);
+static guint            paint_tiles_premultiply       (guint color, guint alpha);
+static void             paint_tiles_update_level_tile (PaintTiles *self, int level, int column, int row);
+
+/*******************************************************************************
+* Paint Tiles モジュール:
+* 画像を固定の大きさのタイルに分割して格納します。
+* タイルは最初に書き込まれたときに作成します。
+* 作成されていないタイルは透明として扱います。
+* タイルは他のタイル格納域と共有でき、共有しているタイルは書き込む前に複製します。
+* 縮小表示のために縦横を半分ずつに縮小した画像を段階ごとに保持します。
+* 縮小した画像は描画するときに必要なタイルだけを作成し、
+* 元のタイルが変更されると再作成します。
+* ジャーナルから読み込んだタイルは最初に使われたときに復元します。
+*/
+
+/*******************************************************************************
+* @brief 画像の範囲外にあるタイルの領域を消去します。
+*/
+static void
+paint_tiles_clear_edges (PaintTiles *self)
+{
+	int column, row, x, y;
+	x = self->width % TILE_SIZE;
+	y = self->height % TILE_SIZE;
+
+	if (x)
+	{
+		for (row = 0; row < self->rows; row++)
+		{
+			paint_tiles_clear_tile (self, self->columns - 1, row, x, 0, TILE_SIZE - x, TILE_SIZE);
+		}
+	}
+	if (y)
+	{
+		for (column = 0; column < self->columns; column++)
+		{
+			paint_tiles_clear_tile (self, column, self->rows - 1, 0, y, TILE_SIZE, TILE_SIZE - y);
+		}
+	}
+}
+
+/*******************************************************************************
+* @brief 別のタイル格納域の内容に置き換えます。
+* タイルは複製せずに共有します。
+*/
+void
+paint_tiles_assign (PaintTiles *self, PaintTiles *source)
+{
+	int n, n_tiles;
+	paint_tiles_clear (self);
+	n_tiles = source->columns * source->rows;
+
+	if ((self->columns != source->columns) || (self->rows != source->rows))
+	{
+		g_free (self->tiles);
+		self->tiles = g_new0 (cairo_surface_t *, (gsize) n_tiles);
+		self->columns = source->columns;
+		self->rows = source->rows;
+	}
+	for (n = 0; n < n_tiles; n++)
+	{
+		if (source->tiles [n])
+		{
+			self->tiles [n] = cairo_surface_reference (source->tiles [n]);
+		}
+	}
+	if (source->journal)
+	{
+		/* 復元していないタイルは復元せずに共有します。 */
+		self->journal = paint_journal_ref (source->journal);
+		self->pending = g_memdup2 (source->pending, (gsize) n_tiles);
+	}
+
+	self->width = source->width;
+	self->height = source->height;
+}
+
+/*******************************************************************************
+* @brief ジャーナルのタイルを使用します。
+* タイルはこの時点では復元せず、最初に使われたときに復元します。
+* 大きさは変更しないため、先にジャーナルの大きさに合わせておきます。
+*/
+void
+paint_tiles_attach (PaintTiles *self, PaintJournal *journal)
+{
+	int column, row;
+	paint_tiles_clear (self);
+	self->journal = paint_journal_ref (journal);
+	self->pending = g_new0 (guchar, (gsize) self->columns * self->rows);
+
+	for (row = 0; row < self->rows; row++)
+	{
+		for (column = 0; column < self->columns; column++)
+		{
+			self->pending [row * self->columns + column] = paint_journal_has_tile (journal, column, row);
+		}
+	}
+}
+
+/*******************************************************************************
+* @brief すべてのタイルを破棄します。
+*/
+void
+paint_tiles_clear (PaintTiles *self)
+{
+	int n, n_tiles;
+	n_tiles = self->columns * self->rows;
+
+	for (n = 0; n < n_tiles; n++)
+	{
+		g_clear_pointer (&self->tiles [n], cairo_surface_destroy);
+	}
+
+	g_clear_pointer (&self->journal, paint_journal_unref);
+	g_clear_pointer (&self->pending, g_free);
+	paint_tiles_clear_levels (self);
+}
+
+/*******************************************************************************
+* @brief 縮小した画像をすべて破棄します。
+*/
+static void
+paint_tiles_clear_levels (PaintTiles *self)
+{
+	PaintTilesLevel *level;
+	int n, n_tiles;
+
+	if (self->levels)
+	{
+		for (level = self->levels; level < self->levels + self->n_levels; level++)
+		{
+			n_tiles = level->columns * level->rows;
+
+			for (n = 0; n < n_tiles; n++)
+			{
+				g_clear_pointer (&level->tiles [n], cairo_surface_destroy);
+			}
+
+			g_free (level->tiles);
+			g_free (level->valid);
+		}
+
+		g_clear_pointer (&self->levels, g_free);
+		self->n_levels = 0;
+	}
+}
+
+/*******************************************************************************
+* @brief 実行中のコマンドの確定した部分のうち、書き込んでいない部分を書き込みます。
+* 未確定の部分は書き込まず、次の点で近似し直せるように残します。
+* @return コマンドを部分ごとに書き込めない場合は FALSE。
+*/
+gboolean
+paint_tiles_commit (PaintTiles *self, PaintCommand *command, const cairo_rectangle_int_t *bounds)
+{
+	if (paint_command_get_opaque (command))
+	{
+		paint_tiles_execute_func (self, command, bounds, paint_command_execute_fixed);
+		paint_command_commit (command);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*******************************************************************************
+* @brief タイルの一部を消去します。
+* 画像の範囲内をすべて消去する場合はタイルを破棄し、それ以外は行ごとにゼロで埋めます。
+*/
+static void
+paint_tiles_clear_tile (PaintTiles *self, int column, int row, int x, int y, int width, int height)
+{
+	cairo_surface_t *tile;
+	guchar *data;
+	int stride, n;
+	gboolean covered;
+	covered = (x <= 0) && (y <= 0) && (x + width >= MIN (TILE_SIZE, self->width - column * TILE_SIZE)) && (y + height >= MIN (TILE_SIZE, self->height - row * TILE_SIZE));
+
+	if (covered && self->pending && self->pending [row * self->columns + column])
+	{
+		/* 復元していないタイルは復元せずに透明にします。 */
+		self->pending [row * self->columns + column] = FALSE;
+		paint_tiles_invalidate (self, column, row);
+	}
+	else if (paint_tiles_fetch (self, column, row))
+	{
+		if (covered)
+		{
+			/* 範囲外は常に透明なので、作成されていないタイルと同じです。 */
+			g_clear_pointer (&self->tiles [row * self->columns + column], cairo_surface_destroy);
+			paint_tiles_invalidate (self, column, row);
+			return;
+		}
+
+		tile = paint_tiles_create_tile (self, column, row);
+		cairo_surface_flush (tile);
+		data = cairo_image_surface_get_data (tile) + (gsize) x * sizeof (guint32);
+		stride = cairo_image_surface_get_stride (tile);
+
+		for (n = y; n < y + height; n++)
+		{
+			memset (data + n * stride, 0, (gsize) width * sizeof (guint32));
+		}
+
+		cairo_surface_mark_dirty (tile);
+	}
+}
+
+/*******************************************************************************
+* @brief タイルを複製します。
+*/
+static cairo_surface_t *
+paint_tiles_copy_tile (cairo_surface_t *source)
+{
+	cairo_surface_t *tile;
+	tile = cairo_image_surface_create (TILE_FORMAT, TILE_SIZE, TILE_SIZE);
+	cairo_surface_flush (source);
+	cairo_surface_flush (tile);
+	memcpy (cairo_image_surface_get_data (tile), cairo_image_surface_get_data (source), (gsize) cairo_image_surface_get_stride (source) * TILE_SIZE);
+	cairo_surface_mark_dirty (tile);
+	return tile;
+}
+
+/*******************************************************************************
+* @brief 縮小した画像を格納する領域を作成します。
+* 段階ごとに縦横を半分にし、タイルが 1 つになるまで作成します。
+*/
+static void
+paint_tiles_create_levels (PaintTiles *self)
+{
+	PaintTilesLevel *level;
+	int columns, rows;
+	columns = self->columns;
+	rows = self->rows;
+
+	while ((columns > 1) || (rows > 1))
+	{
+		columns = (columns + 1) / 2;
+		rows = (rows + 1) / 2;
+		self->n_levels++;
+	}
+
+	self->levels = g_new0 (PaintTilesLevel, self->n_levels);
+	columns = self->columns;
+	rows = self->rows;
+
+	for (level = self->levels; level < self->levels + self->n_levels; level++)
+	{
+		columns = (columns + 1) / 2;
+		rows = (rows + 1) / 2;
+		level->tiles = g_new0 (cairo_surface_t *, (gsize) columns * rows);
+		level->valid = g_new0 (guchar, (gsize) columns * rows);
+		level->columns = columns;
+		level->rows = rows;
+	}
+}
+
+/*******************************************************************************
+* @brief 書き込むタイルを取得します。
+* 作成されていないタイルは作成し、共有しているタイルは複製します。
+*/
+static cairo_surface_t *
+paint_tiles_create_tile (PaintTiles *self, int column, int row)
+{
+	cairo_surface_t **tile, *copy;
+	paint_tiles_fetch (self, column, row);
+	tile = &self->tiles [row * self->columns + column];
+
+	paint_tiles_invalidate (self, column, row);
+
+	if (!*tile)
+	{
+		*tile = cairo_image_surface_create (TILE_FORMAT, TILE_SIZE, TILE_SIZE);
+	}
+	else if (cairo_surface_get_reference_count (*tile) > 1)
+	{
+		copy = paint_tiles_copy_tile (*tile);
+		cairo_surface_destroy (*tile);
+		*tile = copy;
+	}
+
+	return *tile;
+}
+
+/*******************************************************************************
+* @brief タイルを縦横半分に縮小し、縮小したタイルの一部に書き込みます。
+* 隣り合う 2×2 ピクセルの平均を求めます。
+* @param source 縮小するタイル。NULL の場合は透明にします。
+*/
+static void
+paint_tiles_downsample (cairo_surface_t *target, cairo_surface_t *source, int x, int y)
+{
+	const guint32 *source_pixel1, *source_pixel2;
+	guchar *target_data, *source_data;
+	guint32 *target_pixel, p1, p2, p3, p4, rb, ag;
+	int stride, column, row;
+	target_data = cairo_image_surface_get_data (target);
+	stride = cairo_image_surface_get_stride (target);
+	source_data = source ? cairo_image_surface_get_data (source) : NULL;
+
+	for (row = 0; row < TILE_SIZE / 2; row++)
+	{
+		target_pixel = (guint32 *) (target_data + (y + row) * stride) + x;
+
+		if (source_data)
+		{
+			source_pixel1 = (const guint32 *) (source_data + row * 2 * stride);
+			source_pixel2 = (const guint32 *) (source_data + (row * 2 + 1) * stride);
+
+			for (column = 0; column < TILE_SIZE / 2; column++)
+			{
+				p1 = source_pixel1 [column * 2];
+				p2 = source_pixel1 [column * 2 + 1];
+				p3 = source_pixel2 [column * 2];
+				p4 = source_pixel2 [column * 2 + 1];
+				rb = (p1 & 0x00FF00FF) + (p2 & 0x00FF00FF) + (p3 & 0x00FF00FF) + (p4 & 0x00FF00FF) + 0x00020002;
+				ag = ((p1 >> 8) & 0x00FF00FF) + ((p2 >> 8) & 0x00FF00FF) + ((p3 >> 8) & 0x00FF00FF) + ((p4 >> 8) & 0x00FF00FF) + 0x00020002;
+				target_pixel [column] = ((rb >> 2) & 0x00FF00FF) | (((ag >> 2) & 0x00FF00FF) << 8);
+			}
+		}
+		else
+		{
+			memset (target_pixel, 0, TILE_SIZE / 2 * sizeof (guint32));
+		}
+	}
+}
+
+/*******************************************************************************
+* @brief 指定した範囲にコマンドを実行します。
+* 範囲と重なるタイルだけに書き込みます。
+*/
+void
+paint_tiles_execute (PaintTiles *self, PaintCommand *command, const cairo_rectangle_int_t *bounds)
+{
+	paint_tiles_execute_func (self, command, bounds, paint_command_execute);
+}
+
+/*******************************************************************************
+* @brief 消去するコマンドの範囲を描画せずに消去します。
+*/
+static void
+paint_tiles_execute_clear (PaintTiles *self, PaintCommandClear *command, const cairo_rectangle_int_t *bounds)
+{
+	cairo_rectangle_int_t rectangle;
+	int column, row, column1, row1, column2, row2, x, y, x1, y1, x2, y2;
+	paint_command_clear_get_point (command, &rectangle.x, &rectangle.y);
+	paint_command_clear_get_size (command, &rectangle.width, &rectangle.height);
+
+	if (gdk_rectangle_intersect (&rectangle, bounds, &rectangle) && paint_tiles_get_range (self, rectangle.x, rectangle.y, rectangle.width, rectangle.height, &column1, &row1, &column2, &row2))
+	{
+		x1 = MAX (rectangle.x, 0);
+		y1 = MAX (rectangle.y, 0);
+		x2 = MIN (rectangle.x + rectangle.width, self->width);
+		y2 = MIN (rectangle.y + rectangle.height, self->height);
+
+		for (row = row1; row < row2; row++)
+		{
+			for (column = column1; column < column2; column++)
+			{
+				x = column * TILE_SIZE;
+				y = row * TILE_SIZE;
+				paint_tiles_clear_tile (self, column, row, MAX (x1 - x, 0), MAX (y1 - y, 0), MIN (x2 - x, TILE_SIZE) - MAX (x1 - x, 0), MIN (y2 - y, TILE_SIZE) - MAX (y1 - y, 0));
+			}
+		}
+	}
+}
+
+/*******************************************************************************
+* @brief 範囲と重なるタイルごとに描画します。
+* 描画は画像の範囲内に切り抜きます。
+* 消去するコマンドは作成されていないタイルには描画しません。
+* 透明にするコマンドは描画せずにタイルを直接消去します。
+*/
+static void
+paint_tiles_execute_func (PaintTiles *self, PaintCommand *command, const cairo_rectangle_int_t *bounds, PaintCommandExecuteFunc execute)
+{
+	cairo_surface_t *tile;
+	cairo_t *cairo;
+	int column, row, column1, row1, column2, row2;
+	gboolean erase;
+	erase = paint_command_get_command_type (command) == PAINT_COMMAND_TYPE_ERASE;
+
+	if (paint_command_get_command_type (command) == PAINT_COMMAND_TYPE_CLEAR)
+	{
+		paint_tiles_execute_clear (self, PAINT_COMMAND_CLEAR (command), bounds);
+		return;
+	}
+	if (paint_tiles_get_range (self, bounds->x, bounds->y, bounds->width, bounds->height, &column1, &row1, &column2, &row2))
+	{
+		for (row = row1; row < row2; row++)
+		{
+			for (column = column1; column < column2; column++)
+			{
+				/* 作成されていないタイルは透明なので、消去する必要はありません。 */
+				if (erase && !paint_tiles_fetch (self, column, row))
+				{
+					continue;
+				}
+
+				tile = paint_tiles_create_tile (self, column, row);
+				cairo = cairo_create (tile);
+				cairo_translate (cairo, -column * TILE_SIZE, -row * TILE_SIZE);
+
+				/* 画像の範囲外は透明のまま残し、縮小した画像や大きさを広げた画像に現れないようにします。 */
+				cairo_rectangle (cairo, column * TILE_SIZE, row * TILE_SIZE, MIN (TILE_SIZE, self->width - column * TILE_SIZE), MIN (TILE_SIZE, self->height - row * TILE_SIZE));
+				cairo_clip (cairo);
+				execute (command, cairo);
+				cairo_destroy (cairo);
+			}
+		}
+	}
+}
+
+/*******************************************************************************
+* @brief ジャーナルから読み込んだタイルをまだ復元していない場合は復元します。
+* @return タイル。透明な場合は NULL。
+*/
+static cairo_surface_t *
+paint_tiles_fetch (PaintTiles *self, int column, int row)
+{
+	int n;
+	n = row * self->columns + column;
+
+	if (self->pending && self->pending [n])
+	{
+		self->tiles [n] = paint_journal_load_tile (self->journal, column, row);
+		self->pending [n] = FALSE;
+	}
+
+	return self->tiles [n];
+}
+
+/*******************************************************************************
+* @brief 破棄します。
+*/
+void
+paint_tiles_free (PaintTiles *self)
+{
+	paint_tiles_clear (self);
+	g_free (self->tiles);
+	g_free (self);
+}
+
+/*******************************************************************************
+* @brief タイルの列数を取得します。
+*/
+int
+paint_tiles_get_columns (PaintTiles *self)
+{
+	return self->columns;
+}
+
+/*******************************************************************************
+* @brief 画像の高さを取得します。
+*/
+int
+paint_tiles_get_height (PaintTiles *self)
+{
+	return self->height;
+}
+
+/*******************************************************************************
+* @brief 拡大率に応じて描画する縮小の段階を選択します。
+* 表示倍率が 1/2 以下になるごとに 1 段階ずつ縮小した画像を使用します。
+*/
+static int
+paint_tiles_get_level (PaintTiles *self, cairo_t *cairo)
+{
+	double x, y, scale;
+	int level;
+	x = 1;
+	y = 0;
+	cairo_user_to_device_distance (cairo, &x, &y);
+	scale = hypot (x, y);
+	level = 0;
+
+	if (!self->levels)
+	{
+		paint_tiles_create_levels (self);
+	}
+	while ((level < self->n_levels) && (scale * (2 << level) <= 1))
+	{
+		level++;
+	}
+
+	return level;
+}
+
+/*******************************************************************************
+* @brief 縮小した画像のタイルを取得します。
+* 元のタイルが変更されている場合は再作成します。
+* @return 透明な場合は NULL。
+*/
+static cairo_surface_t *
+paint_tiles_get_level_tile (PaintTiles *self, int level, int column, int row)
+{
+	PaintTilesLevel *data;
+	int n;
+
+	if (level)
+	{
+		data = &self->levels [level - 1];
+		n = row * data->columns + column;
+
+		if (!data->valid [n])
+		{
+			paint_tiles_update_level_tile (self, level, column, row);
+			data->valid [n] = TRUE;
+		}
+
+		return data->tiles [n];
+	}
+
+	return paint_tiles_fetch (self, column, row);
+}
+
+/*******************************************************************************
+* @brief 指定した範囲と重なるタイルの範囲を取得します。
+* @return 重なるタイルがない場合は FALSE。
+*/
+static gboolean
+paint_tiles_get_range (PaintTiles *self, int x, int y, int width, int height, int *column1, int *row1, int *column2, int *row2)
+{
+	int x1, y1, x2, y2;
+	x1 = MAX (x, 0);
+	y1 = MAX (y, 0);
+	x2 = MIN (x + width, self->width);
+	y2 = MIN (y + height, self->height);
+
+	if ((x1 < x2) && (y1 < y2))
+	{
+		*column1 = x1 / TILE_SIZE;
+		*row1 = y1 / TILE_SIZE;
+		*column2 = (x2 + TILE_SIZE - 1) / TILE_SIZE;
+		*row2 = (y2 + TILE_SIZE - 1) / TILE_SIZE;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*******************************************************************************
+* @brief タイルを読み込んだジャーナルを取得します。
+* @return ジャーナルから読み込んでいない場合は NULL。
+*/
+PaintJournal *
+paint_tiles_get_journal (PaintTiles *self)
+{
+	return self->journal;
+}
+
+/*******************************************************************************
+* @brief ジャーナルのタイルをまだ復元していないかどうかを取得します。
+* 復元していないタイルは、読み込んでから変更されていません。
+*/
+gboolean
+paint_tiles_get_pending (PaintTiles *self, int column, int row)
+{
+	return self->pending && self->pending [row * self->columns + column];
+}
+
+/*******************************************************************************
+* @brief タイルの行数を取得します。
+*/
+int
+paint_tiles_get_rows (PaintTiles *self)
+{
+	return self->rows;
+}
+
+/*******************************************************************************
+* @brief タイルを取得します。
+* @return 作成されていない場合は NULL。
+*/
+cairo_surface_t *
+paint_tiles_get_tile (PaintTiles *self, int column, int row)
+{
+	return paint_tiles_fetch (self, column, row);
+}
+
+/*******************************************************************************
+* @brief 画像の幅を取得します。
+*/
+int
+paint_tiles_get_width (PaintTiles *self)
+{
+	return self->width;
+}
+
+/*******************************************************************************
+* @brief タイルを含む縮小した画像のタイルを無効にします。
+*/
+static void
+paint_tiles_invalidate (PaintTiles *self, int column, int row)
+{
+	PaintTilesLevel *level;
+
+	for (level = self->levels; level < self->levels + self->n_levels; level++)
+	{
+		column /= 2;
+		row /= 2;
+		level->valid [row * level->columns + column] = FALSE;
+	}
+}
+
+/*******************************************************************************
+* @brief 画像を読み込みます。
+* 透明なタイルは作成しません。
+*/
+void
+paint_tiles_load (PaintTiles *self, GdkPixbuf *source)
+{
+	cairo_surface_t *tile;
+	int column, row, x, y, width, height;
+	paint_tiles_clear (self);
+	width = MIN (gdk_pixbuf_get_width (source), self->width);
+	height = MIN (gdk_pixbuf_get_height (source), self->height);
+
+	for (row = 0; row * TILE_SIZE < height; row++)
+	{
+		for (column = 0; column * TILE_SIZE < width; column++)
+		{
+			x = column * TILE_SIZE;
+			y = row * TILE_SIZE;
+			tile = paint_tiles_create_tile (self, column, row);
+
+			if (!paint_tiles_load_tile (tile, source, x, y, MIN (width - x, TILE_SIZE), MIN (height - y, TILE_SIZE)))
+			{
+				g_clear_pointer (&self->tiles [row * self->columns + column], cairo_surface_destroy);
+			}
+		}
+	}
+}
+
+/*******************************************************************************
+* @brief 画像の一部をタイルに変換します。
+* @return タイルが透明な場合は FALSE。
+*/
+static gboolean
+paint_tiles_load_tile (cairo_surface_t *tile, GdkPixbuf *source, int x, int y, int width, int height)
+{
+	const guchar *pixels, *source_pixel;
+	guchar *data;
+	guint32 *target_pixel;
+	guint r, g, b, a, visible;
+	int n_channels, rowstride, stride, column, row;
+	pixels = gdk_pixbuf_read_pixels (source);
+	n_channels = gdk_pixbuf_get_n_channels (source);
+	rowstride = gdk_pixbuf_get_rowstride (source);
+	cairo_surface_flush (tile);
+	data = cairo_image_surface_get_data (tile);
+	stride = cairo_image_surface_get_stride (tile);
+	visible = 0;
+
+	for (row = 0; row < height; row++)
+	{
+		source_pixel = pixels + (gsize) (y + row) * rowstride + (gsize) x * n_channels;
+		target_pixel = (guint32 *) (data + row * stride);
+
+		for (column = 0; column < width; column++)
+		{
+			r = source_pixel [0];
+			g = source_pixel [1];
+			b = source_pixel [2];
+			a = (n_channels == 4) ? source_pixel [3] : G_MAXUINT8;
+
+			if (a != G_MAXUINT8)
+			{
+				r = paint_tiles_premultiply (r, a);
+				g = paint_tiles_premultiply (g, a);
+				b = paint_tiles_premultiply (b, a);
+			}
+
+			*target_pixel++ = RGBA (r, g, b, a);
+			source_pixel += n_channels;
+			visible |= a;
+		}
+	}
+
+	cairo_surface_mark_dirty (tile);
+	return visible != 0;
+}
+
+/*******************************************************************************
+* @brief 作成します。
+*/
+PaintTiles *
+paint_tiles_new (void)
+{
+	return g_new0 (PaintTiles, 1);
+}
+
+/*******************************************************************************
+* @brief 指定した範囲のタイルを描画します。
+* 縮小して表示する場合は縮小した画像を描画します。
+* 作成されていないタイルは描画しません。
+*/
+void
+paint_tiles_paint (PaintTiles *self, cairo_t *cairo)
+{
+	cairo_surface_t *tile;
+	cairo_pattern_t *pattern;
+	cairo_matrix_t matrix;
+	double x1, y1, x2, y2;
+	int column, row, column1, row1, column2, row2, level, size, x, y;
+	cairo_clip_extents (cairo, &x1, &y1, &x2, &y2);
+	x = floor (x1);
+	y = floor (y1);
+
+	if (paint_tiles_get_range (self, x, y, ceil (x2) - x, ceil (y2) - y, &column1, &row1, &column2, &row2))
+	{
+		level = paint_tiles_get_level (self, cairo);
+		size = TILE_SIZE << level;
+		column1 >>= level;
+		row1 >>= level;
+		column2 = ((column2 - 1) >> level) + 1;
+		row2 = ((row2 - 1) >> level) + 1;
+
+		/* 隣り合うタイルの境界に継ぎ目を作りません。 */
+		cairo_save (cairo);
+		cairo_set_antialias (cairo, CAIRO_ANTIALIAS_NONE);
+
+		for (row = row1; row < row2; row++)
+		{
+			for (column = column1; column < column2; column++)
+			{
+				tile = paint_tiles_get_level_tile (self, level, column, row);
+
+				if (tile)
+				{
+					x = column * size;
+					y = row * size;
+					pattern = cairo_pattern_create_for_surface (tile);
+					cairo_matrix_init_scale (&matrix, 1.0 / (1 << level), 1.0 / (1 << level));
+					cairo_matrix_translate (&matrix, -x, -y);
+					cairo_pattern_set_matrix (pattern, &matrix);
+					cairo_pattern_set_extend (pattern, CAIRO_EXTEND_PAD);
+					cairo_set_source (cairo, pattern);
+					cairo_pattern_destroy (pattern);
+					cairo_rectangle (cairo, x, y, MIN (size, self->width - x), MIN (size, self->height - y));
+					cairo_fill (cairo);
+				}
+			}
+		}
+
+		cairo_restore (cairo);
+	}
+}
+
+/*******************************************************************************
+* @brief 色にアルファ値を乗算します。
+*/
+static guint
+paint_tiles_premultiply (guint color, guint alpha)
+{
+	guint t;
+	t = color * alpha + 0x80;
+	return (t + (t >> 8)) >> 8;
+}
+
+/*******************************************************************************
+* @brief タイルを置き換えます。
+* @param tile 所有権を引き継ぐタイル。NULL の場合は透明にします。
+* @return 置き換えられたタイル。所有権は呼び出し元に移ります。
+*/
+cairo_surface_t *
+paint_tiles_swap_tile (PaintTiles *self, int column, int row, cairo_surface_t *tile)
+{
+	cairo_surface_t *previous;
+	previous = paint_tiles_fetch (self, column, row);
+	self->tiles [row * self->columns + column] = tile;
+	paint_tiles_invalidate (self, column, row);
+	return previous;
+}
+
+/*******************************************************************************
+* @brief 縮小した画像のタイルを 1 つ前の段階の 2×2 個のタイルから作成します。
+*/
+static void
+paint_tiles_update_level_tile (PaintTiles *self, int level, int column, int row)
+{
+	cairo_surface_t **tile, *sources [4];
+	int n, x, y, columns, rows;
+	gboolean visible;
+	tile = &self->levels [level - 1].tiles [row * self->levels [level - 1].columns + column];
+	columns = (level > 1) ? self->levels [level - 2].columns : self->columns;
+	rows = (level > 1) ? self->levels [level - 2].rows : self->rows;
+	visible = FALSE;
+
+	for (n = 0; n < 4; n++)
+	{
+		x = column * 2 + n % 2;
+		y = row * 2 + n / 2;
+		sources [n] = ((x < columns) && (y < rows)) ? paint_tiles_get_level_tile (self, level - 1, x, y) : NULL;
+		visible |= sources [n] != NULL;
+	}
+	if (!visible)
+	{
+		g_clear_pointer (tile, cairo_surface_destroy);
+		return;
+	}
+	if (!*tile)
+	{
+		*tile = cairo_image_surface_create (TILE_FORMAT, TILE_SIZE, TILE_SIZE);
+	}
+
+	cairo_surface_flush (*tile);
+
+	for (n = 0; n < 4; n++)
+	{
+		if (sources [n])
+		{
+			cairo_surface_flush (sources [n]);
+		}
+
+		paint_tiles_downsample (*tile, sources [n], n % 2 * TILE_SIZE / 2, n / 2 * TILE_SIZE / 2);
+	}
+
+	cairo_surface_mark_dirty (*tile);
+}
+
+/*******************************************************************************
+* @brief 画像の大きさを変更します。
+* 範囲内に残るタイルは再利用します。
+*/
+void
+paint_tiles_resize (PaintTiles *self, int width, int height)
+{
+	cairo_surface_t **tiles;
+	guchar *pending;
+	int column, row, columns, rows;
+	width = MAX (width, 0);
+	height = MAX (height, 0);
+	columns = (width + TILE_SIZE - 1) / TILE_SIZE;
+	rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+	tiles = g_new0 (cairo_surface_t *, (gsize) columns * rows);
+	pending = self->pending ? g_new0 (guchar, (gsize) columns * rows) : NULL;
+
+	for (row = 0; row < self->rows; row++)
+	{
+		for (column = 0; column < self->columns; column++)
+		{
+			if ((column < columns) && (row < rows))
+			{
+				tiles [row * columns + column] = self->tiles [row * self->columns + column];
+
+				if (pending)
+				{
+					pending [row * columns + column] = self->pending [row * self->columns + column];
+				}
+			}
+			else if (self->tiles [row * self->columns + column])
+			{
+				cairo_surface_destroy (self->tiles [row * self->columns + column]);
+			}
+		}
+	}
+
+	paint_tiles_clear_levels (self);
+	g_free (self->tiles);
+	g_free (self->pending);
+	self->tiles = tiles;
+	self->pending = pending;
+	self->width = width;
+	self->height = height;
+	self->columns = columns;
+	self->rows = rows;
+	paint_tiles_clear_edges (self);
+}
@@ -2,9 +2,13 @@
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
 #include <locale.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include "share.h"
 #define ABOUT_COPYRIGHT         "Copyright © 2025 Taichi Murakami."
 #define ABOUT_WEBSITE           "https://mi19a009.github.io/paint/"
+#define DIRECTORY_ATTRIBUTES    G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_TYPE "," G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE
 #define ALERT_FORMAT            "%s"
 #define FILTER_ALL              "*.*"
 #define FILTER_IMAGE            "image/*"
@@ -14,21 +18,54 @@
 #define GETTEXT_LINK            "/proc/self/exe"
 #define GETTEXT_LOCALE          ""
 #define GETTEXT_PATH            "locale"
+#define LOAD_BUFFER_SIZE        65536
+#define OPTION_SOURCE_HEIGHT    "x-share-source-height"
+#define OPTION_SOURCE_WIDTH     "x-share-source-width"
+#define OPTION_VALUE_CCH        16
 #define PRINT_N_PAGES           1
 #define PROPERTY_APPLICATION_ID "application-id"
 #define PROPERTY_FLAGS          "flags"
+#define SIGNAL_AREA_PREPARED    "area-prepared"
+#define SIGNAL_AREA_UPDATED     "area-updated"
 #define SIGNAL_BEGIN_PRINT      "begin-print"
 #define SIGNAL_DESTROY          "destroy"
 #define SIGNAL_DRAW_PAGE        "draw-page"
 #define SIGNAL_END_PRINT        "end-print"
+#define SIGNAL_SIZE_PREPARED    "size-prepared"
+#define TEXT_LOAD_FAILED        _("Failed to load the image")
 #define TITLE_ALL               _("All Files")
+#define TITLE_FOLDER            _("Open Folder")
 #define TITLE_IMAGE             _("Image Files")
 #define TITLE_OPEN              _("Open File")
 #define TITLE_SAVE              _("Save As")
 
+typedef struct _ShareListItem  ShareListItem;
+typedef struct _ShareLoadData  ShareLoadData;
 typedef struct _SharePrintData SharePrintData;
 typedef void (*ShareFileFilterAdd) (GtkFileFilter *filter, const char *format);
 
+/* ディレクトリの項目 */
+struct _ShareListItem
+{
+	char  *key;
+	GFile *file;
+};
+
+/* 読み込み */
+struct _ShareLoadData
+{
+	GMutex                  mutex;
+	GdkPixbuf              *pixbuf;
+	GdkPixbuf              *update;
+	SharePixbufProgressFunc progress;
+	gpointer                user_data;
+	cairo_rectangle_int_t   area;
+	double                  scale;
+	int                     width;
+	int                     height;
+	gboolean                pending;
+};
+
 /* 印刷 */
 struct _SharePrintData
 {
@@ -36,16 +73,27 @@ struct _SharePrintData
 	cairo_surface_t *surface;
 };
 
-static void share_about_dialog_init        (GtkAboutDialog *dialog, const char *title, const char *logo_icon_name);
-static void share_application_init         (void);
-static void share_file_dialog_init         (GtkFileDialog *dialog, const char *title, GFile *initial_file);
-static void share_file_dialog_init_filters (GtkFileDialog *dialog, ShareFileDialogFlag flags);
-static void share_file_filters_add         (GListStore *filters, const char *name, const char *format, ShareFileFilterAdd add);
-static void share_present                  (GtkWindow *window, GtkWindow *parent);
-static void share_print_operation_begin    (GtkPrintOperation *operation, GtkPrintContext *context, SharePrintData *data);
-static void share_print_operation_draw     (GtkPrintOperation *operation, GtkPrintContext *context, int page, SharePrintData *data);
-static void share_print_operation_end      (GtkPrintOperation *operation, GtkPrintContext *context, SharePrintData *data);
-static void share_print_operation_init     (GtkPrintContext *context, SharePrintData *data);
+static void       share_about_dialog_init        (GtkAboutDialog *dialog, const char *title, const char *logo_icon_name);
+static void       share_application_init         (void);
+static gint       share_directory_list_compare   (gconstpointer a, gconstpointer b);
+static void       share_directory_list_thread    (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+static void       share_file_dialog_init         (GtkFileDialog *dialog, const char *title, GFile *initial_file);
+static void       share_file_dialog_init_filters (GtkFileDialog *dialog, ShareFileDialogFlag flags);
+static void       share_file_filters_add         (GListStore *filters, const char *name, const char *format, ShareFileFilterAdd add);
+static void       share_pixbuf_fit_size          (GdkPixbufLoader *loader, int width, int height, gpointer user_data);
+static void       share_pixbuf_load_free         (gpointer data);
+static void       share_pixbuf_load_prepared     (GdkPixbufLoader *loader, gpointer user_data);
+static gboolean   share_pixbuf_load_progress     (gpointer user_data);
+static void       share_pixbuf_load_size         (GdkPixbufLoader *loader, int width, int height, gpointer user_data);
+static void       share_pixbuf_load_thread       (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+static void       share_pixbuf_load_updated      (GdkPixbufLoader *loader, int x, int y, int width, int height, gpointer user_data);
+static GdkPixbuf *share_pixbuf_read              (GFile *file, GCancellable *cancellable, GError **error);
+static GdkPixbuf *share_pixbuf_read_stream       (GInputStream *stream, GdkPixbufLoader *loader, GCancellable *cancellable, GError **error);
+static void       share_present                  (GtkWindow *window, GtkWindow *parent);
+static void       share_print_operation_begin    (GtkPrintOperation *operation, GtkPrintContext *context, SharePrintData *data);
+static void       share_print_operation_draw     (GtkPrintOperation *operation, GtkPrintContext *context, int page, SharePrintData *data);
+static void       share_print_operation_end      (GtkPrintOperation *operation, GtkPrintContext *context, SharePrintData *data);
+static void       share_print_operation_init     (GtkPrintContext *context, SharePrintData *data);
 static const char *ABOUT_AUTHORS [] = { "Taichi Murakami", NULL };
 
 /*******************************************************************************
@@ -150,6 +198,100 @@ share_application_set_accel_entries (GtkApplication *application, const ShareAcc
 	}
 }
 
+/*******************************************************************************
+* @brief ディレクトリ内の画像ファイルを非同期に列挙します。
+* 列挙はワーカー スレッドで行い、ファイル名の自然な順序で並べ替えます。
+* @param directory ディレクトリ。コールバックの source_object に渡します。
+*/
+void
+share_directory_list_images_async (GFile *directory, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+	GTask *task;
+	task = g_task_new (directory, cancellable, callback, user_data);
+	g_task_set_source_tag (task, share_directory_list_images_async);
+	g_task_run_in_thread (task, share_directory_list_thread);
+	g_object_unref (task);
+}
+
+/*******************************************************************************
+* @brief 非同期に列挙した画像ファイルを取得します。
+* @return GFile の配列。失敗した場合や取り消した場合は NULL。
+*/
+GPtrArray *
+share_directory_list_images_finish (GAsyncResult *result, GError **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/*******************************************************************************
+* @brief ディレクトリの項目を比較します。
+*/
+static gint
+share_directory_list_compare (gconstpointer a, gconstpointer b)
+{
+	return strcmp (((const ShareListItem *) a)->key, ((const ShareListItem *) b)->key);
+}
+
+/*******************************************************************************
+* @brief ワーカー スレッドでディレクトリ内の画像ファイルを列挙します。
+*/
+static void
+share_directory_list_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+	GArray *items;
+	GError *error;
+	GFileEnumerator *enumerator;
+	GFileInfo *info;
+	GPtrArray *files;
+	ShareListItem item;
+	const char *content_type;
+	guint n;
+	error = NULL;
+	enumerator = g_file_enumerate_children (G_FILE (source_object), DIRECTORY_ATTRIBUTES, G_FILE_QUERY_INFO_NONE, cancellable, &error);
+
+	if (enumerator)
+	{
+		items = g_array_new (FALSE, FALSE, sizeof (ShareListItem));
+
+		while ((info = g_file_enumerator_next_file (enumerator, cancellable, &error)))
+		{
+			content_type = g_file_info_get_content_type (info);
+
+			if ((g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR) && content_type && g_content_type_is_mime_type (content_type, FILTER_IMAGE))
+			{
+				item.key = g_utf8_collate_key_for_filename (g_file_info_get_name (info), -1);
+				item.file = g_file_get_child (G_FILE (source_object), g_file_info_get_name (info));
+				g_array_append_val (items, item);
+			}
+
+			g_object_unref (info);
+		}
+
+		g_array_sort (items, share_directory_list_compare);
+		files = g_ptr_array_new_full (items->len, g_object_unref);
+
+		for (n = 0; n < items->len; n++)
+		{
+			item = g_array_index (items, ShareListItem, n);
+			g_ptr_array_add (files, item.file);
+			g_free (item.key);
+		}
+
+		g_array_unref (items);
+		g_object_unref (enumerator);
+
+		if (!error)
+		{
+			g_task_return_pointer (task, files, (GDestroyNotify) g_ptr_array_unref);
+			return;
+		}
+
+		g_ptr_array_unref (files);
+	}
+
+	g_task_return_error (task, error);
+}
+
 /*******************************************************************************
 * @brief ファイル ダイアログを初期化します。
 * @param dialog ファイル ダイアログ。
@@ -217,6 +359,22 @@ share_file_dialog_save (GtkWindow *parent, GFile *initial_file, GAsyncReadyCallb
 	g_object_unref (dialog);
 }
 
+/*******************************************************************************
+* @brief フォルダーを選択するダイアログを表示します。
+* @param parent ファイル ダイアログの親ウィンドウ。
+* @param initial_folder フォルダー。
+*/
+void
+share_file_dialog_select_folder (GtkWindow *parent, GFile *initial_folder, GAsyncReadyCallback callback, gpointer user_data)
+{
+	GtkFileDialog *dialog;
+	dialog = gtk_file_dialog_new ();
+	share_file_dialog_init (dialog, TITLE_FOLDER, NULL);
+	gtk_file_dialog_set_initial_folder (dialog, initial_folder);
+	gtk_file_dialog_select_folder (dialog, parent, NULL, callback, user_data);
+	g_object_unref (dialog);
+}
+
 /*******************************************************************************
 * @brief ファイル フィルターを作成します。
 * @param filters ファイル フィルターのコレクション。
@@ -241,17 +399,370 @@ share_file_filters_add (GListStore *filters, const char *name, const char *forma
 */
 GdkPixbuf *
 share_pixbuf_create_from_file (GFile *file, GError **error)
+{
+	return share_pixbuf_read (file, NULL, error);
+}
+
+/*******************************************************************************
+* @brief 指定した大きさに収まるように画像ファイルを読み込みます。
+* 画像ローダーで縮小しながら復号します。指定した大きさより小さい画像は拡大しません。
+* @param size 幅と高さの上限。
+* @return 画像。
+*/
+GdkPixbuf *
+share_pixbuf_create_from_file_at_size (GFile *file, int size, GCancellable *cancellable, GError **error)
+{
+	GdkPixbuf *pixbuf;
+	GdkPixbufLoader *loader;
+	GFileInputStream *stream;
+	pixbuf = NULL;
+	stream = g_file_read (file, cancellable, error);
+
+	if (stream)
+	{
+		loader = gdk_pixbuf_loader_new ();
+		g_signal_connect (loader, SIGNAL_SIZE_PREPARED, G_CALLBACK (share_pixbuf_fit_size), GINT_TO_POINTER (size));
+		pixbuf = share_pixbuf_read_stream (G_INPUT_STREAM (stream), loader, cancellable, error);
+		g_object_unref (loader);
+		g_object_unref (stream);
+	}
+
+	return pixbuf;
+}
+
+/*******************************************************************************
+* @brief 画像の大きさが決まりました。
+* 上限を超える場合は縦横比を保って縮小します。
+*/
+static void
+share_pixbuf_fit_size (GdkPixbufLoader *loader, int width, int height, gpointer user_data)
+{
+	int size;
+	size = GPOINTER_TO_INT (user_data);
+
+	if ((width > size) || (height > size))
+	{
+		if (width > height)
+		{
+			height = MAX (1, (int) ((gint64) height * size / width));
+			width = size;
+		}
+		else
+		{
+			width = MAX (1, (int) ((gint64) width * size / height));
+			height = size;
+		}
+
+		gdk_pixbuf_loader_set_size (loader, width, height);
+	}
+}
+
+/*******************************************************************************
+* @brief 縮小して読み込んだ画像の元の大きさを取得します。
+* 縮小していない画像の場合は画像の大きさを取得します。
+*/
+void
+share_pixbuf_get_source_size (GdkPixbuf *pixbuf, int *width, int *height)
+{
+	const char *option;
+	option = gdk_pixbuf_get_option (pixbuf, OPTION_SOURCE_WIDTH);
+	*width = option ? atoi (option) : gdk_pixbuf_get_width (pixbuf);
+	option = gdk_pixbuf_get_option (pixbuf, OPTION_SOURCE_HEIGHT);
+	*height = option ? atoi (option) : gdk_pixbuf_get_height (pixbuf);
+}
+
+/*******************************************************************************
+* @brief 画像ファイルを非同期に読み込みます。
+* 画像はワーカー スレッドで少しずつ復号します。
+* 復号した範囲はメイン スレッドで progress に通知します。
+* 通知が処理される前に復号した範囲はまとめて通知します。
+* 通知する画像は画像ローダーとは別の画像で、メイン スレッドだけが書き換えるため、通知の外でも読めます。
+* @param file 画像ファイル。コールバックの source_object に渡します。
+* @param scale 縮小率。1 未満の場合は画像ローダーで縮小しながら復号します。
+* JPEG 画像は DCT の段階で縮小するため、元の大きさで復号するより速く、メモリも少なくて済みます。
+* @param cancellable 読み込みを取り消す場合に使用します。
+* @param progress 復号した範囲を受け取ります。NULL の場合は通知しません。
+*/
+void
+share_pixbuf_load_async (GFile *file, double scale, GCancellable *cancellable, SharePixbufProgressFunc progress, GAsyncReadyCallback callback, gpointer user_data)
+{
+	GTask *task;
+	ShareLoadData *data;
+	data = g_new0 (ShareLoadData, 1);
+	g_mutex_init (&data->mutex);
+	data->scale = scale;
+	data->progress = progress;
+	data->user_data = user_data;
+	task = g_task_new (file, cancellable, callback, user_data);
+	g_task_set_source_tag (task, share_pixbuf_load_async);
+	g_task_set_task_data (task, data, share_pixbuf_load_free);
+	g_task_run_in_thread (task, share_pixbuf_load_thread);
+	g_object_unref (task);
+}
+
+/*******************************************************************************
+* @brief 非同期に読み込んだ画像を取得します。
+* @return 画像。失敗した場合や取り消した場合は NULL。
+*/
+GdkPixbuf *
+share_pixbuf_load_finish (GAsyncResult *result, GError **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/*******************************************************************************
+* @brief 読み込みの状態を破棄します。
+*/
+static void
+share_pixbuf_load_free (gpointer data)
+{
+	ShareLoadData *load;
+	load = data;
+	g_clear_object (&load->pixbuf);
+	g_clear_object (&load->update);
+	g_mutex_clear (&load->mutex);
+	g_free (load);
+}
+
+/*******************************************************************************
+* @brief 画像を作成しました。
+* ワーカー スレッドで呼び出します。
+* 縮小した場合は元の大きさを画像に記録します。
+* 通知する場合は画像ローダーの画像を複製し、以降の書き込みはメイン スレッドに任せます。
+*/
+static void
+share_pixbuf_load_prepared (GdkPixbufLoader *loader, gpointer user_data)
 {
 	GdkPixbuf *pixbuf;
+	ShareLoadData *data;
+	char value [OPTION_VALUE_CCH];
+	data = g_task_get_task_data (G_TASK (user_data));
+	pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+
+	if (data->width)
+	{
+		g_snprintf (value, OPTION_VALUE_CCH, "%d", data->width);
+		gdk_pixbuf_set_option (pixbuf, OPTION_SOURCE_WIDTH, value);
+		g_snprintf (value, OPTION_VALUE_CCH, "%d", data->height);
+		gdk_pixbuf_set_option (pixbuf, OPTION_SOURCE_HEIGHT, value);
+	}
+
+	if (data->progress)
+	{
+		pixbuf = gdk_pixbuf_copy (pixbuf);
+		gdk_pixbuf_copy_options (gdk_pixbuf_loader_get_pixbuf (loader), pixbuf);
+		g_mutex_lock (&data->mutex);
+		g_clear_object (&data->pixbuf);
+		data->pixbuf = pixbuf;
+		g_mutex_unlock (&data->mutex);
+	}
+}
+
+/*******************************************************************************
+* @brief 復号した範囲を通知します。
+* メイン スレッドで呼び出します。
+* ワーカー スレッドで複製した範囲を通知する画像に書き込んでから通知します。
+* 完了した読み込みと取り消した読み込みは通知しません。
+*/
+static gboolean
+share_pixbuf_load_progress (gpointer user_data)
+{
+	GTask *task;
+	GdkPixbuf *pixbuf, *update;
+	ShareLoadData *data;
+	cairo_rectangle_int_t area;
+	task = G_TASK (user_data);
+	data = g_task_get_task_data (task);
+	g_mutex_lock (&data->mutex);
+	pixbuf = data->pixbuf ? g_object_ref (data->pixbuf) : NULL;
+	update = g_steal_pointer (&data->update);
+	area = data->area;
+	data->pending = FALSE;
+	g_mutex_unlock (&data->mutex);
+
+	if (pixbuf && update)
+	{
+		if (!g_task_get_completed (task) && !g_cancellable_is_cancelled (g_task_get_cancellable (task)))
+		{
+			gdk_pixbuf_copy_area (update, 0, 0, area.width, area.height, pixbuf, area.x, area.y);
+			data->progress (pixbuf, &area, data->user_data);
+		}
+	}
+	if (pixbuf)
+	{
+		g_object_unref (pixbuf);
+	}
+	if (update)
+	{
+		g_object_unref (update);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+/*******************************************************************************
+* @brief 画像の大きさが決まりました。
+* ワーカー スレッドで呼び出します。
+* 縮小率に合わせて復号する大きさを設定します。
+*/
+static void
+share_pixbuf_load_size (GdkPixbufLoader *loader, int width, int height, gpointer user_data)
+{
+	ShareLoadData *data;
+	int scaled_width, scaled_height;
+	data = g_task_get_task_data (G_TASK (user_data));
+	scaled_width = MAX (1, (int) ceil (width * data->scale));
+	scaled_height = MAX (1, (int) ceil (height * data->scale));
+
+	if ((scaled_width < width) && (scaled_height < height))
+	{
+		data->width = width;
+		data->height = height;
+		gdk_pixbuf_loader_set_size (loader, scaled_width, scaled_height);
+	}
+}
+
+/*******************************************************************************
+* @brief ワーカー スレッドで画像ファイルを読み込みます。
+*/
+static void
+share_pixbuf_load_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+	GError *error;
+	GdkPixbuf *pixbuf;
+	GdkPixbufLoader *loader;
 	GFileInputStream *stream;
-	stream = g_file_read (file, NULL, error);
+	ShareLoadData *data;
+	error = NULL;
+	pixbuf = NULL;
+	data = task_data;
+	stream = g_file_read (G_FILE (source_object), cancellable, &error);
 
 	if (stream)
 	{
-		pixbuf = gdk_pixbuf_new_from_stream (G_INPUT_STREAM (stream), NULL, error);
+		loader = gdk_pixbuf_loader_new ();
+		g_signal_connect (loader, SIGNAL_AREA_PREPARED, G_CALLBACK (share_pixbuf_load_prepared), task);
+
+		if (data->scale < 1)
+		{
+			g_signal_connect (loader, SIGNAL_SIZE_PREPARED, G_CALLBACK (share_pixbuf_load_size), task);
+		}
+		if (data->progress)
+		{
+			g_signal_connect (loader, SIGNAL_AREA_UPDATED, G_CALLBACK (share_pixbuf_load_updated), task);
+		}
+
+		pixbuf = share_pixbuf_read_stream (G_INPUT_STREAM (stream), loader, cancellable, &error);
+		g_object_unref (loader);
 		g_object_unref (stream);
 	}
+	if (pixbuf)
+	{
+		g_task_return_pointer (task, pixbuf, g_object_unref);
+	}
+	else
+	{
+		g_task_return_error (task, error);
+	}
+}
 
+/*******************************************************************************
+* @brief 画像の一部を復号しました。
+* ワーカー スレッドで呼び出します。
+* 画像ローダーの画像はこのスレッドが書き換え続けるため、通知を待っている範囲を含めて複製します。
+* 通知を待っている範囲がない場合だけメイン スレッドに通知を予約します。
+*/
+static void
+share_pixbuf_load_updated (GdkPixbufLoader *loader, int x, int y, int width, int height, gpointer user_data)
+{
+	GdkPixbuf *source, *update;
+	ShareLoadData *data;
+	cairo_rectangle_int_t area;
+	data = g_task_get_task_data (G_TASK (user_data));
+	area.x = x;
+	area.y = y;
+	area.width = width;
+	area.height = height;
+	g_mutex_lock (&data->mutex);
+
+	if (data->pending)
+	{
+		gdk_rectangle_union (&data->area, &area, &area);
+	}
+
+	g_mutex_unlock (&data->mutex);
+	source = gdk_pixbuf_new_subpixbuf (gdk_pixbuf_loader_get_pixbuf (loader), area.x, area.y, area.width, area.height);
+	update = gdk_pixbuf_copy (source);
+	g_object_unref (source);
+	g_mutex_lock (&data->mutex);
+	g_clear_object (&data->update);
+	data->update = update;
+	data->area = area;
+
+	if (!data->pending)
+	{
+		data->pending = TRUE;
+		g_main_context_invoke_full (g_task_get_context (G_TASK (user_data)), G_PRIORITY_DEFAULT, share_pixbuf_load_progress, g_object_ref (user_data), g_object_unref);
+	}
+
+	g_mutex_unlock (&data->mutex);
+}
+
+/*******************************************************************************
+* @brief 画像ファイルを読み込みます。
+*/
+static GdkPixbuf *
+share_pixbuf_read (GFile *file, GCancellable *cancellable, GError **error)
+{
+	GdkPixbuf *pixbuf;
+	GFileInputStream *stream;
+	pixbuf = NULL;
+	stream = g_file_read (file, cancellable, error);
+
+	if (stream)
+	{
+		pixbuf = gdk_pixbuf_new_from_stream (G_INPUT_STREAM (stream), cancellable, error);
+		g_object_unref (stream);
+	}
+
+	return pixbuf;
+}
+
+/*******************************************************************************
+* @brief ストリームを少しずつ画像ローダーに渡して復号します。
+* 画像が得られなかった場合は必ずエラーを設定します。
+* @param loader シグナルを接続済みの画像ローダー。閉じますが、参照は解放しません。
+*/
+static GdkPixbuf *
+share_pixbuf_read_stream (GInputStream *stream, GdkPixbufLoader *loader, GCancellable *cancellable, GError **error)
+{
+	GdkPixbuf *pixbuf;
+	guchar *buffer;
+	gssize size;
+	gboolean succeeded;
+	buffer = g_malloc (LOAD_BUFFER_SIZE);
+	succeeded = TRUE;
+
+	while (succeeded && ((size = g_input_stream_read (stream, buffer, LOAD_BUFFER_SIZE, cancellable, error)) > 0))
+	{
+		succeeded = gdk_pixbuf_loader_write (loader, buffer, size, error);
+	}
+
+	succeeded = succeeded && (size == 0);
+	succeeded = gdk_pixbuf_loader_close (loader, succeeded ? error : NULL) && succeeded;
+	pixbuf = succeeded ? gdk_pixbuf_loader_get_pixbuf (loader) : NULL;
+
+	if (pixbuf)
+	{
+		g_object_ref (pixbuf);
+	}
+	else if (succeeded)
+	{
+		/* 画像ローダーが画像を作らずに閉じた場合もエラーとして返します。 */
+		g_set_error_literal (error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_FAILED, TEXT_LOAD_FAILED);
+	}
+
+	g_free (buffer);
 	return pixbuf;
 }
 
@@ -372,3 +883,30 @@ share_surface_load (cairo_surface_t *surface, GdkPixbuf *pixbuf)
 		cairo_destroy (cairo);
 	}
 }
+
+/*******************************************************************************
+* @brief 指定したサーフィスの一部を画像の同じ範囲で更新します。
+* 指定した範囲だけを変換します。
+* @param surface 書き込み先。
+* @param pixbuf 読み込み元。
+* @param area 更新する範囲。
+*/
+void
+share_surface_load_area (cairo_surface_t *surface, GdkPixbuf *pixbuf, const cairo_rectangle_int_t *area)
+{
+	GdkPixbuf *source;
+	cairo_t *cairo;
+
+	if ((area->width > 0) && (area->height > 0))
+	{
+		source = gdk_pixbuf_new_subpixbuf (pixbuf, area->x, area->y, area->width, area->height);
+		cairo = cairo_create (surface);
+		cairo_set_antialias (cairo, CAIRO_ANTIALIAS_NONE);
+		cairo_set_operator (cairo, CAIRO_OPERATOR_SOURCE);
+		gdk_cairo_set_source_pixbuf (cairo, source, area->x, area->y);
+		cairo_rectangle (cairo, area->x, area->y, area->width, area->height);
+		cairo_fill (cairo);
+		cairo_destroy (cairo);
+		g_object_unref (source);
+	}
+}
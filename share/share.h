@@ -4,6 +4,7 @@
 
 typedef enum   _ShareFileDialogFlag ShareFileDialogFlag;
 typedef struct _ShareAccelEntry     ShareAccelEntry;
+typedef void (*SharePixbufProgressFunc) (GdkPixbuf *pixbuf, const cairo_rectangle_int_t *area, gpointer user_data);
 
 /* ファイル フィルター */
 enum _ShareFileDialogFlag
@@ -21,15 +22,23 @@ struct _ShareAccelEntry
 };
 
 /* Share モジュール */
-void                    share_about_dialog_show             (GtkWindow *parent, const char *title, const char *logo_icon_name);
-void                    share_alert_dialog_show             (GtkWindow *parent, const GError *error);
-int                     share_application_run               (int argc, char **argv, GType type, const char *application_id, GApplicationFlags flags);
-void                    share_application_set_accel_entries (GtkApplication *application, const ShareAccelEntry *entries, int n_entries);
-void                    share_file_dialog_open              (GtkWindow *parent, GFile *initial_file, GAsyncReadyCallback callback, gpointer user_data, ShareFileDialogFlag flags);
-void                    share_file_dialog_save              (GtkWindow *parent, GFile *initial_file, GAsyncReadyCallback callback, gpointer user_data, ShareFileDialogFlag flags);
-GdkPixbuf              *share_pixbuf_create_from_file       (GFile *file, GError **error);
-GtkPrintOperationResult share_print_operation_run           (GtkWindow *parent, GdkPixbuf *pixbuf, GError **error);
-void                    share_surface_load                  (cairo_surface_t *surface, GdkPixbuf *pixbuf);
+void                    share_about_dialog_show               (GtkWindow *parent, const char *title, const char *logo_icon_name);
+void                    share_alert_dialog_show               (GtkWindow *parent, const GError *error);
+int                     share_application_run                 (int argc, char **argv, GType type, const char *application_id, GApplicationFlags flags);
+void                    share_application_set_accel_entries   (GtkApplication *application, const ShareAccelEntry *entries, int n_entries);
+void                    share_directory_list_images_async     (GFile *directory, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+GPtrArray              *share_directory_list_images_finish    (GAsyncResult *result, GError **error);
+void                    share_file_dialog_open                (GtkWindow *parent, GFile *initial_file, GAsyncReadyCallback callback, gpointer user_data, ShareFileDialogFlag flags);
+void                    share_file_dialog_save                (GtkWindow *parent, GFile *initial_file, GAsyncReadyCallback callback, gpointer user_data, ShareFileDialogFlag flags);
+void                    share_file_dialog_select_folder       (GtkWindow *parent, GFile *initial_folder, GAsyncReadyCallback callback, gpointer user_data);
+GdkPixbuf              *share_pixbuf_create_from_file         (GFile *file, GError **error);
+GdkPixbuf              *share_pixbuf_create_from_file_at_size (GFile *file, int size, GCancellable *cancellable, GError **error);
+void                    share_pixbuf_get_source_size          (GdkPixbuf *pixbuf, int *width, int *height);
+void                    share_pixbuf_load_async               (GFile *file, double scale, GCancellable *cancellable, SharePixbufProgressFunc progress, GAsyncReadyCallback callback, gpointer user_data);
+GdkPixbuf              *share_pixbuf_load_finish              (GAsyncResult *result, GError **error);
+GtkPrintOperationResult share_print_operation_run             (GtkWindow *parent, GdkPixbuf *pixbuf, GError **error);
+void                    share_surface_load                    (cairo_surface_t *surface, GdkPixbuf *pixbuf);
+void                    share_surface_load_area               (cairo_surface_t *surface, GdkPixbuf *pixbuf, const cairo_rectangle_int_t *area);
 
 /* 32-ビット色 */
 #define GetBValue(rgba)  ((rgba) & 255)
@@ -26,7 +26,10 @@ static const char *ACCELS_CLOSE        [] = { "<Ctrl>q", NULL };
 static const char *ACCELS_FULLSCREEN   [] = { "F11", NULL };
 static const char *ACCELS_HELP_OVERLAY [] = { "<Ctrl>question", "<Ctrl>slash", NULL };
 static const char *ACCELS_NEW          [] = { "<Ctrl>n", NULL };
+static const char *ACCELS_NEXT         [] = { "Page_Down", "<Alt>Right", NULL };
 static const char *ACCELS_OPEN         [] = { "<Ctrl>o", NULL };
+static const char *ACCELS_OPEN_FOLDER  [] = { "<Shift><Ctrl>o", NULL };
+static const char *ACCELS_PREVIOUS     [] = { "Page_Up", "<Alt>Left", NULL };
 static const char *ACCELS_PRINT        [] = { "<Ctrl>p", NULL };
 static const char *ACCELS_RESTORE_ZOOM [] = { "<Ctrl>0", NULL };
 static const char *ACCELS_UNFULLSCREEN [] = { "Escape", NULL };
@@ -41,7 +44,10 @@ ACCEL_ENTRIES [] =
 	{ "win.fullscreen",        ACCELS_FULLSCREEN   },
 	{ "win.show-help-overlay", ACCELS_HELP_OVERLAY },
 	{ "app.new",               ACCELS_NEW          },
+	{ "win.next",              ACCELS_NEXT         },
 	{ "win.open",              ACCELS_OPEN         },
+	{ "win.open-folder",       ACCELS_OPEN_FOLDER  },
+	{ "win.previous",          ACCELS_PREVIOUS     },
 	{ "win.print",             ACCELS_PRINT        },
 	{ "win.restore-zoom",      ACCELS_RESTORE_ZOOM },
 	{ "win.unfullscreen",      ACCELS_UNFULLSCREEN },
@@ -109,18 +115,28 @@ viewer_application_init (ViewerApplication *self)
 
 /*******************************************************************************
 * @brief 指定したファイルを開きます。
+* フォルダーはギャラリー ウィンドウで表示します。
 */
 static void
 viewer_application_open (GApplication *self, GFile **files, gint n_files, const gchar *hint)
 {
-	GtkWidget *document;
+	GtkWidget *window;
 	int n;
 
 	for (n = 0; n < n_files; n++)
 	{
-		document = viewer_document_window_new (self);
-		viewer_document_window_set_file (VIEWER_DOCUMENT_WINDOW (document), files [n]);
-		gtk_window_present (GTK_WINDOW (document));
+		if (g_file_query_file_type (files [n], G_FILE_QUERY_INFO_NONE, NULL) == G_FILE_TYPE_DIRECTORY)
+		{
+			window = viewer_gallery_window_new (self);
+			viewer_gallery_window_set_directory (VIEWER_GALLERY_WINDOW (window), files [n]);
+		}
+		else
+		{
+			window = viewer_document_window_new (self);
+			viewer_document_window_load (VIEWER_DOCUMENT_WINDOW (window), files [n]);
+		}
+
+		gtk_window_present (GTK_WINDOW (window));
 	}
 }
 
@@ -0,0 +1,362 @@
+/* Copyright (C) 2025 Taichi Murakami. */
+#include <gtk/gtk.h>
+#include <glib/gi18n.h>
+#include "viewer.h"
+#include "share.h"
+
+typedef struct _ViewerCacheEntry ViewerCacheEntry;
+typedef struct _ViewerCacheLoad  ViewerCacheLoad;
+
+/* キャッシュ */
+struct _ViewerCache
+{
+	GHashTable *entries;
+	GHashTable *loads;
+	GQueue     *queue;
+	gsize       limit;
+	gsize       size;
+};
+
+/* キャッシュの項目 */
+struct _ViewerCacheEntry
+{
+	GFile     *file;
+	GdkPixbuf *pixbuf;
+	gsize      size;
+};
+
+/* 先読み中の画像ファイル */
+struct _ViewerCacheLoad
+{
+	GCancellable *cancellable;
+	GQueue        waiters;
+};
+
+static void     viewer_cache_cancel_load   (gpointer data);
+static void     viewer_cache_complete_load (ViewerCacheLoad *load, GdkPixbuf *pixbuf, const GError *error);
+static void     viewer_cache_free_entry    (ViewerCacheEntry *entry);
+static gboolean viewer_cache_is_waited     (ViewerCacheLoad *load);
+static void     viewer_cache_respond_load  (GObject *file, GAsyncResult *result, gpointer user_data);
+static void     viewer_cache_trim          (ViewerCache *self);
+
+/*******************************************************************************
+* Viewer Cache モジュール:
+* 復号した画像を最近使用した順に保持します。
+* 使用量が上限を超えた場合は最も長く使用していない画像から破棄します。
+* 先読みする画像はワーカー スレッドで復号し、不要になった先読みは取り消します。
+* 先読み中の画像ファイルを開く場合は、復号し直さずに先読みの完了を待ちます。
+*/
+
+/*******************************************************************************
+* @brief 先読みを取り消します。
+* 完了を待っている要求も取り消します。
+*/
+static void
+viewer_cache_cancel_load (gpointer data)
+{
+	ViewerCacheLoad *load;
+	GError *error;
+	load = data;
+	error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED, _("Operation was cancelled"));
+	g_cancellable_cancel (load->cancellable);
+	viewer_cache_complete_load (load, NULL, error);
+	g_error_free (error);
+}
+
+/*******************************************************************************
+* @brief 先読みの結果を完了を待っている要求に返し、先読みを破棄します。
+*/
+static void
+viewer_cache_complete_load (ViewerCacheLoad *load, GdkPixbuf *pixbuf, const GError *error)
+{
+	GTask *task;
+
+	while ((task = g_queue_pop_head (&load->waiters)))
+	{
+		if (pixbuf)
+		{
+			g_task_return_pointer (task, g_object_ref (pixbuf), g_object_unref);
+		}
+		else
+		{
+			g_task_return_error (task, g_error_copy (error));
+		}
+
+		g_object_unref (task);
+	}
+
+	g_object_unref (load->cancellable);
+	g_free (load);
+}
+
+/*******************************************************************************
+* @brief 破棄します。
+* 先読み中の画像ファイルはすべて取り消します。
+*/
+void
+viewer_cache_free (ViewerCache *self)
+{
+	g_hash_table_unref (self->loads);
+	g_hash_table_unref (self->entries);
+	g_queue_free_full (self->queue, (GDestroyNotify) viewer_cache_free_entry);
+	g_free (self);
+}
+
+/*******************************************************************************
+* @brief 項目を破棄します。
+*/
+static void
+viewer_cache_free_entry (ViewerCacheEntry *entry)
+{
+	g_object_unref (entry->file);
+	g_object_unref (entry->pixbuf);
+	g_free (entry);
+}
+
+/*******************************************************************************
+* @brief 指定した画像ファイルを先読み中かどうかを取得します。
+*/
+gboolean
+viewer_cache_is_loading (ViewerCache *self, GFile *file)
+{
+	return g_hash_table_contains (self->loads, file);
+}
+
+/*******************************************************************************
+* @brief 取り消していない要求が先読みの完了を待っているかどうかを取得します。
+*/
+static gboolean
+viewer_cache_is_waited (ViewerCacheLoad *load)
+{
+	GCancellable *cancellable;
+	GList *link;
+
+	for (link = load->waiters.head; link; link = link->next)
+	{
+		cancellable = g_task_get_cancellable (link->data);
+
+		if (!cancellable || !g_cancellable_is_cancelled (cancellable))
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/*******************************************************************************
+* @brief 画像を格納します。
+* 格納した画像は最近使用した画像として扱います。
+*/
+void
+viewer_cache_insert (ViewerCache *self, GFile *file, GdkPixbuf *pixbuf)
+{
+	ViewerCacheEntry *entry;
+	GList *link;
+	link = g_hash_table_lookup (self->entries, file);
+
+	if (link)
+	{
+		entry = link->data;
+		g_queue_unlink (self->queue, link);
+		g_queue_push_head_link (self->queue, link);
+		g_set_object (&entry->pixbuf, pixbuf);
+		self->size -= entry->size;
+	}
+	else
+	{
+		entry = g_new (ViewerCacheEntry, 1);
+		entry->file = g_object_ref (file);
+		entry->pixbuf = g_object_ref (pixbuf);
+		g_queue_push_head (self->queue, entry);
+		g_hash_table_insert (self->entries, entry->file, self->queue->head);
+	}
+
+	entry->size = gdk_pixbuf_get_byte_length (pixbuf);
+	self->size += entry->size;
+	viewer_cache_trim (self);
+}
+
+/*******************************************************************************
+* @brief 画像を取得します。
+* 取得した画像は最近使用した画像として扱います。
+* @return 格納されていない場合は NULL。
+*/
+GdkPixbuf *
+viewer_cache_lookup (ViewerCache *self, GFile *file)
+{
+	ViewerCacheEntry *entry;
+	GList *link;
+	link = g_hash_table_lookup (self->entries, file);
+
+	if (link)
+	{
+		entry = link->data;
+		g_queue_unlink (self->queue, link);
+		g_queue_push_head_link (self->queue, link);
+		return g_object_ref (entry->pixbuf);
+	}
+
+	return NULL;
+}
+
+/*******************************************************************************
+* @brief 画像を非同期に取得します。
+* 先読み中の画像ファイルは先読みの完了を待ちます。
+* 先読み中でない場合は G_IO_ERROR_NOT_FOUND で完了します。
+* @param file 画像ファイル。コールバックの source_object に渡します。
+*/
+void
+viewer_cache_lookup_async (ViewerCache *self, GFile *file, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+	ViewerCacheLoad *load;
+	GTask *task;
+	task = g_task_new (file, cancellable, callback, user_data);
+	g_task_set_source_tag (task, viewer_cache_lookup_async);
+	load = g_hash_table_lookup (self->loads, file);
+
+	if (load)
+	{
+		g_queue_push_tail (&load->waiters, task);
+	}
+	else
+	{
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "%s", _("The picture is not being loaded"));
+		g_object_unref (task);
+	}
+}
+
+/*******************************************************************************
+* @brief 非同期に取得した画像を取得します。
+* @return 画像。失敗した場合や取り消した場合は NULL。
+*/
+GdkPixbuf *
+viewer_cache_lookup_finish (GAsyncResult *result, GError **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/*******************************************************************************
+* @brief 作成します。
+*/
+ViewerCache *
+viewer_cache_new (void)
+{
+	ViewerCache *self;
+	self = g_new0 (ViewerCache, 1);
+	self->entries = g_hash_table_new (g_file_hash, (GEqualFunc) g_file_equal);
+	self->loads = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal, g_object_unref, viewer_cache_cancel_load);
+	self->queue = g_queue_new ();
+	self->limit = G_MAXSIZE;
+	return self;
+}
+
+/*******************************************************************************
+* @brief 指定した画像ファイルを先読みします。
+* 指定していない画像ファイルの先読みは取り消します。
+* 格納済みの画像ファイルと先読み中の画像ファイルは読み込みません。
+* 完了を待っている要求がある先読みは取り消しません。
+* @param scale 縮小率。
+*/
+void
+viewer_cache_prefetch (ViewerCache *self, GFile **files, guint n_files, double scale)
+{
+	ViewerCacheLoad *load;
+	GHashTableIter iter;
+	gpointer file, value;
+	guint n;
+	gboolean wanted;
+	g_hash_table_iter_init (&iter, self->loads);
+
+	while (g_hash_table_iter_next (&iter, &file, &value))
+	{
+		for (wanted = FALSE, n = 0; !wanted && (n < n_files); n++)
+		{
+			wanted = g_file_equal (file, files [n]);
+		}
+		if (!wanted && !viewer_cache_is_waited (value))
+		{
+			g_hash_table_iter_remove (&iter);
+		}
+	}
+	for (n = 0; n < n_files; n++)
+	{
+		if (!g_hash_table_contains (self->entries, files [n]) && !g_hash_table_contains (self->loads, files [n]))
+		{
+			load = g_new0 (ViewerCacheLoad, 1);
+			load->cancellable = g_cancellable_new ();
+			g_hash_table_insert (self->loads, g_object_ref (files [n]), load);
+			share_pixbuf_load_async (files [n], scale, load->cancellable, NULL, viewer_cache_respond_load, self);
+		}
+	}
+}
+
+/*******************************************************************************
+* @brief 先読みを完了しました。
+* 取り消した先読みはキャッシュに触れずに破棄します。
+* 完了を待っている要求には結果を返します。
+*/
+static void
+viewer_cache_respond_load (GObject *file, GAsyncResult *result, gpointer user_data)
+{
+	ViewerCache *self;
+	GdkPixbuf *pixbuf;
+	GError *error;
+	gpointer key, load;
+	error = NULL;
+	pixbuf = share_pixbuf_load_finish (result, &error);
+
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		g_error_free (error);
+		return;
+	}
+
+	self = user_data;
+
+	if (pixbuf)
+	{
+		viewer_cache_insert (self, G_FILE (file), pixbuf);
+	}
+	if (g_hash_table_steal_extended (self->loads, file, &key, &load))
+	{
+		viewer_cache_complete_load (load, pixbuf, error);
+		g_object_unref (key);
+	}
+	if (pixbuf)
+	{
+		g_object_unref (pixbuf);
+	}
+	if (error)
+	{
+		g_error_free (error);
+	}
+}
+
+/*******************************************************************************
+* @brief メモリ使用量の上限を設定します。
+*/
+void
+viewer_cache_set_limit (ViewerCache *self, gsize limit)
+{
+	self->limit = limit;
+	viewer_cache_trim (self);
+}
+
+/*******************************************************************************
+* @brief 使用量が上限を超えている間、最も長く使用していない画像を破棄します。
+* 最近使用した画像は上限を超えていても破棄しません。
+*/
+static void
+viewer_cache_trim (ViewerCache *self)
+{
+	ViewerCacheEntry *entry;
+
+	while ((self->size > self->limit) && (self->queue->length > 1))
+	{
+		entry = g_queue_pop_tail (self->queue);
+		g_hash_table_remove (self->entries, entry->file);
+		self->size -= entry->size;
+		viewer_cache_free_entry (entry);
+	}
+}
@@ -4,6 +4,8 @@
 #include "viewer.h"
 #include "share.h"
 #define ACTION_FULLSCREEN           "fullscreen"
+#define ACTION_PRINT                "print"
+#define CURSOR_BUSY                 "progress"
 #define FILE_PROPERTY_NAME          "file"
 #define FILE_PROPERTY_NICK          "Picture File"
 #define FILE_PROPERTY_BLURB         "Picture File"
@@ -17,10 +19,14 @@
 #define PIXBUF_PROPERTY_FLAGS       G_PARAM_READWRITE
 #define PROPERTY_APPLICATION        "application"
 #define PROPERTY_SHOW_MENUBAR       "show-menubar"
+#define PREFETCH_AHEAD              2
+#define PREFETCH_BEHIND             1
+#define SETTINGS_CACHE_LIMIT        "cache-limit"
 #define SETTINGS_HEIGHT             "window-height"
 #define SETTINGS_MAXIMIZED          "window-maximized"
 #define SETTINGS_WIDTH              "window-width"
 #define SIGNAL_BEGIN                "begin"
+#define SIGNAL_END                  "end"
 #define SIGNAL_NOTIFY_STATE         "notify::state"
 #define SIGNAL_SCALE_CHANGED        "scale-changed"
 #define TITLE                       _("Picture Viewer")
@@ -49,58 +55,95 @@ enum _ViewerDocumentWindowProperties
 struct _ViewerDocumentWindow
 {
 	GtkApplicationWindow parent_instance;
+	GCancellable        *cancellable;
+	GCancellable        *listing;
+	GCancellable        *printing;
+	GFile               *directory;
 	GFile               *file;
+	GPtrArray           *files;
 	GdkPixbuf           *pixbuf;
 	GtkWidget           *area;
+	ViewerCache         *cache;
+	ViewerSource        *source;
+	cairo_surface_t     *surface;
 	double               scale;
+	double               target;
+	guint                tick;
 	int                  zoom;
 	int                  width;
 	int                  height;
+	int                  cache_limit;
+	int                  index;
 	unsigned char        maximized;
 	unsigned char        fullscreen;
+	unsigned char        zooming;
 };
 
-static void viewer_document_window_activate_about        (GSimpleAction *action, GVariant *parameter, gpointer user_data);
-static void viewer_document_window_activate_fullscreen   (GSimpleAction *action, GVariant *parameter, gpointer user_data);
-static void viewer_document_window_activate_open         (GSimpleAction *action, GVariant *parameter, gpointer user_data);
-static void viewer_document_window_activate_print        (GSimpleAction *action, GVariant *parameter, gpointer user_data);
-static void viewer_document_window_activate_restore_zoom (GSimpleAction *action, GVariant *parameter, gpointer user_data);
-static void viewer_document_window_activate_unfullscreen (GSimpleAction *action, GVariant *parameter, gpointer user_data);
-static void viewer_document_window_activate_zoom_in      (GSimpleAction *action, GVariant *parameter, gpointer user_data);
-static void viewer_document_window_activate_zoom_out     (GSimpleAction *action, GVariant *parameter, gpointer user_data);
-static void viewer_document_window_check_action          (GActionMap *self, const char *name, gboolean checked);
-static void viewer_document_window_class_init            (ViewerDocumentWindowClass *this_class);
-static void viewer_document_window_class_init_object     (GObjectClass *this_class);
-static void viewer_document_window_class_init_widget     (GtkWidgetClass *this_class);
-static void viewer_document_window_constructed           (GObject *self);
-static void viewer_document_window_destroy               (ViewerDocumentWindow *self);
-static void viewer_document_window_dispose               (GObject *self);
-static void viewer_document_window_draw                  (GtkDrawingArea *area, cairo_t *cairo, int width, int height, gpointer user_data);
-static void viewer_document_window_enable_actions        (GActionMap *self, gboolean enabled);
-static void viewer_document_window_get_property          (GObject *self, guint property_id, GValue *value, GParamSpec *pspec);
-static void viewer_document_window_init                  (ViewerDocumentWindow *self);
-static void viewer_document_window_init_actions          (GActionMap *self);
-static void viewer_document_window_init_area             (ViewerDocumentWindow *self);
-static void viewer_document_window_init_content          (ViewerDocumentWindow *self);
-static void viewer_document_window_init_settings         (ViewerDocumentWindow *self);
-static void viewer_document_window_realize               (GtkWidget *self);
-static void viewer_document_window_respond_open          (GObject *dialog, GAsyncResult *result, gpointer user_data);
-static void viewer_document_window_set_fullscreen        (ViewerDocumentWindow *self, gboolean fullscreen);
-static void viewer_document_window_set_maximized         (ViewerDocumentWindow *self, gboolean maximized);
-static void viewer_document_window_set_property          (GObject *self, guint property_id, const GValue *value, GParamSpec *pspec);
-static void viewer_document_window_settings_apply        (ViewerDocumentWindow *self);
-static void viewer_document_window_settings_load         (ViewerDocumentWindow *self);
-static void viewer_document_window_settings_save         (ViewerDocumentWindow *self);
-static void viewer_document_window_size_allocate         (GtkWidget *self, int width, int height, int baseline);
-static void viewer_document_window_surface_changed       (GdkSurface *surface, GParamSpec *pspec, gpointer user_data);
-static void viewer_document_window_surface_connect       (GtkWidget *self);
-static void viewer_document_window_surface_disconnect    (GtkWidget *self);
-static void viewer_document_window_unrealize             (GtkWidget *self);
-static void viewer_document_window_update_area           (ViewerDocumentWindow *self);
-static void viewer_document_window_update_size           (ViewerDocumentWindow *self);
-static void viewer_document_window_update_title          (ViewerDocumentWindow *self);
-static void viewer_document_window_zoom_begin            (GtkGesture *gesture, GdkEventSequence *sequence, gpointer user_data);
-static void viewer_document_window_zoom_changed          (GtkGestureZoom *zoom, double scale, gpointer user_data);
+static void     viewer_document_window_activate_about        (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void     viewer_document_window_activate_fullscreen   (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void     viewer_document_window_activate_next         (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void     viewer_document_window_activate_open         (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void     viewer_document_window_activate_open_folder  (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void     viewer_document_window_activate_previous     (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void     viewer_document_window_activate_print        (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void     viewer_document_window_activate_restore_zoom (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void     viewer_document_window_activate_unfullscreen (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void     viewer_document_window_activate_zoom_in      (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void     viewer_document_window_activate_zoom_out     (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void     viewer_document_window_check_action          (GActionMap *self, const char *name, gboolean checked);
+static void     viewer_document_window_class_init            (ViewerDocumentWindowClass *this_class);
+static void     viewer_document_window_class_init_object     (GObjectClass *this_class);
+static void     viewer_document_window_class_init_widget     (GtkWidgetClass *this_class);
+static void     viewer_document_window_complete_load         (ViewerDocumentWindow *self, GFile *file, GdkPixbuf *pixbuf, GError *error);
+static void     viewer_document_window_constructed           (GObject *self);
+static void     viewer_document_window_destroy               (ViewerDocumentWindow *self);
+static void     viewer_document_window_dispose               (GObject *self);
+static void     viewer_document_window_draw                  (GtkDrawingArea *area, cairo_t *cairo, int width, int height, gpointer user_data);
+static void     viewer_document_window_enable_action         (GActionMap *self, const char *name, gboolean enabled);
+static void     viewer_document_window_enable_actions        (GActionMap *self, gboolean enabled);
+static double   viewer_document_window_get_load_scale        (ViewerDocumentWindow *self);
+static void     viewer_document_window_get_property          (GObject *self, guint property_id, GValue *value, GParamSpec *pspec);
+static void     viewer_document_window_go                    (ViewerDocumentWindow *self, int offset);
+static void     viewer_document_window_init                  (ViewerDocumentWindow *self);
+static void     viewer_document_window_init_actions          (GActionMap *self);
+static void     viewer_document_window_init_area             (ViewerDocumentWindow *self);
+static void     viewer_document_window_init_content          (ViewerDocumentWindow *self);
+static void     viewer_document_window_init_settings         (ViewerDocumentWindow *self);
+static void     viewer_document_window_prefetch              (ViewerDocumentWindow *self);
+static void     viewer_document_window_print                 (ViewerDocumentWindow *self, GdkPixbuf *pixbuf);
+static void     viewer_document_window_realize               (GtkWidget *self);
+static void     viewer_document_window_respond_cache         (GObject *file, GAsyncResult *result, gpointer user_data);
+static void     viewer_document_window_respond_error         (const GError *error, gpointer user_data);
+static void     viewer_document_window_respond_folder        (GObject *dialog, GAsyncResult *result, gpointer user_data);
+static void     viewer_document_window_respond_list          (GObject *directory, GAsyncResult *result, gpointer user_data);
+static void     viewer_document_window_respond_load          (GObject *file, GAsyncResult *result, gpointer user_data);
+static void     viewer_document_window_respond_open          (GObject *dialog, GAsyncResult *result, gpointer user_data);
+static void     viewer_document_window_respond_print         (GObject *file, GAsyncResult *result, gpointer user_data);
+static void     viewer_document_window_respond_progress      (GdkPixbuf *pixbuf, const cairo_rectangle_int_t *area, gpointer user_data);
+static void     viewer_document_window_respond_source        (GObject *file, GAsyncResult *result, gpointer user_data);
+static void     viewer_document_window_set_busy              (ViewerDocumentWindow *self, gboolean busy);
+static void     viewer_document_window_set_fullscreen        (ViewerDocumentWindow *self, gboolean fullscreen);
+static void     viewer_document_window_set_maximized         (ViewerDocumentWindow *self, gboolean maximized);
+static void     viewer_document_window_set_property          (GObject *self, guint property_id, const GValue *value, GParamSpec *pspec);
+static void     viewer_document_window_set_source            (ViewerDocumentWindow *self, ViewerSource *source);
+static void     viewer_document_window_settings_apply        (ViewerDocumentWindow *self);
+static void     viewer_document_window_settings_load         (ViewerDocumentWindow *self);
+static void     viewer_document_window_settings_save         (ViewerDocumentWindow *self);
+static void     viewer_document_window_size_allocate         (GtkWidget *self, int width, int height, int baseline);
+static void     viewer_document_window_surface_changed       (GdkSurface *surface, GParamSpec *pspec, gpointer user_data);
+static void     viewer_document_window_surface_connect       (GtkWidget *self);
+static void     viewer_document_window_surface_disconnect    (GtkWidget *self);
+static void     viewer_document_window_unrealize             (GtkWidget *self);
+static void     viewer_document_window_update_area           (ViewerDocumentWindow *self);
+static void     viewer_document_window_update_files          (ViewerDocumentWindow *self);
+static void     viewer_document_window_update_scale          (ViewerDocumentWindow *self);
+static void     viewer_document_window_update_size           (ViewerDocumentWindow *self);
+static void     viewer_document_window_update_surface        (ViewerDocumentWindow *self);
+static void     viewer_document_window_update_title          (ViewerDocumentWindow *self);
+static void     viewer_document_window_zoom_begin            (GtkGesture *gesture, GdkEventSequence *sequence, gpointer user_data);
+static void     viewer_document_window_zoom_changed          (GtkGestureZoom *zoom, double scale, gpointer user_data);
+static void     viewer_document_window_zoom_end              (GtkGesture *gesture, GdkEventSequence *sequence, gpointer user_data);
+static gboolean viewer_document_window_zoom_tick             (GtkWidget *area, GdkFrameClock *clock, gpointer user_data);
 
 /*******************************************************************************
 * Viewer Document Window クラス:
@@ -109,7 +152,7 @@ static void viewer_document_window_zoom_changed          (GtkGestureZoom *zoom,
 * ウィンドウ破棄時はドキュメントを破棄します。
 */
 G_DEFINE_FINAL_TYPE (ViewerDocumentWindow, viewer_document_window, GTK_TYPE_APPLICATION_WINDOW);
-static const char *DISABLED_ACTIONS [] = { "print", "restore-zoom", "zoom-in", "zoom-out" };
+static const char *DISABLED_ACTIONS [] = { "next", "previous", "print", "restore-zoom", "zoom-in", "zoom-out" };
 
 /* メニュー アクション */
 static const GActionEntry
@@ -117,7 +160,10 @@ ACTION_ENTRIES [] =
 {
 	{ "show-about",   viewer_document_window_activate_about,        NULL, NULL,    NULL },
 	{ "fullscreen",   viewer_document_window_activate_fullscreen,   NULL, "false", NULL },
+	{ "next",         viewer_document_window_activate_next,         NULL, NULL,    NULL },
 	{ "open",         viewer_document_window_activate_open,         NULL, NULL,    NULL },
+	{ "open-folder",  viewer_document_window_activate_open_folder,  NULL, NULL,    NULL },
+	{ "previous",     viewer_document_window_activate_previous,     NULL, NULL,    NULL },
 	{ "print",        viewer_document_window_activate_print,        NULL, NULL,    NULL },
 	{ "restore-zoom", viewer_document_window_activate_restore_zoom, NULL, NULL,    NULL },
 	{ "unfullscreen", viewer_document_window_activate_unfullscreen, NULL, NULL,    NULL },
@@ -153,6 +199,15 @@ viewer_document_window_activate_fullscreen (GSimpleAction *action, GVariant *par
 	}
 }
 
+/*******************************************************************************
+* @brief 次の画像ファイルを開きます。
+*/
+static void
+viewer_document_window_activate_next (GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	viewer_document_window_go (VIEWER_DOCUMENT_WINDOW (user_data), 1);
+}
+
 /*******************************************************************************
 * @brief ファイルを開くダイアログを表示します。
 */
@@ -166,27 +221,52 @@ viewer_document_window_activate_open (GSimpleAction *action, GVariant *parameter
 
 /*******************************************************************************
 * @brief 印刷ダイアログを表示します。
+* 縮小して表示している画像は元の大きさで非同期に読み込み直してから印刷します。
 */
 static void
 viewer_document_window_activate_print (GSimpleAction *action, GVariant *parameter, gpointer user_data)
 {
 	ViewerDocumentWindow *self;
-	GError *error;
+	int width, height;
 	self = VIEWER_DOCUMENT_WINDOW (user_data);
 
-	if (self->pixbuf)
+	if (self->pixbuf && !self->printing)
 	{
-		error = NULL;
-		share_print_operation_run (GTK_WINDOW (self), self->pixbuf, &error);
+		share_pixbuf_get_source_size (self->pixbuf, &width, &height);
 
-		if (error)
+		if ((width != gdk_pixbuf_get_width (self->pixbuf)) && self->file)
 		{
-			share_alert_dialog_show (GTK_WINDOW (self), error);
-			g_error_free (error);
+			self->printing = g_cancellable_new ();
+			viewer_document_window_set_busy (self, TRUE);
+			share_pixbuf_load_async (self->file, 1, self->printing, NULL, viewer_document_window_respond_print, g_object_ref (self));
+		}
+		else
+		{
+			viewer_document_window_print (self, self->pixbuf);
 		}
 	}
 }
 
+/*******************************************************************************
+* @brief フォルダーを選択するダイアログを表示します。
+*/
+static void
+viewer_document_window_activate_open_folder (GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	ViewerDocumentWindow *self;
+	self = VIEWER_DOCUMENT_WINDOW (user_data);
+	share_file_dialog_select_folder (GTK_WINDOW (self), self->directory, viewer_document_window_respond_folder, self);
+}
+
+/*******************************************************************************
+* @brief 前の画像ファイルを開きます。
+*/
+static void
+viewer_document_window_activate_previous (GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	viewer_document_window_go (VIEWER_DOCUMENT_WINDOW (user_data), -1);
+}
+
 /*******************************************************************************
 * @brief 既定の拡大率に戻します。
 */
@@ -282,6 +362,45 @@ viewer_document_window_class_init_widget (GtkWidgetClass *this_class)
 	this_class->unrealize = viewer_document_window_unrealize;
 }
 
+/*******************************************************************************
+* @brief 読み込みの結果を表示します。
+* 途中まで表示している画像はそのまま使用します。
+* 取り消した読み込みの結果は破棄します。
+* 画像とエラーとウィンドウの参照は解放します。
+*/
+static void
+viewer_document_window_complete_load (ViewerDocumentWindow *self, GFile *file, GdkPixbuf *pixbuf, GError *error)
+{
+	if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		g_clear_object (&self->cancellable);
+		viewer_document_window_set_busy (self, FALSE);
+		viewer_document_window_set_file (self, pixbuf ? file : NULL);
+		viewer_document_window_set_pixbuf (self, pixbuf);
+
+		if (pixbuf)
+		{
+			viewer_cache_insert (self->cache, file, pixbuf);
+			viewer_document_window_update_files (self);
+			viewer_document_window_update_scale (self);
+		}
+		if (error)
+		{
+			share_alert_dialog_show (GTK_WINDOW (self), error);
+		}
+	}
+	if (pixbuf)
+	{
+		g_object_unref (pixbuf);
+	}
+	if (error)
+	{
+		g_error_free (error);
+	}
+
+	g_object_unref (self);
+}
+
 /*******************************************************************************
 * @brief クラスのインスタンスを初期化します。
 */
@@ -298,8 +417,34 @@ viewer_document_window_constructed (GObject *self)
 static void
 viewer_document_window_destroy (ViewerDocumentWindow *self)
 {
+	if (self->tick)
+	{
+		gtk_widget_remove_tick_callback (self->area, self->tick);
+		self->tick = 0;
+	}
+	if (self->cancellable)
+	{
+		g_cancellable_cancel (self->cancellable);
+		g_clear_object (&self->cancellable);
+	}
+	if (self->listing)
+	{
+		g_cancellable_cancel (self->listing);
+		g_clear_object (&self->listing);
+	}
+	if (self->printing)
+	{
+		g_cancellable_cancel (self->printing);
+		g_clear_object (&self->printing);
+	}
+
+	g_clear_pointer (&self->cache, viewer_cache_free);
+	g_clear_pointer (&self->files, g_ptr_array_unref);
+	g_clear_object (&self->directory);
 	g_clear_object (&self->file);
 	g_clear_object (&self->pixbuf);
+	g_clear_pointer (&self->source, viewer_source_free);
+	g_clear_pointer (&self->surface, cairo_surface_destroy);
 	viewer_document_window_settings_save (self);
 }
 
@@ -315,15 +460,37 @@ viewer_document_window_dispose (GObject *self)
 
 /*******************************************************************************
 * @brief 領域を描画します。
+* 画像を変換したサーフィスか、タイル化した画像の表示範囲を描画します。
+* ピンチ操作中は変換済みのサーフィスを最近傍補間で拡大縮小するだけにします。
 */
 static void
 viewer_document_window_draw (GtkDrawingArea *area, cairo_t *cairo, int width, int height, gpointer user_data)
 {
 	ViewerDocumentWindow *self;
 	double zoom;
+	int source_width, source_height;
 	self = VIEWER_DOCUMENT_WINDOW (user_data);
 
-	if (self->pixbuf)
+	if (self->surface)
+	{
+		share_pixbuf_get_source_size (self->pixbuf, &source_width, &source_height);
+
+		if ((self->zoom != ZOOM_PROPERTY_DEFAULT_VALUE) || (source_width != gdk_pixbuf_get_width (self->pixbuf)))
+		{
+			zoom = viewer_document_window_get_zoom_percent (self);
+			cairo_scale (cairo, zoom * source_width / gdk_pixbuf_get_width (self->pixbuf), zoom * source_height / gdk_pixbuf_get_height (self->pixbuf));
+		}
+
+		cairo_set_source_surface (cairo, self->surface, 0, 0);
+
+		if (self->zooming)
+		{
+			cairo_pattern_set_filter (cairo_get_source (cairo), CAIRO_FILTER_FAST);
+		}
+
+		cairo_paint (cairo);
+	}
+	else if (self->source)
 	{
 		if (self->zoom != ZOOM_PROPERTY_DEFAULT_VALUE)
 		{
@@ -331,8 +498,22 @@ viewer_document_window_draw (GtkDrawingArea *area, cairo_t *cairo, int width, in
 			cairo_scale (cairo, zoom, zoom);
 		}
 
-		gdk_cairo_set_source_pixbuf (cairo, self->pixbuf, 0, 0);
-		cairo_paint (cairo);
+		viewer_source_paint (self->source, self->area, cairo);
+	}
+}
+
+/*******************************************************************************
+* @brief アクションを有効または無効にします。
+*/
+static void
+viewer_document_window_enable_action (GActionMap *self, const char *name, gboolean enabled)
+{
+	GAction *action;
+	action = g_action_map_lookup_action (self, name);
+
+	if (G_IS_SIMPLE_ACTION (action))
+	{
+		g_simple_action_set_enabled (G_SIMPLE_ACTION (action), enabled);
 	}
 }
 
@@ -378,6 +559,18 @@ viewer_document_window_get_pixbuf (ViewerDocumentWindow *self)
 	return pixbuf ? g_object_ref (pixbuf) : NULL;
 }
 
+/*******************************************************************************
+* @brief 現在の拡大率で表示するのに必要な縮小率を取得します。
+* @return 元の大きさで表示する場合は 1。
+*/
+static double
+viewer_document_window_get_load_scale (ViewerDocumentWindow *self)
+{
+	double scale;
+	scale = viewer_document_window_get_zoom_percent (self) * gtk_widget_get_scale_factor (self->area);
+	return MIN (scale, 1);
+}
+
 /*******************************************************************************
 * @brief プロパティを取得します。
 */
@@ -422,12 +615,34 @@ viewer_document_window_get_zoom_percent (ViewerDocumentWindow *self)
 	return self->zoom / (float) ZOOM_PROPERTY_DEFAULT_VALUE;
 }
 
+/*******************************************************************************
+* @brief 同じディレクトリ内の画像ファイルを開きます。
+* @param offset 現在の画像ファイルからの位置。
+*/
+static void
+viewer_document_window_go (ViewerDocumentWindow *self, int offset)
+{
+	int index;
+
+	if (self->files && (self->index >= 0))
+	{
+		index = self->index + offset;
+
+		if ((index >= 0) && (index < (int) self->files->len))
+		{
+			viewer_document_window_load (self, g_ptr_array_index (self->files, index));
+		}
+	}
+}
+
 /*******************************************************************************
 * @brief クラスのインスタンスを初期化します。
 */
 static void
 viewer_document_window_init (ViewerDocumentWindow *self)
 {
+	self->cache = viewer_cache_new ();
+	self->index = -1;
 	self->zoom = ZOOM_PROPERTY_DEFAULT_VALUE;
 	viewer_document_window_init_actions (G_ACTION_MAP (self));
 	viewer_document_window_init_content (self);
@@ -474,6 +689,7 @@ viewer_document_window_init_content (ViewerDocumentWindow *self)
 	gesture = gtk_gesture_zoom_new ();
 	g_signal_connect (gesture, SIGNAL_BEGIN, G_CALLBACK (viewer_document_window_zoom_begin), self);
 	g_signal_connect (gesture, SIGNAL_SCALE_CHANGED, G_CALLBACK (viewer_document_window_zoom_changed), self);
+	g_signal_connect (gesture, SIGNAL_END, G_CALLBACK (viewer_document_window_zoom_end), self);
 	gtk_widget_add_controller (content, GTK_EVENT_CONTROLLER (gesture));
 }
 
@@ -496,6 +712,91 @@ viewer_document_window_new (GApplication *application)
 	return g_object_new (VIEWER_TYPE_DOCUMENT_WINDOW, PROPERTY_APPLICATION, application, PROPERTY_SHOW_MENUBAR, TRUE, NULL);
 }
 
+/*******************************************************************************
+* @brief 画像ファイルを開きます。
+* キャッシュにない画像ファイルは非同期に読み込み、復号した部分から順に表示します。
+* 全体を復号すると大きすぎる画像はタイル化して表示範囲だけを復号します。
+* 先読み中の画像ファイルは読み込み直さずに先読みの完了を待ちます。
+* 読み込み中の画像ファイルがある場合は取り消します。
+*/
+void
+viewer_document_window_load (ViewerDocumentWindow *self, GFile *file)
+{
+	GdkPixbuf *pixbuf;
+
+	if (self->cancellable)
+	{
+		g_cancellable_cancel (self->cancellable);
+		g_clear_object (&self->cancellable);
+	}
+
+	pixbuf = viewer_cache_lookup (self->cache, file);
+
+	if (pixbuf)
+	{
+		viewer_document_window_set_busy (self, FALSE);
+		viewer_document_window_set_file (self, file);
+		viewer_document_window_set_pixbuf (self, pixbuf);
+		viewer_document_window_update_files (self);
+		viewer_document_window_update_scale (self);
+		g_object_unref (pixbuf);
+	}
+	else
+	{
+		self->cancellable = g_cancellable_new ();
+		viewer_document_window_set_busy (self, TRUE);
+
+		if (viewer_cache_is_loading (self->cache, file))
+		{
+			viewer_cache_lookup_async (self->cache, file, self->cancellable, viewer_document_window_respond_cache, g_object_ref (self));
+		}
+		else
+		{
+			viewer_source_open_async (file, self->cancellable, viewer_document_window_respond_source, g_object_ref (self));
+		}
+	}
+}
+
+/*******************************************************************************
+* @brief 現在の画像ファイルの前後を先読みします。
+*/
+static void
+viewer_document_window_prefetch (ViewerDocumentWindow *self)
+{
+	GFile *files [PREFETCH_AHEAD + PREFETCH_BEHIND];
+	int n, n_files, index;
+	n_files = 0;
+
+	for (n = -PREFETCH_BEHIND; n <= PREFETCH_AHEAD; n++)
+	{
+		index = self->index + n;
+
+		if (n && (index >= 0) && (index < (int) self->files->len))
+		{
+			files [n_files++] = g_ptr_array_index (self->files, index);
+		}
+	}
+
+	viewer_cache_prefetch (self->cache, files, n_files, viewer_document_window_get_load_scale (self));
+}
+
+/*******************************************************************************
+* @brief 画像を印刷します。
+*/
+static void
+viewer_document_window_print (ViewerDocumentWindow *self, GdkPixbuf *pixbuf)
+{
+	GError *error;
+	error = NULL;
+	share_print_operation_run (GTK_WINDOW (self), pixbuf, &error);
+
+	if (error)
+	{
+		share_alert_dialog_show (GTK_WINDOW (self), error);
+		g_error_free (error);
+	}
+}
+
 /*******************************************************************************
 * @brief ウィンドウを表示します。
 */
@@ -507,36 +808,220 @@ viewer_document_window_realize (GtkWidget *self)
 }
 
 /*******************************************************************************
-* @brief 指定したファイルを開きます。
+* @brief 先読みの完了を待ちました。
 */
 static void
-viewer_document_window_respond_open (GObject *dialog, GAsyncResult *result, gpointer user_data)
+viewer_document_window_respond_cache (GObject *file, GAsyncResult *result, gpointer user_data)
 {
 	GError *error;
-	GFile *file;
 	GdkPixbuf *pixbuf;
+	error = NULL;
+	pixbuf = viewer_cache_lookup_finish (result, &error);
+	viewer_document_window_complete_load (VIEWER_DOCUMENT_WINDOW (user_data), G_FILE (file), pixbuf, error);
+}
+
+/*******************************************************************************
+* @brief タイル化した画像の復号に失敗しました。
+*/
+static void
+viewer_document_window_respond_error (const GError *error, gpointer user_data)
+{
+	share_alert_dialog_show (GTK_WINDOW (user_data), error);
+}
+
+/*******************************************************************************
+* @brief 選択したフォルダーをギャラリー ウィンドウで表示します。
+*/
+static void
+viewer_document_window_respond_folder (GObject *dialog, GAsyncResult *result, gpointer user_data)
+{
+	GFile *directory;
+	GtkWidget *gallery;
+	directory = gtk_file_dialog_select_folder_finish (GTK_FILE_DIALOG (dialog), result, NULL);
+
+	if (directory)
+	{
+		gallery = viewer_gallery_window_new (G_APPLICATION (gtk_window_get_application (GTK_WINDOW (user_data))));
+		viewer_gallery_window_set_directory (VIEWER_GALLERY_WINDOW (gallery), directory);
+		gtk_window_present (GTK_WINDOW (gallery));
+		g_object_unref (directory);
+	}
+}
+
+/*******************************************************************************
+* @brief ディレクトリの列挙を完了しました。
+*/
+static void
+viewer_document_window_respond_list (GObject *directory, GAsyncResult *result, gpointer user_data)
+{
+	GError *error;
+	GPtrArray *files;
 	ViewerDocumentWindow *self;
+	error = NULL;
+	self = VIEWER_DOCUMENT_WINDOW (user_data);
+	files = share_directory_list_images_finish (result, &error);
+
+	if (files)
+	{
+		g_clear_object (&self->listing);
+		g_clear_pointer (&self->files, g_ptr_array_unref);
+		g_set_object (&self->directory, G_FILE (directory));
+		self->files = files;
+		viewer_document_window_update_files (self);
+	}
+	else if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		g_clear_object (&self->listing);
+	}
+	if (error)
+	{
+		g_error_free (error);
+	}
+
+	g_object_unref (self);
+}
+
+/*******************************************************************************
+* @brief 読み込みを完了しました。
+*/
+static void
+viewer_document_window_respond_load (GObject *file, GAsyncResult *result, gpointer user_data)
+{
+	GError *error;
+	GdkPixbuf *pixbuf;
+	error = NULL;
+	pixbuf = share_pixbuf_load_finish (result, &error);
+	viewer_document_window_complete_load (VIEWER_DOCUMENT_WINDOW (user_data), G_FILE (file), pixbuf, error);
+}
+
+/*******************************************************************************
+* @brief 指定したファイルを開きます。
+*/
+static void
+viewer_document_window_respond_open (GObject *dialog, GAsyncResult *result, gpointer user_data)
+{
+	GFile *file;
 	file = gtk_file_dialog_open_finish (GTK_FILE_DIALOG (dialog), result, NULL);
 
 	if (file)
 	{
-		error = NULL;
-		self = VIEWER_DOCUMENT_WINDOW (user_data);
-		pixbuf = share_pixbuf_create_from_file (file, &error);
-		viewer_document_window_set_file (self, pixbuf ? file : NULL);
-		viewer_document_window_set_pixbuf (self, pixbuf);
+		viewer_document_window_load (VIEWER_DOCUMENT_WINDOW (user_data), file);
 		g_object_unref (file);
+	}
+}
+
+/*******************************************************************************
+* @brief 印刷する画像の読み込みを完了しました。
+* 取り消した読み込みの結果は破棄します。
+*/
+static void
+viewer_document_window_respond_print (GObject *file, GAsyncResult *result, gpointer user_data)
+{
+	GError *error;
+	GdkPixbuf *pixbuf;
+	ViewerDocumentWindow *self;
+	error = NULL;
+	self = VIEWER_DOCUMENT_WINDOW (user_data);
+	pixbuf = share_pixbuf_load_finish (result, &error);
+
+	if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		g_clear_object (&self->printing);
+		viewer_document_window_set_busy (self, self->cancellable != NULL);
 
 		if (pixbuf)
 		{
-			g_object_unref (pixbuf);
+			viewer_document_window_print (self, pixbuf);
 		}
 		if (error)
 		{
 			share_alert_dialog_show (GTK_WINDOW (self), error);
-			g_error_free (error);
 		}
 	}
+	if (pixbuf)
+	{
+		g_object_unref (pixbuf);
+	}
+	if (error)
+	{
+		g_error_free (error);
+	}
+
+	g_object_unref (self);
+}
+
+/*******************************************************************************
+* @brief 画像の一部を復号しました。
+* 最初の通知で画像を設定し、以降は復号した範囲だけを変換します。
+*/
+static void
+viewer_document_window_respond_progress (GdkPixbuf *pixbuf, const cairo_rectangle_int_t *area, gpointer user_data)
+{
+	ViewerDocumentWindow *self;
+	self = VIEWER_DOCUMENT_WINDOW (user_data);
+
+	if (self->pixbuf != pixbuf)
+	{
+		viewer_document_window_set_pixbuf (self, pixbuf);
+	}
+	else if (self->surface)
+	{
+		share_surface_load_area (self->surface, pixbuf, area);
+		gtk_widget_queue_draw (self->area);
+	}
+}
+
+/*******************************************************************************
+* @brief 画像ファイルの大きさを調べました。
+* タイル化した場合はそのまま表示し、タイル化しない場合は全体を読み込みます。
+*/
+static void
+viewer_document_window_respond_source (GObject *file, GAsyncResult *result, gpointer user_data)
+{
+	GError *error;
+	ViewerDocumentWindow *self;
+	ViewerSource *source;
+	error = NULL;
+	self = VIEWER_DOCUMENT_WINDOW (user_data);
+	source = viewer_source_open_finish (result, &error);
+
+	if (source)
+	{
+		g_clear_object (&self->cancellable);
+		viewer_document_window_set_busy (self, FALSE);
+		viewer_document_window_set_file (self, G_FILE (file));
+		viewer_document_window_set_source (self, source);
+		viewer_document_window_update_files (self);
+	}
+	else if (error)
+	{
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		{
+			g_clear_object (&self->cancellable);
+			viewer_document_window_set_busy (self, FALSE);
+			viewer_document_window_set_file (self, NULL);
+			viewer_document_window_set_pixbuf (self, NULL);
+			share_alert_dialog_show (GTK_WINDOW (self), error);
+		}
+
+		g_error_free (error);
+	}
+	else
+	{
+		share_pixbuf_load_async (G_FILE (file), viewer_document_window_get_load_scale (self), self->cancellable, viewer_document_window_respond_progress, viewer_document_window_respond_load, g_object_ref (self));
+	}
+
+	g_object_unref (self);
+}
+
+/*******************************************************************************
+* @brief 読み込み中かどうかをカーソルで表示します。
+* 印刷する画像を読み込んでいる間は読み込み中として表示します。
+*/
+static void
+viewer_document_window_set_busy (ViewerDocumentWindow *self, gboolean busy)
+{
+	gtk_widget_set_cursor_from_name (GTK_WIDGET (self), (busy || self->printing) ? CURSOR_BUSY : NULL);
 }
 
 /*******************************************************************************
@@ -584,15 +1069,17 @@ viewer_document_window_set_maximized (ViewerDocumentWindow *self, gboolean maxim
 
 /*******************************************************************************
 * @brief 画像を設定します。
-* 描画領域を更新します。
+* 描画用のサーフィスと描画領域を更新します。
 */
 void
 viewer_document_window_set_pixbuf (ViewerDocumentWindow *self, GdkPixbuf *pixbuf)
 {
 	gboolean enabled;
 
-	if (self->pixbuf != pixbuf)
+	if ((self->pixbuf != pixbuf) || self->source)
 	{
+		g_clear_pointer (&self->source, viewer_source_free);
+
 		if (self->pixbuf)
 		{
 			g_object_unref (self->pixbuf);
@@ -609,6 +1096,7 @@ viewer_document_window_set_pixbuf (ViewerDocumentWindow *self, GdkPixbuf *pixbuf
 		}
 
 		viewer_document_window_enable_actions (G_ACTION_MAP (self), enabled);
+		viewer_document_window_update_surface (self);
 		viewer_document_window_update_area (self);
 		gtk_widget_queue_draw (self->area);
 	}
@@ -640,6 +1128,28 @@ viewer_document_window_set_property (GObject *self, guint property_id, const GVa
 	}
 }
 
+/*******************************************************************************
+* @brief タイル化した画像を設定します。
+* タイル化した画像は全体を復号しないため、印刷できません。
+* @param source 所有権を受け取ります。
+*/
+static void
+viewer_document_window_set_source (ViewerDocumentWindow *self, ViewerSource *source)
+{
+	viewer_document_window_set_pixbuf (self, NULL);
+	self->source = source;
+
+	if (source)
+	{
+		viewer_source_set_error_func (source, viewer_document_window_respond_error, self);
+	}
+
+	viewer_document_window_enable_actions (G_ACTION_MAP (self), source != NULL);
+	viewer_document_window_enable_action (G_ACTION_MAP (self), ACTION_PRINT, FALSE);
+	viewer_document_window_update_area (self);
+	gtk_widget_queue_draw (self->area);
+}
+
 /*******************************************************************************
 * @brief 拡大率を設定します。
 */
@@ -654,6 +1164,11 @@ viewer_document_window_set_zoom (ViewerDocumentWindow *self, int zoom)
 		viewer_document_window_update_title (self);
 		viewer_document_window_update_area (self);
 		gtk_widget_queue_draw (self->area);
+
+		if (!self->zooming)
+		{
+			viewer_document_window_update_scale (self);
+		}
 	}
 }
 
@@ -675,6 +1190,7 @@ viewer_document_window_settings_apply (ViewerDocumentWindow *self)
 	GtkWindow *window;
 	window = GTK_WINDOW (self);
 	gtk_window_set_default_size (window, self->width, self->height);
+	viewer_cache_set_limit (self->cache, (gsize) self->cache_limit << 20);
 
 	if (self->maximized)
 	{
@@ -692,6 +1208,7 @@ viewer_document_window_settings_load (ViewerDocumentWindow *self)
 	settings = viewer_get_settings ();
 	self->width = g_settings_get_int (settings, SETTINGS_WIDTH);
 	self->height = g_settings_get_int (settings, SETTINGS_HEIGHT);
+	self->cache_limit = g_settings_get_int (settings, SETTINGS_CACHE_LIMIT);
 	self->maximized = g_settings_get_boolean (settings, SETTINGS_MAXIMIZED);
 	g_object_unref (settings);
 }
@@ -778,8 +1295,7 @@ viewer_document_window_update_area (ViewerDocumentWindow *self)
 
 	if (self->pixbuf)
 	{
-		width = gdk_pixbuf_get_width (self->pixbuf);
-		height = gdk_pixbuf_get_height (self->pixbuf);
+		share_pixbuf_get_source_size (self->pixbuf, &width, &height);
 
 		if (self->zoom != ZOOM_PROPERTY_DEFAULT_VALUE)
 		{
@@ -788,6 +1304,12 @@ viewer_document_window_update_area (ViewerDocumentWindow *self)
 			height *= zoom;
 		}
 	}
+	else if (self->source)
+	{
+		zoom = viewer_document_window_get_zoom_percent (self);
+		width = viewer_source_get_width (self->source) * zoom;
+		height = viewer_source_get_height (self->source) * zoom;
+	}
 	else
 	{
 		width = 0;
@@ -799,6 +1321,71 @@ viewer_document_window_update_area (ViewerDocumentWindow *self)
 	gtk_drawing_area_set_content_height (area, height);
 }
 
+/*******************************************************************************
+* @brief 現在の画像ファイルの位置を更新し、前後を先読みします。
+* 別のディレクトリの画像ファイルを開いた場合はディレクトリを列挙し直します。
+*/
+static void
+viewer_document_window_update_files (ViewerDocumentWindow *self)
+{
+	GFile *directory;
+	guint index;
+
+	if (self->file)
+	{
+		directory = g_file_get_parent (self->file);
+
+		if (self->directory && directory && g_file_equal (self->directory, directory))
+		{
+			if (g_ptr_array_find_with_equal_func (self->files, self->file, (GEqualFunc) g_file_equal, &index))
+			{
+				self->index = index;
+				viewer_document_window_prefetch (self);
+			}
+			else
+			{
+				self->index = -1;
+			}
+		}
+		else if (directory)
+		{
+			if (self->listing)
+			{
+				g_cancellable_cancel (self->listing);
+				g_object_unref (self->listing);
+			}
+
+			self->index = -1;
+			self->listing = g_cancellable_new ();
+			share_directory_list_images_async (directory, self->listing, viewer_document_window_respond_list, g_object_ref (self));
+		}
+
+		g_clear_object (&directory);
+	}
+}
+
+/*******************************************************************************
+* @brief 縮小して読み込んだ画像では解像度が足りない場合は元の大きさで読み込み直します。
+* 読み込み直す間は縮小した画像を表示し続けます。
+*/
+static void
+viewer_document_window_update_scale (ViewerDocumentWindow *self)
+{
+	int width, height;
+
+	if (self->file && self->pixbuf && !self->cancellable)
+	{
+		share_pixbuf_get_source_size (self->pixbuf, &width, &height);
+
+		if (gdk_pixbuf_get_width (self->pixbuf) < width * viewer_document_window_get_load_scale (self))
+		{
+			self->cancellable = g_cancellable_new ();
+			viewer_document_window_set_busy (self, TRUE);
+			share_pixbuf_load_async (self->file, 1, self->cancellable, NULL, viewer_document_window_respond_load, g_object_ref (self));
+		}
+	}
+}
+
 /*******************************************************************************
 * @brief ウィンドウの大きさを更新します。
 */
@@ -811,6 +1398,22 @@ viewer_document_window_update_size (ViewerDocumentWindow *self)
 	}
 }
 
+/*******************************************************************************
+* @brief 画像を乗算済みアルファのサーフィスに変換します。
+* 描画のたびに画像を変換しないよう、画像を変更したときだけ変換します。
+*/
+static void
+viewer_document_window_update_surface (ViewerDocumentWindow *self)
+{
+	g_clear_pointer (&self->surface, cairo_surface_destroy);
+
+	if (self->pixbuf)
+	{
+		self->surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, gdk_pixbuf_get_width (self->pixbuf), gdk_pixbuf_get_height (self->pixbuf));
+		share_surface_load (self->surface, self->pixbuf);
+	}
+}
+
 /*******************************************************************************
 * @brief ウィンドウ タイトルを更新します。
 */
@@ -854,13 +1457,57 @@ viewer_document_window_zoom_begin (GtkGesture *gesture, GdkEventSequence *sequen
 }
 
 /*******************************************************************************
-* @brief 拡大率を変更します。
+* @brief 拡大率の変更を予約します。
+* 変更は次のフレームの更新でまとめて適用します。
 */
 static void
 viewer_document_window_zoom_changed (GtkGestureZoom *zoom, double scale, gpointer user_data)
 {
 	ViewerDocumentWindow *self;
 	self = VIEWER_DOCUMENT_WINDOW (user_data);
-	scale *= self->scale;
-	viewer_document_window_set_zoom_percent (self, scale);
+	self->target = scale * self->scale;
+	self->zooming = TRUE;
+
+	if (!self->tick)
+	{
+		self->tick = gtk_widget_add_tick_callback (self->area, viewer_document_window_zoom_tick, self, NULL);
+	}
+}
+
+/*******************************************************************************
+* @brief ピンチ操作を終了します。
+* 予約した拡大率を適用し、元の画質で描画し直します。
+*/
+static void
+viewer_document_window_zoom_end (GtkGesture *gesture, GdkEventSequence *sequence, gpointer user_data)
+{
+	ViewerDocumentWindow *self;
+	self = VIEWER_DOCUMENT_WINDOW (user_data);
+
+	if (self->zooming)
+	{
+		if (self->tick)
+		{
+			gtk_widget_remove_tick_callback (self->area, self->tick);
+			self->tick = 0;
+		}
+
+		self->zooming = FALSE;
+		viewer_document_window_set_zoom_percent (self, self->target);
+		viewer_document_window_update_scale (self);
+		gtk_widget_queue_draw (self->area);
+	}
+}
+
+/*******************************************************************************
+* @brief フレームの更新で予約した拡大率を適用します。
+*/
+static gboolean
+viewer_document_window_zoom_tick (GtkWidget *area, GdkFrameClock *clock, gpointer user_data)
+{
+	ViewerDocumentWindow *self;
+	self = VIEWER_DOCUMENT_WINDOW (user_data);
+	self->tick = 0;
+	viewer_document_window_set_zoom_percent (self, self->target);
+	return G_SOURCE_REMOVE;
 }
@@ -0,0 +1,388 @@
+/* Copyright (C) 2025 Taichi Murakami. */
+#include <gtk/gtk.h>
+#include <glib/gi18n.h>
+#include "viewer.h"
+#include "share.h"
+#define CELL_LABEL_CCH        16
+#define CELL_SIZE             128
+#define DATA_CANCELLABLE      "viewer-gallery-cancellable"
+#define DIRECTORY_ATTRIBUTES  G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME "," G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE "," G_FILE_ATTRIBUTE_TIME_MODIFIED
+#define FILE_ATTRIBUTE        "standard::file"
+#define FILTER_IMAGE          "image/*"
+#define LOGO_ICON_NAME        "viewer"
+#define PROPERTY_APPLICATION  "application"
+#define PROPERTY_SHOW_MENUBAR "show-menubar"
+#define SIGNAL_ACTIVATE       "activate"
+#define SIGNAL_BIND           "bind"
+#define SIGNAL_SETUP          "setup"
+#define SIGNAL_UNBIND         "unbind"
+#define TITLE                 _("Picture Viewer")
+#define TITLE_CCH             256
+#define TITLE_FORMAT          "%s - %s"
+#define WINDOW_HEIGHT         600
+#define WINDOW_WIDTH          800
+
+/* クラスのインスタンス */
+struct _ViewerGalleryWindow
+{
+	GtkApplicationWindow parent_instance;
+	GFile               *directory;
+	GtkDirectoryList    *list;
+	GListModel          *model;
+	ViewerThumbnailer   *thumbnailer;
+};
+
+static void     viewer_gallery_window_activate             (GtkGridView *view, guint position, gpointer user_data);
+static void     viewer_gallery_window_activate_about       (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void     viewer_gallery_window_activate_open        (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void     viewer_gallery_window_activate_open_folder (GSimpleAction *action, GVariant *parameter, gpointer user_data);
+static void     viewer_gallery_window_bind                 (GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data);
+static void     viewer_gallery_window_cancel               (gpointer data);
+static void     viewer_gallery_window_class_init           (ViewerGalleryWindowClass *this_class);
+static void     viewer_gallery_window_dispose              (GObject *self);
+static gboolean viewer_gallery_window_filter               (gpointer item, gpointer user_data);
+static char    *viewer_gallery_window_get_name             (GFileInfo *info);
+static void     viewer_gallery_window_init                 (ViewerGalleryWindow *self);
+static void     viewer_gallery_window_init_content         (ViewerGalleryWindow *self);
+static void     viewer_gallery_window_open                 (ViewerGalleryWindow *self, GFile *file);
+static void     viewer_gallery_window_respond_folder       (GObject *dialog, GAsyncResult *result, gpointer user_data);
+static void     viewer_gallery_window_respond_open         (GObject *dialog, GAsyncResult *result, gpointer user_data);
+static void     viewer_gallery_window_respond_thumbnail    (GObject *file, GAsyncResult *result, gpointer user_data);
+static void     viewer_gallery_window_setup                (GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data);
+static void     viewer_gallery_window_unbind               (GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data);
+static void     viewer_gallery_window_update_title         (ViewerGalleryWindow *self);
+
+/*******************************************************************************
+* Viewer Gallery Window クラス:
+* フォルダー内の画像ファイルをサムネイルの一覧で表示するウィンドウを表します。
+* 一覧は表示しているセルだけを作成し、サムネイルは表示したセルから順に作成します。
+* 一覧の画像ファイルを開くとドキュメント ウィンドウで表示します。
+*/
+G_DEFINE_FINAL_TYPE (ViewerGalleryWindow, viewer_gallery_window, GTK_TYPE_APPLICATION_WINDOW);
+
+/* メニュー アクション */
+static const GActionEntry
+ACTION_ENTRIES [] =
+{
+	{ "show-about",  viewer_gallery_window_activate_about,       NULL, NULL, NULL },
+	{ "open",        viewer_gallery_window_activate_open,        NULL, NULL, NULL },
+	{ "open-folder", viewer_gallery_window_activate_open_folder, NULL, NULL, NULL },
+};
+
+/*******************************************************************************
+* @brief 選択した画像ファイルを開きます。
+*/
+static void
+viewer_gallery_window_activate (GtkGridView *view, guint position, gpointer user_data)
+{
+	ViewerGalleryWindow *self;
+	GFileInfo *info;
+	self = VIEWER_GALLERY_WINDOW (user_data);
+	info = g_list_model_get_item (self->model, position);
+
+	if (info)
+	{
+		viewer_gallery_window_open (self, G_FILE (g_file_info_get_attribute_object (info, FILE_ATTRIBUTE)));
+		g_object_unref (info);
+	}
+}
+
+/*******************************************************************************
+* @brief バージョン情報ダイアログを表示します。
+*/
+static void
+viewer_gallery_window_activate_about (GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	share_about_dialog_show (GTK_WINDOW (user_data), TITLE, LOGO_ICON_NAME);
+}
+
+/*******************************************************************************
+* @brief ファイルを開くダイアログを表示します。
+*/
+static void
+viewer_gallery_window_activate_open (GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	share_file_dialog_open (GTK_WINDOW (user_data), NULL, viewer_gallery_window_respond_open, user_data, SHARE_FILE_FILTER_ALL | SHARE_FILE_FILTER_IMAGE);
+}
+
+/*******************************************************************************
+* @brief フォルダーを選択するダイアログを表示します。
+*/
+static void
+viewer_gallery_window_activate_open_folder (GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+	ViewerGalleryWindow *self;
+	self = VIEWER_GALLERY_WINDOW (user_data);
+	share_file_dialog_select_folder (GTK_WINDOW (self), self->directory, viewer_gallery_window_respond_folder, self);
+}
+
+/*******************************************************************************
+* @brief セルに画像ファイルを割り当てます。
+* サムネイルの作成を要求します。
+*/
+static void
+viewer_gallery_window_bind (GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data)
+{
+	ViewerGalleryWindow *self;
+	GCancellable *cancellable;
+	GDateTime *time;
+	GFileInfo *info;
+	GtkWidget *picture, *label;
+	gint64 mtime;
+	self = VIEWER_GALLERY_WINDOW (user_data);
+	info = G_FILE_INFO (gtk_list_item_get_item (item));
+	picture = gtk_widget_get_first_child (gtk_list_item_get_child (item));
+	label = gtk_widget_get_next_sibling (picture);
+	gtk_label_set_text (GTK_LABEL (label), g_file_info_get_display_name (info));
+	gtk_picture_set_paintable (GTK_PICTURE (picture), NULL);
+	time = g_file_info_get_modification_date_time (info);
+	mtime = time ? g_date_time_to_unix (time) : 0;
+	cancellable = g_cancellable_new ();
+	g_object_set_data_full (G_OBJECT (item), DATA_CANCELLABLE, cancellable, viewer_gallery_window_cancel);
+	viewer_thumbnailer_load_async (self->thumbnailer, G_FILE (g_file_info_get_attribute_object (info, FILE_ATTRIBUTE)), mtime, cancellable, viewer_gallery_window_respond_thumbnail, g_object_ref (picture));
+
+	if (time)
+	{
+		g_date_time_unref (time);
+	}
+}
+
+/*******************************************************************************
+* @brief サムネイルの作成を取り消します。
+*/
+static void
+viewer_gallery_window_cancel (gpointer data)
+{
+	g_cancellable_cancel (G_CANCELLABLE (data));
+	g_object_unref (data);
+}
+
+/*******************************************************************************
+* @brief クラスを初期化します。
+*/
+static void
+viewer_gallery_window_class_init (ViewerGalleryWindowClass *this_class)
+{
+	G_OBJECT_CLASS (this_class)->dispose = viewer_gallery_window_dispose;
+}
+
+/*******************************************************************************
+* @brief クラスのインスタンスを破棄します。
+*/
+static void
+viewer_gallery_window_dispose (GObject *self)
+{
+	ViewerGalleryWindow *properties;
+	properties = VIEWER_GALLERY_WINDOW (self);
+	g_clear_pointer (&properties->thumbnailer, viewer_thumbnailer_free);
+	g_clear_object (&properties->directory);
+	G_OBJECT_CLASS (viewer_gallery_window_parent_class)->dispose (self);
+}
+
+/*******************************************************************************
+* @brief 画像ファイルだけを一覧に表示します。
+*/
+static gboolean
+viewer_gallery_window_filter (gpointer item, gpointer user_data)
+{
+	const char *type;
+	type = g_file_info_get_content_type (G_FILE_INFO (item));
+	return type && g_content_type_is_mime_type (type, FILTER_IMAGE);
+}
+
+/*******************************************************************************
+* @brief 並べ替えに使用する表示名を取得します。
+*/
+static char *
+viewer_gallery_window_get_name (GFileInfo *info)
+{
+	return g_strdup (g_file_info_get_display_name (info));
+}
+
+/*******************************************************************************
+* @brief クラスのインスタンスを初期化します。
+*/
+static void
+viewer_gallery_window_init (ViewerGalleryWindow *self)
+{
+	self->thumbnailer = viewer_thumbnailer_new ();
+	g_action_map_add_action_entries (G_ACTION_MAP (self), ACTION_ENTRIES, G_N_ELEMENTS (ACTION_ENTRIES), self);
+	gtk_window_set_default_size (GTK_WINDOW (self), WINDOW_WIDTH, WINDOW_HEIGHT);
+	viewer_gallery_window_init_content (self);
+	viewer_gallery_window_update_title (self);
+}
+
+/*******************************************************************************
+* @brief 内容を作成します。
+* ディレクトリの列挙、絞り込み、並べ替えは少しずつ進め、列挙した分から表示します。
+*/
+static void
+viewer_gallery_window_init_content (ViewerGalleryWindow *self)
+{
+	GtkFilterListModel *filtered;
+	GtkListItemFactory *factory;
+	GtkSortListModel *sorted;
+	GtkStringSorter *sorter;
+	GtkWidget *content, *view;
+	self->list = gtk_directory_list_new (DIRECTORY_ATTRIBUTES, NULL);
+	gtk_directory_list_set_io_priority (self->list, G_PRIORITY_LOW);
+	filtered = gtk_filter_list_model_new (G_LIST_MODEL (self->list), GTK_FILTER (gtk_custom_filter_new (viewer_gallery_window_filter, NULL, NULL)));
+	gtk_filter_list_model_set_incremental (filtered, TRUE);
+	sorter = gtk_string_sorter_new (gtk_cclosure_expression_new (G_TYPE_STRING, NULL, 0, NULL, G_CALLBACK (viewer_gallery_window_get_name), NULL, NULL));
+	gtk_string_sorter_set_collation (sorter, GTK_COLLATION_FILENAME);
+	sorted = gtk_sort_list_model_new (G_LIST_MODEL (filtered), GTK_SORTER (sorter));
+	gtk_sort_list_model_set_incremental (sorted, TRUE);
+	self->model = G_LIST_MODEL (sorted);
+	factory = gtk_signal_list_item_factory_new ();
+	g_signal_connect (factory, SIGNAL_SETUP, G_CALLBACK (viewer_gallery_window_setup), self);
+	g_signal_connect (factory, SIGNAL_BIND, G_CALLBACK (viewer_gallery_window_bind), self);
+	g_signal_connect (factory, SIGNAL_UNBIND, G_CALLBACK (viewer_gallery_window_unbind), self);
+	view = gtk_grid_view_new (GTK_SELECTION_MODEL (gtk_no_selection_new (G_LIST_MODEL (sorted))), factory);
+	gtk_grid_view_set_single_click_activate (GTK_GRID_VIEW (view), TRUE);
+	g_signal_connect (view, SIGNAL_ACTIVATE, G_CALLBACK (viewer_gallery_window_activate), self);
+	content = gtk_scrolled_window_new ();
+	gtk_widget_set_hexpand (content, TRUE);
+	gtk_widget_set_vexpand (content, TRUE);
+	gtk_scrolled_window_set_child (GTK_SCROLLED_WINDOW (content), view);
+	gtk_window_set_child (GTK_WINDOW (self), content);
+}
+
+/*******************************************************************************
+* @brief クラスのインスタンスを作成します。
+*/
+GtkWidget *
+viewer_gallery_window_new (GApplication *application)
+{
+	return g_object_new (VIEWER_TYPE_GALLERY_WINDOW, PROPERTY_APPLICATION, application, PROPERTY_SHOW_MENUBAR, TRUE, NULL);
+}
+
+/*******************************************************************************
+* @brief 画像ファイルをドキュメント ウィンドウで開きます。
+*/
+static void
+viewer_gallery_window_open (ViewerGalleryWindow *self, GFile *file)
+{
+	GtkWidget *document;
+	document = viewer_document_window_new (G_APPLICATION (gtk_window_get_application (GTK_WINDOW (self))));
+	viewer_document_window_load (VIEWER_DOCUMENT_WINDOW (document), file);
+	gtk_window_present (GTK_WINDOW (document));
+}
+
+/*******************************************************************************
+* @brief 選択したフォルダーを表示します。
+*/
+static void
+viewer_gallery_window_respond_folder (GObject *dialog, GAsyncResult *result, gpointer user_data)
+{
+	GFile *directory;
+	directory = gtk_file_dialog_select_folder_finish (GTK_FILE_DIALOG (dialog), result, NULL);
+
+	if (directory)
+	{
+		viewer_gallery_window_set_directory (VIEWER_GALLERY_WINDOW (user_data), directory);
+		g_object_unref (directory);
+	}
+}
+
+/*******************************************************************************
+* @brief 指定したファイルを開きます。
+*/
+static void
+viewer_gallery_window_respond_open (GObject *dialog, GAsyncResult *result, gpointer user_data)
+{
+	GFile *file;
+	file = gtk_file_dialog_open_finish (GTK_FILE_DIALOG (dialog), result, NULL);
+
+	if (file)
+	{
+		viewer_gallery_window_open (VIEWER_GALLERY_WINDOW (user_data), file);
+		g_object_unref (file);
+	}
+}
+
+/*******************************************************************************
+* @brief サムネイルを作成しました。
+* 取り消したサムネイルは破棄します。
+*/
+static void
+viewer_gallery_window_respond_thumbnail (GObject *file, GAsyncResult *result, gpointer user_data)
+{
+	GdkPixbuf *pixbuf;
+	GdkTexture *texture;
+	pixbuf = viewer_thumbnailer_load_finish (result, NULL);
+
+	if (pixbuf)
+	{
+		texture = gdk_memory_texture_new (gdk_pixbuf_get_width (pixbuf), gdk_pixbuf_get_height (pixbuf), gdk_pixbuf_get_has_alpha (pixbuf) ? GDK_MEMORY_R8G8B8A8 : GDK_MEMORY_R8G8B8, gdk_pixbuf_read_pixel_bytes (pixbuf), gdk_pixbuf_get_rowstride (pixbuf));
+		gtk_picture_set_paintable (GTK_PICTURE (user_data), GDK_PAINTABLE (texture));
+		g_object_unref (texture);
+		g_object_unref (pixbuf);
+	}
+
+	g_object_unref (user_data);
+}
+
+/*******************************************************************************
+* @brief 表示するフォルダーを設定します。
+* ウィンドウ タイトルを更新します。
+*/
+void
+viewer_gallery_window_set_directory (ViewerGalleryWindow *self, GFile *directory)
+{
+	if (g_set_object (&self->directory, directory))
+	{
+		gtk_directory_list_set_file (self->list, directory);
+		viewer_gallery_window_update_title (self);
+	}
+}
+
+/*******************************************************************************
+* @brief セルを作成します。
+*/
+static void
+viewer_gallery_window_setup (GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data)
+{
+	GtkWidget *box, *picture, *label;
+	box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 0);
+	picture = gtk_picture_new ();
+	gtk_picture_set_content_fit (GTK_PICTURE (picture), GTK_CONTENT_FIT_CONTAIN);
+	gtk_widget_set_size_request (picture, CELL_SIZE, CELL_SIZE);
+	label = gtk_label_new (NULL);
+	gtk_label_set_ellipsize (GTK_LABEL (label), PANGO_ELLIPSIZE_MIDDLE);
+	gtk_label_set_max_width_chars (GTK_LABEL (label), CELL_LABEL_CCH);
+	gtk_box_append (GTK_BOX (box), picture);
+	gtk_box_append (GTK_BOX (box), label);
+	gtk_list_item_set_child (item, box);
+}
+
+/*******************************************************************************
+* @brief セルから画像ファイルを外します。
+* 作成中のサムネイルは取り消します。
+*/
+static void
+viewer_gallery_window_unbind (GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data)
+{
+	g_object_set_data (G_OBJECT (item), DATA_CANCELLABLE, NULL);
+}
+
+/*******************************************************************************
+* @brief ウィンドウ タイトルを更新します。
+*/
+static void
+viewer_gallery_window_update_title (ViewerGalleryWindow *self)
+{
+	char *name;
+	char title [TITLE_CCH];
+
+	if (self->directory)
+	{
+		name = g_file_get_basename (self->directory);
+		g_snprintf (title, TITLE_CCH, TITLE_FORMAT, name, TITLE);
+		gtk_window_set_title (GTK_WINDOW (self), title);
+		g_free (name);
+	}
+	else
+	{
+		gtk_window_set_title (GTK_WINDOW (self), TITLE);
+	}
+}
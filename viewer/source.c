@@ -0,0 +1,754 @@
+/* Copyright (C) 2025 Taichi Murakami. */
+#include <gtk/gtk.h>
+#include <glib/gi18n.h>
+#include <math.h>
+#include <string.h>
+#include "viewer.h"
+#include "share.h"
+#define HEADER_SIZE      256
+#define KEY(level, column, row) (0x80000000U | ((guint) (level) << 26) | ((guint) (row) << 13) | (guint) (column))
+#define KEY_COLUMN(key)  ((int) ((key) & 0x1FFF))
+#define KEY_LEVEL(key)   ((int) (((key) >> 26) & 0x1F))
+#define KEY_ROW(key)     ((int) (((key) >> 13) & 0x1FFF))
+#define SOURCE_MAXIMUM   (TILE_SIZE << 13)
+#define SOURCE_THRESHOLD (64 << 20)
+#define SPOOL_TEMPLATE   "viewer-XXXXXX.spool"
+#define TEXT_TRUNCATED   _("The picture file is truncated")
+#define TILE_LIMIT       256
+#define TILE_SIZE        256
+
+typedef struct _ViewerSourceTile ViewerSourceTile;
+
+/* タイル化した画像 */
+struct _ViewerSource
+{
+	GMutex                mutex;
+	GThreadPool          *pool;
+	GIOStream            *spool;
+	GInputStream         *stream;
+	GSeekable            *seekable;
+	GHashTable           *tiles;
+	GHashTable           *pending;
+	GHashTable           *failed;
+	GQueue               *queue;
+	GSList               *done;
+	GError               *error;
+	GtkWidget            *widget;
+	ViewerSourceErrorFunc error_func;
+	gpointer              error_data;
+	goffset               offset;
+	guint                 idle;
+	int                   channels;
+	int                   maximum;
+	int                   width;
+	int                   height;
+	int                   n_levels;
+	gboolean              reported;
+};
+
+/* 復号したタイル。復号に失敗した場合は surface が NULL。 */
+struct _ViewerSourceTile
+{
+	cairo_surface_t *surface;
+	guint            key;
+};
+
+static gboolean          viewer_source_deliver     (gpointer user_data);
+static void              viewer_source_free_tile   (ViewerSourceTile *tile);
+static int               viewer_source_get_level   (ViewerSource *self, cairo_t *cairo);
+static cairo_surface_t  *viewer_source_lookup      (ViewerSource *self, int level, int column, int row);
+static ViewerSource     *viewer_source_new         (GInputStream *stream, int width, int height);
+static void              viewer_source_open_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+static void              viewer_source_paint_tile  (cairo_t *cairo, cairo_surface_t *tile, int level, int column, int row, int x, int y, int width, int height);
+static gboolean          viewer_source_read_header (GInputStream *stream, int *channels, int *width, int *height, int *maximum, goffset *offset, GCancellable *cancellable);
+static cairo_surface_t  *viewer_source_read_tile   (ViewerSource *self, int level, int column, int row, GError **error);
+static void              viewer_source_request     (ViewerSource *self, int level, int column, int row);
+static ViewerSource     *viewer_source_spool       (GInputStream *stream, GCancellable *cancellable, GError **error);
+static void              viewer_source_thread      (gpointer data, gpointer user_data);
+static void              viewer_source_trim        (ViewerSource *self);
+
+/*******************************************************************************
+* Viewer Source モジュール:
+* 全体を復号すると大きすぎる画像を、表示している範囲のタイルだけ復号して描画します。
+* 非圧縮の PGM/PPM 画像はファイルから必要な行だけを読み取ります。
+* その他の画像は一度だけ復号して ARGB32 の行を一時ファイルに書き出し、以降は一時ファイルから読み取ります。
+* 縮小表示では拡大率に合わせて間引いたタイルを復号します。
+* タイルはワーカー スレッドで復号し、届くまでは粗いタイルを拡大して表示します。
+* 復号に失敗したタイルは依頼し直さずに粗いタイルで代用し、最初の失敗だけを通知します。
+*/
+
+/*******************************************************************************
+* @brief 復号したタイルをメイン スレッドで受け取ります。
+* 復号に失敗したタイルは失敗したタイルとして記録します。
+*/
+static gboolean
+viewer_source_deliver (gpointer user_data)
+{
+	ViewerSource *self;
+	ViewerSourceTile *tile;
+	GError *error;
+	GSList *done, *item;
+	self = user_data;
+	error = NULL;
+	g_mutex_lock (&self->mutex);
+	done = self->done;
+	self->done = NULL;
+	self->idle = 0;
+
+	if (self->error && !self->reported)
+	{
+		error = g_error_copy (self->error);
+		self->reported = TRUE;
+	}
+
+	for (item = done; item; item = item->next)
+	{
+		tile = item->data;
+		g_hash_table_remove (self->pending, GUINT_TO_POINTER (tile->key));
+	}
+
+	g_mutex_unlock (&self->mutex);
+
+	for (item = done; item; item = item->next)
+	{
+		tile = item->data;
+
+		if (!tile->surface)
+		{
+			g_hash_table_add (self->failed, GUINT_TO_POINTER (tile->key));
+			viewer_source_free_tile (tile);
+		}
+		else if (g_hash_table_contains (self->tiles, GUINT_TO_POINTER (tile->key)))
+		{
+			viewer_source_free_tile (tile);
+		}
+		else
+		{
+			g_queue_push_head (self->queue, tile);
+			g_hash_table_insert (self->tiles, GUINT_TO_POINTER (tile->key), self->queue->head);
+		}
+	}
+
+	g_slist_free (done);
+	viewer_source_trim (self);
+
+	if (self->widget)
+	{
+		gtk_widget_queue_draw (self->widget);
+	}
+	if (error)
+	{
+		if (self->error_func)
+		{
+			self->error_func (error, self->error_data);
+		}
+
+		g_error_free (error);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+/*******************************************************************************
+* @brief 破棄します。
+* 復号中のタイルは完了を待ち、復号待ちのタイルは取り消します。
+*/
+void
+viewer_source_free (ViewerSource *self)
+{
+	g_thread_pool_free (self->pool, TRUE, TRUE);
+
+	if (self->idle)
+	{
+		g_source_remove (self->idle);
+	}
+
+	g_slist_free_full (self->done, (GDestroyNotify) viewer_source_free_tile);
+	g_queue_free_full (self->queue, (GDestroyNotify) viewer_source_free_tile);
+	g_hash_table_unref (self->tiles);
+	g_hash_table_unref (self->pending);
+	g_hash_table_unref (self->failed);
+	g_clear_error (&self->error);
+	g_object_unref (self->stream);
+	g_clear_object (&self->spool);
+	g_mutex_clear (&self->mutex);
+	g_free (self);
+}
+
+/*******************************************************************************
+* @brief タイルを破棄します。
+*/
+static void
+viewer_source_free_tile (ViewerSourceTile *tile)
+{
+	cairo_surface_destroy (tile->surface);
+	g_free (tile);
+}
+
+/*******************************************************************************
+* @brief 画像の高さを取得します。
+*/
+int
+viewer_source_get_height (ViewerSource *self)
+{
+	return self->height;
+}
+
+/*******************************************************************************
+* @brief 拡大率に合わせて縮小段階を選択します。
+* @return 0 の場合は元の大きさ。
+*/
+static int
+viewer_source_get_level (ViewerSource *self, cairo_t *cairo)
+{
+	double x, y, scale;
+	int level;
+	x = 1;
+	y = 0;
+	cairo_user_to_device_distance (cairo, &x, &y);
+	scale = hypot (x, y);
+	level = 0;
+
+	while ((level < self->n_levels) && (scale * (2 << level) <= 1))
+	{
+		level++;
+	}
+
+	return level;
+}
+
+/*******************************************************************************
+* @brief 画像の幅を取得します。
+*/
+int
+viewer_source_get_width (ViewerSource *self)
+{
+	return self->width;
+}
+
+/*******************************************************************************
+* @brief 復号済みのタイルを取得します。
+* 取得したタイルは最近使用したタイルとして扱います。
+* @return 復号していない場合は NULL。
+*/
+static cairo_surface_t *
+viewer_source_lookup (ViewerSource *self, int level, int column, int row)
+{
+	GList *link;
+	link = g_hash_table_lookup (self->tiles, GUINT_TO_POINTER (KEY (level, column, row)));
+
+	if (link)
+	{
+		g_queue_unlink (self->queue, link);
+		g_queue_push_head_link (self->queue, link);
+		return ((ViewerSourceTile *) link->data)->surface;
+	}
+
+	return NULL;
+}
+
+/*******************************************************************************
+* @brief 作成します。
+* @param stream 画像の行を読み取るストリーム。所有権を受け取ります。
+*/
+static ViewerSource *
+viewer_source_new (GInputStream *stream, int width, int height)
+{
+	ViewerSource *self;
+	self = g_new0 (ViewerSource, 1);
+	g_mutex_init (&self->mutex);
+	self->pool = g_thread_pool_new (viewer_source_thread, self, 1, FALSE, NULL);
+	self->stream = stream;
+	self->seekable = G_SEEKABLE (stream);
+	self->tiles = g_hash_table_new (g_direct_hash, g_direct_equal);
+	self->pending = g_hash_table_new (g_direct_hash, g_direct_equal);
+	self->failed = g_hash_table_new (g_direct_hash, g_direct_equal);
+	self->queue = g_queue_new ();
+	self->width = width;
+	self->height = height;
+
+	while ((((width - 1) >> self->n_levels) >= TILE_SIZE) || (((height - 1) >> self->n_levels) >= TILE_SIZE))
+	{
+		self->n_levels++;
+	}
+
+	return self;
+}
+
+/*******************************************************************************
+* @brief 画像ファイルをタイル化して開きます。
+* 全体を復号しても問題ない大きさの画像はタイル化しません。
+* @param file 画像ファイル。コールバックの source_object に渡します。
+*/
+void
+viewer_source_open_async (GFile *file, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+	GTask *task;
+	task = g_task_new (file, cancellable, callback, user_data);
+	g_task_set_source_tag (task, viewer_source_open_async);
+	g_task_run_in_thread (task, viewer_source_open_thread);
+	g_object_unref (task);
+}
+
+/*******************************************************************************
+* @brief タイル化して開いた画像を取得します。
+* @return タイル化しない画像の場合や失敗した場合は NULL。
+*/
+ViewerSource *
+viewer_source_open_finish (GAsyncResult *result, GError **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/*******************************************************************************
+* @brief ワーカー スレッドで画像ファイルの大きさを調べ、必要ならタイル化します。
+*/
+static void
+viewer_source_open_thread (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+	GError *error;
+	GFileInputStream *stream;
+	ViewerSource *self;
+	const char *path;
+	goffset offset;
+	int channels, width, height, maximum;
+	error = NULL;
+	self = NULL;
+	stream = g_file_read (G_FILE (source_object), cancellable, &error);
+
+	if (stream)
+	{
+		if (viewer_source_read_header (G_INPUT_STREAM (stream), &channels, &width, &height, &maximum, &offset, cancellable))
+		{
+			if (((gint64) width * height >= SOURCE_THRESHOLD) && (width <= SOURCE_MAXIMUM) && (height <= SOURCE_MAXIMUM))
+			{
+				self = viewer_source_new (G_INPUT_STREAM (g_object_ref (stream)), width, height);
+				self->channels = channels;
+				self->maximum = maximum;
+				self->offset = offset;
+			}
+		}
+		else if ((path = g_file_peek_path (G_FILE (source_object))) && gdk_pixbuf_get_file_info (path, &width, &height))
+		{
+			if (((gint64) width * height >= SOURCE_THRESHOLD) && (width <= SOURCE_MAXIMUM) && (height <= SOURCE_MAXIMUM) && g_seekable_seek (G_SEEKABLE (stream), 0, G_SEEK_SET, cancellable, &error))
+			{
+				self = viewer_source_spool (G_INPUT_STREAM (stream), cancellable, &error);
+			}
+		}
+
+		g_object_unref (stream);
+	}
+	if (error)
+	{
+		g_task_return_error (task, error);
+	}
+	else
+	{
+		g_task_return_pointer (task, self, (GDestroyNotify) viewer_source_free);
+	}
+}
+
+/*******************************************************************************
+* @brief 表示している範囲のタイルを描画します。
+* 復号していないタイルはワーカー スレッドに復号を依頼し、粗いタイルで代用します。
+* 表示範囲から外れたタイルの復号は取り消します。
+* @param widget タイルが届いた時に再描画するウィジェット。
+*/
+void
+viewer_source_paint (ViewerSource *self, GtkWidget *widget, cairo_t *cairo)
+{
+	GHashTableIter iter;
+	cairo_surface_t *tile;
+	gpointer key;
+	double x1, y1, x2, y2;
+	int column, row, column1, row1, column2, row2, level, coarse, size, x, y;
+	cairo_clip_extents (cairo, &x1, &y1, &x2, &y2);
+	x1 = MAX (x1, 0);
+	y1 = MAX (y1, 0);
+	x2 = MIN (x2, self->width);
+	y2 = MIN (y2, self->height);
+	self->widget = widget;
+
+	if ((x1 < x2) && (y1 < y2))
+	{
+		level = viewer_source_get_level (self, cairo);
+		size = TILE_SIZE << level;
+		column1 = (int) x1 / size;
+		row1 = (int) y1 / size;
+		column2 = ((int) ceil (x2) + size - 1) / size;
+		row2 = ((int) ceil (y2) + size - 1) / size;
+		g_mutex_lock (&self->mutex);
+		g_hash_table_iter_init (&iter, self->pending);
+
+		while (g_hash_table_iter_next (&iter, &key, NULL))
+		{
+			x = KEY_COLUMN (GPOINTER_TO_UINT (key));
+			y = KEY_ROW (GPOINTER_TO_UINT (key));
+
+			if ((KEY_LEVEL (GPOINTER_TO_UINT (key)) != self->n_levels) && ((KEY_LEVEL (GPOINTER_TO_UINT (key)) != level) || (x < column1) || (x >= column2) || (y < row1) || (y >= row2)))
+			{
+				g_hash_table_iter_remove (&iter);
+			}
+		}
+
+		g_mutex_unlock (&self->mutex);
+
+		/* 最も粗いタイルを先に用意し、以降の代用に使います。 */
+		if (!viewer_source_lookup (self, self->n_levels, 0, 0))
+		{
+			viewer_source_request (self, self->n_levels, 0, 0);
+		}
+
+		/* 隣り合うタイルの境界に継ぎ目を作りません。 */
+		cairo_save (cairo);
+		cairo_set_antialias (cairo, CAIRO_ANTIALIAS_NONE);
+
+		for (row = row1; row < row2; row++)
+		{
+			for (column = column1; column < column2; column++)
+			{
+				tile = viewer_source_lookup (self, level, column, row);
+				coarse = level;
+
+				if (!tile)
+				{
+					viewer_source_request (self, level, column, row);
+
+					while (!tile && (coarse < self->n_levels))
+					{
+						coarse++;
+						tile = viewer_source_lookup (self, coarse, column >> (coarse - level), row >> (coarse - level));
+					}
+				}
+				if (tile)
+				{
+					x = column * size;
+					y = row * size;
+					viewer_source_paint_tile (cairo, tile, coarse, column >> (coarse - level), row >> (coarse - level), x, y, MIN (size, self->width - x), MIN (size, self->height - y));
+				}
+			}
+		}
+
+		cairo_restore (cairo);
+	}
+}
+
+/*******************************************************************************
+* @brief タイルで指定した範囲を塗りつぶします。
+* @param level タイルの縮小段階。
+* @param column タイルの列。
+* @param row タイルの行。
+*/
+static void
+viewer_source_paint_tile (cairo_t *cairo, cairo_surface_t *tile, int level, int column, int row, int x, int y, int width, int height)
+{
+	cairo_pattern_t *pattern;
+	cairo_matrix_t matrix;
+	pattern = cairo_pattern_create_for_surface (tile);
+	cairo_matrix_init_scale (&matrix, 1.0 / (1 << level), 1.0 / (1 << level));
+	cairo_matrix_translate (&matrix, -column * (TILE_SIZE << level), -row * (TILE_SIZE << level));
+	cairo_pattern_set_matrix (pattern, &matrix);
+	cairo_pattern_set_extend (pattern, CAIRO_EXTEND_PAD);
+	cairo_set_source (cairo, pattern);
+	cairo_pattern_destroy (pattern);
+	cairo_rectangle (cairo, x, y, width, height);
+	cairo_fill (cairo);
+}
+
+/*******************************************************************************
+* @brief 非圧縮の PGM/PPM 画像のヘッダーを読み取ります。
+* @param channels 1 画素のバイト数。
+* @param maximum 画素の最大値。
+* @param offset 画素の開始位置。
+* @return 行単位で読み取れない画像の場合は FALSE。
+*/
+static gboolean
+viewer_source_read_header (GInputStream *stream, int *channels, int *width, int *height, int *maximum, goffset *offset, GCancellable *cancellable)
+{
+	char buffer [HEADER_SIZE];
+	gsize size, position;
+	gint64 values [3];
+	int n;
+
+	if (!g_input_stream_read_all (stream, buffer, HEADER_SIZE, &size, cancellable, NULL) || (size < 3) || (buffer [0] != 'P') || ((buffer [1] != '5') && (buffer [1] != '6')))
+	{
+		return FALSE;
+	}
+
+	position = 2;
+
+	for (n = 0; n < 3; n++)
+	{
+		while ((position < size) && (g_ascii_isspace (buffer [position]) || (buffer [position] == '#')))
+		{
+			if (buffer [position] == '#')
+			{
+				while ((position < size) && (buffer [position] != '\n'))
+				{
+					position++;
+				}
+			}
+			else
+			{
+				position++;
+			}
+		}
+		for (values [n] = 0; (position < size) && g_ascii_isdigit (buffer [position]) && (values [n] <= G_MAXINT); position++)
+		{
+			values [n] = values [n] * 10 + (buffer [position] - '0');
+		}
+	}
+
+	/* 最大値の後の空白 1 文字に続いて画素が始まります。 */
+	if ((position >= size) || !g_ascii_isspace (buffer [position]) || (values [0] <= 0) || (values [0] > G_MAXINT) || (values [1] <= 0) || (values [1] > G_MAXINT) || (values [2] <= 0) || (values [2] > 255))
+	{
+		return FALSE;
+	}
+
+	*channels = (buffer [1] == '5') ? 1 : 3;
+	*width = values [0];
+	*height = values [1];
+	*maximum = values [2];
+	*offset = position + 1;
+	return TRUE;
+}
+
+/*******************************************************************************
+* @brief ワーカー スレッドでタイルを復号します。
+* 縮小段階に合わせて行と画素を間引いて読み取ります。
+* @return 失敗した場合は NULL。
+*/
+static cairo_surface_t *
+viewer_source_read_tile (ViewerSource *self, int level, int column, int row, GError **error)
+{
+	cairo_surface_t *surface;
+	guchar *buffer, *pixels, *pixel;
+	guint32 *line;
+	gsize span, size;
+	gint64 x1, y1;
+	int width, height, stride, channels, step, x, y, value;
+	gboolean succeeded;
+	step = 1 << level;
+	x1 = (gint64) column * (TILE_SIZE << level);
+	y1 = (gint64) row * (TILE_SIZE << level);
+	width = MIN (TILE_SIZE, (self->width - x1 + step - 1) >> level);
+	height = MIN (TILE_SIZE, (self->height - y1 + step - 1) >> level);
+	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+	pixels = cairo_image_surface_get_data (surface);
+	stride = cairo_image_surface_get_stride (surface);
+	channels = self->spool ? 4 : self->channels;
+	span = ((gsize) (width - 1) * step + 1) * channels;
+	buffer = g_malloc (span);
+	succeeded = pixels != NULL;
+
+	if (!succeeded)
+	{
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, cairo_status_to_string (cairo_surface_status (surface)));
+	}
+	for (y = 0; succeeded && (y < height); y++)
+	{
+		succeeded = g_seekable_seek (self->seekable, self->offset + ((y1 + (gint64) y * step) * self->width + x1) * channels, G_SEEK_SET, NULL, error);
+		succeeded = succeeded && g_input_stream_read_all (self->stream, buffer, span, &size, NULL, error);
+
+		if (succeeded && (size != span))
+		{
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT, TEXT_TRUNCATED);
+			succeeded = FALSE;
+		}
+
+		line = (guint32 *) (pixels + y * stride);
+
+		for (x = 0; succeeded && (x < width); x++)
+		{
+			pixel = buffer + (gsize) x * step * channels;
+
+			switch (channels)
+			{
+			case 1:
+				value = pixel [0] * 255 / self->maximum;
+				line [x] = RGBA (value, value, value, 255);
+				break;
+			case 3:
+				line [x] = RGBA (pixel [0] * 255 / self->maximum, pixel [1] * 255 / self->maximum, pixel [2] * 255 / self->maximum, 255);
+				break;
+			default:
+				memcpy (&line [x], pixel, sizeof (guint32));
+				break;
+			}
+		}
+	}
+
+	g_free (buffer);
+
+	if (!succeeded)
+	{
+		cairo_surface_destroy (surface);
+		return NULL;
+	}
+
+	cairo_surface_mark_dirty (surface);
+	return surface;
+}
+
+/*******************************************************************************
+* @brief タイルの復号をワーカー スレッドに依頼します。
+* 依頼済みのタイルと復号に失敗したタイルは依頼しません。
+*/
+static void
+viewer_source_request (ViewerSource *self, int level, int column, int row)
+{
+	gpointer key;
+	key = GUINT_TO_POINTER (KEY (level, column, row));
+
+	if (g_hash_table_contains (self->failed, key))
+	{
+		return;
+	}
+
+	g_mutex_lock (&self->mutex);
+
+	if (!g_hash_table_contains (self->pending, key))
+	{
+		g_hash_table_add (self->pending, key);
+		g_thread_pool_push (self->pool, key, NULL);
+	}
+
+	g_mutex_unlock (&self->mutex);
+}
+
+/*******************************************************************************
+* @brief タイルの復号に失敗したときに呼び出す関数を設定します。
+* 関数はメイン スレッドで最初の失敗だけを受け取ります。
+*/
+void
+viewer_source_set_error_func (ViewerSource *self, ViewerSourceErrorFunc func, gpointer user_data)
+{
+	self->error_func = func;
+	self->error_data = user_data;
+}
+
+/*******************************************************************************
+* @brief 画像を復号し、ARGB32 の行を一時ファイルに書き出します。
+* 一時ファイルは作成後すぐに削除し、開いている間だけ存在させます。
+* 書き出し後は復号した画像を破棄します。
+*/
+static ViewerSource *
+viewer_source_spool (GInputStream *stream, GCancellable *cancellable, GError **error)
+{
+	GdkPixbuf *pixbuf;
+	GFile *file;
+	GFileIOStream *spool;
+	GOutputStream *output;
+	ViewerSource *self;
+	const guchar *pixels, *pixel;
+	guint32 *line;
+	int width, height, stride, channels, alpha, x, y;
+	gboolean succeeded;
+	self = NULL;
+	spool = NULL;
+	pixbuf = gdk_pixbuf_new_from_stream (stream, cancellable, error);
+	file = pixbuf ? g_file_new_tmp (SPOOL_TEMPLATE, &spool, error) : NULL;
+
+	if (file)
+	{
+		g_file_delete (file, NULL, NULL);
+		g_object_unref (file);
+	}
+	if (spool)
+	{
+		width = gdk_pixbuf_get_width (pixbuf);
+		height = gdk_pixbuf_get_height (pixbuf);
+		stride = gdk_pixbuf_get_rowstride (pixbuf);
+		channels = gdk_pixbuf_get_n_channels (pixbuf);
+		pixels = gdk_pixbuf_read_pixels (pixbuf);
+		output = g_io_stream_get_output_stream (G_IO_STREAM (spool));
+		line = g_new (guint32, width);
+		succeeded = TRUE;
+
+		for (y = 0; succeeded && (y < height); y++)
+		{
+			for (x = 0; x < width; x++)
+			{
+				pixel = pixels + (gsize) y * stride + x * channels;
+				alpha = (channels == 4) ? pixel [3] : 255;
+				line [x] = RGBA ((pixel [0] * alpha + 127) / 255, (pixel [1] * alpha + 127) / 255, (pixel [2] * alpha + 127) / 255, alpha);
+			}
+
+			succeeded = g_output_stream_write_all (output, line, width * sizeof (guint32), NULL, cancellable, error);
+		}
+
+		g_free (line);
+
+		if (succeeded && g_output_stream_flush (output, cancellable, error))
+		{
+			self = viewer_source_new (G_INPUT_STREAM (g_object_ref (g_io_stream_get_input_stream (G_IO_STREAM (spool)))), width, height);
+			self->seekable = G_SEEKABLE (spool);
+			self->spool = G_IO_STREAM (g_object_ref (spool));
+		}
+
+		g_object_unref (spool);
+	}
+
+	g_clear_object (&pixbuf);
+	return self;
+}
+
+/*******************************************************************************
+* @brief ワーカー スレッドで依頼されたタイルを復号します。
+* 依頼を取り消したタイルは復号しません。
+* 復号に失敗したタイルもメイン スレッドに渡し、最初の失敗の原因を保持します。
+*/
+static void
+viewer_source_thread (gpointer data, gpointer user_data)
+{
+	ViewerSource *self;
+	ViewerSourceTile *tile;
+	GError *error;
+	cairo_surface_t *surface;
+	guint key;
+	gboolean wanted;
+	self = user_data;
+	error = NULL;
+	key = GPOINTER_TO_UINT (data);
+	g_mutex_lock (&self->mutex);
+	wanted = g_hash_table_contains (self->pending, data);
+	g_mutex_unlock (&self->mutex);
+	surface = wanted ? viewer_source_read_tile (self, KEY_LEVEL (key), KEY_COLUMN (key), KEY_ROW (key), &error) : NULL;
+	g_mutex_lock (&self->mutex);
+
+	if (wanted)
+	{
+		tile = g_new (ViewerSourceTile, 1);
+		tile->surface = surface;
+		tile->key = key;
+		self->done = g_slist_prepend (self->done, tile);
+
+		if (!self->error)
+		{
+			self->error = g_steal_pointer (&error);
+		}
+		if (!self->idle)
+		{
+			self->idle = g_idle_add (viewer_source_deliver, self);
+		}
+	}
+
+	g_mutex_unlock (&self->mutex);
+	g_clear_error (&error);
+}
+
+/*******************************************************************************
+* @brief 最も長く使用していないタイルから上限を超えた分を破棄します。
+*/
+static void
+viewer_source_trim (ViewerSource *self)
+{
+	ViewerSourceTile *tile;
+
+	while (self->queue->length > TILE_LIMIT)
+	{
+		tile = g_queue_pop_tail (self->queue);
+		g_hash_table_remove (self->tiles, GUINT_TO_POINTER (tile->key));
+		viewer_source_free_tile (tile);
+	}
+}
@@ -0,0 +1,287 @@
+/* Copyright (C) 2025 Taichi Murakami. */
+#include <gtk/gtk.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
+#include <string.h>
+#include "viewer.h"
+#include "share.h"
+#define OPTION_MTIME        "tEXt::Thumb::MTime"
+#define OPTION_URI          "tEXt::Thumb::URI"
+#define THREAD_LIMIT        4
+#define THUMBNAIL_DIRECTORY "thumbnails"
+#define THUMBNAIL_FORMAT    "png"
+#define THUMBNAIL_MODE      0700
+#define THUMBNAIL_SIZE      128
+#define THUMBNAIL_SUBDIR    "normal"
+#define THUMBNAIL_SUFFIX    ".png"
+#define THUMBNAIL_TEMPLATE  ".XXXXXX"
+#define THUMBNAIL_VALUE_CCH 32
+
+typedef struct _ViewerThumbnailerRequest ViewerThumbnailerRequest;
+
+/* サムネイル作成 */
+struct _ViewerThumbnailer
+{
+	GThreadPool  *pool;
+	GCancellable *cancellable;
+	char         *directory;
+	guint         serial;
+};
+
+/* サムネイルの要求 */
+struct _ViewerThumbnailerRequest
+{
+	ViewerThumbnailer *thumbnailer;
+	gint64             mtime;
+	guint              serial;
+};
+
+static void       viewer_thumbnailer_cancel  (GCancellable *cancellable, gpointer user_data);
+static void       viewer_thumbnailer_clear   (gpointer data);
+static gint       viewer_thumbnailer_compare (gconstpointer a, gconstpointer b, gpointer user_data);
+static void       viewer_thumbnailer_drop    (gpointer data);
+static GdkPixbuf *viewer_thumbnailer_read    (ViewerThumbnailer *self, GFile *file, gint64 mtime, GCancellable *cancellable, GError **error);
+static void       viewer_thumbnailer_release (gpointer data);
+static void       viewer_thumbnailer_thread  (gpointer data, gpointer user_data);
+static void       viewer_thumbnailer_write   (GdkPixbuf *pixbuf, const char *path, const char *uri, gint64 mtime);
+
+/*******************************************************************************
+* Viewer Thumbnailer モジュール:
+* freedesktop.org のサムネイル仕様に従ってサムネイルを読み込み、なければ作成して保存します。
+* サムネイルは URI の MD5 をファイル名とし、URI と更新日時が一致しない場合は作り直します。
+* 作成は数を制限したワーカー スレッドで行い、後から要求したサムネイルを先に処理します。
+* 要求は作成するモジュールの参照を保持するため、破棄した後に終わった作成も安全に捨てられます。
+*/
+
+/*******************************************************************************
+* @brief 要求の取り消しを作成中の読み込みに伝えます。
+*/
+static void
+viewer_thumbnailer_cancel (GCancellable *cancellable, gpointer user_data)
+{
+	g_cancellable_cancel (G_CANCELLABLE (user_data));
+}
+
+/*******************************************************************************
+* @brief 最後の参照が解放されたときに破棄します。
+*/
+static void
+viewer_thumbnailer_clear (gpointer data)
+{
+	ViewerThumbnailer *self;
+	self = data;
+	g_object_unref (self->cancellable);
+	g_free (self->directory);
+}
+
+/*******************************************************************************
+* @brief 後から要求したサムネイルを先に処理するように並べ替えます。
+*/
+static gint
+viewer_thumbnailer_compare (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	ViewerThumbnailerRequest *request1, *request2;
+	request1 = g_task_get_task_data (G_TASK (a));
+	request2 = g_task_get_task_data (G_TASK (b));
+	return (request1->serial < request2->serial) - (request1->serial > request2->serial);
+}
+
+/*******************************************************************************
+* @brief 処理しなかった要求を取り消します。
+*/
+static void
+viewer_thumbnailer_drop (gpointer data)
+{
+	g_task_return_new_error (G_TASK (data), G_IO_ERROR, G_IO_ERROR_CANCELLED, "%s", _("Operation was cancelled"));
+	g_object_unref (data);
+}
+
+/*******************************************************************************
+* @brief 破棄します。
+* 作成待ちの要求は取り消し、作成中のサムネイルは取り消して完了を待ちません。
+*/
+void
+viewer_thumbnailer_free (ViewerThumbnailer *self)
+{
+	g_cancellable_cancel (self->cancellable);
+	g_thread_pool_free (self->pool, TRUE, FALSE);
+	self->pool = NULL;
+	g_atomic_rc_box_release_full (self, viewer_thumbnailer_clear);
+}
+
+/*******************************************************************************
+* @brief サムネイルを非同期に取得します。
+* @param file 画像ファイル。コールバックの source_object に渡します。
+* @param mtime 画像ファイルの更新日時。
+*/
+void
+viewer_thumbnailer_load_async (ViewerThumbnailer *self, GFile *file, gint64 mtime, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data)
+{
+	GTask *task;
+	ViewerThumbnailerRequest *request;
+	request = g_new (ViewerThumbnailerRequest, 1);
+	request->thumbnailer = g_atomic_rc_box_acquire (self);
+	request->mtime = mtime;
+	request->serial = ++self->serial;
+	task = g_task_new (file, cancellable, callback, user_data);
+	g_task_set_source_tag (task, viewer_thumbnailer_load_async);
+	g_task_set_task_data (task, request, viewer_thumbnailer_release);
+	g_thread_pool_push (self->pool, task, NULL);
+}
+
+/*******************************************************************************
+* @brief 非同期に取得したサムネイルを取得します。
+* @return サムネイル。失敗した場合や取り消した場合は NULL。
+*/
+GdkPixbuf *
+viewer_thumbnailer_load_finish (GAsyncResult *result, GError **error)
+{
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/*******************************************************************************
+* @brief 作成します。
+*/
+ViewerThumbnailer *
+viewer_thumbnailer_new (void)
+{
+	ViewerThumbnailer *self;
+	self = g_atomic_rc_box_new0 (ViewerThumbnailer);
+	self->pool = g_thread_pool_new_full (viewer_thumbnailer_thread, NULL, viewer_thumbnailer_drop, CLAMP (g_get_num_processors (), 1, THREAD_LIMIT), FALSE, NULL);
+	self->cancellable = g_cancellable_new ();
+	self->directory = g_build_filename (g_get_user_cache_dir (), THUMBNAIL_DIRECTORY, THUMBNAIL_SUBDIR, NULL);
+	g_thread_pool_set_sort_function (self->pool, viewer_thumbnailer_compare, NULL);
+	g_mkdir_with_parents (self->directory, THUMBNAIL_MODE);
+	return self;
+}
+
+/*******************************************************************************
+* @brief ワーカー スレッドでサムネイルを読み込みます。
+* 保存済みのサムネイルが古い場合は画像ファイルから作成して保存します。
+*/
+static GdkPixbuf *
+viewer_thumbnailer_read (ViewerThumbnailer *self, GFile *file, gint64 mtime, GCancellable *cancellable, GError **error)
+{
+	GdkPixbuf *pixbuf;
+	const char *value;
+	char *uri, *name, *path;
+	char buffer [THUMBNAIL_VALUE_CCH];
+	uri = g_file_get_uri (file);
+	name = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+	path = g_strconcat (self->directory, G_DIR_SEPARATOR_S, name, THUMBNAIL_SUFFIX, NULL);
+	g_snprintf (buffer, THUMBNAIL_VALUE_CCH, "%" G_GINT64_FORMAT, mtime);
+	pixbuf = gdk_pixbuf_new_from_file (path, NULL);
+
+	if (pixbuf)
+	{
+		value = gdk_pixbuf_get_option (pixbuf, OPTION_URI);
+
+		if (!value || strcmp (value, uri) || !(value = gdk_pixbuf_get_option (pixbuf, OPTION_MTIME)) || strcmp (value, buffer))
+		{
+			g_clear_object (&pixbuf);
+		}
+	}
+	if (!pixbuf)
+	{
+		pixbuf = share_pixbuf_create_from_file_at_size (file, THUMBNAIL_SIZE, cancellable, error);
+
+		if (pixbuf)
+		{
+			viewer_thumbnailer_write (pixbuf, path, uri, mtime);
+		}
+	}
+
+	g_free (path);
+	g_free (name);
+	g_free (uri);
+	return pixbuf;
+}
+
+/*******************************************************************************
+* @brief 要求を破棄し、作成するモジュールの参照を解放します。
+*/
+static void
+viewer_thumbnailer_release (gpointer data)
+{
+	ViewerThumbnailerRequest *request;
+	request = data;
+	g_atomic_rc_box_release_full (request->thumbnailer, viewer_thumbnailer_clear);
+	g_free (request);
+}
+
+/*******************************************************************************
+* @brief ワーカー スレッドで要求を処理します。
+* 取り消した要求は処理しません。
+* 要求を取り消した場合も、作成するモジュールを破棄した場合も読み込みを中止します。
+*/
+static void
+viewer_thumbnailer_thread (gpointer data, gpointer user_data)
+{
+	GCancellable *cancellable;
+	GError *error;
+	GTask *task;
+	GdkPixbuf *pixbuf;
+	ViewerThumbnailerRequest *request;
+	gulong handler, closing;
+	error = NULL;
+	task = G_TASK (data);
+	request = g_task_get_task_data (task);
+
+	if (g_cancellable_is_cancelled (request->thumbnailer->cancellable))
+	{
+		g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_CANCELLED, "%s", _("Operation was cancelled"));
+	}
+	else if (!g_task_return_error_if_cancelled (task))
+	{
+		cancellable = g_cancellable_new ();
+		handler = g_task_get_cancellable (task) ? g_cancellable_connect (g_task_get_cancellable (task), G_CALLBACK (viewer_thumbnailer_cancel), cancellable, NULL) : 0;
+		closing = g_cancellable_connect (request->thumbnailer->cancellable, G_CALLBACK (viewer_thumbnailer_cancel), cancellable, NULL);
+		pixbuf = viewer_thumbnailer_read (request->thumbnailer, G_FILE (g_task_get_source_object (task)), request->mtime, cancellable, &error);
+		g_cancellable_disconnect (request->thumbnailer->cancellable, closing);
+
+		if (handler)
+		{
+			g_cancellable_disconnect (g_task_get_cancellable (task), handler);
+		}
+		if (pixbuf)
+		{
+			g_task_return_pointer (task, pixbuf, g_object_unref);
+		}
+		else
+		{
+			g_task_return_error (task, error);
+		}
+
+		g_object_unref (cancellable);
+	}
+
+	g_object_unref (task);
+}
+
+/*******************************************************************************
+* @brief サムネイルを保存します。
+* 一時ファイルに書き込んでから置き換え、書きかけのサムネイルを読み込ませません。
+*/
+static void
+viewer_thumbnailer_write (GdkPixbuf *pixbuf, const char *path, const char *uri, gint64 mtime)
+{
+	char *temp;
+	char buffer [THUMBNAIL_VALUE_CCH];
+	int file;
+	temp = g_strconcat (path, THUMBNAIL_TEMPLATE, NULL);
+	file = g_mkstemp_full (temp, O_RDWR, 0600);
+
+	if (file >= 0)
+	{
+		g_close (file, NULL);
+		g_snprintf (buffer, THUMBNAIL_VALUE_CCH, "%" G_GINT64_FORMAT, mtime);
+
+		if (!gdk_pixbuf_save (pixbuf, temp, THUMBNAIL_FORMAT, NULL, OPTION_URI, uri, OPTION_MTIME, buffer, NULL) || g_rename (temp, path))
+		{
+			g_unlink (temp);
+		}
+	}
+
+	g_free (temp);
+}
@@ -3,11 +3,18 @@
 #include <gtk/gtk.h>
 #define VIEWER_RESOURCE_PATH_CCH 64
 
+typedef struct _ViewerCache       ViewerCache;
+typedef struct _ViewerSource      ViewerSource;
+typedef struct _ViewerThumbnailer ViewerThumbnailer;
+typedef void (*ViewerSourceErrorFunc) (const GError *error, gpointer user_data);
+
 G_DECLARE_FINAL_TYPE (ViewerApplication,    viewer_application,     VIEWER, APPLICATION,     GtkApplication);
 G_DECLARE_FINAL_TYPE (ViewerDocumentWindow, viewer_document_window, VIEWER, DOCUMENT_WINDOW, GtkApplicationWindow);
+G_DECLARE_FINAL_TYPE (ViewerGalleryWindow,  viewer_gallery_window,  VIEWER, GALLERY_WINDOW,  GtkApplicationWindow);
 
 #define VIEWER_TYPE_APPLICATION     (viewer_application_get_type     ())
 #define VIEWER_TYPE_DOCUMENT_WINDOW (viewer_document_window_get_type ())
+#define VIEWER_TYPE_GALLERY_WINDOW  (viewer_gallery_window_get_type  ())
 
 /*******************************************************************************
 * Viewer モジュール:
@@ -16,6 +23,19 @@ GResource *viewer_get_resource      (void);
 int        viewer_get_resource_path (char *buffer, size_t maxlen, const char *name);
 GSettings *viewer_get_settings      (void);
 
+/*******************************************************************************
+* Viewer Cache モジュール:
+*/
+void         viewer_cache_free          (ViewerCache *self);
+void         viewer_cache_insert        (ViewerCache *self, GFile *file, GdkPixbuf *pixbuf);
+gboolean     viewer_cache_is_loading    (ViewerCache *self, GFile *file);
+GdkPixbuf   *viewer_cache_lookup        (ViewerCache *self, GFile *file);
+void         viewer_cache_lookup_async  (ViewerCache *self, GFile *file, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+GdkPixbuf   *viewer_cache_lookup_finish (GAsyncResult *result, GError **error);
+ViewerCache *viewer_cache_new           (void);
+void         viewer_cache_prefetch      (ViewerCache *self, GFile **files, guint n_files, double scale);
+void         viewer_cache_set_limit     (ViewerCache *self, gsize limit);
+
 /*******************************************************************************
 * Viewer Document Window モジュール:
 */
@@ -23,8 +43,34 @@ GFile     *viewer_document_window_get_file         (ViewerDocumentWindow *self);
 GdkPixbuf *viewer_document_window_get_pixbuf       (ViewerDocumentWindow *self);
 int        viewer_document_window_get_zoom         (ViewerDocumentWindow *self);
 float      viewer_document_window_get_zoom_percent (ViewerDocumentWindow *self);
+void       viewer_document_window_load             (ViewerDocumentWindow *self, GFile *file);
 GtkWidget *viewer_document_window_new              (GApplication *application);
 void       viewer_document_window_set_file         (ViewerDocumentWindow *self, GFile *file);
 void       viewer_document_window_set_pixbuf       (ViewerDocumentWindow *self, GdkPixbuf *pixbuf);
 void       viewer_document_window_set_zoom         (ViewerDocumentWindow *self, int zoom);
 void       viewer_document_window_set_zoom_percent (ViewerDocumentWindow *self, float zoom);
+
+/*******************************************************************************
+* Viewer Gallery Window モジュール:
+*/
+GtkWidget *viewer_gallery_window_new           (GApplication *application);
+void       viewer_gallery_window_set_directory (ViewerGalleryWindow *self, GFile *directory);
+
+/*******************************************************************************
+* Viewer Source モジュール:
+*/
+void          viewer_source_free           (ViewerSource *self);
+int           viewer_source_get_height     (ViewerSource *self);
+int           viewer_source_get_width      (ViewerSource *self);
+void          viewer_source_open_async     (GFile *file, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+ViewerSource *viewer_source_open_finish    (GAsyncResult *result, GError **error);
+void          viewer_source_paint          (ViewerSource *self, GtkWidget *widget, cairo_t *cairo);
+void          viewer_source_set_error_func (ViewerSource *self, ViewerSourceErrorFunc func, gpointer user_data);
+
+/*******************************************************************************
+* Viewer Thumbnailer モジュール:
+*/
+void               viewer_thumbnailer_free        (ViewerThumbnailer *self);
+void               viewer_thumbnailer_load_async  (ViewerThumbnailer *self, GFile *file, gint64 mtime, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+GdkPixbuf         *viewer_thumbnailer_load_finish (GAsyncResult *result, GError **error);
+ViewerThumbnailer *viewer_thumbnailer_new         (void);